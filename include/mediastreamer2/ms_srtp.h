@@ -147,6 +147,19 @@ MS2_PUBLIC int ms_media_stream_sessions_set_srtp_send_key_b64(MSMediaStreamSessi
  */
 MS2_PUBLIC int ms_media_stream_sessions_set_srtp_send_key(MSMediaStreamSessions *sessions, MSCryptoSuite suite, const char* key, size_t key_length, MSSrtpStreamType stream_type);
 
+/**
+ * Protect a batch of outgoing RTP packets of the given media stream, taking the lock of its srtp context once for the batch.
+ * This is meant for applications sending packets of the stream without its RtpSession, which protects the packets it sends itself.
+ * The packets are protected in place when they are not shared and have room for the SRTP trailer, otherwise they are reallocated.
+ *
+ * @param[in/out]	sessions	The sessions associated to the current media stream
+ * @param[in/out]	packets		The packets to protect
+ * @param[out]		sizes		The size of each protected packet, 0 if it must be dropped because encryption is mandatory, -1 on error
+ * @param[in]		count		The number of packets
+ * @return	0 on success, -1 if a packet could not be protected
+ */
+MS2_PUBLIC int ms_media_stream_sessions_protect_rtp_packets(MSMediaStreamSessions *sessions, mblk_t **packets, int *sizes, int count);
+
 /**
  * Convert MSCryptoSuite enum to a string.
  *
@@ -39,4 +39,30 @@ typedef struct MSAudioMixerCtl{
 #define MS_AUDIO_MIXER_SET_MASTER_CHANNEL		MS_FILTER_METHOD(MS_AUDIO_MIXER_ID,3,int)
 
 #define MS_AUDIO_MIXER_ENABLE_OUTPUT			MS_FILTER_METHOD(MS_AUDIO_MIXER_ID,4,MSAudioMixerCtl)
+
+/**
+ * A set of mixing routines working on 16 bits samples and 32 bits sums, saturated to [-32767;32767].
+ * All the sets produce the same results, their speed depends on the cpu.
+ */
+typedef struct _MSAudioMixerKernels{
+	const char *name;
+	void (*accumulate)(int32_t *sum, const int16_t *contrib, int nwords); /**<sum+=contrib*/
+	void (*saturate)(int16_t *out, const int32_t *sum, int nwords); /**<out=saturate(sum)*/
+	void (*subtract)(int16_t *out, const int32_t *sum, const int16_t *contrib, int nwords); /**<out=saturate(sum-contrib)*/
+}MSAudioMixerKernels;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * Get all the mixing routines supported by the cpu, as a NULL terminated array, the last one being used by the mixer.
+ * The first one is the generic version and the reference of the others. This is meant for tests and benchmarks.
+ */
+MS2_PUBLIC const MSAudioMixerKernels * const *ms_audio_mixer_list_kernels(void);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
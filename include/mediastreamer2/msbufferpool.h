@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MS_BUFFER_POOL_H
+#define MS_BUFFER_POOL_H
+
+#include <mediastreamer2/mscommon.h>
+
+/**
+ * @file msbufferpool.h
+ * @brief mediastreamer2 msbufferpool.h include file
+ *
+ * A pool of data buffers for the small messages exchanged by audio filters and for RTP payloads, to avoid allocating a new buffer for each frame.
+ *
+ */
+
+/**
+ * The pool manages buffers of a few size classes, from 160 to 3840 bytes (10 ms of 8 kHz mono audio to 20 ms of 48 kHz stereo audio).
+ * The pool holds no reference on the buffers it lends: a buffer returns to the pool when the last message using it is freed,
+ * so that a lent buffer used by a single message has a reference count of 1 like any other. Larger sizes are allocated with allocb().
+ * The buffers have MS_BUFFER_POOL_HEADROOM bytes of free space before the data and MS_BUFFER_POOL_TAILROOM bytes after, so that
+ * the RTP header and the SRTP authentication tag can be added to an encoded frame without copying it.
+ * The pool can be used from several threads.
+ * @var MSBufferPool
+ */
+typedef struct _MSBufferPool MSBufferPool;
+
+#define MS_BUFFER_POOL_HEADROOM 64
+#define MS_BUFFER_POOL_TAILROOM 160
+
+/**
+ * Statistics of a MSBufferPool.
+ * The hit rate is hits/requests.
+ */
+typedef struct _MSBufferPoolStats{
+	unsigned int requests; /**< number of buffers requested */
+	unsigned int hits; /**< number of requests served by a buffer released by a previous user */
+	int buffers; /**< number of buffers owned by the pool, which is the highest number of buffers used at the same time */
+	int high_water_mark; /**< highest number of buffers owned by the pool in a single size class */
+}MSBufferPoolStats;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+MS2_PUBLIC MSBufferPool *ms_buffer_pool_new(void);
+
+/**
+ * Set the maximum number of buffers of each size class. Beyond this number, requests are served with allocb(). The default is 1024.
+ */
+MS2_PUBLIC void ms_buffer_pool_set_max_buffers(MSBufferPool *pool, int max_buffers);
+
+/**
+ * Get a message whose buffer can hold at least size bytes, with b_rptr and b_wptr at the beginning of the buffer.
+ */
+MS2_PUBLIC mblk_t *ms_buffer_pool_get(MSBufferPool *pool, int size);
+
+MS2_PUBLIC void ms_buffer_pool_get_stats(MSBufferPool *pool, MSBufferPoolStats *stats);
+
+/**
+ * Tell whether a data block was lent by a pool.
+ */
+MS2_PUBLIC bool_t ms_buffer_pool_is_pool_buffer(const dblk_t *db);
+
+/**
+ * Destroy the pool. Messages still using buffers of the pool remain valid, the pool being freed with the last of them.
+ */
+MS2_PUBLIC void ms_buffer_pool_destroy(MSBufferPool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
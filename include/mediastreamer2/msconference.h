@@ -44,6 +44,7 @@ struct _MSAudioConferenceParams{
 	int max_volumes; /** Max number of volumes sent with the mixer to client header extension */
 	MSAudioConferenceNotifyActiveTalker active_talker_callback;
 	void *user_data;
+	int max_active_speakers; /**< If greater than zero, only the max_active_speakers loudest participants are mixed, see ms_audio_conference_process_events(). */
 };
 
 /**
@@ -98,8 +99,9 @@ MS2_PUBLIC const MSAudioConferenceParams *ms_audio_conference_get_params(MSAudio
  * Adds a participant to the conference.
  * @param obj the conference
  * @param ep the participant, represented as a MSAudioEndpoint object
+ * @return 0 if successful, -1 if the mixer of the conference has no free pin left (it mixes at most 128 participants)
 **/
-MS2_PUBLIC void ms_audio_conference_add_member(MSAudioConference *obj, MSAudioEndpoint *ep);
+MS2_PUBLIC int ms_audio_conference_add_member(MSAudioConference *obj, MSAudioEndpoint *ep);
 
 /**
  * Removes a participant from the conference.
@@ -113,6 +115,8 @@ MS2_PUBLIC void ms_audio_conference_remove_member(MSAudioConference *obj, MSAudi
  * Process events of the audio conference.
  * Calling this method periodically (for example every 50 ms), is necessary
  * to receive the active talker notifications to the callback set in the MSAudioConferenceParams.
+ * When max_active_speakers is set in the MSAudioConferenceParams, this is also where the participants that are mixed
+ * are chosen, according to the volume of their voice.
  * @param obj the conference
 **/
 MS2_PUBLIC void ms_audio_conference_process_events(MSAudioConference *obj);
@@ -127,6 +131,15 @@ MS2_PUBLIC void ms_audio_conference_process_events(MSAudioConference *obj);
 **/
 MS2_PUBLIC void ms_audio_conference_mute_member(MSAudioConference *obj, MSAudioEndpoint *ep, bool_t muted);
 
+/**
+ * Tells whether the voice of a participant is currently mixed in the conference.
+ * All unmuted participants are mixed, unless max_active_speakers is set in the MSAudioConferenceParams.
+ * @param obj the conference
+ * @param ep the participant, represented as a MSAudioEndpoint object
+ * @return TRUE if the participant is mixed, FALSE otherwise.
+**/
+MS2_PUBLIC bool_t ms_audio_conference_member_is_mixed(MSAudioConference *obj, MSAudioEndpoint *ep);
+
 /**
  * Returns the size (ie the number of participants) of a conference.
  * @param obj the conference
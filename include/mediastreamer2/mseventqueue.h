@@ -38,6 +38,16 @@ extern "C" {
 **/ 
 MS2_PUBLIC MSEventQueue *ms_event_queue_new(void);
 
+/**
+ * Creates an event queue able to hold a given number of pending events.
+ *
+ * Events are stored in preallocated slots, so that notifying never blocks. Memory is allocated only for the events
+ * whose argument is larger than 16 bytes.
+ * When all slots are used, new events are discarded until the application pumps the queue.
+ * @param max_events the number of slots, rounded up to a power of two.
+**/
+MS2_PUBLIC MSEventQueue *ms_event_queue_new_with_size(int max_events);
+
 /**
  * Install a global event queue.
  *
@@ -52,6 +62,7 @@ MS2_PUBLIC MS2_DEPRECATED void ms_set_global_event_queue(MSEventQueue *q);
  * The user can register a notify callback per filter using
  * ms_filter_set_notify_callback() in order to be informed 
  * of various events generated by a MSFilter.
+ * Events are taken from the queue by batches. The queue must be pumped by a single thread.
 **/
 MS2_PUBLIC void ms_event_queue_pump(MSEventQueue *q);
 
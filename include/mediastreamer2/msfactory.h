@@ -23,6 +23,7 @@
 
 #include "mediastreamer2/msfilter.h"
 #include "mediastreamer2/devices.h"
+#include "mediastreamer2/msbufferpool.h"
 
 /*do not use these fields directly*/
 struct _MSFactory{
@@ -49,6 +50,8 @@ struct _MSFactory{
 	char *image_resources_dir;
 	char *echo_canceller_filtername;
 	int expected_video_bandwidth;
+	MSBufferPool *buffer_pool;
+	ms_mutex_t stats_lock; /*the filters sharing a MSFilterStats may run on several threads*/
 };
 
 typedef struct _MSFactory MSFactory;
@@ -293,6 +296,22 @@ MS2_PUBLIC unsigned int ms_factory_get_cpu_count(MSFactory *obj);
 **/
 MS2_PUBLIC void ms_factory_set_cpu_count(MSFactory *obj, unsigned int c);
 
+/**
+ * Get the pool of buffers shared by the audio filters and the H26x packetizers of the factory.
+**/
+MS2_PUBLIC MSBufferPool *ms_factory_get_buffer_pool(MSFactory *obj);
+
+/**
+ * Get the statistics of the buffer pool of the factory, to monitor its hit rate and its size.
+**/
+MS2_PUBLIC void ms_factory_get_buffer_pool_stats(MSFactory *obj, MSBufferPoolStats *stats);
+
+/**
+ * Allocate a message of size bytes from the buffer pool of the factory.
+ * Filters use it for the frames they output. The message is allocated with allocb() if obj is NULL.
+**/
+MS2_PUBLIC mblk_t *ms_factory_allocb(MSFactory *obj, int size);
+
 MS2_PUBLIC void ms_factory_add_platform_tag(MSFactory *obj, const char *tag);
 
 MS2_PUBLIC MSList * ms_factory_get_platform_tags(MSFactory *obj);
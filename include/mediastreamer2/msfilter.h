@@ -192,6 +192,8 @@ struct _MSFilter{
 	uint32_t last_tick;
 	MSFilterStats *stats;
 	int postponed_task; /*number of postponed tasks*/
+	uint64_t process_time; /*cumulated time spent in process() in nanoseconds, when measured*/
+	struct _MSLatencyHistogram *latency; /*histogram of the time spent in process(), allocated when first measured*/
 	bool_t seen;
 };
 
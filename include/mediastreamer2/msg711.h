@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MS_G711_H
+#define MS_G711_H
+
+#include <mediastreamer2/mscommon.h>
+
+/**
+ * @file msg711.h
+ * @brief mediastreamer2 msg711.h include file
+ *
+ * Conversion of buffers of 16 bits linear samples to and from G.711 A-law and u-law.
+ *
+ */
+
+/**
+ * A set of G.711 conversion routines. All the sets produce the same results, their speed depends on the cpu.
+ */
+typedef struct _MSG711Kernels{
+	const char *name;
+	void (*alaw_encode)(uint8_t *dst, const int16_t *src, int nsamples);
+	void (*alaw_decode)(int16_t *dst, const uint8_t *src, int nsamples);
+	void (*ulaw_encode)(uint8_t *dst, const int16_t *src, int nsamples);
+	void (*ulaw_decode)(int16_t *dst, const uint8_t *src, int nsamples);
+}MSG711Kernels;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * Get the fastest conversion routines supported by the cpu, which are the ones used by the G.711 encoders and decoders.
+ */
+MS2_PUBLIC const MSG711Kernels *ms_g711_get_kernels(void);
+
+/**
+ * Get all the conversion routines supported by the cpu, as a NULL terminated array.
+ * The first one converts a sample at a time and is the reference of the others. This is meant for tests and benchmarks.
+ */
+MS2_PUBLIC const MSG711Kernels * const *ms_g711_list_kernels(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -194,6 +194,32 @@ typedef enum _MSRecorderState MSRecorderState;
 #define MS_RECORDER_MAX_SIZE_REACHED \
 	MS_FILTER_EVENT_NO_ARG(MSFilterRecorderInterface,1)
 
+/**
+ * Policy of a recorder writing the file from a separate thread, telling when the written data is flushed to the disk.
+**/
+enum _MSRecorderSyncPolicy{
+	MSRecorderSyncNone, /**< let the operating system flush the data */
+	MSRecorderSyncOnClose, /**< flush the data when the file is closed */
+	MSRecorderSyncOnCluster /**< flush the data each time a cluster of the file is complete, and when the file is closed */
+};
+
+typedef enum _MSRecorderSyncPolicy MSRecorderSyncPolicy;
+
+#define MS_RECORDER_SET_SYNC_POLICY \
+	MS_FILTER_METHOD(MSFilterRecorderInterface,7,MSRecorderSyncPolicy)
+
+/**set the maximum amount of data, in bytes, waiting to be written to the file. Beyond it, frames are dropped.*/
+#define MS_RECORDER_SET_WRITE_QUEUE_SIZE \
+	MS_FILTER_METHOD(MSFilterRecorderInterface,8,int)
+
+/**the data waiting to be written exceeds half the write queue size. The argument is the amount of waiting data, in bytes.*/
+#define MS_RECORDER_WRITE_LATE \
+	MS_FILTER_EVENT(MSFilterRecorderInterface,2,int)
+
+/**frames were dropped because the write queue was full. The argument is the number of dropped frames.*/
+#define MS_RECORDER_FRAMES_DROPPED \
+	MS_FILTER_EVENT(MSFilterRecorderInterface,3,int)
+
 
 /** Interface definitions for echo cancellers */
 
@@ -21,7 +21,36 @@
 
 #include <mediastreamer2/msfilter.h>
 
+/**
+ * Behavior of the MSItcSink when the queue towards the MSItcSource is full.
+**/
+typedef enum _MSItcOverflowPolicy{
+	MSItcDropOldest, /**< the oldest queued message is discarded to make room for the new one (default)*/
+	MSItcDropNewest /**< the new message is discarded*/
+}MSItcOverflowPolicy;
+
+/**
+ * Occupancy counters of the queue between a MSItcSink and a MSItcSource.
+**/
+typedef struct _MSItcStats{
+	int size; /**< capacity of the queue, in messages*/
+	int occupancy; /**< number of messages currently queued*/
+	int max_occupancy; /**< highest number of messages queued so far*/
+	unsigned int transferred; /**< number of messages queued so far*/
+	unsigned int dropped; /**< number of messages discarded because the queue was full*/
+}MSItcStats;
+
 #define MS_ITC_SINK_CONNECT MS_FILTER_METHOD(MS_ITC_SINK_ID,0,MSFilter)
 
+/**
+ * Set the capacity of the queue, in messages. The value is rounded up to a power of two.
+ * It must be set before the filters are attached to their tickers, as queued messages are discarded.
+**/
+#define MS_ITC_SINK_SET_MAX_SIZE MS_FILTER_METHOD(MS_ITC_SINK_ID,1,int)
+
+#define MS_ITC_SINK_SET_OVERFLOW_POLICY MS_FILTER_METHOD(MS_ITC_SINK_ID,2,MSItcOverflowPolicy)
+
+#define MS_ITC_SINK_GET_STATS MS_FILTER_METHOD(MS_ITC_SINK_ID,3,MSItcStats)
+
 
 #endif
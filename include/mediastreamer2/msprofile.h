@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MS_PROFILE_H
+#define MS_PROFILE_H
+
+#include <mediastreamer2/msticker.h>
+
+/**
+ * @file msprofile.h
+ * @brief mediastreamer2 msprofile.h include file
+ *
+ * This file provides latency histograms of the filters and tickers, and an export of them in machine-readable
+ * formats so that they can be collected while the graphs are running.
+ *
+ */
+
+/**
+ * @addtogroup mediastreamer2_ticker
+ * @{
+ */
+
+#define MS_LATENCY_HISTOGRAM_SUB_BUCKET_BITS 5
+#define MS_LATENCY_HISTOGRAM_MAX_BITS 36 /* values above 2^36 ns (about 68 seconds) are counted in the last bucket */
+#define MS_LATENCY_HISTOGRAM_BUCKETS ((MS_LATENCY_HISTOGRAM_MAX_BITS-MS_LATENCY_HISTOGRAM_SUB_BUCKET_BITS+1)<<MS_LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+
+/**
+ * Histogram of durations in nanoseconds, with a relative precision of about 3% over the whole range
+ * (buckets are logarithmic, each power of two being split in 32 linear sub-buckets).
+ * Adding a value is allocation-free and runs in constant time.
+ */
+struct _MSLatencyHistogram{
+	uint32_t buckets[MS_LATENCY_HISTOGRAM_BUCKETS];
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+};
+
+typedef struct _MSLatencyHistogram MSLatencyHistogram;
+
+enum _MSProfileFormat{
+	MSProfileFormatJson, /**<a JSON object with one entry per ticker and per filter*/
+	MSProfileFormatPrometheus /**<the Prometheus text exposition format*/
+};
+
+typedef enum _MSProfileFormat MSProfileFormat;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * Remove all values from a histogram.
+ */
+MS2_PUBLIC void ms_latency_histogram_reset(MSLatencyHistogram *h);
+
+/**
+ * Add a duration, in nanoseconds, to a histogram.
+ */
+MS2_PUBLIC void ms_latency_histogram_add_value(MSLatencyHistogram *h, uint64_t value_ns);
+
+/**
+ * Get a percentile of the values added to the histogram.
+ * @param h the histogram
+ * @param percentile the percentile, between 0 and 100, for example 99.9.
+ * @return the highest value of the bucket containing the percentile, in nanoseconds, or 0 if the histogram is empty.
+ */
+MS2_PUBLIC uint64_t ms_latency_histogram_get_percentile(const MSLatencyHistogram *h, double percentile);
+
+/**
+ * Get the histogram of the execution time of a filter's process() and postponed tasks.
+ * Values are added when the filter is measured, that is when statistics are enabled on its factory (see ms_factory_enable_statistics())
+ * or when profiling is enabled on its ticker (see ms_ticker_enable_profiling()).
+ * @param f the filter
+ * @return the histogram, or NULL if the filter was never measured.
+ */
+MS2_PUBLIC const MSLatencyHistogram *ms_filter_get_latency_histogram(const MSFilter *f);
+
+/**
+ * Enable the measurement of the filters running on the ticker, and of the duration of each tick.
+ * Ticks whose processing exceeds the ticker interval are counted as overruns whether profiling is enabled or not.
+ * The tickers of a MSTickerPool always measure their filters, disabling the profiling does not stop it.
+ * @param ticker the MSTicker
+ * @param enabled TRUE to measure the filters
+ */
+MS2_PUBLIC void ms_ticker_enable_profiling(MSTicker *ticker, bool_t enabled);
+
+/**
+ * Get the number of ticks whose processing took longer than the ticker interval.
+ */
+MS2_PUBLIC uint64_t ms_ticker_get_overrun_count(MSTicker *ticker);
+
+/**
+ * Reset the histograms of the ticker and of its filters, the overrun counter and the maximum depth of the queues.
+ */
+MS2_PUBLIC void ms_ticker_reset_profile(MSTicker *ticker);
+
+/**
+ * Take a snapshot of the profile of a ticker: the tick duration histogram and overrun count,
+ * and for each filter of its graphs the latency percentiles (p50, p99, p99.9, max) and the current and maximum depth
+ * of its output queues.
+ * The snapshot is taken between two ticks, it can be requested from any thread.
+ * @param ticker the MSTicker
+ * @param format the output format
+ * @return a string to be freed with ms_free().
+ */
+MS2_PUBLIC char *ms_ticker_get_profile(MSTicker *ticker, MSProfileFormat format);
+
+/**
+ * Take a snapshot of the profile of several tickers, for example the tickers of a MSTickerPool, as a single document.
+ * With the Prometheus format each metric family is declared once, the samples being labelled by ticker.
+ * With the JSON format the document is an array of the objects returned by ms_ticker_get_profile().
+ * @param tickers a list of MSTicker
+ * @param format the output format
+ * @return a string to be freed with ms_free().
+ */
+MS2_PUBLIC char *ms_tickers_get_profile(const MSList *tickers, MSProfileFormat format);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif
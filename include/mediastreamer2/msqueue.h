@@ -33,6 +33,7 @@ typedef struct _MSQueue
 	queue_t q;
 	MSCPoint prev;
 	MSCPoint next;
+	int max_depth; /*highest number of messages held by the queue, see ms_ticker_get_profile()*/
 }MSQueue;
 
 
@@ -44,6 +45,7 @@ static MS2_INLINE mblk_t *ms_queue_get(MSQueue *q){
 
 static MS2_INLINE void ms_queue_put(MSQueue *q, mblk_t *m){
 	putq(&q->q,m);
+	if (q->q.q_mcount>q->max_depth) q->max_depth=q->q.q_mcount;
 	return;
 }
 
@@ -53,6 +55,7 @@ static MS2_INLINE void ms_queue_put(MSQueue *q, mblk_t *m){
  */
 static MS2_INLINE void ms_queue_insert(MSQueue *q, mblk_t *em, mblk_t *m) {
     insq(&q->q, em, m);
+    if (q->q.q_mcount>q->max_depth) q->max_depth=q->q.q_mcount;
     return;
 }
 
@@ -96,6 +99,26 @@ MS2_PUBLIC void ms_queue_flush(MSQueue *q);
 
 MS2_PUBLIC void ms_queue_destroy(MSQueue *q);
 
+/**
+ * Declare the free function of data blocks pointing to memory that must never be written, such as a read-only file mapping.
+ * The messages using such blocks are never writable, so that ms_mblk_make_writable() copies them.
+**/
+MS2_PUBLIC void ms_mblk_add_read_only_free_function(void (*freefn)(void*));
+
+/**
+ * Tell whether the data of a message is not shared with other messages, in which case it can be modified in place.
+ * The data blocks using a free function declared with ms_mblk_add_read_only_free_function() are never writable.
+**/
+MS2_PUBLIC bool_t ms_mblk_is_writable(const mblk_t *m);
+
+/**
+ * Copy-on-write helper for filters that modify their input in place.
+ * Messages may share their data with other messages (for example the ones delivered by a MSTee on each of its outputs),
+ * in which case they must be considered as read-only.
+ * @return m if its data is not shared, otherwise a copy of m, m being freed.
+**/
+MS2_PUBLIC mblk_t *ms_mblk_make_writable(mblk_t *m);
+
 
 #define __mblk_set_flag(m,pos,bitval) \
 	(m)->reserved2=(m->reserved2 & ~(1<<pos)) | ((!!bitval)<<pos) 
@@ -164,6 +187,84 @@ MS2_PUBLIC void ms_bufferizer_uninit(MSBufferizer *obj);
 
 MS2_PUBLIC void ms_bufferizer_destroy(MSBufferizer *obj);
 
+#define MS_RING_BUFFERIZER_INITIAL_METAS 32
+
+typedef struct _MSRingBufferizerMetas{
+	uint64_t pos; /*position in the byte stream of the first byte of the mblk_t these metas come from*/
+#if defined(ORTP_TIMESTAMP)
+	struct timeval timestamp;
+#endif
+	uint8_t ttl_or_hl;
+}MSRingBufferizerMetas;
+
+struct _MSRingBufferizer{
+	uint8_t *buffer; /*capacity bytes of ring, followed by capacity bytes of mirror*/
+	size_t capacity; /*always a power of two*/
+	uint64_t read_pos;
+	uint64_t write_pos;
+	MSRingBufferizerMetas *metas; /*ring of the metas of the buffered blocks, grown when more blocks are buffered*/
+	int metas_capacity; /*always a power of two*/
+	int metas_first;
+	int metas_count;
+	MSRingBufferizerMetas current_metas;
+};
+
+/**
+ * The MSRingBufferizer buffers bytes provided as mblk_t of any size and lets a reader
+ * take them in a FIFO manner with an arbitrary size, like the MSBufferizer.
+ * Bytes are kept in a single ring whose size is a power of two, so that the reader
+ * can work directly on them: ms_ring_bufferizer_peek() returns a pointer on contiguous
+ * bytes and ms_ring_bufferizer_consume() releases them. When the peeked bytes wrap
+ * around the end of the ring, the wrapped part is mirrored after the end.
+ * The ring grows when more bytes than its size are put.
+ */
+typedef struct _MSRingBufferizer MSRingBufferizer;
+
+/*allocates and initialize. initial_size is a hint of the amount of bytes to be buffered, 0 for a default size*/
+MS2_PUBLIC MSRingBufferizer * ms_ring_bufferizer_new(size_t initial_size);
+
+/*initialize in memory*/
+MS2_PUBLIC void ms_ring_bufferizer_init(MSRingBufferizer *obj, size_t initial_size);
+
+/*copy the content of m into the bufferizer, then free m*/
+MS2_PUBLIC void ms_ring_bufferizer_put(MSRingBufferizer *obj, mblk_t *m);
+
+/*copy the content of m into the bufferizer, m is left untouched*/
+MS2_PUBLIC void ms_ring_bufferizer_put_copy(MSRingBufferizer *obj, const mblk_t *m);
+
+/* put every mblk_t from q, into the bufferizer */
+MS2_PUBLIC void ms_ring_bufferizer_put_from_queue(MSRingBufferizer *obj, MSQueue *q);
+
+/**
+ * Get a pointer on the next datalen bytes, without removing them from the bufferizer.
+ * The bytes may be modified in place. The pointer stays valid until the next put, consume, read or flush.
+ * Returns NULL if less than datalen bytes are available.
+ */
+MS2_PUBLIC uint8_t * ms_ring_bufferizer_peek(MSRingBufferizer *obj, size_t datalen);
+
+/*remove datalen bytes from the bufferizer, usually after having processed them through ms_ring_bufferizer_peek()*/
+MS2_PUBLIC void ms_ring_bufferizer_consume(MSRingBufferizer *obj, size_t datalen);
+
+/*read bytes from bufferizer object, with the same semantic as ms_bufferizer_read()*/
+MS2_PUBLIC size_t ms_ring_bufferizer_read(MSRingBufferizer *obj, uint8_t *data, size_t datalen);
+
+/*obtain current meta-information of the last peeked or read bytes (if any) and copy them into 'm'*/
+MS2_PUBLIC void ms_ring_bufferizer_fill_current_metas(MSRingBufferizer *obj, mblk_t *m);
+
+/* returns the number of bytes available in the bufferizer*/
+static MS2_INLINE size_t ms_ring_bufferizer_get_avail(const MSRingBufferizer *obj){
+	return (size_t)(obj->write_pos - obj->read_pos);
+}
+
+#define ms_ring_bufferizer_skip_bytes(obj, bytes) ms_ring_bufferizer_consume(obj, bytes)
+
+/* purge all data pending in the bufferizer */
+MS2_PUBLIC void ms_ring_bufferizer_flush(MSRingBufferizer *obj);
+
+MS2_PUBLIC void ms_ring_bufferizer_uninit(MSRingBufferizer *obj);
+
+MS2_PUBLIC void ms_ring_bufferizer_destroy(MSRingBufferizer *obj);
+
 /**
  * The drop method explicits how the MSFlowControlledBufferizer should react when
  * it detects an excessive amount of samples.
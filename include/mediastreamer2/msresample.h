@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef msresample_h
+#define msresample_h
+
+#include <mediastreamer2/msfilter.h>
+
+/**
+ * Implementation used by the MSResample filter, chosen according to the input and output rates.
+**/
+typedef enum _MSResamplerBackend{
+	MSResamplerBackendNone, /**< rates are equal, samples are passed through*/
+	MSResamplerBackendPolyphase, /**< fixed ratio polyphase filter, for ratios between small integers such as 8k, 16k and 48k conversions*/
+	MSResamplerBackendSpeex /**< speex resampler, for any other ratio*/
+}MSResamplerBackend;
+
+/**
+ * Get the MSResamplerBackend used with the current rates and number of channels.
+**/
+#define MS_RESAMPLE_GET_BACKEND MS_FILTER_METHOD(MS_RESAMPLE_ID,0,MSResamplerBackend)
+
+/**
+ * Dot product of the polyphase backend. n is a multiple of 16, all the kernels give the same result.
+**/
+typedef struct _MSResamplerKernel{
+	const char *name;
+	int32_t (*dot)(const int16_t *a, const int16_t *b, int n);
+}MSResamplerKernel;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * List the dot product kernels usable on this CPU, from the generic one to the one used by the polyphase backend.
+ * The list is NULL terminated.
+**/
+MS2_PUBLIC const MSResamplerKernel * const *ms_resampler_list_kernels(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
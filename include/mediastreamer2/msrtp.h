@@ -52,6 +52,27 @@ typedef struct _MSFilterRequestClientToMixerDataCb MSFilterRequestClientToMixerD
 
 #define MS_RTP_RECV_SET_CLIENT_TO_MIXER_EXTENSION_ID	MS_FILTER_METHOD(MS_RTP_RECV_ID, 3, int)
 
+/**
+ * Statistics of the batched I/O of the RTP filters.
+ * The number of packets per system call is packets/calls.
+**/
+typedef struct _MSRtpBatchStats{
+	unsigned int recv_calls; /**< number of system calls made to receive packets */
+	unsigned int recv_packets; /**< number of packets received */
+	unsigned int send_calls; /**< number of system calls made to send packets */
+	unsigned int send_packets; /**< number of packets sent */
+	unsigned int send_errors; /**< number of packets that could not be sent, see MS_RTP_SEND_ENABLE_BATCH_SEND */
+}MSRtpBatchStats;
+
+/**
+ * Receive the RTP packets several at a time, with one system call. Only available on Linux, the method returns -1 elsewhere.
+ * It is not compatible with TURN, which reads the socket by itself.
+ * The session must be set before.
+**/
+#define MS_RTP_RECV_ENABLE_BATCH_RECEIVE	MS_FILTER_METHOD(MS_RTP_RECV_ID, 4, bool_t)
+
+#define MS_RTP_RECV_GET_BATCH_STATS	MS_FILTER_METHOD(MS_RTP_RECV_ID, 5, MSRtpBatchStats)
+
 #define MS_RTP_RECV_GENERIC_CN_RECEIVED		MS_FILTER_EVENT(MS_RTP_RECV_ID,0, MSCngData)
 
 #define MS_RTP_RECV_MIXER_TO_CLIENT_AUDIO_LEVEL_RECEIVED		MS_FILTER_EVENT(MS_RTP_RECV_ID,1, rtp_audio_level_t[RTP_MAX_MIXER_TO_CLIENT_AUDIO_LEVEL])
@@ -89,6 +110,17 @@ typedef struct _MSFilterRequestClientToMixerDataCb MSFilterRequestClientToMixerD
 
 #define MS_RTP_SEND_SET_CLIENT_TO_MIXER_DATA_REQUEST_CB	MS_FILTER_METHOD(MS_RTP_SEND_ID, 14, MSFilterRequestClientToMixerDataCb)
 
+/**
+ * Send the RTP packets of a tick together, with as few system calls as possible (sendmmsg() and UDP segmentation offload).
+ * Only available on Linux, the method returns -1 elsewhere. It is not compatible with TURN.
+ * The session must be set before.
+ * The packets are actually sent at the end of the tick, after oRTP has counted them as sent: the errors are logged and counted
+ * in the send_errors field of the MSRtpBatchStats.
+**/
+#define MS_RTP_SEND_ENABLE_BATCH_SEND	MS_FILTER_METHOD(MS_RTP_SEND_ID, 15, bool_t)
+
+#define MS_RTP_SEND_GET_BATCH_STATS	MS_FILTER_METHOD(MS_RTP_SEND_ID, 16, MSRtpBatchStats)
+
 
 extern MSFilterDesc ms_rtp_send_desc;
 extern MSFilterDesc ms_rtp_recv_desc;
@@ -25,6 +25,24 @@
 #define MS_TEE_UNMUTE	MS_FILTER_METHOD(MS_TEE_ID,0,int)
 #define MS_TEE_MUTE	MS_FILTER_METHOD(MS_TEE_ID,1,int)
 
+/**
+ * Statistics of an output of the MSTee.
+ * All outputs share the data of the input messages: downstream filters must consider them as read-only,
+ * and call ms_mblk_make_writable() before modifying them.
+**/
+typedef struct _MSTeeOutputStats{
+	int pin; /**< the output pin, to be set by the caller of MS_TEE_GET_OUTPUT_STATS */
+	int queue_depth; /**< number of messages waiting in the output queue after the last process */
+	int max_queue_depth; /**< highest value of queue_depth */
+	unsigned int packets; /**< number of messages delivered on the output */
+	unsigned int dropped; /**< number of messages dropped because the output queue was full */
+	uint64_t bytes; /**< amount of data delivered on the output, in bytes */
+}MSTeeOutputStats;
+
+/*maximum number of messages waiting in an output queue, beyond which the oldest ones are dropped. 0 (the default) means no limit.*/
+#define MS_TEE_SET_MAX_QUEUE_SIZE	MS_FILTER_METHOD(MS_TEE_ID,2,int)
+#define MS_TEE_GET_OUTPUT_STATS	MS_FILTER_METHOD(MS_TEE_ID,3,MSTeeOutputStats)
+
 
 
 #endif
@@ -93,6 +93,14 @@ struct _MSTicker
 	MSTickerLateEvent late_event;
 	unsigned long thread_id;
 	bool_t run;       /* flag to indicate whether the ticker must be run or not */
+	bool_t components_changed; /* set when the list of independent subgraphs must be recomputed */
+	ms_mutex_t task_lock; /* protects task_list when graphs are run by several threads */
+	MSList *components; /* list of lists of source filters, one per connected subgraph (parallel mode only) */
+	struct _MSTickerWorkers *workers; /* pool of threads running the subgraphs, NULL when graphs are run serially */
+	bool_t measure_filters; /* when TRUE, the time spent in each filter is accumulated in the filter (see MSTickerPool)*/
+	uint64_t overruns; /* number of ticks whose processing exceeded the interval */
+	struct _MSLatencyHistogram *tick_latency; /* histogram of the processing time of ticks, when profiling is TRUE */
+	bool_t profiling; /* set by ms_ticker_enable_profiling(), the filters are measured when either this or measure_filters is TRUE */
 };
 
 /**
@@ -194,6 +202,20 @@ MS2_PUBLIC int ms_ticker_attach_multiple(MSTicker *ticker,MSFilter *f,...);
  */
 MS2_PUBLIC int ms_ticker_detach(MSTicker *ticker,MSFilter *f);
 
+/**
+ * Move a chain of filters from a ticker to another one, between two ticks.
+ * Unlike ms_ticker_detach() followed by ms_ticker_attach(), the filters are not postprocessed and preprocessed again:
+ * the graph simply continues its execution on the destination ticker.
+ * Graphs whose filters bind to their ticker in preprocess (for example by setting its time function) must not be moved.
+ *
+ * @param from  the #MSTicker currently running the graph.
+ * @param to  the destination #MSTicker.
+ * @param f  A #MSFilter object of the graph.
+ *
+ * Returns: 0 if successfull, -1 otherwise.
+ */
+MS2_PUBLIC int ms_ticker_move_graph(MSTicker *from, MSTicker *to, MSFilter *f);
+
 /**
  * Destroy a ticker.
  *
@@ -241,6 +263,24 @@ MS2_PUBLIC void ms_ticker_print_graphs(MSTicker *ticker);
 **/
 MS2_PUBLIC float ms_ticker_get_average_load(MSTicker *ticker);
 
+/**
+ * Set the number of threads used to execute the graphs attached to the ticker.
+ * When greater than 1, the attached graphs are partitioned into disjoint connected subgraphs that are
+ * dispatched at each tick to a pool of worker threads. The tick completes once all subgraphs have been processed,
+ * so that the ticker's load and late tick measurements keep their meaning.
+ * Filters belonging to different subgraphs may then run concurrently: they must not share state without locking.
+ * @param ticker the MSTicker
+ * @param nthreads the total number of threads, including the ticker's own thread. 0 or 1 restores serial execution.
+**/
+MS2_PUBLIC void ms_ticker_set_thread_count(MSTicker *ticker, int nthreads);
+
+/**
+ * Get the number of threads used to execute the graphs attached to the ticker.
+ * @param ticker the MSTicker
+ * @return the number of threads, 1 when the graphs are executed serially.
+**/
+MS2_PUBLIC int ms_ticker_get_thread_count(MSTicker *ticker);
+
 /**
  * Get last late tick event description.
  * @param ticker the MSTicker
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MS_TICKER_POOL_H
+#define MS_TICKER_POOL_H
+
+#include <mediastreamer2/msticker.h>
+
+/**
+ * @file mstickerpool.h
+ * @brief mediastreamer2 mstickerpool.h include file
+ *
+ * This file provides an API to run graphs on a set of tickers, without having to choose
+ * the ticker that runs each graph.
+ *
+ */
+
+/**
+ * @addtogroup mediastreamer2_ticker
+ * @{
+ */
+
+/**
+ * A set of tickers sharing the execution of graphs.
+ * Graphs are placed on the least loaded ticker when attached. The time spent by each graph is measured, and
+ * a graph is moved to another ticker of the pool, between two ticks, when its ticker becomes overloaded.
+ * @var MSTickerPool
+ */
+typedef struct _MSTickerPool MSTickerPool;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * Create a pool of tickers.
+ * @param nb_tickers the number of tickers of the pool, typically the number of cpus (see ms_factory_get_cpu_count()).
+ * @param params parameters applied to each ticker. The name of the tickers is suffixed by their index in the pool.
+ * @return the new MSTickerPool.
+ */
+MS2_PUBLIC MSTickerPool *ms_ticker_pool_new(int nb_tickers, const MSTickerParams *params);
+
+/**
+ * Attach a chain of filters to the least loaded ticker of the pool.
+ * Graphs whose filters bind to their ticker in preprocess (for example sound cards setting the ticker's time function)
+ * should not be attached to a pool, as they may be moved to another ticker.
+ * @param pool the MSTickerPool
+ * @param f A #MSFilter object of the graph.
+ * @return 0 if successfull, -1 otherwise.
+ */
+MS2_PUBLIC int ms_ticker_pool_attach(MSTickerPool *pool, MSFilter *f);
+
+/**
+ * Detach a chain of filters that was attached with ms_ticker_pool_attach().
+ * @param pool the MSTickerPool
+ * @param f A #MSFilter object of the graph.
+ * @return 0 if successfull, -1 otherwise.
+ */
+MS2_PUBLIC int ms_ticker_pool_detach(MSTickerPool *pool, MSFilter *f);
+
+/**
+ * Set the load (in percent, see ms_ticker_get_average_load()) above which graphs are moved away from a ticker.
+ * The default value is 80.
+ * @param pool the MSTickerPool
+ * @param max_load the load threshold.
+ */
+MS2_PUBLIC void ms_ticker_pool_set_max_load(MSTickerPool *pool, float max_load);
+
+/**
+ * Get the number of tickers of the pool.
+ * @param pool the MSTickerPool
+ * @return the number of tickers.
+ */
+MS2_PUBLIC int ms_ticker_pool_get_size(const MSTickerPool *pool);
+
+/**
+ * Get a ticker of the pool.
+ * @param pool the MSTickerPool
+ * @param index the index of the ticker, between 0 and ms_ticker_pool_get_size()-1.
+ * @return the MSTicker, or NULL if the index is out of range.
+ */
+MS2_PUBLIC MSTicker *ms_ticker_pool_get_ticker(const MSTickerPool *pool, int index);
+
+/**
+ * Destroy a pool of tickers. All graphs must have been detached before.
+ * @param pool the MSTickerPool
+ */
+MS2_PUBLIC void ms_ticker_pool_destroy(MSTickerPool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif
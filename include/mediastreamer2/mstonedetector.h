@@ -53,4 +53,27 @@ typedef struct _MSToneDetectorEvent MSToneDetectorEvent;
 /** Event generated when a tone is detected */
 #define MS_TONE_DETECTOR_EVENT		MS_FILTER_EVENT(MS_TONE_DETECTOR_ID,0,MSToneDetectorEvent)
 
+/**
+ * Goertzel bank kernel: run the recursion q0=coef*q1-q2+x of every tone over the same samples.
+ * The state of tone i is in q1[i],q2[i], ntones is a multiple of 8. All the kernels give the same results.
+**/
+typedef struct _MSToneDetectorKernel{
+	const char *name;
+	void (*run)(float *q1, float *q2, const float *coef, int ntones, const float *samples, int nsamples);
+}MSToneDetectorKernel;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * List the Goertzel bank kernels usable on this CPU, from the generic one to the one used by the tone detector.
+ * The list is NULL terminated. This is meant for tests and benchmarks.
+**/
+MS2_PUBLIC const MSToneDetectorKernel * const *ms_tone_detector_list_kernels(void);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MS_TRACE_H
+#define MS_TRACE_H
+
+#include <mediastreamer2/msticker.h>
+
+/**
+ * @file mstrace.h
+ * @brief mediastreamer2 mstrace.h include file
+ *
+ * This file provides a recorder of the execution of the tickers: the duration of each tick, of each call to
+ * the filters' process() and of each postponed task is recorded, and can be saved in the Chrome trace event format,
+ * to be opened with Perfetto (https://ui.perfetto.dev) or chrome://tracing.
+ *
+ * Each thread running filters records its spans in its own ring buffer, without taking any lock. When a ring buffer
+ * is full, the oldest spans are overwritten, so that a capture always holds the last moments before it is saved.
+ */
+
+/**
+ * @addtogroup mediastreamer2_ticker
+ * @{
+ */
+
+enum _MSTraceEventType{
+	MSTraceEventTick, /**<the processing of one tick of a ticker*/
+	MSTraceEventProcess, /**<a call to the process() function of a filter*/
+	MSTraceEventTask /**<a task postponed by a filter, see ms_filter_postpone_task()*/
+};
+
+typedef enum _MSTraceEventType MSTraceEventType;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * Start recording the execution of all tickers.
+ * @param events_per_thread the capacity of the ring buffer of each thread, rounded up to a power of two, or 0 for the default
+ * (16384 spans, that is more than 10 seconds of a ticker running a dozen filters).
+ * The spans of a previous recording are discarded and its ring buffers are recycled.
+ */
+MS2_PUBLIC void ms_trace_start(int events_per_thread);
+
+/**
+ * Stop recording. The spans recorded so far are kept until ms_trace_start() is called again.
+ */
+MS2_PUBLIC void ms_trace_stop(void);
+
+/**
+ * Tell whether the execution of the tickers is being recorded.
+ */
+MS2_PUBLIC bool_t ms_trace_is_enabled(void);
+
+/**
+ * Record a span. This is called by the tickers and filters, and does nothing if recording is not enabled.
+ * @param ticker the ticker running the thread, used to name the thread in the trace. May be NULL.
+ * @param type the type of span
+ * @param name the name of the span, it must remain valid until the trace is saved (typically the name of a filter descriptor).
+ * @param instance the object executed, for example the MSFilter.
+ * @param arg an integer saved along with the span, for example the tick number.
+ * @param begin start time of the span, as returned by ms_get_cur_time().
+ * @param end end time of the span, as returned by ms_get_cur_time().
+ */
+MS2_PUBLIC void ms_trace_record(MSTicker *ticker, MSTraceEventType type, const char *name, const void *instance, uint32_t arg,
+	const MSTimeSpec *begin, const MSTimeSpec *end);
+
+/**
+ * Save the recorded spans in the Chrome trace event JSON format.
+ * This can be done while recording, spans overwritten while the file is written are skipped.
+ * @param filename path of the file to write
+ * @return 0 if successful, -1 otherwise.
+ */
+MS2_PUBLIC int ms_trace_save(const char *filename);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif
@@ -37,6 +37,24 @@ typedef struct _MSVideoRouterPinData{
 #define MS_VIDEO_ROUTER_SET_FOCUS MS_FILTER_METHOD(MS_VIDEO_ROUTER_ID,2,int)
 #define MS_VIDEO_ROUTER_SET_AS_LOCAL_MEMBER MS_FILTER_METHOD(MS_VIDEO_ROUTER_ID,3,MSVideoConferenceFilterPinControl)
 
+typedef struct _MSVideoRouterOutputBitrate{
+	int output;
+	int bitrate; /* maximum bitrate the receiver of the output can take, in bits/s, 0 if unlimited */
+}MSVideoRouterOutputBitrate;
+/**
+ * Set the bitrate available for an output. When the input forwarded to this output is a VP8 stream encoded with temporal layers,
+ * the router forwards only the layers that fit in this bitrate. Layers are added at layer sync points or key frames.
+ */
+#define MS_VIDEO_ROUTER_SET_OUTPUT_BITRATE MS_FILTER_METHOD(MS_VIDEO_ROUTER_ID,4,MSVideoRouterOutputBitrate)
+
+typedef struct _MSVideoRouterInputLayers{
+	int input;
+	int temporal_layers; /* set by the router: number of temporal layers of the input stream, 0 if the stream is not layered */
+	int bitrate; /* set by the router: bitrate of all the layers, in bits/s, 0 until measured */
+	int base_layer_bitrate; /* set by the router: bitrate of the base layer, in bits/s, 0 until measured */
+}MSVideoRouterInputLayers;
+#define MS_VIDEO_ROUTER_GET_INPUT_LAYERS MS_FILTER_METHOD(MS_VIDEO_ROUTER_ID,5,MSVideoRouterInputLayers)
+
 #define MS_VIDEO_ROUTER_NOTIFY_PLI MS_FILTER_EVENT(MS_VIDEO_ROUTER_ID,2,int)
 #define MS_VIDEO_ROUTER_NOTIFY_FIR MS_FILTER_EVENT(MS_VIDEO_ROUTER_ID,3,int)
 
@@ -20,27 +20,205 @@
 
 #include "mediastreamer2/msaudiomixer.h"
 #include "mediastreamer2/msticker.h"
+#include "msatomic.h"
+#include "mssimd.h"
 
 #ifdef _MSC_VER
 #include <malloc.h>
 #define alloca _alloca
 #endif
 
-#define MIXER_MAX_CHANNELS 50
+#define MIXER_MAX_CHANNELS 128
 #define ALWAYS_STREAMOUT 1
 #define BYPASS_MODE_TIMEOUT 1000
 
-static void accumulate(int32_t *sum, int16_t* contrib, int nwords){
+static MS2_INLINE int16_t saturate(int32_t s){
+	if (s>32767) return 32767;
+	if (s<-32767) return -32767;
+	return (int16_t)s;
+}
+
+/*
+ * Mixing kernels: a generic version of each one, plus SSE2, AVX2 and NEON versions selected at runtime.
+ * accumulate: sum+=contrib
+ * saturate: out=saturate(sum)
+ * subtract: out=saturate(sum-contrib)
+ */
+static void accumulate_generic(int32_t *sum, const int16_t* contrib, int nwords){
 	int i;
 	for(i=0;i<nwords;++i){
 		sum[i]+=contrib[i];
 	}
 }
 
-static MS2_INLINE int16_t saturate(int32_t s){
-	if (s>32767) return 32767;
-	if (s<-32767) return -32767;
-	return (int16_t)s;
+static void saturate_generic(int16_t *out, const int32_t *sum, int nwords){
+	int i;
+	for(i=0;i<nwords;++i){
+		out[i]=saturate(sum[i]);
+	}
+}
+
+static void subtract_generic(int16_t *out, const int32_t *sum, const int16_t *contrib, int nwords){
+	int i;
+	for(i=0;i<nwords;++i){
+		out[i]=saturate(sum[i]-(int32_t)contrib[i]);
+	}
+}
+
+#if MS_HAS_SSE2
+
+static MS2_INLINE __m128i saturate_sse2(__m128i lo, __m128i hi){
+	/*packs saturates to [-32768;32767], while the mixer clips at -32767*/
+	return _mm_max_epi16(_mm_packs_epi32(lo,hi),_mm_set1_epi16(-32767));
+}
+
+static void accumulate_sse2(int32_t *sum, const int16_t* contrib, int nwords){
+	int i;
+	for(i=0;i+8<=nwords;i+=8){
+		__m128i c=_mm_loadu_si128((const __m128i*)(contrib+i));
+		/*sign extension of 16 bit words to 32 bits*/
+		__m128i lo=_mm_srai_epi32(_mm_unpacklo_epi16(c,c),16);
+		__m128i hi=_mm_srai_epi32(_mm_unpackhi_epi16(c,c),16);
+		_mm_storeu_si128((__m128i*)(sum+i),_mm_add_epi32(_mm_loadu_si128((const __m128i*)(sum+i)),lo));
+		_mm_storeu_si128((__m128i*)(sum+i+4),_mm_add_epi32(_mm_loadu_si128((const __m128i*)(sum+i+4)),hi));
+	}
+	accumulate_generic(sum+i,contrib+i,nwords-i);
+}
+
+static void saturate_sse2_kernel(int16_t *out, const int32_t *sum, int nwords){
+	int i;
+	for(i=0;i+8<=nwords;i+=8){
+		__m128i lo=_mm_loadu_si128((const __m128i*)(sum+i));
+		__m128i hi=_mm_loadu_si128((const __m128i*)(sum+i+4));
+		_mm_storeu_si128((__m128i*)(out+i),saturate_sse2(lo,hi));
+	}
+	saturate_generic(out+i,sum+i,nwords-i);
+}
+
+static void subtract_sse2(int16_t *out, const int32_t *sum, const int16_t *contrib, int nwords){
+	int i;
+	for(i=0;i+8<=nwords;i+=8){
+		__m128i c=_mm_loadu_si128((const __m128i*)(contrib+i));
+		__m128i lo=_mm_sub_epi32(_mm_loadu_si128((const __m128i*)(sum+i)),_mm_srai_epi32(_mm_unpacklo_epi16(c,c),16));
+		__m128i hi=_mm_sub_epi32(_mm_loadu_si128((const __m128i*)(sum+i+4)),_mm_srai_epi32(_mm_unpackhi_epi16(c,c),16));
+		_mm_storeu_si128((__m128i*)(out+i),saturate_sse2(lo,hi));
+	}
+	subtract_generic(out+i,sum+i,contrib+i,nwords-i);
+}
+
+#endif
+
+#if MS_HAS_AVX2
+
+static MS_TARGET_AVX2 void accumulate_avx2(int32_t *sum, const int16_t* contrib, int nwords){
+	int i;
+	for(i=0;i+16<=nwords;i+=16){
+		__m256i lo=_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(contrib+i)));
+		__m256i hi=_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(contrib+i+8)));
+		_mm256_storeu_si256((__m256i*)(sum+i),_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(sum+i)),lo));
+		_mm256_storeu_si256((__m256i*)(sum+i+8),_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(sum+i+8)),hi));
+	}
+	accumulate_generic(sum+i,contrib+i,nwords-i);
+}
+
+static MS_TARGET_AVX2 void saturate_avx2(int16_t *out, const int32_t *sum, int nwords){
+	int i;
+	for(i=0;i+16<=nwords;i+=16){
+		__m256i lo=_mm256_loadu_si256((const __m256i*)(sum+i));
+		__m256i hi=_mm256_loadu_si256((const __m256i*)(sum+i+8));
+		/*packs works within 128 bit lanes, the permutation restores the order of samples*/
+		__m256i packed=_mm256_permute4x64_epi64(_mm256_packs_epi32(lo,hi),0xD8);
+		_mm256_storeu_si256((__m256i*)(out+i),_mm256_max_epi16(packed,_mm256_set1_epi16(-32767)));
+	}
+	saturate_generic(out+i,sum+i,nwords-i);
+}
+
+static MS_TARGET_AVX2 void subtract_avx2(int16_t *out, const int32_t *sum, const int16_t *contrib, int nwords){
+	int i;
+	for(i=0;i+16<=nwords;i+=16){
+		__m256i lo=_mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(sum+i)),
+			_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(contrib+i))));
+		__m256i hi=_mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(sum+i+8)),
+			_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(contrib+i+8))));
+		__m256i packed=_mm256_permute4x64_epi64(_mm256_packs_epi32(lo,hi),0xD8);
+		_mm256_storeu_si256((__m256i*)(out+i),_mm256_max_epi16(packed,_mm256_set1_epi16(-32767)));
+	}
+	subtract_generic(out+i,sum+i,contrib+i,nwords-i);
+}
+
+#endif
+
+#if MS_HAS_ARM_NEON
+
+static void accumulate_neon(int32_t *sum, const int16_t* contrib, int nwords){
+	int i;
+	for(i=0;i+8<=nwords;i+=8){
+		int16x8_t c=vld1q_s16(contrib+i);
+		vst1q_s32(sum+i,vaddw_s16(vld1q_s32(sum+i),vget_low_s16(c)));
+		vst1q_s32(sum+i+4,vaddw_s16(vld1q_s32(sum+i+4),vget_high_s16(c)));
+	}
+	accumulate_generic(sum+i,contrib+i,nwords-i);
+}
+
+static void saturate_neon(int16_t *out, const int32_t *sum, int nwords){
+	int i;
+	for(i=0;i+8<=nwords;i+=8){
+		int16x8_t packed=vcombine_s16(vqmovn_s32(vld1q_s32(sum+i)),vqmovn_s32(vld1q_s32(sum+i+4)));
+		vst1q_s16(out+i,vmaxq_s16(packed,vdupq_n_s16(-32767)));
+	}
+	saturate_generic(out+i,sum+i,nwords-i);
+}
+
+static void subtract_neon(int16_t *out, const int32_t *sum, const int16_t *contrib, int nwords){
+	int i;
+	for(i=0;i+8<=nwords;i+=8){
+		int16x8_t c=vld1q_s16(contrib+i);
+		int32x4_t lo=vsubw_s16(vld1q_s32(sum+i),vget_low_s16(c));
+		int32x4_t hi=vsubw_s16(vld1q_s32(sum+i+4),vget_high_s16(c));
+		vst1q_s16(out+i,vmaxq_s16(vcombine_s16(vqmovn_s32(lo),vqmovn_s32(hi)),vdupq_n_s16(-32767)));
+	}
+	subtract_generic(out+i,sum+i,contrib+i,nwords-i);
+}
+
+#endif
+
+static const MSAudioMixerKernels generic_kernels={"generic",accumulate_generic,saturate_generic,subtract_generic};
+#if MS_HAS_SSE2
+static const MSAudioMixerKernels sse2_kernels={"sse2",accumulate_sse2,saturate_sse2_kernel,subtract_sse2};
+#endif
+#if MS_HAS_AVX2
+static const MSAudioMixerKernels avx2_kernels={"avx2",accumulate_avx2,saturate_avx2,subtract_avx2};
+#endif
+#if MS_HAS_ARM_NEON
+static const MSAudioMixerKernels neon_kernels={"neon",accumulate_neon,saturate_neon,subtract_neon};
+#endif
+
+static const MSAudioMixerKernels *kernels_list[5];
+static const MSAudioMixerKernels *kernels=&generic_kernels;
+static ms_once_t kernels_once=MS_ONCE_INIT;
+
+/*the list is sorted by increasing speed and filled once, ms_once() publishes it to the other threads*/
+static void init_kernels(void){
+	unsigned int features=ms_get_cpu_features();
+	int n=0;
+
+	kernels_list[n++]=&generic_kernels;
+#if MS_HAS_SSE2
+	if (features & MSCpuFeatureSSE2) kernels_list[n++]=&sse2_kernels;
+#endif
+#if MS_HAS_AVX2
+	if (features & MSCpuFeatureAVX2) kernels_list[n++]=&avx2_kernels;
+#endif
+#if MS_HAS_ARM_NEON
+	if (features & MSCpuFeatureNEON) kernels_list[n++]=&neon_kernels;
+#endif
+	kernels=kernels_list[n-1];
+	(void)features;
+}
+
+const MSAudioMixerKernels * const *ms_audio_mixer_list_kernels(void){
+	ms_once(&kernels_once,init_kernels);
+	return kernels_list;
 }
 
 static void apply_gain(int16_t *samples, int nsamples, float gain){
@@ -59,6 +237,7 @@ typedef struct Channel{
 	uint64_t last_activity;
 	bool_t active;
 	bool_t output_enabled;
+	bool_t contributed; /*the channel input was added to the sum during the current tick*/
 } Channel;
 
 static void channel_init(Channel *chan){
@@ -67,6 +246,7 @@ static void channel_init(Channel *chan){
 	chan->gain=1.0;
 	chan->active=TRUE;
 	chan->output_enabled=TRUE;
+	chan->contributed=FALSE;
 }
 
 static void channel_prepare(Channel *chan, int bytes_per_tick){
@@ -76,13 +256,15 @@ static void channel_prepare(Channel *chan, int bytes_per_tick){
 }
 
 static int channel_process_in(Channel *chan, MSQueue *q, int32_t *sum, int nsamples){
+	chan->contributed=FALSE;
 	ms_bufferizer_put_from_queue(&chan->bufferizer,q);
 	if (ms_bufferizer_read(&chan->bufferizer,(uint8_t*)chan->input,nsamples*2)!=0){
 		if (chan->active){
 			if (chan->gain!=1.0){
 				apply_gain(chan->input,nsamples,chan->gain);
 			}
-			accumulate(sum,chan->input,nsamples);
+			kernels->accumulate(sum,chan->input,nsamples);
+			chan->contributed=TRUE;
 		}
 		return nsamples;
 	}else memset(chan->input,0,nsamples*2);
@@ -110,21 +292,10 @@ static int channel_flow_control(Channel *chan, int threshold, uint64_t time){
 	return skip;
 }
 
-static mblk_t *channel_process_out(Channel *chan, int32_t *sum, int nsamples){
-	int i;
-	mblk_t *om=allocb(nsamples*2,0);
-	int16_t *out=(int16_t*)om->b_wptr;
-
-	if (chan->active){
-		/*remove own contribution from sum*/
-		for(i=0;i<nsamples;++i){
-			out[i]=saturate(sum[i]-(int32_t)chan->input[i]);
-		}
-	}else{
-		for(i=0;i<nsamples;++i){
-			out[i]=saturate(sum[i]);
-		}
-	}
+/*output of a channel that contributed to the sum: its own contribution is removed*/
+static mblk_t *channel_process_out(MSFactory *factory, Channel *chan, int32_t *sum, int nsamples){
+	mblk_t *om=ms_factory_allocb(factory,nsamples*2);
+	kernels->subtract((int16_t*)om->b_wptr,sum,chan->input,nsamples);
 	om->b_wptr+=nsamples*2;
 	return om;
 }
@@ -155,6 +326,7 @@ typedef struct MixerState{
 static void mixer_init(MSFilter *f){
 	MixerState *s=ms_new0(MixerState,1);
 	int i;
+	ms_audio_mixer_list_kernels();
 	s->conf_mode=FALSE; /*this is the default, don't change it*/
 	s->nchannels=1;
 	s->rate=44100;
@@ -209,12 +381,10 @@ static void mixer_postprocess(MSFilter *f){
 	
 }
 
-static mblk_t *make_output(int32_t *sum, int nwords){
-	mblk_t *om=allocb(nwords*2,0);
-	int i;
-	for(i=0;i<nwords;++i,om->b_wptr+=2){
-		*(int16_t*)om->b_wptr=saturate(sum[i]);
-	}
+static mblk_t *make_output(MSFactory *factory, int32_t *sum, int nwords){
+	mblk_t *om=ms_factory_allocb(factory,nwords*2);
+	kernels->saturate((int16_t*)om->b_wptr,sum,nwords);
+	om->b_wptr+=nwords*2;
 	return om;
 }
 
@@ -325,7 +495,7 @@ static void mixer_process(MSFilter *f){
 				Channel *chan=&s->channels[i];
 				if (q && chan->output_enabled){
 					if (om==NULL){
-						om=make_output(s->sum,nwords);
+						om=make_output(f->factory,s->sum,nwords);
 					}else{
 						om=dupb(om);
 					}
@@ -333,11 +503,22 @@ static void mixer_process(MSFilter *f){
 				}
 			}
 		}else{
+			/* only the channels that contributed need their own mix: the others all receive the full mix, computed once*/
+			mblk_t *om=NULL;
 			for(i=0;i<MIXER_MAX_CHANNELS;++i){
 				MSQueue *q=f->outputs[i];
 				Channel *chan=&s->channels[i];
 				if (q && chan->output_enabled){
-					ms_queue_put(q,channel_process_out(&s->channels[i],s->sum,nwords));
+					if (chan->contributed){
+						ms_queue_put(q,channel_process_out(f->factory,chan,s->sum,nwords));
+					}else{
+						if (om==NULL){
+							om=make_output(f->factory,s->sum,nwords);
+						}else{
+							om=dupb(om);
+						}
+						ms_queue_put(q,om);
+					}
 				}
 			}
 		}
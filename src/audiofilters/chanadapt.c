@@ -84,7 +84,7 @@ static void adapter_process_2_inputs_to_single_stereo_output(MSFilter *f){
 		ms_flow_controlled_bufferizer_read(&s->input_buffer1, s->buffer1, s->buffer_size);
 		ms_flow_controlled_bufferizer_read(&s->input_buffer2, s->buffer2, s->buffer_size);
 
-		om = allocb(s->buffer_size * 2, 0);
+		om = ms_factory_allocb(f->factory, (int)(s->buffer_size * 2));
 
 		for (i = 0 ; i < s->buffer_size / sizeof(int16_t) ; i++ , om->b_wptr += 4) {
 			((int16_t*)om->b_wptr)[0] = ((int16_t*)s->buffer1)[i];
@@ -110,7 +110,7 @@ static void adapter_process(MSFilter *f) {
 				ms_queue_put(f->outputs[0], im);
 			} else if (s->outputchans == 2) {
 				msgsize = msgdsize(im) * 2;
-				om = allocb(msgsize, 0);
+				om = ms_factory_allocb(f->factory, (int)msgsize);
 				for (;im->b_rptr < im->b_wptr ; im->b_rptr += 2 , om->b_wptr += 4) {
 					((int16_t*)om->b_wptr)[0] = *(int16_t*)im->b_rptr;
 					((int16_t*)om->b_wptr)[1] = *(int16_t*)im->b_rptr;
@@ -119,7 +119,7 @@ static void adapter_process(MSFilter *f) {
 				freemsg(im);
 			} else if (s->inputchans == 2) {
 				msgsize = msgdsize(im)/2;
-				om = allocb(msgsize,0);
+				om = ms_factory_allocb(f->factory, (int)msgsize);
 				for (;im->b_rptr < im->b_wptr ; im->b_rptr += 4 , om->b_wptr += 2) {
 					*(int16_t*)om->b_wptr = *(int16_t*)im->b_rptr;
 				}
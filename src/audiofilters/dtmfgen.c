@@ -289,7 +289,7 @@ static void dtmfgen_process(MSFilter *f){
 			/*after 100 ms without stream we decide to generate our own sample
 			 instead of writing into incoming stream samples*/
 			nsamples=(f->ticker->interval*s->rate)/1000;
-			m=allocb(nsamples*s->nchannels*2,0);
+			m=ms_factory_allocb(f->factory,nsamples*s->nchannels*2);
 			if (s->silence==0){
 				if (s->pos==0){
 					MSDtmfGenEvent ev;
@@ -320,6 +320,8 @@ static void dtmfgen_process(MSFilter *f){
 					strncpy(ev.tone_name,s->current_tone.tone_name,sizeof(ev.tone_name));
 					ms_filter_notify(f,MS_DTMF_GEN_EVENT,&ev);
 				}
+				/*the tone is mixed in place: the buffer may be shared, for example by the outputs of a mixer*/
+				m=ms_mblk_make_writable(m);
 				nsamples=(int)(m->b_wptr-m->b_rptr)/(2*s->nchannels);
 				write_dtmf(f,s, (int16_t*)m->b_rptr,nsamples);
 			}
@@ -22,6 +22,11 @@
 
 #include <math.h>
 
+#include "msatomic.h"
+#ifndef MS_FIXED_POINT
+#include "kiss_fftr.h"
+#endif
+
 #ifndef M_PI
 #define M_PI       3.14159265358979323846
 #endif
@@ -34,17 +39,42 @@
 
 #define EQUALIZER_DEFAULT_RATE 8000
 
+/*impulse responses at least this long are applied by FFT block convolution instead of a direct form FIR*/
+#define EQUALIZER_FFT_CONVOLUTION_MIN_LEN 256
+
+/*
+ * An impulse response together with everything needed to apply it.
+ * Kernels are built by the thread changing the settings and handed to the
+ * processing thread through EqualizerState::pending, so that the ticker never
+ * computes an impulse response.
+ */
+typedef struct _EqualizerKernel{
+	int fir_len;
+	ms_word16_t *fir;
+	ms_mem_t *mem; /*memories for direct form filtering*/
+#ifndef MS_FIXED_POINT
+	int nfft; /*size of the FFT used for overlap-save convolution, 0 when the direct form is used*/
+	kiss_fftr_cfg forward;
+	kiss_fftr_cfg backward;
+	kiss_fft_cpx *response; /*transform of the impulse response, scaled by 1/nfft*/
+	kiss_fft_cpx *spectrum;
+	float *frame;
+	float *history; /*last fir_len-1 input samples*/
+#endif
+} EqualizerKernel;
+
 typedef struct _EqualizerState{
 	int rate;
 	int nfft; /*number of fft points in time*/
 	ms_word16_t *fft_cpx;
 	int fir_len;
-	ms_word16_t *fir;
-	ms_mem_t *mem; /*memories for filtering computations*/
-	bool_t needs_update;
+	EqualizerKernel *kernel; /*owned by the processing thread*/
+	ms_atomic_ptr_t pending; /*kernel waiting to replace the current one*/
 	bool_t active;
 } EqualizerState;
 
+static void equalizer_state_publish(EqualizerState *s);
+
 static void equalizer_state_flatten(EqualizerState *s){
 	int i;
 	ms_word16_t val=(ms_word16_t)(GAIN_ZERODB/s->nfft);
@@ -70,11 +100,7 @@ static void equalizer_rate_update( EqualizerState* s, int rate ){
 	s->fft_cpx=(ms_word16_t*)ms_new0(ms_word16_t,s->nfft);
 	equalizer_state_flatten(s);
 	s->fir_len=s->nfft;
-	if (s->fir != NULL) ms_free(s->fir);
-	s->fir=(ms_word16_t*)ms_new0(ms_word16_t,s->fir_len);
-	if (s->mem != NULL) ms_free(s->mem);
-	s->mem=(ms_mem_t*)ms_new0(ms_mem_t,s->fir_len);
-	s->needs_update=TRUE;
+	equalizer_state_publish(s);
 }
 
 
@@ -85,10 +111,13 @@ static EqualizerState * equalizer_state_new(int rate){
 	return s;
 }
 
+static void equalizer_kernel_destroy(EqualizerKernel *k);
+
 static void equalizer_state_destroy(EqualizerState *s){
+	EqualizerKernel *pending=(EqualizerKernel*)ms_atomic_ptr_exchange(&s->pending,NULL);
+	if (pending) equalizer_kernel_destroy(pending);
+	if (s->kernel) equalizer_kernel_destroy(s->kernel);
 	ms_free(s->fft_cpx);
-	ms_free(s->fir);
-	ms_free(s->mem);
 	ms_free(s);
 }
 
@@ -172,7 +201,7 @@ static void equalizer_state_set(EqualizerState *s, int freq_0, float gain, int f
 		equalizer_point_set(s, i, f, gain);
 	}
 	while (i>=0 && (gain>1.1 || gain<0.9));
-	s->needs_update=TRUE;
+	equalizer_state_publish(s);
 }
 
 static void dump_table(ms_word16_t *t, int len){
@@ -216,31 +245,143 @@ static void norm_and_apodize(ms_word16_t *s, int len){
 	}
 }
 
-static void equalizer_state_compute_impulse_response(EqualizerState *s){
+static void equalizer_state_compute_impulse_response(EqualizerState *s, ms_word16_t *fir){
 	void *fft_handle=ms_fft_init(s->nfft);
 	
 	ms_message("Equalizer rate: %d, selecting %d steps for FFT", s->rate, s->nfft);
 
 	ms_message("Spectral domain:");
 	dump_table(s->fft_cpx,s->nfft);
-	ms_ifft(fft_handle,s->fft_cpx,s->fir);
+	ms_ifft(fft_handle,s->fft_cpx,fir);
 	ms_fft_destroy(fft_handle);
 	/*
 	ms_message("Inverse fft result:");
-	dump_table(s->fir,s->fir_len);
+	dump_table(fir,s->fir_len);
 	*/
-	time_shift(s->fir,s->fir_len);
+	time_shift(fir,s->fir_len);
 	/*
 	ms_message("Time shifted:");
-	dump_table(s->fir,s->fir_len);
+	dump_table(fir,s->fir_len);
 	*/
-	norm_and_apodize(s->fir,s->fir_len);
+	norm_and_apodize(fir,s->fir_len);
 	ms_message("Apodized impulse response:");
-	dump_table(s->fir,s->fir_len);
-	s->needs_update=FALSE;
+	dump_table(fir,s->fir_len);
+}
+
+static void equalizer_kernel_destroy(EqualizerKernel *k){
+#ifndef MS_FIXED_POINT
+	if (k->nfft>0){
+		kiss_fftr_free(k->forward);
+		kiss_fftr_free(k->backward);
+		ms_free(k->response);
+		ms_free(k->spectrum);
+		ms_free(k->frame);
+		ms_free(k->history);
+	}
+#endif
+	ms_free(k->fir);
+	ms_free(k->mem);
+	ms_free(k);
+}
+
+#ifndef MS_FIXED_POINT
+/*
+ * Overlap-save: every block of input is preceded by the last fir_len-1 samples of the previous ones,
+ * so that the circular convolution computed through the FFT equals the linear one on the new samples.
+ * The FFT is four times as long as the impulse response, which lets 20 ms packets go in a single block.
+ */
+static void equalizer_kernel_init_fft(EqualizerKernel *k){
+	int i;
+	float scale;
+
+	k->nfft=4*k->fir_len;
+	k->forward=kiss_fftr_alloc(k->nfft,0,NULL,NULL);
+	k->backward=kiss_fftr_alloc(k->nfft,1,NULL,NULL);
+	k->response=ms_new0(kiss_fft_cpx,k->nfft/2+1);
+	k->spectrum=ms_new0(kiss_fft_cpx,k->nfft/2+1);
+	k->frame=ms_new0(float,k->nfft);
+	k->history=ms_new0(float,k->fir_len-1);
+
+	for(i=0;i<k->fir_len;++i) k->frame[i]=k->fir[i];
+	kiss_fftr(k->forward,k->frame,k->response);
+	/*kiss_fftri() does not normalize, do it once here*/
+	scale=1.0f/(float)k->nfft;
+	for(i=0;i<=k->nfft/2;++i){
+		k->response[i].r*=scale;
+		k->response[i].i*=scale;
+	}
 }
 
+static void equalizer_kernel_convolve(EqualizerKernel *k, int16_t *samples, int nsamples){
+	int hist=k->fir_len-1;
+	int block=k->nfft-hist;
+	int i;
+
+	while(nsamples>0){
+		int n=MIN(nsamples,block);
 
+		memcpy(k->frame,k->history,hist*sizeof(float));
+		for(i=0;i<n;++i) k->frame[hist+i]=(float)samples[i];
+		memset(k->frame+hist+n,0,(k->nfft-hist-n)*sizeof(float));
+		memcpy(k->history,k->frame+n,hist*sizeof(float));
+
+		kiss_fftr(k->forward,k->frame,k->spectrum);
+		for(i=0;i<=k->nfft/2;++i){
+			kiss_fft_cpx a=k->spectrum[i];
+			kiss_fft_cpx b=k->response[i];
+			k->spectrum[i].r=a.r*b.r-a.i*b.i;
+			k->spectrum[i].i=a.r*b.i+a.i*b.r;
+		}
+		kiss_fftri(k->backward,k->spectrum,k->frame);
+		for(i=0;i<n;++i){
+			float y=k->frame[hist+i];
+			samples[i]=(int16_t)(y>32767.0f ? 32767 : (y<-32768.0f ? -32768 : y));
+		}
+		samples+=n;
+		nsamples-=n;
+	}
+}
+#endif
+
+static EqualizerKernel *equalizer_kernel_new(EqualizerState *s){
+	EqualizerKernel *k=ms_new0(EqualizerKernel,1);
+	k->fir_len=s->fir_len;
+	k->fir=(ms_word16_t*)ms_new0(ms_word16_t,k->fir_len);
+	k->mem=(ms_mem_t*)ms_new0(ms_mem_t,k->fir_len);
+	equalizer_state_compute_impulse_response(s,k->fir);
+#ifndef MS_FIXED_POINT
+	if (k->fir_len>=EQUALIZER_FFT_CONVOLUTION_MIN_LEN) equalizer_kernel_init_fft(k);
+#endif
+	return k;
+}
+
+/*called from the thread changing the settings: prepare a kernel and let the processing thread pick it up*/
+static void equalizer_state_publish(EqualizerState *s){
+	EqualizerKernel *k=equalizer_kernel_new(s);
+	EqualizerKernel *replaced=(EqualizerKernel*)ms_atomic_ptr_exchange(&s->pending,k);
+	/*a kernel still pending was never seen by the processing thread*/
+	if (replaced) equalizer_kernel_destroy(replaced);
+}
+
+/*called from the processing thread*/
+static void equalizer_state_swap_kernel(EqualizerState *s){
+	EqualizerKernel *k;
+
+	if (ms_atomic_ptr_load(&s->pending)==NULL) return;
+	k=(EqualizerKernel*)ms_atomic_ptr_exchange(&s->pending,NULL);
+	if (k==NULL) return;
+	if (s->kernel){
+		/*keep the filter memories, so that a new setting does not produce a click*/
+		if (s->kernel->fir_len==k->fir_len){
+			memcpy(k->mem,s->kernel->mem,k->fir_len*sizeof(ms_mem_t));
+#ifndef MS_FIXED_POINT
+			if (k->nfft>0 && s->kernel->nfft>0) memcpy(k->history,s->kernel->history,(k->fir_len-1)*sizeof(float));
+#endif
+		}
+		equalizer_kernel_destroy(s->kernel);
+	}
+	s->kernel=k;
+}
 
 #ifdef MS_FIXED_POINT
 #define INT16_TO_WORD16(i,w,l) w=(i)
@@ -266,10 +407,18 @@ static void word16_to_int16(const ms_word16_t *w, int16_t *is, int l){
 
 static void equalizer_state_run(EqualizerState *s, int16_t *samples, int nsamples){
 	ms_word16_t *w;
-	if (s->needs_update)
-		equalizer_state_compute_impulse_response(s);
+	EqualizerKernel *k;
+
+	equalizer_state_swap_kernel(s);
+	k=s->kernel;
+#ifndef MS_FIXED_POINT
+	if (k->nfft>0){
+		equalizer_kernel_convolve(k,samples,nsamples);
+		return;
+	}
+#endif
 	INT16_TO_WORD16(samples,w,nsamples);
-	ms_fir_mem16(w,s->fir,w,nsamples,s->fir_len,s->mem);
+	ms_fir_mem16(w,k->fir,w,nsamples,k->fir_len,k->mem);
 	WORD16_TO_INT16(w,samples,nsamples);
 }
 
@@ -287,6 +436,8 @@ static void equalizer_process(MSFilter *f){
 	EqualizerState *s=(EqualizerState*)f->data;
 	while((m=ms_queue_get(f->inputs[0]))!=NULL){
 		if (s->active){
+			/*the filtering is done in place: the buffer may be shared, for example by the outputs of a mixer*/
+			m=ms_mblk_make_writable(m);
 			equalizer_state_run(s,(int16_t*)m->b_rptr,(int)((m->b_wptr-m->b_rptr)/2));
 		}
 		ms_queue_put(f->outputs[0],m);
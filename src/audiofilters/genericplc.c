@@ -22,12 +22,18 @@
 #include "mediastreamer2/mscommon.h"
 #include "genericplc.h"
 #include "mediastreamer2/dsptools.h"
+#include "mssimd.h"
 #include <math.h>
 
 #define PI 3.14159265
 
+/* work buffers are carved from a single allocation, their lengths are rounded to 16 samples so that each of them keeps the
+ * alignment of the block: ms_malloc0() only guarantees 16 bytes, hence the unaligned SIMD loads and stores */
+#define PLC_ALIGNED_LEN(n) (((n)+15)&~15)
+
 plc_context_t *generic_plc_create_context(int sample_rate) {
 	int i;
+	int aligned_len;
 	plc_context_t *context = (plc_context_t*) ms_new0(plc_context_t, 1);
 
 	/* Continuity buffer usage :
@@ -37,22 +43,36 @@ plc_context_t *generic_plc_create_context(int sample_rate) {
 	 *     - the second TRANSITION_DELAY ms are mixed for smooth transition with the begining of arrived frame
 	 */
 	context->continuity_buffer = ms_malloc0(2*sample_rate*sizeof(int16_t)*TRANSITION_DELAY/1000); /* continuity buffer introduce a TRANSITION_DELAY ms delay */
+	context->transition_buffer = ms_malloc0(sample_rate*sizeof(int16_t)*TRANSITION_DELAY/1000);
 	context->plc_buffer_len = (uint16_t)(sample_rate*sizeof(int16_t)*PLC_BUFFER_LEN); /* length in bytes of the plc_buffer */
 	context->plc_buffer = ms_malloc0(context->plc_buffer_len);
-	context->hamming_window = ms_malloc0(sample_rate*PLC_BUFFER_LEN*sizeof(float));
 	context->plc_out_buffer = ms_malloc0(2*context->plc_buffer_len);
 	context->plc_index=0;
 	context->plc_samples_used=0;
 	context->sample_rate = sample_rate;
+	context->fft_len = sample_rate*PLC_BUFFER_LEN;
+
+	/* the hamming window and the FFT work buffers: window, time and frequency domain buffers hold fft_len samples, the doubled ones twice that */
+	aligned_len = PLC_ALIGNED_LEN(context->fft_len);
+	context->hamming_window = (ms_word16_t *)ms_malloc0(7*aligned_len*sizeof(ms_word16_t));
+	context->time_domain_buffer = context->hamming_window + aligned_len;
+	context->freq_domain_buffer = context->time_domain_buffer + aligned_len;
+	context->freq_domain_buffer_double = context->freq_domain_buffer + aligned_len;
+	context->time_domain_buffer_double = context->freq_domain_buffer_double + 2*aligned_len;
 
 	/* initialise the fft contexts, one with sample number being the plc buffer length,
 	 * the complex to real is twice that number as buffer is doubled in frequency domain */
-	context->fft_to_frequency_context = ms_fft_init(sample_rate*PLC_BUFFER_LEN);
-	context->fft_to_time_context = ms_fft_init(2*sample_rate*PLC_BUFFER_LEN);
+	context->fft_to_frequency_context = ms_fft_init(context->fft_len);
+	context->fft_to_time_context = ms_fft_init(2*context->fft_len);
 
 	/* initialise hamming window : h(t) = 0.75 - 0.25*cos(2pi*t/T) */
-	for(i=0; i<sample_rate*PLC_BUFFER_LEN; i++) {
-		context->hamming_window[i] = (float)(0.75 - 0.25*cos( 2*PI*i/(sample_rate*PLC_BUFFER_LEN)));
+	for(i=0; i<context->fft_len; i++) {
+		double w = 0.75 - 0.25*cos( 2*PI*i/context->fft_len);
+#ifdef MS_FIXED_POINT
+		context->hamming_window[i] = (ms_word16_t)MIN(32767, (int)(w*32768.0 + 0.5));
+#else
+		context->hamming_window[i] = (ms_word16_t)w;
+#endif
 	}
 
 	return context;
@@ -60,6 +80,7 @@ plc_context_t *generic_plc_create_context(int sample_rate) {
 
 void generic_plc_destroy_context(plc_context_t *context) {
 	ms_free(context->continuity_buffer);
+	ms_free(context->transition_buffer);
 	ms_free(context->plc_buffer);
 	ms_free(context->hamming_window);
 	ms_free(context->plc_out_buffer);
@@ -69,19 +90,55 @@ void generic_plc_destroy_context(plc_context_t *context) {
 	ms_free(context);
 }
 
+/* out[i] = in[i]*window[i], the window being in Q15 in fixed point builds */
+static void generic_plc_apply_window(const int16_t *in, const ms_word16_t *window, ms_word16_t *out, int len) {
+	int i = 0;
+#ifdef MS_FIXED_POINT
+#if MS_HAS_ARM_NEON
+	for (; i + 8 <= len; i += 8) {
+		vst1q_s16(out + i, vqdmulhq_s16(vld1q_s16(in + i), vld1q_s16(window + i)));
+	}
+#endif
+	for (; i < len; i++) {
+		out[i] = (ms_word16_t)(((int32_t)in[i]*window[i]) >> 15);
+	}
+#else
+#if MS_HAS_SSE2
+	for (; i + 8 <= len; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i sign = _mm_srai_epi16(x, 15);
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(x, sign)), _mm_loadu_ps(window + i)));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(x, sign)), _mm_loadu_ps(window + i + 4)));
+	}
+#elif MS_HAS_ARM_NEON
+	for (; i + 8 <= len; i += 8) {
+		int16x8_t x = vld1q_s16(in + i);
+		vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), vld1q_f32(window + i)));
+		vst1q_f32(out + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), vld1q_f32(window + i + 4)));
+	}
+#endif
+	for (; i < len; i++) {
+		out[i] = (float)in[i]*window[i];
+	}
+#endif
+}
+
 void generic_plc_fftbf(plc_context_t *context, int16_t *input_buffer, int16_t *output_buffer, size_t input_buffer_len) {
-	/* Allocate temporary buffers to perform FFT-> double buffer size in frequency domain -> inverse FFT */
-	ms_word16_t *time_domain_buffer = ms_malloc0(input_buffer_len*sizeof(ms_word16_t));
-	ms_word16_t *freq_domain_buffer = ms_malloc0(input_buffer_len*sizeof(ms_word16_t));
-	ms_word16_t *freq_domain_buffer_double = ms_malloc0(2*input_buffer_len*sizeof(ms_word16_t));
-	ms_word16_t *time_domain_buffer_double = ms_malloc0(2*input_buffer_len*sizeof(ms_word16_t));
+	/* FFT -> double buffer size in frequency domain -> inverse FFT, in the work buffers of the context */
+	ms_word16_t *time_domain_buffer = context->time_domain_buffer;
+	ms_word16_t *freq_domain_buffer = context->freq_domain_buffer;
+	ms_word16_t *freq_domain_buffer_double = context->freq_domain_buffer_double;
+	ms_word16_t *time_domain_buffer_double = context->time_domain_buffer_double;
 	size_t i;
 
-	/* convert to ms_word16_t the input buffer */
-	for (i=0; i<input_buffer_len; i++) {
-		time_domain_buffer[i] = (ms_word16_t)((float)input_buffer[i]*context->hamming_window[i]);
+	if (input_buffer_len != (size_t)context->fft_len) {
+		ms_error("generic_plc_fftbf: %i samples given, the context was created for %i", (int)input_buffer_len, context->fft_len);
+		return;
 	}
 
+	/* apply the window and convert to ms_word16_t the input buffer */
+	generic_plc_apply_window(input_buffer, context->hamming_window, time_domain_buffer, (int)input_buffer_len);
+
 	/* FFT */
 	ms_fft(context->fft_to_frequency_context, time_domain_buffer, freq_domain_buffer);
 
@@ -94,16 +151,10 @@ void generic_plc_fftbf(plc_context_t *context, int16_t *input_buffer, int16_t *o
 	/* inverse FFT, we have twice the number of original samples, discard the first half and use the second as new samples */
 	ms_ifft(context->fft_to_time_context, freq_domain_buffer_double, time_domain_buffer_double);
 
-	ms_free(time_domain_buffer);
-	ms_free(freq_domain_buffer);
-	ms_free(freq_domain_buffer_double);
-
 	/* copy generated signal to the plc_out_buffer */
 	for (i=0; i<2*input_buffer_len; i++) {
 		output_buffer[i] = (int16_t)(time_domain_buffer_double[i]);
 	}
-
-	ms_free(time_domain_buffer_double);
 }
 
 void generic_plc_generate_samples(plc_context_t *context, int16_t *data, uint16_t sample_nbr) {
@@ -193,10 +244,9 @@ void generic_plc_update_plc_buffer(plc_context_t *context, unsigned char *data,
 
 void generic_plc_update_continuity_buffer(plc_context_t *context, unsigned char *data, size_t data_len) {
 	size_t transitionBufferSize = context->sample_rate*sizeof(int16_t)*TRANSITION_DELAY/1000;
-	unsigned char *buffer;
+	unsigned char *buffer = context->transition_buffer;
 
 	if (transitionBufferSize > data_len) transitionBufferSize = data_len;
-	buffer=ms_malloc(transitionBufferSize);
 
 	/* get the last TRANSITION_DELAY ms in a temp buffer */
 	memcpy(buffer, data+data_len-transitionBufferSize, transitionBufferSize);
@@ -206,16 +256,55 @@ void generic_plc_update_continuity_buffer(plc_context_t *context, unsigned char
 	memcpy(data, context->continuity_buffer, transitionBufferSize);
 	/* store in context for next msg the last TRANSITION_DELAY ms of current msg */
 	memcpy(context->continuity_buffer, buffer, transitionBufferSize);
-
-	ms_free(buffer);
 }
 
 
 /** Transition mix function, mix last received data with local generated one for smooth transition */
 void generic_plc_transition_mix(int16_t *inout_buffer, int16_t *continuity_buffer, uint16_t fading_sample_nbr) {
-	uint16_t i;
-	for (i=0; i<fading_sample_nbr; i++) {
-		float progress = ((float) i)/fading_sample_nbr;
+	int i = 0;
+	float step;
+
+	if (fading_sample_nbr == 0) return;
+	step = 1.0f/fading_sample_nbr;
+#if MS_HAS_SSE2
+	{
+		const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+		const __m128 vstep = _mm_set1_ps(step);
+		const __m128 one = _mm_set1_ps(1.0f);
+		for (; i + 8 <= fading_sample_nbr; i += 8) {
+			__m128i x = _mm_loadu_si128((const __m128i *)(inout_buffer + i));
+			__m128i c = _mm_loadu_si128((const __m128i *)(continuity_buffer + i));
+			__m128i xsign = _mm_srai_epi16(x, 15), csign = _mm_srai_epi16(c, 15);
+			/* progress computed as i*step like the scalar loop, so that both paths give the same samples */
+			__m128 p0 = _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)i), lanes), vstep);
+			__m128 p1 = _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)(i + 4)), lanes), vstep);
+			__m128 lo = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(c, csign)), _mm_sub_ps(one, p0)),
+				_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(x, xsign)), p0));
+			__m128 hi = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(c, csign)), _mm_sub_ps(one, p1)),
+				_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(x, xsign)), p1));
+			_mm_storeu_si128((__m128i *)(inout_buffer + i), _mm_packs_epi32(_mm_cvttps_epi32(lo), _mm_cvttps_epi32(hi)));
+		}
+	}
+#elif MS_HAS_ARM_NEON
+	{
+		static const float lane_offsets[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+		const float32x4_t lanes = vld1q_f32(lane_offsets);
+		const float32x4_t one = vdupq_n_f32(1.0f);
+		for (; i + 8 <= fading_sample_nbr; i += 8) {
+			int16x8_t x = vld1q_s16(inout_buffer + i);
+			int16x8_t c = vld1q_s16(continuity_buffer + i);
+			float32x4_t p0 = vmulq_n_f32(vaddq_f32(vdupq_n_f32((float)i), lanes), step);
+			float32x4_t p1 = vmulq_n_f32(vaddq_f32(vdupq_n_f32((float)(i + 4)), lanes), step);
+			float32x4_t lo = vaddq_f32(vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(c))), vsubq_f32(one, p0)),
+				vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), p0));
+			float32x4_t hi = vaddq_f32(vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(c))), vsubq_f32(one, p1)),
+				vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), p1));
+			vst1q_s16(inout_buffer + i, vcombine_s16(vqmovn_s32(vcvtq_s32_f32(lo)), vqmovn_s32(vcvtq_s32_f32(hi))));
+		}
+	}
+#endif
+	for (; i<fading_sample_nbr; i++) {
+		float progress = (float)i*step;
 		inout_buffer[i] = (int16_t)((float)continuity_buffer[i]*(1-progress) + (float)inout_buffer[i]*progress);
 	}
 }
@@ -20,6 +20,8 @@
 #ifndef genericplc_h
 #define genericplc_h
 
+#include "mediastreamer2/dsptools.h"
+
 /* define transition duration in ms when starting/ending a comfort noise period - it introduces an equivalent delay */
 #define TRANSITION_DELAY 5
 
@@ -39,7 +41,13 @@ typedef struct {
 	unsigned char *continuity_buffer; /**< buffer used to store a small set of future samples */
 	uint16_t plc_buffer_len; /**< The buffer len in bytes*/
 	unsigned char *plc_buffer; /**< buffer to store the previous frames used to generate plc */
-	float *hamming_window; /**< store the hamming window to apply to signal before fft */
+	int fft_len; /**< number of samples of plc_buffer, which is the size of the forward FFT */
+	ms_word16_t *hamming_window; /**< store the hamming window to apply to signal before fft, in Q15 in fixed point builds */
+	ms_word16_t *time_domain_buffer; /**< work buffers of generic_plc_fftbf(), allocated once with the context */
+	ms_word16_t *freq_domain_buffer;
+	ms_word16_t *freq_domain_buffer_double;
+	ms_word16_t *time_domain_buffer_double;
+	unsigned char *transition_buffer; /**< work buffer of generic_plc_update_continuity_buffer() */
 	int16_t *plc_out_buffer; /**< buffer to store the frames generated by plc, same length than previous frames one  */
 	uint16_t plc_index; /**< index of plc_out_buffer to the next samples */
 	uint16_t plc_samples_used; /**< number of plc frames already used */
@@ -77,7 +77,7 @@ static void enc_process(MSFilter *f){
 	ms_bufferizer_put_from_queue(s->bufferizer,f->inputs[0]);
 	
 	while(ms_bufferizer_get_avail(s->bufferizer)>=s->nbytes) {
-		mblk_t *om=allocb(s->nbytes,0);
+		mblk_t *om=ms_factory_allocb(f->factory,(int)s->nbytes);
 		om->b_wptr+=ms_bufferizer_read(s->bufferizer,om->b_wptr,s->nbytes);
 		host_to_network((int16_t*)om->b_rptr,(int)(s->nbytes/2));
 		ms_bufferizer_fill_current_metas(s->bufferizer, om);
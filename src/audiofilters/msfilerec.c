@@ -85,11 +85,7 @@ static void rec_process(MSFilter *f){
 				max_size_reached = 1;
 			}
 			if (s->swap) {
-				if (dblk_ref_value(m->b_datap) != 1){
-					mblk_t *old = m;
-					m = copymsg(m);
-					freemsg(old);
-				}
+				m = ms_mblk_make_writable(m);
 				swap_bytes(m->b_rptr,len);
 			}
 			ms_async_writer_write(s->writer,m);
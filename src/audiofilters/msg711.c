@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mediastreamer2/msg711.h"
+#include "g711.h"
+#include "msatomic.h"
+#include "mssimd.h"
+
+/*
+ * A-law encoding only depends on the 13 most significant bits of the sample and u-law encoding on the 14 most significant
+ * bits, so that the encoding tables are indexed by the sample shifted right by 3 (A-law) or 2 (u-law) bits.
+ */
+static uint8_t alaw_enc_table[1<<13];
+static uint8_t ulaw_enc_table[1<<14];
+static int16_t alaw_dec_table[256];
+static int16_t ulaw_dec_table[256];
+
+static void init_tables(void){
+	int i;
+	for(i=0;i<(1<<13);i++){
+		alaw_enc_table[i]=Snack_Lin2Alaw((short)(i<<3));
+	}
+	for(i=0;i<(1<<14);i++){
+		ulaw_enc_table[i]=Snack_Lin2Mulaw((short)(i<<2));
+	}
+	for(i=0;i<256;i++){
+		alaw_dec_table[i]=Snack_Alaw2Lin((unsigned char)i);
+		ulaw_dec_table[i]=Snack_Mulaw2Lin((unsigned char)i);
+	}
+}
+
+static void alaw_encode_scalar(uint8_t *dst, const int16_t *src, int nsamples){
+	int i;
+	for(i=0;i<nsamples;i++) dst[i]=Snack_Lin2Alaw(src[i]);
+}
+
+static void alaw_decode_scalar(int16_t *dst, const uint8_t *src, int nsamples){
+	int i;
+	for(i=0;i<nsamples;i++) dst[i]=Snack_Alaw2Lin(src[i]);
+}
+
+static void ulaw_encode_scalar(uint8_t *dst, const int16_t *src, int nsamples){
+	int i;
+	for(i=0;i<nsamples;i++) dst[i]=Snack_Lin2Mulaw(src[i]);
+}
+
+static void ulaw_decode_scalar(int16_t *dst, const uint8_t *src, int nsamples){
+	int i;
+	for(i=0;i<nsamples;i++) dst[i]=Snack_Mulaw2Lin(src[i]);
+}
+
+static void alaw_encode_table(uint8_t *dst, const int16_t *src, int nsamples){
+	int i;
+	for(i=0;i<nsamples;i++) dst[i]=alaw_enc_table[(uint16_t)src[i]>>3];
+}
+
+static void alaw_decode_table(int16_t *dst, const uint8_t *src, int nsamples){
+	int i;
+	for(i=0;i<nsamples;i++) dst[i]=alaw_dec_table[src[i]];
+}
+
+static void ulaw_encode_table(uint8_t *dst, const int16_t *src, int nsamples){
+	int i;
+	for(i=0;i<nsamples;i++) dst[i]=ulaw_enc_table[(uint16_t)src[i]>>2];
+}
+
+static void ulaw_decode_table(int16_t *dst, const uint8_t *src, int nsamples){
+	int i;
+	for(i=0;i<nsamples;i++) dst[i]=ulaw_dec_table[src[i]];
+}
+
+/*
+ * SIMD encoders: the segment is the number of segment ends below the magnitude, and the quantization bits are selected
+ * among the magnitude shifted by each possible segment. Decoding with a 256 entries table is as fast as it can get,
+ * so that the SIMD kernels share the table decoders.
+ */
+#if MS_HAS_SSE2
+
+#define SEGMENT_SSE2(shift, end) \
+	above=_mm_cmpgt_epi16(mag,_mm_set1_epi16(end)); \
+	seg=_mm_sub_epi16(seg,above); \
+	quant=_mm_or_si128(_mm_and_si128(above,_mm_srli_epi16(mag,shift)),_mm_andnot_si128(above,quant))
+
+static MS2_INLINE __m128i alaw_encode8_sse2(__m128i pcm){
+	__m128i v=_mm_srai_epi16(pcm,3);
+	__m128i neg=_mm_cmplt_epi16(v,_mm_setzero_si128());
+	__m128i mag=_mm_xor_si128(v,neg); /*-v-1 for negative samples*/
+	__m128i quant=_mm_srli_epi16(mag,1);
+	__m128i seg=_mm_setzero_si128();
+	__m128i above,aval;
+	SEGMENT_SSE2(2,0x3F);
+	SEGMENT_SSE2(3,0x7F);
+	SEGMENT_SSE2(4,0xFF);
+	SEGMENT_SSE2(5,0x1FF);
+	SEGMENT_SSE2(6,0x3FF);
+	SEGMENT_SSE2(7,0x7FF);
+	seg=_mm_sub_epi16(seg,_mm_cmpgt_epi16(mag,_mm_set1_epi16(0x1F)));
+	aval=_mm_or_si128(_mm_slli_epi16(seg,4),_mm_and_si128(quant,_mm_set1_epi16(0xF)));
+	return _mm_xor_si128(aval,_mm_xor_si128(_mm_set1_epi16(0xD5),_mm_and_si128(neg,_mm_set1_epi16(0x80))));
+}
+
+static MS2_INLINE __m128i ulaw_encode8_sse2(__m128i pcm){
+	__m128i v=_mm_srai_epi16(pcm,2);
+	__m128i neg=_mm_cmplt_epi16(v,_mm_setzero_si128());
+	__m128i mag=_mm_sub_epi16(_mm_xor_si128(v,neg),neg);
+	__m128i quant,seg=_mm_setzero_si128();
+	__m128i above,overflow,uval;
+	mag=_mm_add_epi16(_mm_min_epi16(mag,_mm_set1_epi16(8159)),_mm_set1_epi16(0x84>>2));
+	quant=_mm_srli_epi16(mag,1);
+	SEGMENT_SSE2(2,0x3F);
+	SEGMENT_SSE2(3,0x7F);
+	SEGMENT_SSE2(4,0xFF);
+	SEGMENT_SSE2(5,0x1FF);
+	SEGMENT_SSE2(6,0x3FF);
+	SEGMENT_SSE2(7,0x7FF);
+	SEGMENT_SSE2(8,0xFFF);
+	/*the magnitude of -32768 ends beyond the last segment*/
+	overflow=_mm_cmpgt_epi16(mag,_mm_set1_epi16(0x1FFF));
+	uval=_mm_or_si128(_mm_slli_epi16(seg,4),_mm_and_si128(quant,_mm_set1_epi16(0xF)));
+	uval=_mm_or_si128(_mm_andnot_si128(overflow,uval),_mm_and_si128(overflow,_mm_set1_epi16(0x7F)));
+	return _mm_xor_si128(uval,_mm_xor_si128(_mm_set1_epi16(0xFF),_mm_and_si128(neg,_mm_set1_epi16(0x80))));
+}
+
+static void alaw_encode_sse2(uint8_t *dst, const int16_t *src, int nsamples){
+	int i;
+	for(i=0;i+16<=nsamples;i+=16){
+		__m128i lo=alaw_encode8_sse2(_mm_loadu_si128((const __m128i*)(src+i)));
+		__m128i hi=alaw_encode8_sse2(_mm_loadu_si128((const __m128i*)(src+i+8)));
+		_mm_storeu_si128((__m128i*)(dst+i),_mm_packus_epi16(lo,hi));
+	}
+	alaw_encode_table(dst+i,src+i,nsamples-i);
+}
+
+static void ulaw_encode_sse2(uint8_t *dst, const int16_t *src, int nsamples){
+	int i;
+	for(i=0;i+16<=nsamples;i+=16){
+		__m128i lo=ulaw_encode8_sse2(_mm_loadu_si128((const __m128i*)(src+i)));
+		__m128i hi=ulaw_encode8_sse2(_mm_loadu_si128((const __m128i*)(src+i+8)));
+		_mm_storeu_si128((__m128i*)(dst+i),_mm_packus_epi16(lo,hi));
+	}
+	ulaw_encode_table(dst+i,src+i,nsamples-i);
+}
+
+#endif
+
+#if MS_HAS_AVX2
+
+#define SEGMENT_AVX2(shift, end) \
+	above=_mm256_cmpgt_epi16(mag,_mm256_set1_epi16(end)); \
+	seg=_mm256_sub_epi16(seg,above); \
+	quant=_mm256_blendv_epi8(quant,_mm256_srli_epi16(mag,shift),above)
+
+static MS2_INLINE MS_TARGET_AVX2 __m256i alaw_encode16_avx2(__m256i pcm){
+	__m256i v=_mm256_srai_epi16(pcm,3);
+	__m256i neg=_mm256_cmpgt_epi16(_mm256_setzero_si256(),v);
+	__m256i mag=_mm256_xor_si256(v,neg);
+	__m256i quant=_mm256_srli_epi16(mag,1);
+	__m256i seg=_mm256_setzero_si256();
+	__m256i above,aval;
+	SEGMENT_AVX2(2,0x3F);
+	SEGMENT_AVX2(3,0x7F);
+	SEGMENT_AVX2(4,0xFF);
+	SEGMENT_AVX2(5,0x1FF);
+	SEGMENT_AVX2(6,0x3FF);
+	SEGMENT_AVX2(7,0x7FF);
+	seg=_mm256_sub_epi16(seg,_mm256_cmpgt_epi16(mag,_mm256_set1_epi16(0x1F)));
+	aval=_mm256_or_si256(_mm256_slli_epi16(seg,4),_mm256_and_si256(quant,_mm256_set1_epi16(0xF)));
+	return _mm256_xor_si256(aval,_mm256_xor_si256(_mm256_set1_epi16(0xD5),_mm256_and_si256(neg,_mm256_set1_epi16(0x80))));
+}
+
+static MS2_INLINE MS_TARGET_AVX2 __m256i ulaw_encode16_avx2(__m256i pcm){
+	__m256i v=_mm256_srai_epi16(pcm,2);
+	__m256i neg=_mm256_cmpgt_epi16(_mm256_setzero_si256(),v);
+	__m256i mag=_mm256_abs_epi16(v);
+	__m256i quant,seg=_mm256_setzero_si256();
+	__m256i above,uval;
+	mag=_mm256_add_epi16(_mm256_min_epu16(mag,_mm256_set1_epi16(8159)),_mm256_set1_epi16(0x84>>2));
+	quant=_mm256_srli_epi16(mag,1);
+	SEGMENT_AVX2(2,0x3F);
+	SEGMENT_AVX2(3,0x7F);
+	SEGMENT_AVX2(4,0xFF);
+	SEGMENT_AVX2(5,0x1FF);
+	SEGMENT_AVX2(6,0x3FF);
+	SEGMENT_AVX2(7,0x7FF);
+	SEGMENT_AVX2(8,0xFFF);
+	uval=_mm256_or_si256(_mm256_slli_epi16(seg,4),_mm256_and_si256(quant,_mm256_set1_epi16(0xF)));
+	uval=_mm256_blendv_epi8(uval,_mm256_set1_epi16(0x7F),_mm256_cmpgt_epi16(mag,_mm256_set1_epi16(0x1FFF)));
+	return _mm256_xor_si256(uval,_mm256_xor_si256(_mm256_set1_epi16(0xFF),_mm256_and_si256(neg,_mm256_set1_epi16(0x80))));
+}
+
+static MS_TARGET_AVX2 void alaw_encode_avx2(uint8_t *dst, const int16_t *src, int nsamples){
+	int i;
+	for(i=0;i+32<=nsamples;i+=32){
+		__m256i lo=alaw_encode16_avx2(_mm256_loadu_si256((const __m256i*)(src+i)));
+		__m256i hi=alaw_encode16_avx2(_mm256_loadu_si256((const __m256i*)(src+i+16)));
+		/*packing works within 128 bits lanes*/
+		_mm256_storeu_si256((__m256i*)(dst+i),_mm256_permute4x64_epi64(_mm256_packus_epi16(lo,hi),0xD8));
+	}
+	alaw_encode_table(dst+i,src+i,nsamples-i);
+}
+
+static MS_TARGET_AVX2 void ulaw_encode_avx2(uint8_t *dst, const int16_t *src, int nsamples){
+	int i;
+	for(i=0;i+32<=nsamples;i+=32){
+		__m256i lo=ulaw_encode16_avx2(_mm256_loadu_si256((const __m256i*)(src+i)));
+		__m256i hi=ulaw_encode16_avx2(_mm256_loadu_si256((const __m256i*)(src+i+16)));
+		_mm256_storeu_si256((__m256i*)(dst+i),_mm256_permute4x64_epi64(_mm256_packus_epi16(lo,hi),0xD8));
+	}
+	ulaw_encode_table(dst+i,src+i,nsamples-i);
+}
+
+#endif
+
+#if MS_HAS_ARM_NEON
+
+#define SEGMENT_NEON(shift, end) \
+	above=vcgtq_s16(mag,vdupq_n_s16(end)); \
+	seg=vsubq_s16(seg,vreinterpretq_s16_u16(above)); \
+	quant=vbslq_s16(above,vshrq_n_s16(mag,shift),quant)
+
+static MS2_INLINE uint8x8_t alaw_encode8_neon(int16x8_t pcm){
+	int16x8_t v=vshrq_n_s16(pcm,3);
+	uint16x8_t neg=vcltq_s16(v,vdupq_n_s16(0));
+	int16x8_t mag=veorq_s16(v,vreinterpretq_s16_u16(neg));
+	int16x8_t quant=vshrq_n_s16(mag,1);
+	int16x8_t seg=vdupq_n_s16(0);
+	uint16x8_t above;
+	int16x8_t aval;
+	SEGMENT_NEON(2,0x3F);
+	SEGMENT_NEON(3,0x7F);
+	SEGMENT_NEON(4,0xFF);
+	SEGMENT_NEON(5,0x1FF);
+	SEGMENT_NEON(6,0x3FF);
+	SEGMENT_NEON(7,0x7FF);
+	seg=vsubq_s16(seg,vreinterpretq_s16_u16(vcgtq_s16(mag,vdupq_n_s16(0x1F))));
+	aval=vorrq_s16(vshlq_n_s16(seg,4),vandq_s16(quant,vdupq_n_s16(0xF)));
+	aval=veorq_s16(aval,veorq_s16(vdupq_n_s16(0xD5),vandq_s16(vreinterpretq_s16_u16(neg),vdupq_n_s16(0x80))));
+	return vmovn_u16(vreinterpretq_u16_s16(aval));
+}
+
+static MS2_INLINE uint8x8_t ulaw_encode8_neon(int16x8_t pcm){
+	int16x8_t v=vshrq_n_s16(pcm,2);
+	uint16x8_t neg=vcltq_s16(v,vdupq_n_s16(0));
+	int16x8_t mag=vaddq_s16(vminq_s16(vabsq_s16(v),vdupq_n_s16(8159)),vdupq_n_s16(0x84>>2));
+	int16x8_t quant=vshrq_n_s16(mag,1);
+	int16x8_t seg=vdupq_n_s16(0);
+	uint16x8_t above;
+	int16x8_t uval;
+	SEGMENT_NEON(2,0x3F);
+	SEGMENT_NEON(3,0x7F);
+	SEGMENT_NEON(4,0xFF);
+	SEGMENT_NEON(5,0x1FF);
+	SEGMENT_NEON(6,0x3FF);
+	SEGMENT_NEON(7,0x7FF);
+	SEGMENT_NEON(8,0xFFF);
+	uval=vorrq_s16(vshlq_n_s16(seg,4),vandq_s16(quant,vdupq_n_s16(0xF)));
+	uval=vbslq_s16(vcgtq_s16(mag,vdupq_n_s16(0x1FFF)),vdupq_n_s16(0x7F),uval);
+	uval=veorq_s16(uval,veorq_s16(vdupq_n_s16(0xFF),vandq_s16(vreinterpretq_s16_u16(neg),vdupq_n_s16(0x80))));
+	return vmovn_u16(vreinterpretq_u16_s16(uval));
+}
+
+static void alaw_encode_neon(uint8_t *dst, const int16_t *src, int nsamples){
+	int i;
+	for(i=0;i+8<=nsamples;i+=8){
+		vst1_u8(dst+i,alaw_encode8_neon(vld1q_s16(src+i)));
+	}
+	alaw_encode_table(dst+i,src+i,nsamples-i);
+}
+
+static void ulaw_encode_neon(uint8_t *dst, const int16_t *src, int nsamples){
+	int i;
+	for(i=0;i+8<=nsamples;i+=8){
+		vst1_u8(dst+i,ulaw_encode8_neon(vld1q_s16(src+i)));
+	}
+	ulaw_encode_table(dst+i,src+i,nsamples-i);
+}
+
+#endif
+
+static const MSG711Kernels scalar_kernels={"scalar",alaw_encode_scalar,alaw_decode_scalar,ulaw_encode_scalar,ulaw_decode_scalar};
+static const MSG711Kernels table_kernels={"table",alaw_encode_table,alaw_decode_table,ulaw_encode_table,ulaw_decode_table};
+#if MS_HAS_SSE2
+static const MSG711Kernels sse2_kernels={"sse2",alaw_encode_sse2,alaw_decode_table,ulaw_encode_sse2,ulaw_decode_table};
+#endif
+#if MS_HAS_AVX2
+static const MSG711Kernels avx2_kernels={"avx2",alaw_encode_avx2,alaw_decode_table,ulaw_encode_avx2,ulaw_decode_table};
+#endif
+#if MS_HAS_ARM_NEON
+static const MSG711Kernels neon_kernels={"neon",alaw_encode_neon,alaw_decode_table,ulaw_encode_neon,ulaw_decode_table};
+#endif
+
+static const MSG711Kernels *kernels[6];
+static ms_once_t kernels_once=MS_ONCE_INIT;
+
+/*the tables and the list are filled once, ms_once() publishes them to the other threads*/
+static void init_kernels(void){
+	unsigned int features=ms_get_cpu_features();
+	int n=0;
+
+	init_tables();
+	kernels[n++]=&scalar_kernels;
+	/*the SSE2 encoders are about twice slower than the tables when the tables stay in the cache*/
+#if MS_HAS_SSE2
+	if (features & MSCpuFeatureSSE2) kernels[n++]=&sse2_kernels;
+#endif
+	kernels[n++]=&table_kernels;
+#if MS_HAS_AVX2
+	if (features & MSCpuFeatureAVX2) kernels[n++]=&avx2_kernels;
+#endif
+#if MS_HAS_ARM_NEON
+	if (features & MSCpuFeatureNEON) kernels[n++]=&neon_kernels;
+#endif
+	(void)features;
+}
+
+const MSG711Kernels * const *ms_g711_list_kernels(void){
+	ms_once(&kernels_once,init_kernels);
+	return kernels;
+}
+
+const MSG711Kernels *ms_g711_get_kernels(void){
+	const MSG711Kernels * const *list=ms_g711_list_kernels();
+	const MSG711Kernels *best=NULL;
+	/*the list is sorted by increasing speed*/
+	for(;*list!=NULL;list++) best=*list;
+	return best;
+}
@@ -17,9 +17,6 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#ifdef _WIN32
-#include <malloc.h>  // for alloca
-#endif
 #include <stdint.h>
 
 #include <mediastreamer2/msfilter.h>
@@ -42,7 +39,7 @@ struct EncState {
 	uint32_t ts;
 	int ptime;
 	int maxptime;
-	MSBufferizer *bufferizer;
+	MSRingBufferizer *bufferizer;
 };
 
 static void enc_init(MSFilter *f)
@@ -50,7 +47,7 @@ static void enc_init(MSFilter *f)
 	struct EncState *s=ms_new0(struct EncState,1);
 	s->state = g722_encode_init(NULL, 64000, 0);
 	s->ts=0;
-	s->bufferizer=ms_bufferizer_new();
+	s->bufferizer=ms_ring_bufferizer_new(0);
 	s->ptime = 20;
 	s->maxptime = MS_DEFAULT_MAX_PTIME;
 	f->data=s;
@@ -60,7 +57,7 @@ static void enc_uninit(MSFilter *f)
 {
 	struct EncState *s=(struct EncState*)f->data;
 	g722_encode_release(s->state);
-	ms_bufferizer_destroy(s->bufferizer);
+	ms_ring_bufferizer_destroy(s->bufferizer);
 	ms_free(s);
 	f->data = 0;
 };
@@ -104,20 +101,21 @@ static void enc_process(MSFilter *f)
 		frame_per_packet=1;
 
 	nbytes = 160*2;  //  10 Msec at 16KHZ  = 320 bytes of data
-	buf = (uint8_t*)alloca(nbytes*frame_per_packet);
 
 	while((im=ms_queue_get(f->inputs[0])))
-		ms_bufferizer_put(s->bufferizer,im);
+		ms_ring_bufferizer_put(s->bufferizer,im);
 
 	chunksize = nbytes*frame_per_packet;
-	while(ms_bufferizer_read(s->bufferizer,buf, chunksize) == chunksize) {
-		mblk_t *om=allocb(nbytes*frame_per_packet,0);//too large...
+	while((buf=ms_ring_bufferizer_peek(s->bufferizer, chunksize)) != NULL) {
+		/* at 64 kbit/s, G722 produces one byte for two samples */
+		mblk_t *om=ms_factory_allocb(f->factory,(int)(chunksize/4));
 		int k;
 		
 		scale_down((int16_t *)buf,(int)(chunksize/2));
 		k = g722_encode(s->state, om->b_wptr, (int16_t *)buf, (int)(chunksize/2));
 		om->b_wptr += k;
-		ms_bufferizer_fill_current_metas(s->bufferizer, om);
+		ms_ring_bufferizer_fill_current_metas(s->bufferizer, om);
+		ms_ring_bufferizer_consume(s->bufferizer, chunksize);
 		mblk_set_timestamp_info(om,s->ts);
 		ms_queue_put(f->outputs[0],om);
 		/* Nr of samples is really chunksize/2 but for G722 we must pretend we have a 8KHZ sampling rate */
@@ -248,7 +246,7 @@ static void dec_process(MSFilter *f) {
 		uint8_t *reencoded_buffer = ms_malloc0(msg_size);
 
 
-		om=allocb(msg_size*4,0);
+		om=ms_factory_allocb(f->factory,(int)msg_size*4);
 		mblk_meta_copy(im, om);
 
 		if ((declen = g722_decode(s->dec_state,(int16_t *)om->b_wptr, im->b_rptr, (int)msg_size))<0) {
@@ -292,7 +290,7 @@ static void dec_process(MSFilter *f) {
 
 		ms_concealer_inc_sample_time(s->concealer, f->ticker->time, f->ticker->interval, FALSE);
 
-		om = allocb(buff_size, 0);
+		om = ms_factory_allocb(f->factory, (int)buff_size);
 
 		mblk_set_plc_flag(om, 1);
 		generic_plc_generate_samples(s->plc_context, (int16_t *)om->b_wptr, (uint16_t)(buff_size/sizeof(int16_t)));
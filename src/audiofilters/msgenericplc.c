@@ -103,7 +103,7 @@ static void generic_plc_process(MSFilter *f) {
 	if (ms_concealer_context_is_concealement_required(mgps->concealer, f->ticker->time)) {
 		unsigned int buff_size = mgps->rate*sizeof(int16_t)*mgps->nchannels*f->ticker->interval/1000;
 #ifdef HAVE_G729B
-		m = allocb(buff_size, 0);
+		m = ms_factory_allocb(f->factory, (int)buff_size);
 
 		/* Transmitted CNG data is in mgps->cng_data : give it to bcg729 decoder -> output in m->b_wptr */
 		if (mgps->cng_set) { /* received some CNG data */
@@ -125,7 +125,7 @@ static void generic_plc_process(MSFilter *f) {
 			//memset(m->b_wptr, 0, buff_size);
 		}
 #else
-		m = allocb(buff_size, 0);
+		m = ms_factory_allocb(f->factory, (int)buff_size);
 		if (mgps->cng_set){
 			mgps->cng_set=FALSE; /* reset flag */
 			mgps->cng_running=TRUE;
@@ -18,6 +18,8 @@
  */
 
 #include "mediastreamer2/msfilter.h"
+#include "mediastreamer2/msresample.h"
+#include "resampler.h"
 
 #ifdef _MSC_VER
 #include <malloc.h>
@@ -30,6 +32,68 @@
 #include "cpu-features.h"
 #endif
 
+/*speex backend, for any conversion*/
+typedef struct _SpeexBackend{
+	SpeexResamplerState *handle;
+	int nchannels;
+}SpeexBackend;
+
+static bool_t speex_backend_supports(int input_rate, int output_rate, int nchannels){
+	return TRUE;
+}
+
+static void *speex_backend_create(int input_rate, int output_rate, int nchannels, int cpu_features){
+	SpeexBackend *sb;
+	int err=0;
+	int quality=SPEEX_RESAMPLER_QUALITY_VOIP; /*default value is voip*/
+#if MS_HAS_ARM /*on ARM, NEON optimization are mandatory to support this quality, else using basic mode*/
+#if SPEEX_LIB_SET_CPU_FEATURES
+	if (cpu_features != SPEEX_LIB_CPU_FEATURE_NEON)
+		quality=SPEEX_RESAMPLER_QUALITY_MIN;
+#elif !MS_HAS_ARM_NEON
+	quality=SPEEX_RESAMPLER_QUALITY_MIN;
+#endif /*SPEEX_LIB_SET_CPU_FEATURES*/
+#endif /*MS_HAS_ARM*/
+	ms_message("Initializing speex resampler in mode [%s] ",(quality==SPEEX_RESAMPLER_QUALITY_VOIP?"voip":"min"));
+	sb=ms_new0(SpeexBackend,1);
+	sb->handle=speex_resampler_init(nchannels, input_rate, output_rate, quality, &err);
+	sb->nchannels=nchannels;
+	return sb;
+}
+
+static void speex_backend_process(void *ctx, const int16_t *in, unsigned int *inlen, int16_t *out, unsigned int *outlen){
+	SpeexBackend *sb=(SpeexBackend*)ctx;
+	spx_uint32_t spx_inlen=*inlen, spx_outlen=*outlen;
+	if (sb->nchannels==1){
+		speex_resampler_process_int(sb->handle, 0, (const spx_int16_t*)in, &spx_inlen, (spx_int16_t*)out, &spx_outlen);
+	}else{
+		speex_resampler_process_interleaved_int(sb->handle, (const spx_int16_t*)in, &spx_inlen, (spx_int16_t*)out, &spx_outlen);
+	}
+	*inlen=spx_inlen;
+	*outlen=spx_outlen;
+}
+
+static void speex_backend_destroy(void *ctx){
+	SpeexBackend *sb=(SpeexBackend*)ctx;
+	speex_resampler_destroy(sb->handle);
+	ms_free(sb);
+}
+
+static const MSResamplerDesc speex_resampler_desc={
+	MSResamplerBackendSpeex,
+	"speex",
+	speex_backend_supports,
+	speex_backend_create,
+	speex_backend_process,
+	speex_backend_destroy
+};
+
+/*by order of preference*/
+static const MSResamplerDesc *resampler_descs[]={
+	&ms_polyphase_resampler_desc,
+	&speex_resampler_desc
+};
+
 typedef struct _ResampleData{
 	MSBufferizer *bz;
 	uint32_t ts;
@@ -37,7 +101,10 @@ typedef struct _ResampleData{
 	uint32_t output_rate;
 	int in_nchannels;
 	int out_nchannels;
-	SpeexResamplerState *handle;
+	const MSResamplerDesc *backend;
+	void *handle;
+	uint32_t handle_input_rate;
+	uint32_t handle_output_rate;
 	int cpuFeatures; /*store because there is no SPEEX_LIB_GET_CPU_FEATURES*/
 } ResampleData;
 
@@ -53,13 +120,36 @@ static ResampleData * resample_data_new(void){
 	return obj;
 }
 
+static void resample_destroy_backend(ResampleData *dt){
+	if (dt->handle!=NULL){
+		dt->backend->destroy(dt->handle);
+		dt->handle=NULL;
+	}
+}
+
 static void resample_data_destroy(ResampleData *obj){
-	if (obj->handle!=NULL)
-		speex_resampler_destroy(obj->handle);
+	resample_destroy_backend(obj);
 	ms_bufferizer_destroy(obj->bz);
 	ms_free(obj);
 }
 
+static const MSResamplerDesc *resample_choose_backend(const ResampleData *dt){
+	size_t i;
+	for(i=0;i<sizeof(resampler_descs)/sizeof(resampler_descs[0]);++i){
+		if (resampler_descs[i]->supports((int)dt->input_rate,(int)dt->output_rate,dt->in_nchannels)) return resampler_descs[i];
+	}
+	return &speex_resampler_desc;
+}
+
+static void resample_init_backend(ResampleData *dt){
+	dt->backend=resample_choose_backend(dt);
+	dt->handle=dt->backend->create((int)dt->input_rate,(int)dt->output_rate,dt->in_nchannels,dt->cpuFeatures);
+	dt->handle_input_rate=dt->input_rate;
+	dt->handle_output_rate=dt->output_rate;
+	ms_message("MSResample: %u->%u Hz, %i channel(s), using %s backend",
+		dt->input_rate,dt->output_rate,dt->in_nchannels,dt->backend->name);
+}
+
 static void resample_init(MSFilter *obj){
 	ResampleData* data=resample_data_new();
 #ifdef SPEEX_LIB_SET_CPU_FEATURES
@@ -105,24 +195,9 @@ static int resample_channel_adapt(int in_nchannels, int out_nchannels, mblk_t *i
 	return 0;
 }
 
-static void resample_init_speex(ResampleData *dt){
-	int err=0;
-	int quality=SPEEX_RESAMPLER_QUALITY_VOIP; /*default value is voip*/
-#if MS_HAS_ARM /*on ARM, NEON optimization are mandatory to support this quality, else using basic mode*/
-#if SPEEX_LIB_SET_CPU_FEATURES
-	if (dt->cpuFeatures != SPEEX_LIB_CPU_FEATURE_NEON)
-		quality=SPEEX_RESAMPLER_QUALITY_MIN;
-#elif !MS_HAS_ARM_NEON
-	quality=SPEEX_RESAMPLER_QUALITY_MIN;
-#endif /*SPEEX_LIB_SET_CPU_FEATURES*/
-#endif /*MS_HAS_ARM*/
-	ms_message("Initializing speex resampler in mode [%s] ",(quality==SPEEX_RESAMPLER_QUALITY_VOIP?"voip":"min"));
-	dt->handle=speex_resampler_init(dt->in_nchannels, dt->input_rate, dt->output_rate, quality, &err);
-}
-
 static void resample_preprocess(MSFilter *obj){
 	ResampleData *dt=(ResampleData*)obj->data;
-	if(dt->handle == NULL) resample_init_speex(dt);
+	if(dt->handle == NULL && dt->input_rate!=dt->output_rate) resample_init_backend(dt);
 }
 
 static void resample_process_ms2(MSFilter *obj){
@@ -141,42 +216,24 @@ static void resample_process_ms2(MSFilter *obj){
 		return;
 	}
 	ms_filter_lock(obj);
-	if (dt->handle!=NULL){
-		spx_uint32_t inrate=0, outrate=0;
-		speex_resampler_get_rate(dt->handle,&inrate,&outrate);
-		if ((uint32_t)inrate!=dt->input_rate || (uint32_t)outrate!=dt->output_rate){
-			speex_resampler_destroy(dt->handle);
-			dt->handle=0;
-		}
+	if (dt->handle!=NULL && (dt->handle_input_rate!=dt->input_rate || dt->handle_output_rate!=dt->output_rate)){
+		resample_destroy_backend(dt);
 	}
 	if (dt->handle==NULL){
-		resample_init_speex(dt);
+		resample_init_backend(dt);
 	}
 
 
 	while((im=ms_queue_get(obj->inputs[0]))!=NULL){
-		spx_uint32_t inlen=(spx_uint32_t)((im->b_wptr-im->b_rptr)/(2*dt->in_nchannels));
-		spx_uint32_t outlen=(spx_uint32_t)(((inlen*dt->output_rate)/dt->input_rate)+1);
-		spx_uint32_t inlen_orig=inlen;
-		om=allocb(outlen*2*dt->in_nchannels,0);
+		unsigned int inlen=(unsigned int)((im->b_wptr-im->b_rptr)/(2*dt->in_nchannels));
+		unsigned int outlen=(unsigned int)(((inlen*dt->output_rate)/dt->input_rate)+1);
+		unsigned int inlen_orig=inlen;
+		om=ms_factory_allocb(obj->factory,outlen*2*dt->in_nchannels);
 		mblk_meta_copy(im, om);
-		if (dt->in_nchannels==1){
-			speex_resampler_process_int(dt->handle,
-					0,
-					(spx_int16_t*)im->b_rptr,
-					&inlen,
-					(spx_int16_t*)om->b_wptr,
-					&outlen);
-		}else{
-			speex_resampler_process_interleaved_int(dt->handle,
-					(int16_t*)im->b_rptr,
-					&inlen,
-					(int16_t*)om->b_wptr,
-					&outlen);
-		}
+		dt->backend->process(dt->handle,(const int16_t*)im->b_rptr,&inlen,(int16_t*)om->b_wptr,&outlen);
 		if (inlen_orig!=inlen){
 			ms_error("Bug in resampler ! only %u samples consumed instead of %u, out=%u",
-				(unsigned int)inlen,(unsigned int)inlen_orig,(unsigned int)outlen);
+				inlen,inlen_orig,outlen);
 		}
 		om->b_wptr+=outlen*2*dt->in_nchannels;
 		mblk_set_timestamp_info(om,dt->ts);
@@ -209,9 +266,8 @@ static int set_input_nchannels(MSFilter *f, void *arg){
 	ResampleData *dt=(ResampleData*)f->data;
 	int chans=*(int*)arg;
 	ms_filter_lock(f);
-	if (dt->in_nchannels!=chans && dt->handle!=NULL){
-		speex_resampler_destroy(dt->handle);
-		dt->handle=NULL;
+	if (dt->in_nchannels!=chans){
+		resample_destroy_backend(dt);
 	}
 	dt->in_nchannels=chans;
 	ms_filter_unlock(f);
@@ -222,20 +278,35 @@ static int set_output_nchannels(MSFilter *f, void *arg) {
 	ResampleData *dt = (ResampleData *)f->data;
 	int chans = *(int *)arg;
 	ms_filter_lock(f);
-	if (dt->out_nchannels != chans && dt->handle != NULL) {
-		speex_resampler_destroy(dt->handle);
-		dt->handle = NULL;
+	if (dt->out_nchannels != chans) {
+		resample_destroy_backend(dt);
 	}
 	dt->out_nchannels = chans;
 	ms_filter_unlock(f);
 	return 0;
 }
 
+static int get_backend(MSFilter *f, void *arg){
+	ResampleData *dt=(ResampleData*)f->data;
+	ms_filter_lock(f);
+	if (dt->input_rate==dt->output_rate){
+		*(MSResamplerBackend*)arg=MSResamplerBackendNone;
+	}else if (dt->handle!=NULL && dt->handle_input_rate==dt->input_rate && dt->handle_output_rate==dt->output_rate){
+		*(MSResamplerBackend*)arg=dt->backend->backend;
+	}else{
+		/*the backend will be created on next process, with the current settings*/
+		*(MSResamplerBackend*)arg=resample_choose_backend(dt)->backend;
+	}
+	ms_filter_unlock(f);
+	return 0;
+}
+
 static MSFilterMethod methods[]={
 	{	MS_FILTER_SET_SAMPLE_RATE	 ,	ms_resample_set_sr		},
 	{	MS_FILTER_SET_OUTPUT_SAMPLE_RATE ,	ms_resample_set_output_sr	},
 	{	MS_FILTER_SET_NCHANNELS,		set_input_nchannels		},
 	{	MS_FILTER_SET_OUTPUT_NCHANNELS,		set_output_nchannels		},
+	{	MS_RESAMPLE_GET_BACKEND,		get_backend			},
 	{	0				 ,	NULL	}
 };
 
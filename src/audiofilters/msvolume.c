@@ -410,7 +410,8 @@ static void update_energy(Volume *v, int16_t *signal, int numsamples, uint64_t c
 	ortp_extremum_record_min(&v->min,curtime,v->energy);
 }
 
-static void apply_gain(Volume *v, mblk_t *m, float tgain) {
+/*returns the buffer holding the result, a copy of m if the gain has to be applied to a buffer that is shared*/
+static mblk_t *apply_gain(Volume *v, mblk_t *m, float tgain) {
 	int16_t *sample;
 	int dc_offset = 0;
 	int32_t intgain;
@@ -437,6 +438,10 @@ static void apply_gain(Volume *v, mblk_t *m, float tgain) {
 
 	//if (v->peer) ms_message("MSVolume:%p Applying gain %5f, v->gain=%5f, tgain=%5f, ng_gain=%5f",v,gain,v->gain,tgain,v->ng_gain);
 
+	if (v->remove_dc || gain!=1){
+		/*the samples are modified in place: the buffer may be shared, for example by the outputs of a mixer*/
+		m=ms_mblk_make_writable(m);
+	}
 	if (v->remove_dc){
 		for (	sample=(int16_t*)m->b_rptr;
 					sample<(int16_t*)m->b_wptr;
@@ -453,6 +458,7 @@ static void apply_gain(Volume *v, mblk_t *m, float tgain) {
 			*sample = saturate(((*sample) * intgain) / 4096);
 		}
 	}
+	return m;
 }
 
 static void volume_preprocess(MSFilter *f){
@@ -492,7 +498,7 @@ static void volume_process(MSFilter *f){
 		size_t nbytes=(size_t)(v->nsamples*2);
 		ms_bufferizer_put_from_queue(v->buffer,f->inputs[0]);
 		while(ms_bufferizer_get_avail(v->buffer)>=nbytes){
-			m=allocb(nbytes,0);
+			m=ms_factory_allocb(f->factory,(int)nbytes);
 			ms_bufferizer_read(v->buffer,m->b_wptr,nbytes);
 			m->b_wptr+=nbytes;
 			update_energy(v,(int16_t*)m->b_rptr, v->nsamples, f->ticker->time);
@@ -508,7 +514,7 @@ static void volume_process(MSFilter *f){
 			 */
 			if (v->agc_enabled) target_gain/= volume_agc_process(f, m);
 			if (v->noise_gate_enabled) volume_noise_gate_process(v, v->instant_energy, m);
-			apply_gain(v, m, target_gain);
+			m=apply_gain(v, m, target_gain);
 			ms_queue_put(f->outputs[0],m);
 		}
 	}else{
@@ -518,7 +524,7 @@ static void volume_process(MSFilter *f){
 			target_gain = v->static_gain;
 
 			if (v->noise_gate_enabled) volume_noise_gate_process(v, v->instant_energy, m);
-			apply_gain(v, m, target_gain);
+			m=apply_gain(v, m, target_gain);
 			ms_queue_put(f->outputs[0],m);
 		}
 	}
@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Fixed ratio polyphase resampler, for conversions between rates whose ratio reduces to small integers
+ * (8k, 16k, 24k, 32k, 48k...). The signal is virtually upsampled by 'up', filtered by a windowed sinc lowpass
+ * and decimated by 'down': each output sample is the dot product of one phase of the filter with the last input
+ * samples. Coefficients and samples are 16 bits, the dot product is computed by SIMD kernels selected at runtime.
+ */
+
+#include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/msresample.h"
+#include "resampler.h"
+#include "msatomic.h"
+#include "mssimd.h"
+
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define POLYPHASE_MAX_FACTOR 6
+/*filter length, in samples of the lowest of the two rates*/
+#define POLYPHASE_BASE_TAPS 32
+/*cutoff frequency, relative to the Nyquist frequency of the lowest of the two rates*/
+#define POLYPHASE_CUTOFF 0.92
+#define POLYPHASE_KAISER_BETA 8.0
+
+typedef struct _PolyphaseResampler{
+	int up;
+	int down;
+	int taps; /*number of coefficients of each phase, a multiple of 16*/
+	int16_t *coefs; /*phase p is at coefs+p*taps, reversed, in Q15*/
+	int nchannels;
+	int16_t **history; /*per channel, the taps-1 last consumed samples followed by the pending ones*/
+	int capacity;
+	int avail;
+	int pos; /*position of the next output sample, in the upsampled domain, relative to the start of history*/
+}PolyphaseResampler;
+
+/*
+ * Dot product kernels: a generic version, plus SSE2, AVX2 and NEON versions selected at runtime.
+ * n is a multiple of 16. The coefficients are designed so that the sum fits in 32 bits,
+ * all versions give the same result.
+ */
+static int32_t dot_generic(const int16_t *a, const int16_t *b, int n){
+	int32_t acc=0;
+	int i;
+	for(i=0;i<n;++i){
+		acc+=(int32_t)a[i]*(int32_t)b[i];
+	}
+	return acc;
+}
+
+#if MS_HAS_SSE2
+
+static int32_t dot_sse2(const int16_t *a, const int16_t *b, int n){
+	__m128i acc0=_mm_setzero_si128(), acc1=_mm_setzero_si128();
+	int32_t r[4];
+	int i;
+	for(i=0;i<n;i+=16){
+		acc0=_mm_add_epi32(acc0,_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(a+i)),_mm_loadu_si128((const __m128i*)(b+i))));
+		acc1=_mm_add_epi32(acc1,_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(a+i+8)),_mm_loadu_si128((const __m128i*)(b+i+8))));
+	}
+	_mm_storeu_si128((__m128i*)r,_mm_add_epi32(acc0,acc1));
+	return r[0]+r[1]+r[2]+r[3];
+}
+
+#endif
+
+#if MS_HAS_AVX2
+
+static MS_TARGET_AVX2 int32_t dot_avx2(const int16_t *a, const int16_t *b, int n){
+	__m256i acc=_mm256_setzero_si256();
+	__m128i sum;
+	int i;
+	for(i=0;i<n;i+=16){
+		acc=_mm256_add_epi32(acc,_mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(a+i)),_mm256_loadu_si256((const __m256i*)(b+i))));
+	}
+	sum=_mm_add_epi32(_mm256_castsi256_si128(acc),_mm256_extracti128_si256(acc,1));
+	sum=_mm_add_epi32(sum,_mm_shuffle_epi32(sum,0x4E));
+	sum=_mm_add_epi32(sum,_mm_shuffle_epi32(sum,0xB1));
+	return _mm_cvtsi128_si32(sum);
+}
+
+#endif
+
+#if MS_HAS_ARM_NEON
+
+static int32_t dot_neon(const int16_t *a, const int16_t *b, int n){
+	int32x4_t acc0=vdupq_n_s32(0), acc1=vdupq_n_s32(0);
+	int32x2_t sum;
+	int i;
+	for(i=0;i<n;i+=16){
+		int16x8_t a0=vld1q_s16(a+i), b0=vld1q_s16(b+i);
+		int16x8_t a1=vld1q_s16(a+i+8), b1=vld1q_s16(b+i+8);
+		acc0=vmlal_s16(acc0,vget_low_s16(a0),vget_low_s16(b0));
+		acc1=vmlal_s16(acc1,vget_high_s16(a0),vget_high_s16(b0));
+		acc0=vmlal_s16(acc0,vget_low_s16(a1),vget_low_s16(b1));
+		acc1=vmlal_s16(acc1,vget_high_s16(a1),vget_high_s16(b1));
+	}
+	acc0=vaddq_s32(acc0,acc1);
+	sum=vadd_s32(vget_low_s32(acc0),vget_high_s32(acc0));
+	return vget_lane_s32(vpadd_s32(sum,sum),0);
+}
+
+#endif
+
+static const MSResamplerKernel generic_kernel={"generic",dot_generic};
+#if MS_HAS_SSE2
+static const MSResamplerKernel sse2_kernel={"sse2",dot_sse2};
+#endif
+#if MS_HAS_AVX2
+static const MSResamplerKernel avx2_kernel={"avx2",dot_avx2};
+#endif
+#if MS_HAS_ARM_NEON
+static const MSResamplerKernel neon_kernel={"neon",dot_neon};
+#endif
+
+static const MSResamplerKernel *kernels[5];
+static const MSResamplerKernel *kernel=&generic_kernel;
+static ms_once_t kernels_once=MS_ONCE_INIT;
+
+static void polyphase_init_kernels(void){
+	unsigned int features=ms_get_cpu_features();
+	int n=0;
+
+	kernels[n++]=&generic_kernel;
+#if MS_HAS_SSE2
+	if (features & MSCpuFeatureSSE2) kernels[n++]=&sse2_kernel;
+#endif
+#if MS_HAS_AVX2
+	if (features & MSCpuFeatureAVX2) kernels[n++]=&avx2_kernel;
+#endif
+#if MS_HAS_ARM_NEON
+	if (features & MSCpuFeatureNEON) kernels[n++]=&neon_kernel;
+#endif
+	(void)features;
+	/*the list is sorted by increasing speed*/
+	kernel=kernels[n-1];
+}
+
+const MSResamplerKernel * const *ms_resampler_list_kernels(void){
+	ms_once(&kernels_once,polyphase_init_kernels);
+	return kernels;
+}
+
+static int gcd(int a, int b){
+	while(b!=0){
+		int t=a%b;
+		a=b;
+		b=t;
+	}
+	return a;
+}
+
+static bool_t polyphase_supports(int input_rate, int output_rate, int nchannels){
+	int g;
+	if (input_rate<=0 || output_rate<=0 || nchannels<=0) return FALSE;
+	g=gcd(input_rate,output_rate);
+	return output_rate/g<=POLYPHASE_MAX_FACTOR && input_rate/g<=POLYPHASE_MAX_FACTOR;
+}
+
+/*zeroth order modified Bessel function of the first kind, for the Kaiser window*/
+static double bessel_i0(double x){
+	double sum=1, term=1;
+	int k;
+	for(k=1;k<50;++k){
+		term*=(x/(2*k))*(x/(2*k));
+		sum+=term;
+		if (term<sum*1e-12) break;
+	}
+	return sum;
+}
+
+static void polyphase_design(PolyphaseResampler *r){
+	int factor=MAX(r->up,r->down);
+	int ntaps;
+	double fc, center;
+	int i;
+
+	r->taps=((POLYPHASE_BASE_TAPS*factor+r->up-1)/r->up+15)&~15;
+	ntaps=r->taps*r->up;
+	r->coefs=ms_new0(int16_t,ntaps);
+	/*cutoff in cycles per sample of the upsampled signal, the gain of up compensates the zeros inserted by upsampling*/
+	fc=0.5*POLYPHASE_CUTOFF/factor;
+	center=(ntaps-1)/2.0;
+	for(i=0;i<ntaps;++i){
+		double t=i-center;
+		double sinc=(t==0) ? 1.0 : sin(2*M_PI*fc*t)/(2*M_PI*fc*t);
+		double w=bessel_i0(POLYPHASE_KAISER_BETA*sqrt(1-(t/center)*(t/center)))/bessel_i0(POLYPHASE_KAISER_BETA);
+		double h=r->up*2*fc*sinc*w*32768.0;
+		int phase=i%r->up;
+		int k=i/r->up;
+		long q=lround(h);
+		if (q>32767) q=32767;
+		if (q<-32767) q=-32767;
+		r->coefs[phase*r->taps+(r->taps-1-k)]=(int16_t)q;
+	}
+}
+
+static void *polyphase_create(int input_rate, int output_rate, int nchannels, int cpu_features){
+	PolyphaseResampler *r;
+	int g=gcd(input_rate,output_rate);
+	int i;
+
+	ms_once(&kernels_once,polyphase_init_kernels);
+	r=ms_new0(PolyphaseResampler,1);
+	r->up=output_rate/g;
+	r->down=input_rate/g;
+	polyphase_design(r);
+	r->nchannels=nchannels;
+	r->capacity=r->taps*4;
+	r->history=ms_new0(int16_t*,nchannels);
+	for(i=0;i<nchannels;++i) r->history[i]=ms_new0(int16_t,r->capacity);
+	/*the filter starts on taps-1 samples of silence*/
+	r->avail=r->taps-1;
+	r->pos=(r->taps-1)*r->up;
+	ms_message("Polyphase resampler created for %i->%i Hz (%i/%i), %i taps per phase",
+		input_rate,output_rate,r->up,r->down,r->taps);
+	return r;
+}
+
+static void polyphase_destroy(void *ctx){
+	PolyphaseResampler *r=(PolyphaseResampler*)ctx;
+	int i;
+	for(i=0;i<r->nchannels;++i) ms_free(r->history[i]);
+	ms_free(r->history);
+	ms_free(r->coefs);
+	ms_free(r);
+}
+
+static MS2_INLINE int16_t polyphase_saturate(int32_t acc){
+	acc=(acc+(1<<14))>>15;
+	if (acc>32767) return 32767;
+	if (acc<-32768) return -32768;
+	return (int16_t)acc;
+}
+
+static void polyphase_process(void *ctx, const int16_t *in, unsigned int *inlen, int16_t *out, unsigned int *outlen){
+	PolyphaseResampler *r=(PolyphaseResampler*)ctx;
+	int nin=(int)*inlen;
+	unsigned int produced=0;
+	int c, i, consumed;
+
+	if (r->avail+nin>r->capacity){
+		r->capacity=r->avail+nin;
+		for(c=0;c<r->nchannels;++c) r->history[c]=ms_realloc(r->history[c],r->capacity*sizeof(int16_t));
+	}
+	for(c=0;c<r->nchannels;++c){
+		int16_t *h=r->history[c]+r->avail;
+		for(i=0;i<nin;++i) h[i]=in[i*r->nchannels+c];
+	}
+	r->avail+=nin;
+
+	while(produced<*outlen && r->pos/r->up<r->avail){
+		int base=r->pos/r->up;
+		const int16_t *coefs=r->coefs+(r->pos%r->up)*r->taps;
+		for(c=0;c<r->nchannels;++c){
+			out[produced*r->nchannels+c]=polyphase_saturate(kernel->dot(coefs,r->history[c]+base-r->taps+1,r->taps));
+		}
+		produced++;
+		r->pos+=r->down;
+	}
+
+	/*keep the samples still needed by the next outputs*/
+	consumed=MIN(r->pos/r->up,r->avail)-(r->taps-1);
+	if (consumed>0){
+		for(c=0;c<r->nchannels;++c) memmove(r->history[c],r->history[c]+consumed,(r->avail-consumed)*sizeof(int16_t));
+		r->avail-=consumed;
+		r->pos-=consumed*r->up;
+	}
+	*outlen=produced;
+}
+
+const MSResamplerDesc ms_polyphase_resampler_desc={
+	MSResamplerBackendPolyphase,
+	"polyphase",
+	polyphase_supports,
+	polyphase_create,
+	polyphase_process,
+	polyphase_destroy
+};
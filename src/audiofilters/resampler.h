@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef resampler_h
+#define resampler_h
+
+#include "mediastreamer2/msresample.h"
+
+/*
+ * Interface of the resampler implementations used by the MSResample filter.
+ * Samples are 16 bits, interleaved when there are several channels, lengths are counted in samples per channel.
+ */
+typedef struct _MSResamplerDesc{
+	MSResamplerBackend backend;
+	const char *name;
+	/*tells whether the implementation handles this conversion*/
+	bool_t (*supports)(int input_rate, int output_rate, int nchannels);
+	/*cpu_features are the SPEEX_LIB_CPU_FEATURE_* flags detected by the MSResample instance*/
+	void *(*create)(int input_rate, int output_rate, int nchannels, int cpu_features);
+	/*inlen is updated with the number of samples consumed, outlen with the number of samples written*/
+	void (*process)(void *ctx, const int16_t *in, unsigned int *inlen, int16_t *out, unsigned int *outlen);
+	void (*destroy)(void *ctx);
+}MSResamplerDesc;
+
+extern const MSResamplerDesc ms_polyphase_resampler_desc;
+
+#endif
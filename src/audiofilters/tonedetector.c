@@ -23,6 +23,8 @@
 
 #include "mediastreamer2/mstonedetector.h"
 #include "mediastreamer2/msticker.h"
+#include "msatomic.h"
+#include "mssimd.h"
 
 #include <math.h>
 
@@ -30,74 +32,206 @@
 #define M_PI       3.14159265358979323846
 #endif
 
-#define MAX_SCANS 10
+#define MAX_SCANS 64
+/*the bank is evaluated by groups of 8 tones, unused lanes have a null coefficient*/
+#define BANK_LANES ((MAX_SCANS+7)&~7)
+/*number of samples converted to float before running the bank over them*/
+#define CHUNK_SAMPLES 80
 
 static const float energy_min_threshold=0.01f;
 
 typedef struct _GoertzelState{
 	uint64_t starttime;
 	int dur;
-	float coef;
 	bool_t event_sent;
 	bool_t pad[3];
 }GoertzelState;
 
-static void goertzel_state_init(GoertzelState *gs, int frequency, int sampling_frequency){
-	gs->coef=(float)2*(float)cos(2*M_PI*((float)frequency/(float)sampling_frequency));
-	gs->starttime=0;
-	gs->dur=0;
+/*
+ * Goertzel bank kernels: run the recursion q0=coef*q1-q2+x of every tone over the same samples.
+ * All versions perform the same float operations in the same order, so that they give the same results.
+ */
+static void goertzel_bank_generic(float *q1, float *q2, const float *coef, int ntones, const float *samples, int nsamples){
+	int i,k;
+	for(k=0;k<ntones;++k){
+		float c=coef[k];
+		float s1=q1[k];
+		float s2=q2[k];
+		for(i=0;i<nsamples;++i){
+			float tmp=s1;
+			s1=(c*s1) - s2 + samples[i];
+			s2=tmp;
+		}
+		q1[k]=s1;
+		q2[k]=s2;
+	}
 }
 
-static float goertzel_state_run(GoertzelState *gs,int16_t  *samples, int nsamples, float total_energy){
-	int i;
-	float tmp;
-	float q1=0;
-	float q2=0;
-	float freq_en;
+#if MS_HAS_SSE2
+
+static void goertzel_bank_sse2(float *q1, float *q2, const float *coef, int ntones, const float *samples, int nsamples){
+	int i,k;
+	/*two independent groups of 4 tones are interleaved to hide the latency of the recursion*/
+	for(k=0;k<ntones;k+=8){
+		__m128 c0=_mm_loadu_ps(coef+k), c1=_mm_loadu_ps(coef+k+4);
+		__m128 a1=_mm_loadu_ps(q1+k), a2=_mm_loadu_ps(q2+k);
+		__m128 b1=_mm_loadu_ps(q1+k+4), b2=_mm_loadu_ps(q2+k+4);
+		for(i=0;i<nsamples;++i){
+			__m128 x=_mm_set1_ps(samples[i]);
+			__m128 a0=_mm_add_ps(_mm_sub_ps(_mm_mul_ps(c0,a1),a2),x);
+			__m128 b0=_mm_add_ps(_mm_sub_ps(_mm_mul_ps(c1,b1),b2),x);
+			a2=a1; a1=a0;
+			b2=b1; b1=b0;
+		}
+		_mm_storeu_ps(q1+k,a1); _mm_storeu_ps(q2+k,a2);
+		_mm_storeu_ps(q1+k+4,b1); _mm_storeu_ps(q2+k+4,b2);
+	}
+}
 
-	for(i=0;i<nsamples;++i){
-		tmp=q1;
-		q1=(gs->coef*q1) - q2 + (float)samples[i];
-		q2=tmp;
+#endif
+
+#if MS_HAS_AVX2
+
+static MS_TARGET_AVX2 void goertzel_bank_avx2(float *q1, float *q2, const float *coef, int ntones, const float *samples, int nsamples){
+	int i,k=0;
+	/*mul and sub are kept separate (no fma) to match the other versions*/
+	for(;k+16<=ntones;k+=16){
+		__m256 c0=_mm256_loadu_ps(coef+k), c1=_mm256_loadu_ps(coef+k+8);
+		__m256 a1=_mm256_loadu_ps(q1+k), a2=_mm256_loadu_ps(q2+k);
+		__m256 b1=_mm256_loadu_ps(q1+k+8), b2=_mm256_loadu_ps(q2+k+8);
+		for(i=0;i<nsamples;++i){
+			__m256 x=_mm256_set1_ps(samples[i]);
+			__m256 a0=_mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(c0,a1),a2),x);
+			__m256 b0=_mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(c1,b1),b2),x);
+			a2=a1; a1=a0;
+			b2=b1; b1=b0;
+		}
+		_mm256_storeu_ps(q1+k,a1); _mm256_storeu_ps(q2+k,a2);
+		_mm256_storeu_ps(q1+k+8,b1); _mm256_storeu_ps(q2+k+8,b2);
+	}
+	if (k<ntones){
+		__m256 c0=_mm256_loadu_ps(coef+k);
+		__m256 a1=_mm256_loadu_ps(q1+k), a2=_mm256_loadu_ps(q2+k);
+		for(i=0;i<nsamples;++i){
+			__m256 a0=_mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(c0,a1),a2),_mm256_set1_ps(samples[i]));
+			a2=a1; a1=a0;
+		}
+		_mm256_storeu_ps(q1+k,a1); _mm256_storeu_ps(q2+k,a2);
 	}
-	
-	freq_en= (q1*q1) + (q2*q2) - (q1*q2*gs->coef);
-	/*return a relative frequency energy compared over the total signal energy */
-	return freq_en/(total_energy*(float)nsamples*0.5f);
 }
 
-static float compute_energy(int16_t *samples, int nsamples){
-	float en=0;
-	int i;
-	for(i=0;i<nsamples;++i){
-		float s=(float)samples[i];
-		en+=s*s;
+#endif
+
+#if MS_HAS_ARM_NEON
+
+static void goertzel_bank_neon(float *q1, float *q2, const float *coef, int ntones, const float *samples, int nsamples){
+	int i,k;
+	for(k=0;k<ntones;k+=8){
+		float32x4_t c0=vld1q_f32(coef+k), c1=vld1q_f32(coef+k+4);
+		float32x4_t a1=vld1q_f32(q1+k), a2=vld1q_f32(q2+k);
+		float32x4_t b1=vld1q_f32(q1+k+4), b2=vld1q_f32(q2+k+4);
+		for(i=0;i<nsamples;++i){
+			float32x4_t x=vdupq_n_f32(samples[i]);
+			float32x4_t a0=vaddq_f32(vsubq_f32(vmulq_f32(c0,a1),a2),x);
+			float32x4_t b0=vaddq_f32(vsubq_f32(vmulq_f32(c1,b1),b2),x);
+			a2=a1; a1=a0;
+			b2=b1; b1=b0;
+		}
+		vst1q_f32(q1+k,a1); vst1q_f32(q2+k,a2);
+		vst1q_f32(q1+k+4,b1); vst1q_f32(q2+k+4,b2);
 	}
-	return en;
+}
+
+#endif
+
+static const MSToneDetectorKernel generic_kernel={"generic",goertzel_bank_generic};
+#if MS_HAS_SSE2
+static const MSToneDetectorKernel sse2_kernel={"sse2",goertzel_bank_sse2};
+#endif
+#if MS_HAS_AVX2
+static const MSToneDetectorKernel avx2_kernel={"avx2",goertzel_bank_avx2};
+#endif
+#if MS_HAS_ARM_NEON
+static const MSToneDetectorKernel neon_kernel={"neon",goertzel_bank_neon};
+#endif
+
+static const MSToneDetectorKernel *kernels_list[5];
+static const MSToneDetectorKernel *kernel=&generic_kernel;
+static ms_once_t kernels_once=MS_ONCE_INIT;
+
+/*the list is sorted by increasing speed and filled once, ms_once() publishes it to the other threads*/
+static void init_kernels(void){
+	unsigned int features=ms_get_cpu_features();
+	int n=0;
+
+	kernels_list[n++]=&generic_kernel;
+#if MS_HAS_SSE2
+	if (features & MSCpuFeatureSSE2) kernels_list[n++]=&sse2_kernel;
+#endif
+#if MS_HAS_AVX2
+	if (features & MSCpuFeatureAVX2) kernels_list[n++]=&avx2_kernel;
+#endif
+#if MS_HAS_ARM_NEON
+	if (features & MSCpuFeatureNEON) kernels_list[n++]=&neon_kernel;
+#endif
+	kernel=kernels_list[n-1];
+	(void)features;
+}
+
+const MSToneDetectorKernel * const *ms_tone_detector_list_kernels(void){
+	ms_once(&kernels_once,init_kernels);
+	return kernels_list;
 }
 
 typedef struct _DetectorState{
 	MSToneDetectorDef tone_def[MAX_SCANS];
 	GoertzelState tone_gs[MAX_SCANS];
 	int nscans;
-	MSBufferizer *buf;
+	/*the Goertzel bank, one lane per scan*/
+	float coef[BANK_LANES];
+	float q1[BANK_LANES];
+	float q2[BANK_LANES];
+	int nlanes;
+	/*samples of the current frame not yet given to the bank*/
+	float chunk[CHUNK_SAMPLES];
+	int chunk_len;
+	float frame_energy;
+	int frame_count;
+	uint8_t pending_byte;	/*first byte of a sample split across two blocks*/
+	bool_t has_pending_byte;
 	int rate;
-	int framesize;
+	int frame_samples;
 	int frame_ms;
 }DetectorState;
 
+static void detector_reset_frame(DetectorState *s){
+	memset(s->q1,0,sizeof(s->q1));
+	memset(s->q2,0,sizeof(s->q2));
+	s->chunk_len=0;
+	s->frame_energy=0;
+	s->frame_count=0;
+}
+
+static void detector_update_coefs(DetectorState *s){
+	int i;
+	memset(s->coef,0,sizeof(s->coef));
+	for(i=0;i<s->nscans;++i){
+		s->coef[i]=(float)2*(float)cos(2*M_PI*((float)s->tone_def[i].frequency/(float)s->rate));
+	}
+	s->nlanes=(s->nscans+7)&~7;
+	detector_reset_frame(s);
+}
+
 static void detector_init(MSFilter *f){
 	DetectorState *s=ms_new0(DetectorState,1);
-	s->buf=ms_bufferizer_new();
+	ms_tone_detector_list_kernels();
 	s->rate=8000;
 	s->frame_ms=20;
-	s->framesize=2*(s->frame_ms*s->rate)/1000;
+	s->frame_samples=(s->frame_ms*s->rate)/1000;
 	f->data=s;
 }
 
 static void detector_uninit(MSFilter *f){
-	DetectorState *s=(DetectorState *)f->data;
-	ms_bufferizer_destroy (s->buf);
 	ms_free(f->data);
 }
 
@@ -116,8 +250,9 @@ static int detector_add_scan(MSFilter *f, void *arg){
 	int i=find_free_slot(s);
 	if (i!=-1){
 		s->tone_def[i]=*def;
+		memset(&s->tone_gs[i],0,sizeof(s->tone_gs[i]));
 		s->nscans++;
-		goertzel_state_init(&s->tone_gs[i],def->frequency,s->rate);
+		detector_update_coefs(s);
 		return 0;
 	}
 	return -1;
@@ -127,12 +262,15 @@ static int detector_clear_scans(MSFilter *f, void *arg){
 	DetectorState *s=(DetectorState *)f->data;
 	memset(&s->tone_def,0,sizeof(s->tone_def));
 	s->nscans=0;
+	detector_update_coefs(s);
 	return 0;
 }
 
 static int detector_set_rate(MSFilter *f, void *arg){
 	DetectorState *s=(DetectorState *)f->data;
 	s->rate = *((int*) arg);
+	s->frame_samples=(s->frame_ms*s->rate)/1000;
+	detector_update_coefs(s);
 	return 0;
 }
 
@@ -145,46 +283,95 @@ static void end_all_tones(DetectorState *s){
 	}
 }
 
+static void detector_end_frame(MSFilter *f, DetectorState *s){
+	float en=s->frame_energy;
+	if (en>energy_min_threshold*(32767.0*32767.0*0.7)){
+		int i;
+		for(i=0;i<s->nscans;++i){
+			GoertzelState *gs=&s->tone_gs[i];
+			MSToneDetectorDef *tone_def=&s->tone_def[i];
+			float q1=s->q1[i], q2=s->q2[i];
+			/*relative frequency energy compared over the total signal energy */
+			float freq_en=((q1*q1) + (q2*q2) - (q1*q2*s->coef[i]))/(en*(float)s->frame_samples*0.5f);
+			if (freq_en>=tone_def->min_amplitude){
+				if (gs->dur==0) gs->starttime=f->ticker->time;
+				gs->dur+=s->frame_ms;
+				if (gs->dur>=tone_def->min_duration && !gs->event_sent){
+					MSToneDetectorEvent event;
+
+					strncpy(event.tone_name,tone_def->tone_name,sizeof(event.tone_name));
+					event.tone_start_time=gs->starttime;
+					ms_filter_notify(f,MS_TONE_DETECTOR_EVENT,&event);
+					gs->event_sent=TRUE;
+				}
+			}else{
+				gs->event_sent=FALSE;
+				gs->dur=0;
+				gs->starttime=0;
+			}
+		}
+	}else end_all_tones(s);
+	detector_reset_frame(s);
+}
+
+static void detector_flush_chunk(MSFilter *f, DetectorState *s){
+	kernel->run(s->q1,s->q2,s->coef,s->nlanes,s->chunk,s->chunk_len);
+	s->chunk_len=0;
+	if (s->frame_count==s->frame_samples) detector_end_frame(f,s);
+}
+
+/*converts up to nsamples samples into the chunk, returns how many were taken*/
+static int detector_take_samples(MSFilter *f, DetectorState *s, const uint8_t *p, int nsamples){
+	float en=s->frame_energy;
+	int i;
+	nsamples=MIN(nsamples,MIN(CHUNK_SAMPLES-s->chunk_len,s->frame_samples-s->frame_count));
+	for(i=0;i<nsamples;++i){
+		int16_t sample;
+		float x;
+		memcpy(&sample,p+2*i,sizeof(sample));
+		x=(float)sample;
+		en+=x*x;
+		s->chunk[s->chunk_len+i]=x;
+	}
+	s->frame_energy=en;
+	s->chunk_len+=nsamples;
+	s->frame_count+=nsamples;
+	if (s->chunk_len==CHUNK_SAMPLES || s->frame_count==s->frame_samples) detector_flush_chunk(f,s);
+	return nsamples;
+}
+
+/*analyses the samples of a block in place, a sample may be split across two blocks*/
+static void detector_analyse(MSFilter *f, DetectorState *s, mblk_t *m){
+	for(;m!=NULL;m=m->b_cont){
+		const uint8_t *p=m->b_rptr;
+		const uint8_t *end=m->b_wptr;
+
+		if (p<end && s->has_pending_byte){
+			uint8_t bytes[2];
+			bytes[0]=s->pending_byte;
+			bytes[1]=*p++;
+			s->has_pending_byte=FALSE;
+			detector_take_samples(f,s,bytes,1);
+		}
+		while(end-p>=2){
+			p+=2*detector_take_samples(f,s,p,(int)((end-p)/2));
+		}
+		if (p<end){
+			s->pending_byte=*p;
+			s->has_pending_byte=TRUE;
+		}
+	}
+}
+
 static void detector_process(MSFilter *f){
 	DetectorState *s=(DetectorState *)f->data;
 	mblk_t *m;
-	
+
 	while ((m=ms_queue_get(f->inputs[0]))!=NULL){
-		ms_queue_put(f->outputs[0],m);
-		if (s->nscans>0){
-			ms_bufferizer_put(s->buf,dupmsg(m));
-		}
-	}
-	if (s->nscans>0){
-		uint8_t *buf=alloca(s->framesize);
-
-		while(ms_bufferizer_read(s->buf,buf,s->framesize)!=0){
-			float en=compute_energy((int16_t*)buf,s->framesize/2);
-			if (en>energy_min_threshold*(32767.0*32767.0*0.7)){
-				int i;
-				for(i=0;i<s->nscans;++i){
-					GoertzelState *gs=&s->tone_gs[i];
-					MSToneDetectorDef *tone_def=&s->tone_def[i];
-					float freq_en=goertzel_state_run(gs,(int16_t*)buf,s->framesize/2,en);
-					if (freq_en>=tone_def->min_amplitude){
-						if (gs->dur==0) gs->starttime=f->ticker->time;
-						gs->dur+=s->frame_ms;
-						if (gs->dur>=tone_def->min_duration && !gs->event_sent){
-							MSToneDetectorEvent event;
-						
-							strncpy(event.tone_name,tone_def->tone_name,sizeof(event.tone_name));
-							event.tone_start_time=gs->starttime;
-							ms_filter_notify(f,MS_TONE_DETECTOR_EVENT,&event);
-							gs->event_sent=TRUE;
-						}
-					}else{
-						gs->event_sent=FALSE;
-						gs->dur=0;
-						gs->starttime=0;
-					}
-				}
-			}else end_all_tones(s);
+		if (s->nscans>0 && s->frame_samples>0){
+			detector_analyse(f,s,m);
 		}
+		ms_queue_put(f->outputs[0],m);
 	}
 }
 
@@ -19,7 +19,7 @@
 
 
 #include "mediastreamer2/msfilter.h"
-#include "g711.h"
+#include "mediastreamer2/msg711.h"
 
 typedef struct _UlawEncData{
 	MSBufferizer *bz;
@@ -74,12 +74,9 @@ static void ulaw_enc_process(MSFilter *obj){
 	}
 
 	while (ms_bufferizer_read(bz,buffer,size_of_pcm)==size_of_pcm){
-		mblk_t *o=allocb(size_of_pcm/2,0);
-		size_t i;
-		for (i=0;i<size_of_pcm/2;i++){
-			*o->b_wptr=Snack_Lin2Mulaw(((int16_t*)buffer)[i]);
-			o->b_wptr++;
-		}
+		mblk_t *o=ms_factory_allocb(obj->factory,size_of_pcm/2);
+		ms_g711_get_kernels()->ulaw_encode(o->b_wptr,(const int16_t*)buffer,(int)(size_of_pcm/2));
+		o->b_wptr+=size_of_pcm/2;
 		mblk_set_timestamp_info(o,dt->ts);
 		ms_bufferizer_fill_current_metas(bz, o);
 		dt->ts+=(uint32_t)(size_of_pcm/2);
@@ -210,11 +207,10 @@ static void ulaw_dec_process(MSFilter *obj){
 	while((m=ms_queue_get(obj->inputs[0]))!=NULL){
 		mblk_t *o;
 		msgpullup(m,-1);
-		o=allocb((m->b_wptr-m->b_rptr)*2,0);
+		o=ms_factory_allocb(obj->factory,(int)(m->b_wptr-m->b_rptr)*2);
 		mblk_meta_copy(m, o);
-		for(;m->b_rptr<m->b_wptr;m->b_rptr++,o->b_wptr+=2){
-			*((int16_t*)(o->b_wptr))=Snack_Mulaw2Lin(*m->b_rptr);
-		}
+		ms_g711_get_kernels()->ulaw_decode((int16_t*)o->b_wptr,m->b_rptr,(int)(m->b_wptr-m->b_rptr));
+		o->b_wptr+=(m->b_wptr-m->b_rptr)*2;
 		freemsg(m);
 		ms_queue_put(obj->outputs[0],o);
 	}
@@ -20,11 +20,21 @@
 
 #include "mediastreamer2/mseventqueue.h"
 #include "mediastreamer2/msfilter.h"
+#include "msatomic.h"
 
 #ifndef MS_EVENT_QUEUE_MAX_SIZE
 #define MS_EVENT_QUEUE_MAX_SIZE 1024
 #endif
 
+/*number of events taken from the queue at once by ms_event_queue_pump()*/
+#define MS_EVENT_QUEUE_BATCH_SIZE 32
+
+/*
+ * Event arguments are at most 255 bytes long, as their size is encoded in the lowest byte of the event id. Most of them
+ * are a few integers and are stored in the slot, the larger ones are allocated so that the slots remain small.
+ */
+#define MS_EVENT_INLINE_ARG_SIZE 16
+
 typedef enum {
 	OnlySynchronous,
 	OnlyAsynchronous,
@@ -41,132 +51,210 @@ struct _MSNotifyContext{
 
 typedef struct _MSNotifyContext MSNotifyContext;
 
-struct _MSEventQueue{
-	ms_mutex_t mutex; /*could be replaced by an atomic counter for freeroom*/
-	MSFilter *current_notifier;
-	queue_t q;
-};
-
 typedef struct {
 	MSFilter* filter;
 	unsigned int ev_id;
 	int pad; /* So that next is 64 bit aligned*/
 } MSEventHeader;
 
+typedef struct {
+	MSEventHeader header;
+	union {
+		uint64_t data[MS_EVENT_INLINE_ARG_SIZE/sizeof(uint64_t)];
+		void *ptr; /*argument larger than MS_EVENT_INLINE_ARG_SIZE*/
+	} arg;
+} MSEvent;
 
-static void write_event(MSEventQueue *q, MSFilter *f, unsigned int ev_id, void *arg){
-	int argsize=ev_id & 0xff;
-	int header_size = sizeof(MSEventHeader);
-	mblk_t *event_message;
+/*
+ * A slot of the ring. The sequence number tells whether the slot is free for the writer at position pos (sequence==pos),
+ * or holds an event ready to be read at position pos (sequence==pos+1).
+ */
+typedef struct {
+	ms_atomic_uint_t sequence;
+	MSEvent event;
+} MSEventSlot;
 
-	if (q->q.q_mcount > MS_EVENT_QUEUE_MAX_SIZE){
-		ms_error("Mediastreamer2 event queue is stalled, discarding event.");
-		return;
-	}
+/*
+ * Filters notify from the ticker threads, possibly several at once: events are written without lock into a ring of
+ * preallocated slots. The reading side (pump, skip and clean) and the batch of events taken from the ring are protected
+ * by the mutex.
+ */
+struct _MSEventQueue{
+	ms_mutex_t mutex;
+	MSFilter *current_notifier;
+	MSEventSlot *slots;
+	unsigned int mask;
+	ms_atomic_uint_t write_pos;
+	unsigned int read_pos;
+	MSEvent batch[MS_EVENT_QUEUE_BATCH_SIZE]; /*events taken from the ring and not dispatched yet*/
+	int batch_count;
+	int batch_index;
+};
 
-	event_message = allocb(header_size + argsize, 0);
 
-	((MSEventHeader *)event_message->b_wptr)->filter = f;
-	((MSEventHeader *)event_message->b_wptr)->ev_id = ev_id;
+static void *event_arg(MSEvent *ev){
+	return (ev->header.ev_id & 0xff)>MS_EVENT_INLINE_ARG_SIZE ? ev->arg.ptr : (void*)ev->arg.data;
+}
 
-	event_message->b_wptr += header_size;
+static void event_free_arg(MSEvent *ev){
+	if ((ev->header.ev_id & 0xff)>MS_EVENT_INLINE_ARG_SIZE) ms_free(ev->arg.ptr);
+}
 
-	if (argsize > 0) {
-		memcpy(event_message->b_wptr, arg, argsize);
-		event_message->b_wptr += argsize;
+static void write_event(MSEventQueue *q, MSFilter *f, unsigned int ev_id, void *arg){
+	int argsize=ev_id & 0xff;
+	unsigned int pos=ms_atomic_load(&q->write_pos);
+	void *large_arg=NULL;
+	MSEventSlot *slot;
+
+	/*allocated before taking a slot, so that the slot is published as soon as possible*/
+	if (argsize>MS_EVENT_INLINE_ARG_SIZE){
+		large_arg=ms_malloc(argsize);
+		memcpy(large_arg,arg,argsize);
 	}
 
-	ms_mutex_lock(&q->mutex);
-	putq(&q->q, event_message);
-	ms_mutex_unlock(&q->mutex);
-}
-
-static void parse_event(uint8_t *rptr, MSFilter **f, unsigned int *id, void **data, int *argsize){
-	int header_size = sizeof(MSEventHeader);
+	for(;;){
+		int diff;
+		slot=&q->slots[pos & q->mask];
+		diff=(int)(ms_atomic_load(&slot->sequence)-pos);
+		if (diff==0){
+			if (ms_atomic_compare_exchange(&q->write_pos,pos,pos+1)) break;
+		}else if (diff<0){
+			/*the slot still holds an event that was not read: the queue is full*/
+			ms_error("Mediastreamer2 event queue is stalled, discarding event.");
+			if (large_arg) ms_free(large_arg);
+			return;
+		}
+		/*another thread took this slot*/
+		pos=ms_atomic_load(&q->write_pos);
+	}
 
-	if (((intptr_t)rptr % 4) != 0) ms_fatal("Unaligned access");
-	*f = ((MSEventHeader *)rptr)->filter;
-	*id = ((MSEventHeader *)rptr)->ev_id;
+	slot->event.header.filter = f;
+	slot->event.header.ev_id = ev_id;
+	if (large_arg) {
+		slot->event.arg.ptr = large_arg;
+	} else if (argsize > 0) {
+		memcpy(slot->event.arg.data, arg, argsize);
+	}
+	ms_atomic_store(&slot->sequence,pos+1);
+}
 
-	*argsize = (*id) & 0xff;
-	*data = rptr + header_size;
+/*take a batch of events from the ring, must be called with the mutex held*/
+static int fetch_events(MSEventQueue *q){
+	int count=0;
+
+	while(count<MS_EVENT_QUEUE_BATCH_SIZE){
+		MSEventSlot *slot=&q->slots[q->read_pos & q->mask];
+		if (ms_atomic_load(&slot->sequence)!=q->read_pos+1) break;
+		q->batch[count]=slot->event;
+		/*give the slot back to writers for the next round*/
+		ms_atomic_store(&slot->sequence,q->read_pos+q->mask+1);
+		q->read_pos++;
+		count++;
+	}
+	q->batch_count=count;
+	q->batch_index=0;
+	return count;
 }
 
 static bool_t read_event(MSEventQueue *q){
-	mblk_t *event_message;
-	bool_t has_read = FALSE;
+	MSEvent event;
+	MSFilter *f;
+	unsigned int id;
+	int argsize;
 
 	ms_mutex_lock(&q->mutex);
-	event_message = getq(&q->q);
+	if (q->batch_index>=q->batch_count && fetch_events(q)==0){
+		ms_mutex_unlock(&q->mutex);
+		return FALSE;
+	}
+	/*the event is moved out of the batch: a callback may pump the queue again and overwrite the batch*/
+	event=q->batch[q->batch_index++];
+	f=event.header.filter;
+	if (f) q->current_notifier=f;
 	ms_mutex_unlock(&q->mutex);
-	
-	if (event_message){
-		MSFilter *f;
-		unsigned int id;
-		void *data;
-		int argsize;
-
-		parse_event(event_message->b_rptr,&f,&id,&data,&argsize);
-		if (f) {
-			q->current_notifier=f;
-			ms_filter_invoke_callbacks(&q->current_notifier,id,argsize>0 ? data : NULL, OnlyAsynchronous);
-			q->current_notifier=NULL;
-		}
-		freeb(event_message);
-		has_read = TRUE;
+	id=event.header.ev_id;
+	argsize=id & 0xff;
+	if (f) {
+		ms_filter_invoke_callbacks(&q->current_notifier,id,argsize>0 ? event_arg(&event) : NULL, OnlyAsynchronous);
+		q->current_notifier=NULL;
 	}
-	return has_read;
+	event_free_arg(&event);
+	return TRUE;
 }
 
 /*clean all events belonging to a MSFilter that is about to be destroyed*/
 void ms_event_queue_clean(MSEventQueue *q, MSFilter *destroyed){
-	queue_t freeq;
-	mblk_t *event_message;
+	unsigned int pos,end;
 	int cleaned_events = 0;
-	
-	qinit(&freeq);
+	int i;
+
 	ms_mutex_lock(&q->mutex);
-	for (event_message = qbegin(&q->q); !qend(&q->q, event_message); ){
-		MSFilter *f;
-		unsigned int id;
-		void *data;
-		int argsize;
-		mblk_t *next_event_message = event_message->b_next;
-
-		parse_event(event_message->b_rptr,&f,&id,&data,&argsize);
-		if (f == destroyed){
+	/*
+	 * Events are not removed but neutralized, they will be skipped when read. The slots taken by writers that did not
+	 * publish their event yet are skipped: they hold events of other filters, the destroyed one no longer runs.
+	 */
+	end=ms_atomic_load(&q->write_pos);
+	for (pos = q->read_pos; pos != end; pos++){
+		MSEventSlot *slot=&q->slots[pos & q->mask];
+		if (ms_atomic_load(&slot->sequence)!=pos+1) continue;
+		if (slot->event.header.filter == destroyed){
+			slot->event.header.filter = NULL;
 			cleaned_events++;
-			remq(&q->q, event_message);
-			putq(&freeq, event_message);
 		}
-		event_message = next_event_message;
 	}
-	ms_mutex_unlock(&q->mutex);
-	if (cleaned_events > 0){
-		ms_message("Cleaned [%i] pending event(s) generated by MSFilter [%s:%p]", cleaned_events, destroyed->desc->name, destroyed);
+	for (i = q->batch_index; i < q->batch_count; i++){
+		if (q->batch[i].header.filter == destroyed){
+			q->batch[i].header.filter = NULL;
+			cleaned_events++;
+		}
 	}
 	if (q->current_notifier==destroyed){
 		q->current_notifier=NULL;
 	}
-	flushq(&freeq, 0);
+	ms_mutex_unlock(&q->mutex);
+	if (cleaned_events > 0){
+		ms_message("Cleaned [%i] pending event(s) generated by MSFilter [%s:%p]", cleaned_events, destroyed->desc->name, destroyed);
+	}
 }
 
-MSEventQueue *ms_event_queue_new(){
+MSEventQueue *ms_event_queue_new_with_size(int max_events){
 	MSEventQueue *q=ms_new0(MSEventQueue,1);
+	unsigned int size=1;
+	unsigned int i;
+
+	while(size<(unsigned int)max_events) size<<=1;
 	ms_mutex_init(&q->mutex,NULL);
-	qinit(&q->q);
+	q->slots=ms_new0(MSEventSlot,size);
+	q->mask=size-1;
+	for(i=0;i<size;i++){
+		ms_atomic_store(&q->slots[i].sequence,i);
+	}
 	return q;
 }
 
+MSEventQueue *ms_event_queue_new(){
+	return ms_event_queue_new_with_size(MS_EVENT_QUEUE_MAX_SIZE);
+}
+
 void ms_event_queue_destroy(MSEventQueue *q){
-	flushq(&q->q, 0);
+	ms_event_queue_skip(q);
 	ms_mutex_destroy(&q->mutex);
+	ms_free(q->slots);
 	ms_free(q);
 }
 
+static void skip_batch(MSEventQueue *q){
+	for(;q->batch_index<q->batch_count;q->batch_index++){
+		event_free_arg(&q->batch[q->batch_index]);
+	}
+}
+
 void ms_event_queue_skip(MSEventQueue *q){
 	ms_mutex_lock(&q->mutex);
-	flushq(&q->q, 0);
+	skip_batch(q);
+	while(fetch_events(q)>0){
+		skip_batch(q);
+	}
 	ms_mutex_unlock(&q->mutex);
 }
 
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mediastreamer2/msbufferpool.h"
+
+#define MS_BUFFER_POOL_NCLASSES 6
+#define MS_BUFFER_POOL_DEFAULT_MAX_BUFFERS 1024
+
+static const int buffer_pool_sizes[MS_BUFFER_POOL_NCLASSES]={160, 320, 640, 960, 1920, 3840};
+
+#define MS_BUFFER_POOL_MAGIC 0x6d73706c /*"mspl"*/
+
+typedef struct _MSBufferPoolClass MSBufferPoolClass;
+
+/*
+ * Placed before each buffer of the pool, so that pool buffers are told apart by an explicit marker
+ * (the linker may merge their free function with another one having the same code), and find their way back to the pool.
+ */
+typedef struct _MSBufferPoolTag{
+	uint32_t magic;
+	MSBufferPool *pool;
+	MSBufferPoolClass *cl;
+	struct _MSBufferPoolTag *next; /*next free buffer of the class*/
+}MSBufferPoolTag;
+
+struct _MSBufferPoolClass{
+	MSBufferPoolTag *free_buffers; /* the released buffers, the most recently released first */
+	int nbuffers; /* buffers of the class, lent or free */
+	int size;
+};
+
+/*
+ * The pool holds no reference on the buffers it lends, so that a lent buffer used by a single message has a reference count of 1,
+ * like any other message, and is modified in place by the code checking dblk_ref_value().
+ * Instead, the free function of the buffers returns them to the pool when their last reference is released.
+ */
+struct _MSBufferPool{
+	ms_mutex_t lock;
+	MSBufferPoolClass classes[MS_BUFFER_POOL_NCLASSES];
+	int max_buffers;
+	int lent; /* buffers currently used by messages */
+	bool_t destroyed; /* the pool is freed by the release of the last lent buffer */
+	MSBufferPoolStats stats;
+};
+
+MSBufferPool *ms_buffer_pool_new(void){
+	MSBufferPool *pool=ms_new0(MSBufferPool,1);
+	int i;
+	ms_mutex_init(&pool->lock,NULL);
+	for(i=0;i<MS_BUFFER_POOL_NCLASSES;i++){
+		pool->classes[i].size=buffer_pool_sizes[i];
+	}
+	pool->max_buffers=MS_BUFFER_POOL_DEFAULT_MAX_BUFFERS;
+	return pool;
+}
+
+void ms_buffer_pool_set_max_buffers(MSBufferPool *pool, int max_buffers){
+	pool->max_buffers=max_buffers;
+}
+
+static MSBufferPoolClass *find_class(MSBufferPool *pool, int size){
+	int i;
+	for(i=0;i<MS_BUFFER_POOL_NCLASSES;i++){
+		if (size<=pool->classes[i].size) return &pool->classes[i];
+	}
+	return NULL;
+}
+
+static void pool_free(MSBufferPool *pool){
+	int i;
+	for(i=0;i<MS_BUFFER_POOL_NCLASSES;i++){
+		MSBufferPoolTag *tag;
+		while((tag=pool->classes[i].free_buffers)!=NULL){
+			pool->classes[i].free_buffers=tag->next;
+			ms_free(tag);
+		}
+	}
+	ms_mutex_destroy(&pool->lock);
+	ms_free(pool);
+}
+
+/*called when the last reference to a lent buffer is released, possibly by another thread than the one which got it*/
+static void pool_buffer_release(void *buffer){
+	MSBufferPoolTag *tag=(MSBufferPoolTag*)buffer-1;
+	MSBufferPool *pool=tag->pool;
+	bool_t last=FALSE;
+
+	ms_mutex_lock(&pool->lock);
+	pool->lent--;
+	if (pool->destroyed){
+		tag->cl->nbuffers--;
+		last=(pool->lent==0);
+		ms_free(tag);
+	}else{
+		tag->next=tag->cl->free_buffers;
+		tag->cl->free_buffers=tag;
+	}
+	ms_mutex_unlock(&pool->lock);
+	if (last) pool_free(pool);
+}
+
+bool_t ms_buffer_pool_is_pool_buffer(const dblk_t *db){
+	if (db->db_freefn!=pool_buffer_release) return FALSE;
+	return ((const MSBufferPoolTag*)db->db_base-1)->magic==MS_BUFFER_POOL_MAGIC;
+}
+
+static MSBufferPoolTag *pool_buffer_new(MSBufferPool *pool, MSBufferPoolClass *cl){
+	MSBufferPoolTag *tag=(MSBufferPoolTag*)ms_malloc(sizeof(MSBufferPoolTag)+MS_BUFFER_POOL_HEADROOM+cl->size+MS_BUFFER_POOL_TAILROOM);
+	tag->magic=MS_BUFFER_POOL_MAGIC;
+	tag->pool=pool;
+	tag->cl=cl;
+	tag->next=NULL;
+	return tag;
+}
+
+mblk_t *ms_buffer_pool_get(MSBufferPool *pool, int size){
+	MSBufferPoolClass *cl=find_class(pool,size);
+	MSBufferPoolTag *tag;
+	mblk_t *m;
+
+	if (cl==NULL) return allocb(size,0);
+	ms_mutex_lock(&pool->lock);
+	pool->stats.requests++;
+	tag=cl->free_buffers;
+	if (tag!=NULL){
+		/*the most recently released buffer is the most likely to be in the cache*/
+		cl->free_buffers=tag->next;
+		pool->stats.hits++;
+	}else if (cl->nbuffers<pool->max_buffers){
+		tag=pool_buffer_new(pool,cl);
+		cl->nbuffers++;
+		pool->stats.buffers++;
+		if (cl->nbuffers>pool->stats.high_water_mark) pool->stats.high_water_mark=cl->nbuffers;
+	}
+	if (tag!=NULL) pool->lent++;
+	ms_mutex_unlock(&pool->lock);
+	if (tag==NULL) return allocb(size,0);
+
+	m=esballoc((uint8_t*)(tag+1),MS_BUFFER_POOL_HEADROOM+cl->size+MS_BUFFER_POOL_TAILROOM,0,pool_buffer_release);
+	m->b_rptr=m->b_wptr=m->b_datap->db_base+MS_BUFFER_POOL_HEADROOM;
+	return m;
+}
+
+void ms_buffer_pool_get_stats(MSBufferPool *pool, MSBufferPoolStats *stats){
+	ms_mutex_lock(&pool->lock);
+	*stats=pool->stats;
+	ms_mutex_unlock(&pool->lock);
+}
+
+void ms_buffer_pool_destroy(MSBufferPool *pool){
+	bool_t unused;
+	/*the buffers still used by messages are freed with the messages, the last one freeing the pool*/
+	ms_mutex_lock(&pool->lock);
+	pool->destroyed=TRUE;
+	unused=(pool->lent==0);
+	ms_mutex_unlock(&pool->lock);
+	if (unused) pool_free(pool);
+}
@@ -131,6 +131,19 @@ void ms_factory_set_cpu_count(MSFactory *obj, unsigned int c) {
 	obj->cpu_count = c;
 }
 
+MSBufferPool *ms_factory_get_buffer_pool(MSFactory *obj) {
+	return obj->buffer_pool;
+}
+
+void ms_factory_get_buffer_pool_stats(MSFactory *obj, MSBufferPoolStats *stats) {
+	ms_buffer_pool_get_stats(obj->buffer_pool, stats);
+}
+
+mblk_t *ms_factory_allocb(MSFactory *obj, int size) {
+	if (obj == NULL || obj->buffer_pool == NULL) return allocb(size, 0);
+	return ms_buffer_pool_get(obj->buffer_pool, size);
+}
+
 void ms_factory_add_platform_tag(MSFactory *obj, const char *tag) {
 	if ((tag == NULL) || (tag[0] == '\0')) return;
 	if (bctbx_list_find_custom(obj->platform_tags, (bctbx_compare_func)strcasecmp, tag) == NULL) {
@@ -155,13 +168,16 @@ static int compare_stats_with_name(const MSFilterStats *stat, const char *name){
 }
 
 static MSFilterStats *find_or_create_stats(MSFactory *factory, MSFilterDesc *desc){
-	bctbx_list_t *elem=bctbx_list_find_custom(factory->stats_list,(bctbx_compare_func)compare_stats_with_name,desc->name);
+	bctbx_list_t *elem;
 	MSFilterStats *ret=NULL;
+	ms_mutex_lock(&factory->stats_lock);
+	elem=bctbx_list_find_custom(factory->stats_list,(bctbx_compare_func)compare_stats_with_name,desc->name);
 	if (elem==NULL){
 		ret=ms_new0(MSFilterStats,1);
 		ret->name=desc->name;
 		factory->stats_list=bctbx_list_append(factory->stats_list,ret);
 	}else ret=(MSFilterStats*)elem->data;
+	ms_mutex_unlock(&factory->stats_lock);
 	return ret;
 }
 
@@ -203,6 +219,8 @@ void ms_factory_init(MSFactory *obj){
 #endif
 	ms_factory_set_cpu_count(obj,num_cpu);
 	ms_factory_set_mtu(obj,MS_MTU_DEFAULT);
+	obj->buffer_pool=ms_buffer_pool_new();
+	ms_mutex_init(&obj->stats_lock,NULL);
 #ifdef _WIN32
 	ms_factory_add_platform_tag(obj, "win32");
 #ifdef MS2_WINDOWS_PHONE
@@ -478,10 +496,12 @@ const bctbx_list_t * ms_factory_get_statistics(MSFactory* obj){
 void ms_factory_reset_statistics(MSFactory *obj){
 	bctbx_list_t *elem;
 
+	ms_mutex_lock(&obj->stats_lock);
 	for(elem=obj->stats_list;elem!=NULL;elem=elem->next){
 		MSFilterStats *stats=(MSFilterStats *)elem->data;
 		ms_u_box_plot_reset(&stats->bp_elapsed);
 	}
+	ms_mutex_unlock(&obj->stats_lock);
 }
 
 static int usage_compare(const MSFilterStats *s1, const MSFilterStats *s2){
@@ -495,6 +515,7 @@ void ms_factory_log_statistics(MSFactory *obj) {
 	bctbx_list_t *sorted = NULL;
 	bctbx_list_t *elem;
 	double total = 0.0;
+	ms_mutex_lock(&obj->stats_lock);
 	for (elem = obj->stats_list; elem != NULL; elem = elem->next) {
 		MSFilterStats *stats = (MSFilterStats *)elem->data;
 		sorted = bctbx_list_insert_sorted(sorted, stats, (bctbx_compare_func)usage_compare);
@@ -515,6 +536,7 @@ void ms_factory_log_statistics(MSFactory *obj) {
 		ms_message("%-29s %-9llu %-7.2f %-7.2f %-7.2f %-7.2f %9.1f", stats->name, (long long unsigned)stats->bp_elapsed.count, min, mean, max, sd, percentage);
 	}
 	ms_message("=================================================================================");
+	ms_mutex_unlock(&obj->stats_lock);
 	bctbx_list_free(sorted);
 }
 
@@ -1133,6 +1155,8 @@ void ms_factory_destroy(MSFactory *factory) {
 	if (factory->plugins_dir) ms_free(factory->plugins_dir);
 	if (factory->image_resources_dir) ms_free(factory->image_resources_dir);
 	if (factory->wbcmanager) ms_web_cam_manager_destroy(factory->wbcmanager);
+	if (factory->buffer_pool) ms_buffer_pool_destroy(factory->buffer_pool);
+	ms_mutex_destroy(&factory->stats_lock);
 	ms_free(factory);
 	if (factory == fallback_factory) fallback_factory = NULL;
 }
@@ -19,6 +19,8 @@
 
 #include "mediastreamer2/msfilter.h"
 #include "mediastreamer2/msticker.h"
+#include "mediastreamer2/msprofile.h"
+#include "mediastreamer2/mstrace.h"
 
 #define MS_FILTER_METHOD_GET_FID(id)	(((id)>>16) & 0xFFFF)
 #define MS_FILTER_METHOD_GET_INDEX(id) ( ((id)>>8) & 0XFF)
@@ -134,6 +136,9 @@ int ms_filter_link(MSFilter *f1, int pin1, MSFilter *f2, int pin2){
 	q=ms_queue_new(f1,pin1,f2,pin2);
 	f1->outputs[pin1]=q;
 	f2->inputs[pin2]=q;
+	/*the ticker must recompute its independent subgraphs if it runs them in parallel*/
+	if (f1->ticker) f1->ticker->components_changed=TRUE;
+	if (f2->ticker) f2->ticker->components_changed=TRUE;
 	return 0;
 }
 
@@ -156,6 +161,8 @@ int ms_filter_unlink(MSFilter *f1, int pin1, MSFilter *f2, int pin2){
 	q=f1->outputs[pin1];
 	f1->outputs[pin1]=f2->inputs[pin2]=0;
 	ms_queue_destroy(q);
+	if (f1->ticker) f1->ticker->components_changed=TRUE;
+	if (f2->ticker) f2->ticker->components_changed=TRUE;
 	return 0;
 }
 
@@ -214,26 +221,46 @@ void ms_filter_destroy(MSFilter *f){
 		f->desc->uninit(f);
 	if (f->inputs!=NULL)	ms_free(f->inputs);
 	if (f->outputs!=NULL)	ms_free(f->outputs);
+	if (f->latency!=NULL)	ms_free(f->latency);
 	ms_mutex_destroy(&f->lock);
 	ms_filter_clear_notify_callback(f);
 	ms_filter_clean_pending_events(f);
 	ms_free(f);
 }
 
+static MS2_INLINE bool_t ms_filter_measured(MSFilter *f){
+	return f->stats || (f->ticker && (f->ticker->measure_filters || f->ticker->profiling));
+}
+
+static void ms_filter_add_measure(MSFilter *f, uint64_t elapsed_time){
+	f->process_time += elapsed_time;
+	if (f->stats){
+		/*the filters of a same type share their statistics, and may be processed in parallel*/
+		ms_mutex_lock(&f->factory->stats_lock);
+		ms_u_box_plot_add_value(&f->stats->bp_elapsed, elapsed_time);
+		ms_mutex_unlock(&f->factory->stats_lock);
+	}
+	if (f->latency==NULL) f->latency=ms_new0(MSLatencyHistogram,1);
+	ms_latency_histogram_add_value(f->latency, elapsed_time);
+}
+
 void ms_filter_process(MSFilter *f){
 	MSTimeSpec start,stop;
 	uint64_t elapsed_time;
+	bool_t measured=ms_filter_measured(f);
+	bool_t traced=ms_trace_is_enabled();
 
 	ms_debug("Executing process of filter %s:%p",f->desc->name,f);
 
-	if (f->stats)
+	if (measured || traced)
 		ms_get_cur_time(&start);
 
 	f->desc->process(f);
-	if (f->stats){
+	if (measured || traced){
 		ms_get_cur_time(&stop);
 		elapsed_time = (stop.tv_sec-start.tv_sec)*1000000000LL + (stop.tv_nsec-start.tv_nsec);
-		ms_u_box_plot_add_value(&f->stats->bp_elapsed, elapsed_time);
+		if (measured) ms_filter_add_measure(f, elapsed_time);
+		if (traced) ms_trace_record(f->ticker, MSTraceEventProcess, f->desc->name, f, f->last_tick, &start, &stop);
 	}
 
 }
@@ -241,17 +268,20 @@ void ms_filter_process(MSFilter *f){
 void ms_filter_task_process(MSFilterTask *task){
 	MSTimeSpec start,stop;
 	MSFilter *f=task->f;
+	bool_t measured=ms_filter_measured(f);
+	bool_t traced=ms_trace_is_enabled();
 	/*ms_message("Executing task of filter %s:%p",f->desc->name,f);*/
 
-	if (f->stats)
+	if (measured || traced)
 		ms_get_cur_time(&start);
 
 	task->taskfunc(f);
-	if (f->stats){
+	if (measured || traced){
 		uint64_t elapsed_time;
 		ms_get_cur_time(&stop);
 		elapsed_time = (stop.tv_sec-start.tv_sec)*1000000000LL + (stop.tv_nsec-start.tv_nsec);
-		ms_u_box_plot_add_value(&f->stats->bp_elapsed, elapsed_time);
+		if (measured) ms_filter_add_measure(f, elapsed_time);
+		if (traced) ms_trace_record(f->ticker, MSTraceEventTask, f->desc->name, f, f->last_tick, &start, &stop);
 	}
 	f->postponed_task--;
 }
@@ -288,7 +318,9 @@ void ms_filter_postpone_task(MSFilter *f, MSFilterFunc taskfunc){
 	task=ms_new0(MSFilterTask,1);
 	task->f=f;
 	task->taskfunc=taskfunc;
+	ms_mutex_lock(&ticker->task_lock);
 	ticker->task_list=bctbx_list_prepend(ticker->task_list,task);
+	ms_mutex_unlock(&ticker->task_lock);
 	f->postponed_task++;
 }
 
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mediastreamer2/msprofile.h"
+
+#include <math.h>
+
+#define SUB_BUCKETS (1<<MS_LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+
+static int most_significant_bit(uint64_t value){
+#if defined(__GNUC__)
+	return 63-__builtin_clzll(value);
+#else
+	int msb=0;
+	while (value>>=1) msb++;
+	return msb;
+#endif
+}
+
+/*
+ * Values below SUB_BUCKETS have their own bucket. Above, each power of two is split in SUB_BUCKETS buckets,
+ * selected by the bits that follow the most significant one.
+ */
+static int bucket_index(uint64_t value){
+	int msb;
+	if (value<SUB_BUCKETS) return (int)value;
+	msb=most_significant_bit(value);
+	if (msb>=MS_LATENCY_HISTOGRAM_MAX_BITS) return MS_LATENCY_HISTOGRAM_BUCKETS-1;
+	return ((msb-MS_LATENCY_HISTOGRAM_SUB_BUCKET_BITS+1)<<MS_LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+		+ (int)((value>>(msb-MS_LATENCY_HISTOGRAM_SUB_BUCKET_BITS)) & (SUB_BUCKETS-1));
+}
+
+static uint64_t bucket_highest_value(int index){
+	int shift;
+	if (index<SUB_BUCKETS) return (uint64_t)index;
+	shift=(index>>MS_LATENCY_HISTOGRAM_SUB_BUCKET_BITS)-1;
+	return (((uint64_t)(SUB_BUCKETS+(index & (SUB_BUCKETS-1))))<<shift) + (((uint64_t)1)<<shift) - 1;
+}
+
+void ms_latency_histogram_reset(MSLatencyHistogram *h){
+	memset(h,0,sizeof(*h));
+}
+
+void ms_latency_histogram_add_value(MSLatencyHistogram *h, uint64_t value_ns){
+	h->buckets[bucket_index(value_ns)]++;
+	if (h->count==0 || value_ns<h->min) h->min=value_ns;
+	if (value_ns>h->max) h->max=value_ns;
+	h->count++;
+	h->sum+=value_ns;
+}
+
+uint64_t ms_latency_histogram_get_percentile(const MSLatencyHistogram *h, double percentile){
+	uint64_t rank,cumulated=0;
+	int i;
+
+	if (h->count==0) return 0;
+	if (percentile>=100) return h->max;
+	rank=(uint64_t)ceil(percentile*(double)h->count/100.0);
+	if (rank<1) rank=1;
+	for(i=0;i<MS_LATENCY_HISTOGRAM_BUCKETS;i++){
+		cumulated+=h->buckets[i];
+		if (cumulated>=rank){
+			uint64_t value;
+			if (i==MS_LATENCY_HISTOGRAM_BUCKETS-1) break; /*the last bucket has no upper bound*/
+			value=bucket_highest_value(i);
+			return value<h->max ? value : h->max;
+		}
+	}
+	return h->max;
+}
+
+const MSLatencyHistogram *ms_filter_get_latency_histogram(const MSFilter *f){
+	return f->latency;
+}
@@ -27,6 +27,7 @@
 #include "mediastreamer2/msticker.h"
 #include "mediastreamer2/msvideo.h"
 #include "mediastreamer2/flowcontrol.h"
+#include "msatomic.h"
 
 
 
@@ -46,6 +47,7 @@ void ms_queue_init(MSQueue *q){
 	q->prev.pin=0;
 	q->next.filter=0;
 	q->next.pin=0;
+	q->max_depth=0;
 	qinit(&q->q);
 }
 
@@ -58,6 +60,50 @@ void ms_queue_flush(MSQueue *q){
 	flushq(&q->q,0);
 }
 
+#define MS_MBLK_MAX_READ_ONLY_FREEFNS 4
+
+/*free functions of the data blocks pointing to memory that must never be written*/
+static ms_atomic_ptr_t read_only_freefns[MS_MBLK_MAX_READ_ONLY_FREEFNS];
+static ms_atomic_uint_t read_only_freefns_count;
+
+static bool_t is_read_only_freefn(void (*freefn)(void*)){
+	int i;
+	if (freefn==NULL) return FALSE;
+	for(i=0;i<MS_MBLK_MAX_READ_ONLY_FREEFNS;i++){
+		if (ms_atomic_ptr_load(&read_only_freefns[i])==(void*)freefn) return TRUE;
+	}
+	return FALSE;
+}
+
+void ms_mblk_add_read_only_free_function(void (*freefn)(void*)){
+	unsigned int index;
+	if (is_read_only_freefn(freefn)) return;
+	index=ms_atomic_fetch_add(&read_only_freefns_count,1);
+	if (index>=MS_MBLK_MAX_READ_ONLY_FREEFNS){
+		ms_error("ms_mblk_add_read_only_free_function(): too many free functions declared.");
+		return;
+	}
+	ms_atomic_ptr_exchange(&read_only_freefns[index],(void*)freefn);
+}
+
+bool_t ms_mblk_is_writable(const mblk_t *m){
+	for(;m!=NULL;m=m->b_cont){
+		if (is_read_only_freefn(m->b_datap->db_freefn)) return FALSE;
+		if (dblk_ref_value(m->b_datap)!=1) return FALSE;
+	}
+	return TRUE;
+}
+
+mblk_t *ms_mblk_make_writable(mblk_t *m){
+	if (!ms_mblk_is_writable(m)){
+		mblk_t *copy=copymsg(m);
+		mblk_meta_copy(m,copy);
+		freemsg(m);
+		return copy;
+	}
+	return m;
+}
+
 
 void ms_bufferizer_init(MSBufferizer *obj){
 	qinit(&obj->q);
@@ -141,6 +187,173 @@ void ms_bufferizer_destroy(MSBufferizer *obj){
 }
 
 
+#define MS_RING_BUFFERIZER_DEFAULT_SIZE 4096
+
+static size_t ring_size_for(size_t size){
+	size_t capacity = 256;
+	while (capacity < size) capacity <<= 1;
+	return capacity;
+}
+
+void ms_ring_bufferizer_init(MSRingBufferizer *obj, size_t initial_size){
+	memset(obj, 0, sizeof(*obj));
+	obj->capacity = ring_size_for(initial_size ? initial_size : MS_RING_BUFFERIZER_DEFAULT_SIZE);
+	obj->buffer = (uint8_t *)ms_malloc(obj->capacity * 2);
+	obj->metas_capacity = MS_RING_BUFFERIZER_INITIAL_METAS;
+	obj->metas = ms_new0(MSRingBufferizerMetas, obj->metas_capacity);
+}
+
+MSRingBufferizer * ms_ring_bufferizer_new(size_t initial_size){
+	MSRingBufferizer *obj = (MSRingBufferizer *)ms_new0(MSRingBufferizer, 1);
+	ms_ring_bufferizer_init(obj, initial_size);
+	return obj;
+}
+
+/*copy len bytes into the ring, starting at stream position pos*/
+static void ring_copy_in(uint8_t *buffer, size_t capacity, uint64_t pos, const uint8_t *data, size_t len){
+	size_t offset = (size_t)(pos & (capacity - 1));
+	size_t first = MIN(len, capacity - offset);
+	memcpy(buffer + offset, data, first);
+	if (first < len) memcpy(buffer, data + first, len - first);
+}
+
+/*get a pointer on the len bytes at the read position, mirroring the wrapped part after the end of the ring*/
+static uint8_t *ring_contiguous(MSRingBufferizer *obj, size_t len){
+	size_t offset = (size_t)(obj->read_pos & (obj->capacity - 1));
+	if (offset + len > obj->capacity){
+		memcpy(obj->buffer + obj->capacity, obj->buffer, offset + len - obj->capacity);
+	}
+	return obj->buffer + offset;
+}
+
+static void ring_grow(MSRingBufferizer *obj, size_t needed){
+	size_t avail = ms_ring_bufferizer_get_avail(obj);
+	size_t capacity = ring_size_for(needed);
+	uint8_t *buffer = (uint8_t *)ms_malloc(capacity * 2);
+	if (avail > 0) ring_copy_in(buffer, capacity, obj->read_pos, ring_contiguous(obj, avail), avail);
+	ms_free(obj->buffer);
+	obj->buffer = buffer;
+	obj->capacity = capacity;
+}
+
+/*forget the metas of blocks entirely consumed*/
+static void ring_prune_metas(MSRingBufferizer *obj){
+	while (obj->metas_count > 1 && obj->metas[(obj->metas_first + 1) & (obj->metas_capacity - 1)].pos <= obj->read_pos){
+		obj->metas_first = (obj->metas_first + 1) & (obj->metas_capacity - 1);
+		obj->metas_count--;
+	}
+}
+
+/*the metas of every buffered block are kept, so that the ones of the bytes being read are always known*/
+static void ring_grow_metas(MSRingBufferizer *obj){
+	MSRingBufferizerMetas *metas = ms_new0(MSRingBufferizerMetas, obj->metas_capacity * 2);
+	int i;
+	for (i = 0; i < obj->metas_count; i++){
+		metas[i] = obj->metas[(obj->metas_first + i) & (obj->metas_capacity - 1)];
+	}
+	ms_free(obj->metas);
+	obj->metas = metas;
+	obj->metas_capacity *= 2;
+	obj->metas_first = 0;
+}
+
+static void ring_push_metas(MSRingBufferizer *obj, const mblk_t *m){
+	MSRingBufferizerMetas *metas;
+	ring_prune_metas(obj);
+	if (obj->metas_count == obj->metas_capacity) ring_grow_metas(obj);
+	metas = &obj->metas[(obj->metas_first + obj->metas_count) & (obj->metas_capacity - 1)];
+	metas->pos = obj->write_pos;
+#if defined(ORTP_TIMESTAMP)
+	metas->timestamp = m->timestamp;
+#endif
+	metas->ttl_or_hl = m->ttl_or_hl;
+	obj->metas_count++;
+}
+
+/*select the metas of the block holding the byte at the read position, as ms_bufferizer_read() does*/
+static void ring_update_current_metas(MSRingBufferizer *obj){
+	ring_prune_metas(obj);
+	if (obj->metas_count > 0) obj->current_metas = obj->metas[obj->metas_first];
+}
+
+void ms_ring_bufferizer_put_copy(MSRingBufferizer *obj, const mblk_t *m){
+	const mblk_t *it;
+	size_t size = msgdsize(m);
+
+	if (size == 0) return;
+	if (ms_ring_bufferizer_get_avail(obj) + size > obj->capacity){
+		ring_grow(obj, ms_ring_bufferizer_get_avail(obj) + size);
+	}
+	ring_push_metas(obj, m);
+	for (it = m; it != NULL; it = it->b_cont){
+		size_t len = (size_t)(it->b_wptr - it->b_rptr);
+		ring_copy_in(obj->buffer, obj->capacity, obj->write_pos, it->b_rptr, len);
+		obj->write_pos += len;
+	}
+}
+
+void ms_ring_bufferizer_put(MSRingBufferizer *obj, mblk_t *m){
+	ms_ring_bufferizer_put_copy(obj, m);
+	freemsg(m);
+}
+
+void ms_ring_bufferizer_put_from_queue(MSRingBufferizer *obj, MSQueue *q){
+	mblk_t *m;
+	while((m=ms_queue_get(q))!=NULL){
+		ms_ring_bufferizer_put(obj,m);
+	}
+}
+
+uint8_t * ms_ring_bufferizer_peek(MSRingBufferizer *obj, size_t datalen){
+	if (datalen == 0 || ms_ring_bufferizer_get_avail(obj) < datalen) return NULL;
+	ring_update_current_metas(obj);
+	return ring_contiguous(obj, datalen);
+}
+
+void ms_ring_bufferizer_consume(MSRingBufferizer *obj, size_t datalen){
+	ring_update_current_metas(obj);
+	obj->read_pos += MIN(datalen, ms_ring_bufferizer_get_avail(obj));
+}
+
+size_t ms_ring_bufferizer_read(MSRingBufferizer *obj, uint8_t *data, size_t datalen){
+	size_t offset, first;
+
+	if (datalen == 0 || ms_ring_bufferizer_get_avail(obj) < datalen) return 0;
+	if (data){
+		offset = (size_t)(obj->read_pos & (obj->capacity - 1));
+		first = MIN(datalen, obj->capacity - offset);
+		memcpy(data, obj->buffer + offset, first);
+		if (first < datalen) memcpy(data + first, obj->buffer, datalen - first);
+	}
+	ms_ring_bufferizer_consume(obj, datalen);
+	return datalen;
+}
+
+void ms_ring_bufferizer_fill_current_metas(MSRingBufferizer *obj, mblk_t *dest){
+#if defined(ORTP_TIMESTAMP)
+	dest->timestamp = obj->current_metas.timestamp;
+#endif
+	dest->ttl_or_hl = obj->current_metas.ttl_or_hl;
+}
+
+void ms_ring_bufferizer_flush(MSRingBufferizer *obj){
+	obj->read_pos = obj->write_pos;
+	obj->metas_count = 0;
+}
+
+void ms_ring_bufferizer_uninit(MSRingBufferizer *obj){
+	ms_free(obj->buffer);
+	obj->buffer = NULL;
+	ms_free(obj->metas);
+	obj->metas = NULL;
+}
+
+void ms_ring_bufferizer_destroy(MSRingBufferizer *obj){
+	ms_ring_bufferizer_uninit(obj);
+	ms_free(obj);
+}
+
+
 static const uint32_t flow_control_interval_ms = 5000;
 static const uint32_t max_size_ms = 100;
 
@@ -18,6 +18,8 @@
  */
 
 #include "mediastreamer2/msticker.h"
+#include "mediastreamer2/msprofile.h"
+#include "mediastreamer2/mstrace.h"
 
 #ifndef _WIN32
 #include <sys/time.h>
@@ -46,6 +48,30 @@ static void * ms_ticker_run(void *s);
 static uint64_t get_cur_time_ms(void *);
 static int wait_next_tick(void *, uint64_t virt_ticker_time);
 static void remove_tasks_for_filter(MSTicker *ticker, MSFilter *f);
+static void ms_ticker_workers_destroy(MSTicker *ticker);
+static int set_high_prio(MSTicker *obj);
+static void unset_high_prio(int precision);
+
+struct _MSTickerWorker{
+	MSTicker *ticker;
+	ms_thread_t thread;
+	unsigned long thread_id;
+};
+
+typedef struct _MSTickerWorker MSTickerWorker;
+
+struct _MSTickerWorkers{
+	ms_mutex_t lock;
+	ms_cond_t cond; /* signaled when subgraphs are available for processing */
+	ms_cond_t done_cond; /* signaled when the last subgraph of a tick has been processed */
+	MSTickerWorker *threads;
+	int nthreads;
+	bctbx_list_t *pending; /* next subgraph to be processed during the current tick */
+	int busy; /* number of subgraphs being processed */
+	bool_t running;
+};
+
+typedef struct _MSTickerWorkers MSTickerWorkers;
 
 static void ms_ticker_start(MSTicker *s){
 	s->run=TRUE;
@@ -56,6 +82,7 @@ static void ms_ticker_init(MSTicker *ticker, const MSTickerParams *params)
 {
 	ms_mutex_init(&ticker->lock,NULL);
 	ms_mutex_init(&ticker->cur_time_lock, NULL);
+	ms_mutex_init(&ticker->task_lock, NULL);
 	ticker->execution_list=NULL;
 	ticker->task_list=NULL;
 	ticker->ticks=1;
@@ -73,6 +100,13 @@ static void ms_ticker_init(MSTicker *ticker, const MSTickerParams *params)
 	ticker->late_event.lateMs = 0;
 	ticker->late_event.time = 0;
 	ticker->late_event.current_late_ms = 0;
+	ticker->components=NULL;
+	ticker->components_changed=FALSE;
+	ticker->workers=NULL;
+	ticker->measure_filters=FALSE;
+	ticker->profiling=FALSE;
+	ticker->overruns=0;
+	ticker->tick_latency=NULL;
 	ms_ticker_start(ticker);
 }
 
@@ -111,9 +145,13 @@ void ms_ticker_set_priority(MSTicker *ticker, MSTickerPrio prio){
 static void ms_ticker_uninit(MSTicker *ticker)
 {
 	ms_ticker_stop(ticker);
+	ms_ticker_workers_destroy(ticker);
+	bctbx_list_free_with_data(ticker->components,(void (*)(void*))bctbx_list_free);
 	ms_free(ticker->name);
+	if (ticker->tick_latency) ms_free(ticker->tick_latency);
 	ms_mutex_destroy(&ticker->lock);
 	ms_mutex_destroy(&ticker->cur_time_lock);
+	ms_mutex_destroy(&ticker->task_lock);
 }
 
 void ms_ticker_destroy(MSTicker *ticker){
@@ -176,6 +214,7 @@ int ms_ticker_attach_multiple(MSTicker *ticker,MSFilter *f,...)
 	if (total_sources){
 		ms_mutex_lock(&ticker->lock);
 		ticker->execution_list=bctbx_list_concat(ticker->execution_list,total_sources);
+		ticker->components_changed=TRUE;
 		ms_mutex_unlock(&ticker->lock);
 	}
 	return 0;
@@ -216,6 +255,7 @@ int ms_ticker_detach(MSTicker *ticker, MSFilter *f){
 	for(it=sources;it!=NULL;it=bctbx_list_next(it)){
 		ticker->execution_list=bctbx_list_remove(ticker->execution_list,it->data);
 	}
+	ticker->components_changed=TRUE;
 	ms_mutex_unlock(&ticker->lock);
 	bctbx_list_for_each(filters,(void (*)(void*))call_postprocess);
 	bctbx_list_free(filters);
@@ -223,6 +263,56 @@ int ms_ticker_detach(MSTicker *ticker, MSFilter *f){
 	return 0;
 }
 
+int ms_ticker_move_graph(MSTicker *from, MSTicker *to, MSFilter *f){
+	bctbx_list_t *sources=NULL;
+	bctbx_list_t *filters=NULL;
+	bctbx_list_t *it,*next;
+	MSTicker *first,*second;
+
+	if (f->ticker!=from){
+		ms_error("ms_ticker_move_graph(): filter %s:%p is not scheduled by MSTicker %p.",f->desc->name,f,from);
+		return -1;
+	}
+	if (from==to) return 0;
+	/*always lock the tickers in the same order to avoid deadlocks between concurrent moves*/
+	first=(from<to) ? from : to;
+	second=(from<to) ? to : from;
+	ms_mutex_lock(&first->lock);
+	ms_mutex_lock(&second->lock);
+
+	filters=ms_filter_find_neighbours(f);
+	sources=get_sources(filters);
+	for(it=sources;it!=NULL;it=it->next){
+		from->execution_list=bctbx_list_remove(from->execution_list,it->data);
+	}
+	to->execution_list=bctbx_list_concat(to->execution_list,sources);
+	for(it=filters;it!=NULL;it=it->next){
+		MSFilter *filter=(MSFilter*)it->data;
+		filter->ticker=to;
+		/*the tick counters of the two tickers are unrelated*/
+		filter->last_tick=0;
+	}
+	/*postponed tasks follow their filter*/
+	ms_mutex_lock(&first->task_lock);
+	ms_mutex_lock(&second->task_lock);
+	for(it=from->task_list;it!=NULL;it=next){
+		MSFilterTask *t=(MSFilterTask*)it->data;
+		next=it->next;
+		if (bctbx_list_find(filters,t->f)!=NULL){
+			from->task_list=bctbx_list_erase_link(from->task_list,it);
+			to->task_list=bctbx_list_prepend(to->task_list,t);
+		}
+	}
+	ms_mutex_unlock(&second->task_lock);
+	ms_mutex_unlock(&first->task_lock);
+	from->components_changed=TRUE;
+	to->components_changed=TRUE;
+
+	ms_mutex_unlock(&second->lock);
+	ms_mutex_unlock(&first->lock);
+	bctbx_list_free(filters);
+	return 0;
+}
 
 static bool_t filter_can_process(MSFilter *f, uint32_t tick){
 	/* look if filters before this one have run */
@@ -306,6 +396,7 @@ static void run_tasks(MSTicker *ticker){
 
 static void remove_tasks_for_filter(MSTicker *ticker, MSFilter *f){
 	bctbx_list_t *elem,*nextelem;
+	ms_mutex_lock(&ticker->task_lock);
 	for (elem=ticker->task_list;elem!=NULL;elem=nextelem){
 		MSFilterTask *t=(MSFilterTask*)elem->data;
 		nextelem=elem->next;
@@ -314,6 +405,157 @@ static void remove_tasks_for_filter(MSTicker *ticker, MSFilter *f){
 			ms_free(t);
 		}
 	}
+	ms_mutex_unlock(&ticker->task_lock);
+}
+
+/*
+ * Partition the execution list into lists of sources that belong to the same connected subgraph.
+ * Such subgraphs share no queue, so that they can be run concurrently.
+ */
+static void update_components(MSTicker *s){
+	bctbx_list_t *remaining=bctbx_list_copy(s->execution_list);
+
+	bctbx_list_free_with_data(s->components,(void (*)(void*))bctbx_list_free);
+	s->components=NULL;
+	while(remaining!=NULL){
+		bctbx_list_t *filters=ms_filter_find_neighbours((MSFilter*)remaining->data);
+		bctbx_list_t *component=NULL;
+		bctbx_list_t *it,*next;
+		/* keep the order of the execution list among the sources of a subgraph */
+		for(it=remaining;it!=NULL;it=next){
+			next=it->next;
+			if (bctbx_list_find(filters,it->data)!=NULL){
+				component=bctbx_list_append(component,it->data);
+				remaining=bctbx_list_erase_link(remaining,it);
+			}
+		}
+		bctbx_list_free(filters);
+		s->components=bctbx_list_append(s->components,component);
+	}
+	s->components_changed=FALSE;
+	ms_message("%s: %i independent graphs to be run by %i threads.",s->name,(int)bctbx_list_size(s->components),
+		s->workers->nthreads+1);
+}
+
+/*must be called with workers->lock held*/
+static void run_pending_components(MSTicker *s, MSTickerWorkers *w){
+	while(w->pending!=NULL){
+		bctbx_list_t *sources=(bctbx_list_t*)w->pending->data;
+		w->pending=w->pending->next;
+		w->busy++;
+		ms_mutex_unlock(&w->lock);
+		run_graphs(s,sources,FALSE);
+		ms_mutex_lock(&w->lock);
+		w->busy--;
+	}
+}
+
+static void *ms_ticker_worker_run(void *arg){
+	MSTickerWorker *worker=(MSTickerWorker*)arg;
+	MSTicker *s=worker->ticker;
+	MSTickerWorkers *w=s->workers;
+	int precision=set_high_prio(s);
+
+	ms_mutex_lock(&w->lock);
+	worker->thread_id=ms_thread_self();
+	while(w->running){
+		if (w->pending!=NULL){
+			run_pending_components(s,w);
+			if (w->busy==0) ms_cond_signal(&w->done_cond);
+		}else{
+			ms_cond_wait(&w->cond,&w->lock);
+		}
+	}
+	ms_mutex_unlock(&w->lock);
+	unset_high_prio(precision);
+	return NULL;
+}
+
+/*
+ * Run the independent subgraphs using the worker threads. The ticker thread takes its share of the work,
+ * then waits for the workers to complete, so that the tick ends only when all graphs have been processed.
+ */
+static void run_components(MSTicker *s){
+	MSTickerWorkers *w=s->workers;
+
+	if (s->components_changed) update_components(s);
+	ms_mutex_lock(&w->lock);
+	w->pending=s->components;
+	ms_cond_broadcast(&w->cond);
+	run_pending_components(s,w);
+	while(w->busy>0){
+		ms_cond_wait(&w->done_cond,&w->lock);
+	}
+	ms_mutex_unlock(&w->lock);
+}
+
+static void ms_ticker_workers_create(MSTicker *ticker, int nthreads){
+	MSTickerWorkers *w=ms_new0(MSTickerWorkers,1);
+	int i;
+
+	ms_mutex_init(&w->lock,NULL);
+	ms_cond_init(&w->cond,NULL);
+	ms_cond_init(&w->done_cond,NULL);
+	w->nthreads=nthreads;
+	w->threads=ms_new0(MSTickerWorker,nthreads);
+	w->running=TRUE;
+	ticker->workers=w;
+	ticker->components_changed=TRUE;
+	for(i=0;i<nthreads;i++){
+		w->threads[i].ticker=ticker;
+		ms_thread_create(&w->threads[i].thread,NULL,ms_ticker_worker_run,&w->threads[i]);
+	}
+}
+
+static void ms_ticker_workers_destroy(MSTicker *ticker){
+	MSTickerWorkers *w=ticker->workers;
+	int i;
+
+	if (w==NULL) return;
+	ms_mutex_lock(&w->lock);
+	w->running=FALSE;
+	ms_cond_broadcast(&w->cond);
+	ms_mutex_unlock(&w->lock);
+	for(i=0;i<w->nthreads;i++){
+		ms_thread_join(w->threads[i].thread,NULL);
+	}
+	ticker->workers=NULL;
+	ms_free(w->threads);
+	ms_mutex_destroy(&w->lock);
+	ms_cond_destroy(&w->cond);
+	ms_cond_destroy(&w->done_cond);
+	ms_free(w);
+}
+
+static bool_t ms_ticker_is_worker_thread(MSTicker *ticker){
+	MSTickerWorkers *w=ticker->workers;
+	unsigned long self;
+	int i;
+
+	if (w==NULL) return FALSE;
+	self=ms_thread_self();
+	for(i=0;i<w->nthreads;i++){
+		if (w->threads[i].thread_id==self) return TRUE;
+	}
+	return FALSE;
+}
+
+void ms_ticker_set_thread_count(MSTicker *ticker, int nthreads){
+	/*taking the main lock guarantees that no tick is being processed*/
+	ms_mutex_lock(&ticker->lock);
+	ms_ticker_workers_destroy(ticker);
+	if (nthreads>1){
+		ms_ticker_workers_create(ticker,nthreads-1);
+	}else{
+		bctbx_list_free_with_data(ticker->components,(void (*)(void*))bctbx_list_free);
+		ticker->components=NULL;
+	}
+	ms_mutex_unlock(&ticker->lock);
+	ms_message("%s: graphs will be run by %i thread(s).",ticker->name,nthreads>1 ? nthreads : 1);
+}
+
+int ms_ticker_get_thread_count(MSTicker *ticker){
+	return ticker->workers ? ticker->workers->nthreads+1 : 1;
 }
 
 static uint64_t get_cur_time_ms(void *unused){
@@ -453,16 +695,25 @@ void * ms_ticker_run(void *arg)
 		s->ticks++;
 		/*Step 1: run the graphs*/
 		{
-#if TICKER_MEASUREMENTS
 			MSTimeSpec begin,end;/*used to measure time spent in processing one tick*/
+			uint64_t elapsed_ns;
+#if TICKER_MEASUREMENTS
 			double iload;
+#endif
 
 			ms_get_cur_time(&begin);
-#endif
 			run_tasks(s);
-			run_graphs(s,s->execution_list,FALSE);
-#if TICKER_MEASUREMENTS
+			if (s->workers) run_components(s);
+			else run_graphs(s,s->execution_list,FALSE);
 			ms_get_cur_time(&end);
+			elapsed_ns=(end.tv_sec-begin.tv_sec)*1000000000LL + (end.tv_nsec-begin.tv_nsec);
+			if (elapsed_ns>(uint64_t)s->interval*1000000) s->overruns++;
+			if (s->profiling){
+				if (s->tick_latency==NULL) s->tick_latency=ms_new0(MSLatencyHistogram,1);
+				ms_latency_histogram_add_value(s->tick_latency,elapsed_ns);
+			}
+			ms_trace_record(s,MSTraceEventTick,"tick",s,s->ticks,&begin,&end);
+#if TICKER_MEASUREMENTS
 			iload=100*((end.tv_sec-begin.tv_sec)*1000.0 + (end.tv_nsec-begin.tv_nsec)/1000000.0)/(double)s->interval;
 			s->av_load=(smooth_coef*s->av_load)+((1.0-smooth_coef)*iload);
 #endif
@@ -581,12 +832,225 @@ float ms_ticker_get_average_load(MSTicker *ticker){
 }
 
 void ms_ticker_get_last_late_tick(MSTicker *ticker, MSTickerLateEvent *ev){
-	bool_t need_lock = ms_thread_self() != ticker->thread_id;
+	/*worker threads run filters while the ticker thread holds the lock*/
+	bool_t need_lock = ms_thread_self() != ticker->thread_id && !ms_ticker_is_worker_thread(ticker);
 	if (need_lock) ms_mutex_lock(&ticker->lock);
 	memcpy(ev,&ticker->late_event,sizeof(MSTickerLateEvent));
 	if (need_lock) ms_mutex_unlock(&ticker->lock);
 }
 
+void ms_ticker_enable_profiling(MSTicker *ticker, bool_t enabled){
+	/*measure_filters is owned by the MSTickerPool, which needs the measurements whatever the profiling*/
+	ticker->profiling=enabled;
+}
+
+uint64_t ms_ticker_get_overrun_count(MSTicker *ticker){
+	return ticker->overruns;
+}
+
+/*returns the filters of all graphs of the ticker, must be called with the ticker lock held*/
+static bctbx_list_t *ms_ticker_get_filters(MSTicker *ticker){
+	bctbx_list_t *filters=NULL;
+	bctbx_list_t *it,*elem;
+	for(it=ticker->execution_list;it!=NULL;it=it->next){
+		bctbx_list_t *neighbours=ms_filter_find_neighbours((MSFilter*)it->data);
+		for(elem=neighbours;elem!=NULL;elem=elem->next){
+			if (bctbx_list_find(filters,elem->data)==NULL) filters=bctbx_list_append(filters,elem->data);
+		}
+		bctbx_list_free(neighbours);
+	}
+	return filters;
+}
+
+void ms_ticker_reset_profile(MSTicker *ticker){
+	bool_t need_lock = ms_thread_self() != ticker->thread_id && !ms_ticker_is_worker_thread(ticker);
+	bctbx_list_t *filters,*it;
+	int i;
+
+	if (need_lock) ms_mutex_lock(&ticker->lock);
+	ticker->overruns=0;
+	if (ticker->tick_latency) ms_latency_histogram_reset(ticker->tick_latency);
+	filters=ms_ticker_get_filters(ticker);
+	for(it=filters;it!=NULL;it=it->next){
+		MSFilter *f=(MSFilter*)it->data;
+		if (f->latency) ms_latency_histogram_reset(f->latency);
+		for(i=0;i<f->desc->noutputs;i++){
+			if (f->outputs[i]) f->outputs[i]->max_depth=f->outputs[i]->q.q_mcount;
+		}
+	}
+	bctbx_list_free(filters);
+	if (need_lock) ms_mutex_unlock(&ticker->lock);
+}
+
+/*escapes a string so that it can be used in a JSON string or a Prometheus label value*/
+static char *append_escaped(char *out, const char *str){
+	for(;str && *str!='\0';str++){
+		if (*str=='"' || *str=='\\') out=ms_strcat_printf(out,"\\%c",*str);
+		else if (*str=='\n') out=ms_strcat_printf(out,"\\n");
+		else if ((unsigned char)*str>=0x20) out=ms_strcat_printf(out,"%c",*str);
+	}
+	return out;
+}
+
+static char *append_json_histogram(char *out, const MSLatencyHistogram *h){
+	static const MSLatencyHistogram empty={{0}};
+	if (h==NULL) h=&empty;
+	return ms_strcat_printf(out,"{\"count\":%llu,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}",
+		(unsigned long long)h->count,
+		(unsigned long long)ms_latency_histogram_get_percentile(h,50),
+		(unsigned long long)ms_latency_histogram_get_percentile(h,99),
+		(unsigned long long)ms_latency_histogram_get_percentile(h,99.9),
+		(unsigned long long)h->max);
+}
+
+static char *ms_ticker_profile_to_json(MSTicker *ticker, bctbx_list_t *filters){
+	char *out=ms_strdup("{\"ticker\":\"");
+	bctbx_list_t *it;
+	int i;
+
+	out=append_escaped(out,ticker->name);
+	out=ms_strcat_printf(out,"\",\"interval_ms\":%i,\"ticks\":%u,\"overruns\":%llu,\"late_ms\":%i,\"tick\":",
+		ticker->interval,ticker->ticks,(unsigned long long)ticker->overruns,ticker->late_event.current_late_ms);
+	out=append_json_histogram(out,ticker->tick_latency);
+	out=ms_strcat_printf(out,",\"filters\":[");
+	for(it=filters;it!=NULL;it=it->next){
+		MSFilter *f=(MSFilter*)it->data;
+		bool_t first=TRUE;
+		out=ms_strcat_printf(out,"%s{\"name\":\"%s\",\"instance\":\"%p\",\"process\":",it==filters ? "" : ",",f->desc->name,f);
+		out=append_json_histogram(out,f->latency);
+		out=ms_strcat_printf(out,",\"outputs\":[");
+		for(i=0;i<f->desc->noutputs;i++){
+			MSQueue *q=f->outputs[i];
+			if (q==NULL) continue;
+			out=ms_strcat_printf(out,"%s{\"pin\":%i,\"depth\":%i,\"max_depth\":%i}",first ? "" : ",",i,q->q.q_mcount,q->max_depth);
+			first=FALSE;
+		}
+		out=ms_strcat_printf(out,"]}");
+	}
+	return ms_strcat_printf(out,"]}");
+}
+
+/*the metric families of the Prometheus export, each one being declared once per scrape whatever the number of tickers*/
+enum{
+	PrometheusTickerOverruns,
+	PrometheusTickerLate,
+	PrometheusTickDuration,
+	PrometheusFilterProcessDuration,
+	PrometheusQueueDepth,
+	PrometheusQueueMaxDepth,
+	PrometheusFamilies
+};
+
+static const char * const prometheus_families[PrometheusFamilies][2]={
+	{"ms_ticker_overruns_total","counter"},
+	{"ms_ticker_late_seconds","gauge"},
+	{"ms_ticker_tick_duration_seconds","summary"},
+	{"ms_filter_process_duration_seconds","summary"},
+	{"ms_queue_depth","gauge"},
+	{"ms_queue_max_depth","gauge"}
+};
+
+static char *append_prometheus_summary(char *out, const char *metric, const char *labels, const MSLatencyHistogram *h){
+	static const double quantiles[]={50,99,99.9};
+	size_t i;
+	for(i=0;i<sizeof(quantiles)/sizeof(quantiles[0]);i++){
+		out=ms_strcat_printf(out,"%s{%s,quantile=\"%g\"} %.9f\n",metric,labels,quantiles[i]/100.0,
+			(double)ms_latency_histogram_get_percentile(h,quantiles[i])*1e-9);
+	}
+	out=ms_strcat_printf(out,"%s_sum{%s} %.9f\n",metric,labels,(double)h->sum*1e-9);
+	return ms_strcat_printf(out,"%s_count{%s} %llu\n",metric,labels,(unsigned long long)h->count);
+}
+
+/*appends the samples of the ticker to the samples of each metric family*/
+static void ms_ticker_profile_to_prometheus(MSTicker *ticker, bctbx_list_t *filters, char *families[PrometheusFamilies]){
+	char *ticker_label=append_escaped(ms_strdup("ticker=\""),ticker->name);
+	bctbx_list_t *it;
+	int i;
+
+	ticker_label=ms_strcat_printf(ticker_label,"\"");
+	families[PrometheusTickerOverruns]=ms_strcat_printf(families[PrometheusTickerOverruns],"ms_ticker_overruns_total{%s} %llu\n",
+		ticker_label,(unsigned long long)ticker->overruns);
+	families[PrometheusTickerLate]=ms_strcat_printf(families[PrometheusTickerLate],"ms_ticker_late_seconds{%s} %.3f\n",
+		ticker_label,ticker->late_event.current_late_ms*1e-3);
+	if (ticker->tick_latency){
+		families[PrometheusTickDuration]=append_prometheus_summary(families[PrometheusTickDuration],
+			"ms_ticker_tick_duration_seconds",ticker_label,ticker->tick_latency);
+	}
+	for(it=filters;it!=NULL;it=it->next){
+		MSFilter *f=(MSFilter*)it->data;
+		if (f->latency){
+			char *labels=ms_strdup_printf("%s,filter=\"%s\",instance=\"%p\"",ticker_label,f->desc->name,f);
+			families[PrometheusFilterProcessDuration]=append_prometheus_summary(families[PrometheusFilterProcessDuration],
+				"ms_filter_process_duration_seconds",labels,f->latency);
+			ms_free(labels);
+		}
+		for(i=0;i<f->desc->noutputs;i++){
+			if (f->outputs[i]==NULL) continue;
+			families[PrometheusQueueDepth]=ms_strcat_printf(families[PrometheusQueueDepth],
+				"ms_queue_depth{%s,filter=\"%s\",instance=\"%p\",pin=\"%i\"} %i\n",
+				ticker_label,f->desc->name,f,i,f->outputs[i]->q.q_mcount);
+			families[PrometheusQueueMaxDepth]=ms_strcat_printf(families[PrometheusQueueMaxDepth],
+				"ms_queue_max_depth{%s,filter=\"%s\",instance=\"%p\",pin=\"%i\"} %i\n",
+				ticker_label,f->desc->name,f,i,f->outputs[i]->max_depth);
+		}
+	}
+	ms_free(ticker_label);
+}
+
+/*takes the snapshot of one ticker, between two ticks. For the Prometheus format, the samples are appended to families and NULL is returned*/
+static char *ms_ticker_take_profile(MSTicker *ticker, MSProfileFormat format, char *families[PrometheusFamilies]){
+	bool_t need_lock = ms_thread_self() != ticker->thread_id && !ms_ticker_is_worker_thread(ticker);
+	bctbx_list_t *filters;
+	char *ret=NULL;
+
+	if (need_lock) ms_mutex_lock(&ticker->lock);
+	filters=ms_ticker_get_filters(ticker);
+	if (format==MSProfileFormatPrometheus) ms_ticker_profile_to_prometheus(ticker,filters,families);
+	else ret=ms_ticker_profile_to_json(ticker,filters);
+	bctbx_list_free(filters);
+	if (need_lock) ms_mutex_unlock(&ticker->lock);
+	return ret;
+}
+
+char *ms_tickers_get_profile(const MSList *tickers, MSProfileFormat format){
+	const MSList *it;
+	char *out;
+
+	if (format==MSProfileFormatPrometheus){
+		char *families[PrometheusFamilies];
+		int i;
+		for(i=0;i<PrometheusFamilies;i++) families[i]=ms_strdup("");
+		for(it=tickers;it!=NULL;it=it->next){
+			ms_ticker_take_profile((MSTicker*)it->data,format,families);
+		}
+		out=ms_strdup("");
+		for(i=0;i<PrometheusFamilies;i++){
+			if (families[i][0]!='\0'){
+				out=ms_strcat_printf(out,"# TYPE %s %s\n%s",prometheus_families[i][0],prometheus_families[i][1],families[i]);
+			}
+			ms_free(families[i]);
+		}
+		return out;
+	}
+	out=ms_strdup("[");
+	for(it=tickers;it!=NULL;it=it->next){
+		char *profile=ms_ticker_take_profile((MSTicker*)it->data,format,NULL);
+		out=ms_strcat_printf(out,"%s%s",it==tickers ? "" : ",",profile);
+		ms_free(profile);
+	}
+	return ms_strcat_printf(out,"]");
+}
+
+char *ms_ticker_get_profile(MSTicker *ticker, MSProfileFormat format){
+	char *ret;
+	if (format==MSProfileFormatPrometheus){
+		MSList *tickers=bctbx_list_append(NULL,ticker);
+		ret=ms_tickers_get_profile(tickers,format);
+		bctbx_list_free(tickers);
+	}else ret=ms_ticker_take_profile(ticker,format,NULL);
+	return ret;
+}
+
 static void ms_ticker_synchronizer_reset(MSTickerSynchronizer* ts){
 	memset(ts, 0, sizeof(*ts));
 }
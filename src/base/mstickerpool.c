@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mediastreamer2/mstickerpool.h"
+
+#define BALANCE_INTERVAL 1000 /* interval between two load balancing passes, in milliseconds */
+#define BALANCER_SLEEP 100 /* granularity of the balancer thread's sleep, in milliseconds */
+#define DEFAULT_MAX_LOAD 80.0f
+#define MIN_LOAD_DIFFERENCE 20.0f /* do not move graphs between tickers whose loads are close */
+#define DEFAULT_GRAPH_LOAD 1.0f /* estimated load of a graph, before any measurement */
+
+typedef struct _MSTickerPoolGraph{
+	MSFilter *f; /* the filter given to ms_ticker_pool_attach() */
+	MSTicker *ticker;
+	uint64_t last_process_time;
+	float load; /* load of the graph on its ticker, in percent */
+}MSTickerPoolGraph;
+
+struct _MSTickerPool{
+	ms_mutex_t lock;
+	MSTicker **tickers;
+	float *added_load; /* estimated load of the graphs attached since the last balancing pass, per ticker */
+	int nb_tickers;
+	bctbx_list_t *graphs;
+	ms_thread_t balancer;
+	uint64_t last_balance_time;
+	float max_load;
+	bool_t running;
+};
+
+static uint64_t graph_process_time(MSFilter *f){
+	bctbx_list_t *filters=ms_filter_find_neighbours(f);
+	bctbx_list_t *it;
+	uint64_t total=0;
+	for(it=filters;it!=NULL;it=it->next){
+		total+=((MSFilter*)it->data)->process_time;
+	}
+	bctbx_list_free(filters);
+	return total;
+}
+
+/*must be called with pool->lock held*/
+static void update_graph_loads(MSTickerPool *pool, uint64_t elapsed_ms){
+	bctbx_list_t *it;
+	for(it=pool->graphs;it!=NULL;it=it->next){
+		MSTickerPoolGraph *g=(MSTickerPoolGraph*)it->data;
+		uint64_t process_time;
+		/*the ticker lock guarantees that the graph is neither processed nor traversed meanwhile*/
+		ms_mutex_lock(&g->ticker->lock);
+		process_time=graph_process_time(g->f);
+		ms_mutex_unlock(&g->ticker->lock);
+		if (elapsed_ms>0){
+			g->load=(float)(100.0*(double)(process_time-g->last_process_time)/(elapsed_ms*1000000.0));
+		}
+		g->last_process_time=process_time;
+	}
+}
+
+static float average_graph_load(MSTickerPool *pool){
+	bctbx_list_t *it;
+	float total=0;
+	int count=0;
+	for(it=pool->graphs;it!=NULL;it=it->next){
+		MSTickerPoolGraph *g=(MSTickerPoolGraph*)it->data;
+		if (g->load>0){
+			total+=g->load;
+			count++;
+		}
+	}
+	return count>0 ? total/(float)count : DEFAULT_GRAPH_LOAD;
+}
+
+static int least_loaded_ticker(MSTickerPool *pool){
+	int i,best=0;
+	float best_load=0;
+	for(i=0;i<pool->nb_tickers;i++){
+		float load=ms_ticker_get_average_load(pool->tickers[i])+pool->added_load[i];
+		if (i==0 || load<best_load){
+			best=i;
+			best_load=load;
+		}
+	}
+	return best;
+}
+
+/*
+ * Move one graph from the most loaded ticker to the least loaded one, if the former is overloaded.
+ * The graph chosen is the heaviest one that does not make the destination more loaded than the source.
+ */
+static void balance(MSTickerPool *pool){
+	bctbx_list_t *it;
+	MSTickerPoolGraph *candidate=NULL;
+	float busiest_load=0,idlest_load=0;
+	int i,busiest=0,idlest=0;
+	uint64_t now=ms_get_cur_time_ms();
+
+	ms_mutex_lock(&pool->lock);
+	update_graph_loads(pool,now-pool->last_balance_time);
+	pool->last_balance_time=now;
+	for(i=0;i<pool->nb_tickers;i++){
+		float load=ms_ticker_get_average_load(pool->tickers[i]);
+		pool->added_load[i]=0;
+		if (i==0 || load>busiest_load){
+			busiest=i;
+			busiest_load=load;
+		}
+		if (i==0 || load<idlest_load){
+			idlest=i;
+			idlest_load=load;
+		}
+	}
+	if (busiest_load>pool->max_load && busiest_load-idlest_load>MIN_LOAD_DIFFERENCE){
+		for(it=pool->graphs;it!=NULL;it=it->next){
+			MSTickerPoolGraph *g=(MSTickerPoolGraph*)it->data;
+			if (g->ticker!=pool->tickers[busiest]) continue;
+			if (g->load>(busiest_load-idlest_load)/2) continue;
+			if (candidate==NULL || g->load>candidate->load) candidate=g;
+		}
+		if (candidate){
+			ms_message("MSTickerPool [%p]: moving graph of %s:%p (load %f) from %s (load %f) to %s (load %f)",pool,
+				candidate->f->desc->name,candidate->f,candidate->load,pool->tickers[busiest]->name,busiest_load,
+				pool->tickers[idlest]->name,idlest_load);
+			if (ms_ticker_move_graph(pool->tickers[busiest],pool->tickers[idlest],candidate->f)==0){
+				candidate->ticker=pool->tickers[idlest];
+			}
+		}
+	}
+	ms_mutex_unlock(&pool->lock);
+}
+
+static void *ms_ticker_pool_balancer_run(void *arg){
+	MSTickerPool *pool=(MSTickerPool*)arg;
+	uint64_t elapsed=0;
+
+	while(pool->running){
+		ms_usleep(BALANCER_SLEEP*1000);
+		elapsed+=BALANCER_SLEEP;
+		if (elapsed>=BALANCE_INTERVAL){
+			balance(pool);
+			elapsed=0;
+		}
+	}
+	return NULL;
+}
+
+MSTickerPool *ms_ticker_pool_new(int nb_tickers, const MSTickerParams *params){
+	MSTickerPool *pool=ms_new0(MSTickerPool,1);
+	int i;
+
+	if (nb_tickers<1) nb_tickers=1;
+	ms_mutex_init(&pool->lock,NULL);
+	pool->nb_tickers=nb_tickers;
+	pool->tickers=ms_new0(MSTicker*,nb_tickers);
+	pool->added_load=ms_new0(float,nb_tickers);
+	pool->max_load=DEFAULT_MAX_LOAD;
+	for(i=0;i<nb_tickers;i++){
+		MSTickerParams tparams=*params;
+		char *name=ms_strdup_printf("%s-%i",params->name ? params->name : "MSTicker",i);
+		tparams.name=name;
+		pool->tickers[i]=ms_ticker_new_with_params(&tparams);
+		pool->tickers[i]->measure_filters=TRUE;
+		ms_free(name);
+	}
+	pool->last_balance_time=ms_get_cur_time_ms();
+	pool->running=TRUE;
+	ms_thread_create(&pool->balancer,NULL,ms_ticker_pool_balancer_run,pool);
+	return pool;
+}
+
+int ms_ticker_pool_attach(MSTickerPool *pool, MSFilter *f){
+	MSTickerPoolGraph *g;
+	int index;
+	int err;
+
+	ms_mutex_lock(&pool->lock);
+	index=least_loaded_ticker(pool);
+	err=ms_ticker_attach(pool->tickers[index],f);
+	if (err==0){
+		g=ms_new0(MSTickerPoolGraph,1);
+		g->f=f;
+		g->ticker=pool->tickers[index];
+		/*the ticker load is averaged over several ticks: account for this graph until the next balancing pass*/
+		pool->added_load[index]+=average_graph_load(pool);
+		pool->graphs=bctbx_list_append(pool->graphs,g);
+	}
+	ms_mutex_unlock(&pool->lock);
+	return err;
+}
+
+static MSTickerPoolGraph *find_graph(MSTickerPool *pool, MSFilter *f){
+	bctbx_list_t *it;
+	bctbx_list_t *filters;
+	MSTickerPoolGraph *found=NULL;
+
+	for(it=pool->graphs;it!=NULL;it=it->next){
+		MSTickerPoolGraph *g=(MSTickerPoolGraph*)it->data;
+		if (g->f==f) return g;
+	}
+	/*f may be any filter of the graph*/
+	if (f->ticker==NULL) return NULL;
+	ms_mutex_lock(&f->ticker->lock);
+	filters=ms_filter_find_neighbours(f);
+	ms_mutex_unlock(&f->ticker->lock);
+	for(it=pool->graphs;it!=NULL && found==NULL;it=it->next){
+		MSTickerPoolGraph *g=(MSTickerPoolGraph*)it->data;
+		if (bctbx_list_find(filters,g->f)!=NULL) found=g;
+	}
+	bctbx_list_free(filters);
+	return found;
+}
+
+int ms_ticker_pool_detach(MSTickerPool *pool, MSFilter *f){
+	MSTickerPoolGraph *g;
+	int err;
+
+	ms_mutex_lock(&pool->lock);
+	g=find_graph(pool,f);
+	if (g==NULL){
+		ms_mutex_unlock(&pool->lock);
+		ms_error("ms_ticker_pool_detach(): filter %s:%p is not scheduled by MSTickerPool %p.",f->desc->name,f,pool);
+		return -1;
+	}
+	err=ms_ticker_detach(g->ticker,f);
+	pool->graphs=bctbx_list_remove(pool->graphs,g);
+	ms_free(g);
+	ms_mutex_unlock(&pool->lock);
+	return err;
+}
+
+void ms_ticker_pool_set_max_load(MSTickerPool *pool, float max_load){
+	pool->max_load=max_load;
+}
+
+int ms_ticker_pool_get_size(const MSTickerPool *pool){
+	return pool->nb_tickers;
+}
+
+MSTicker *ms_ticker_pool_get_ticker(const MSTickerPool *pool, int index){
+	if (index<0 || index>=pool->nb_tickers) return NULL;
+	return pool->tickers[index];
+}
+
+void ms_ticker_pool_destroy(MSTickerPool *pool){
+	int i;
+
+	pool->running=FALSE;
+	ms_thread_join(pool->balancer,NULL);
+	if (pool->graphs){
+		ms_error("MSTickerPool [%p] destroyed while %i graphs are still attached.",pool,(int)bctbx_list_size(pool->graphs));
+		bctbx_list_free_with_data(pool->graphs,ms_free);
+	}
+	for(i=0;i<pool->nb_tickers;i++){
+		ms_ticker_destroy(pool->tickers[i]);
+	}
+	ms_free(pool->tickers);
+	ms_free(pool->added_load);
+	ms_mutex_destroy(&pool->lock);
+	ms_free(pool);
+}
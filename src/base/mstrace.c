@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mediastreamer2/mstrace.h"
+#include "msatomic.h"
+
+#define DEFAULT_EVENTS_PER_THREAD 16384
+#define MAX_THREADS 64
+
+typedef struct _MSTraceEvent{
+	uint64_t begin_ns;
+	const char *name;
+	const void *instance;
+	uint32_t duration_ns;
+	uint32_t arg;
+	int type;
+}MSTraceEvent;
+
+/*
+ * The ring buffer of a thread. It has a single writer, the thread itself, that publishes each event by incrementing
+ * write_index. Readers detect the events that were overwritten while they were copied by reading write_index again.
+ * The state packs the recording the ring belongs to and the number of writers holding it: a slot of a previous
+ * recording is reassigned only once no writer holds it, its generation being set to 0 while it is rewritten.
+ */
+typedef struct _MSTraceRing{
+	ms_atomic_uint_t state;
+	ms_atomic_ptr_t thread_id; /*the identity of the ring is read without the lock, see acquire_ring()*/
+	ms_atomic_ptr_t ticker;
+	char name[64];
+	MSTraceEvent *events;
+	uint32_t allocated; /*number of events allocated, kept when the ring is reassigned*/
+	uint32_t mask;
+	ms_atomic_uint_t write_index;
+	bool_t full;
+}MSTraceRing;
+
+#define RING_USERS_MASK 0xffffU
+#define RING_GENERATION(state) ((state)>>16)
+#define RING_STATE(generation,users) (((unsigned int)(generation)<<16)|(users))
+
+typedef struct _MSTraceRecorder{
+	ms_mutex_t lock; /*protects the assignment of rings and the saving of traces*/
+	MSTraceRing rings[MAX_THREADS];
+	ms_atomic_uint_t nrings; /*number of slots ever used, they are reassigned by the following recordings*/
+	ms_atomic_uint_t generation; /*the current recording, never 0*/
+	ms_atomic_uint_t enabled;
+	ms_atomic_uint_t dropped; /*spans of threads that could not get a ring*/
+	uint32_t capacity;
+	uint64_t origin_ns;
+	bool_t started;
+}MSTraceRecorder;
+
+static MSTraceRecorder recorder;
+static ms_once_t recorder_once=MS_ONCE_INIT;
+
+static void recorder_init(void){
+	ms_mutex_init(&recorder.lock,NULL);
+}
+
+static uint64_t time_spec_to_ns(const MSTimeSpec *ts){
+	return (uint64_t)ts->tv_sec*1000000000ULL + (uint64_t)ts->tv_nsec;
+}
+
+static uint32_t round_to_power_of_two(int value){
+	uint32_t ret=1;
+	while (ret<(uint32_t)value && ret<(1U<<30)) ret<<=1;
+	return ret;
+}
+
+void ms_trace_start(int events_per_thread){
+	MSTimeSpec now;
+	unsigned int generation;
+	ms_once(&recorder_once,recorder_init);
+	/*the rings of the previous recording become stale: threads and tickers created since then can get one*/
+	ms_atomic_store(&recorder.enabled,FALSE);
+	ms_mutex_lock(&recorder.lock);
+	generation=(ms_atomic_load(&recorder.generation)+1) & RING_USERS_MASK;
+	ms_atomic_store(&recorder.generation,generation!=0 ? generation : 1);
+	recorder.capacity=round_to_power_of_two(events_per_thread>0 ? events_per_thread : DEFAULT_EVENTS_PER_THREAD);
+	recorder.started=TRUE;
+	ms_get_cur_time(&now);
+	recorder.origin_ns=time_spec_to_ns(&now);
+	ms_atomic_store(&recorder.dropped,0);
+	ms_atomic_store(&recorder.enabled,TRUE);
+	ms_mutex_unlock(&recorder.lock);
+	ms_message("Ticker trace recording started.");
+}
+
+void ms_trace_stop(void){
+	ms_atomic_store(&recorder.enabled,FALSE);
+	ms_message("Ticker trace recording stopped.");
+}
+
+bool_t ms_trace_is_enabled(void){
+	return ms_atomic_load(&recorder.enabled)!=0;
+}
+
+static void release_ring(MSTraceRing *ring){
+	ms_atomic_fetch_add(&ring->state,(unsigned int)-1);
+}
+
+/*
+ * Returns the ring of the thread in the current recording, held by the caller. The identity of a slot is read without
+ * the lock and validated as with a sequence lock: taking the ring fails if its state changed meanwhile.
+ */
+static MSTraceRing *acquire_ring(unsigned int generation, unsigned long thread_id, const MSTicker *ticker){
+	unsigned int i,nrings=ms_atomic_load(&recorder.nrings);
+	/*start from the most recent ring, in case a thread id and a ticker address have been reused*/
+	for(i=nrings;i>0;i--){
+		MSTraceRing *ring=&recorder.rings[i-1];
+		unsigned int state=ms_atomic_load(&ring->state);
+		if (RING_GENERATION(state)!=generation) continue;
+		if (ms_atomic_ptr_load(&ring->thread_id)!=(void *)(uintptr_t)thread_id) continue;
+		if (ms_atomic_ptr_load(&ring->ticker)!=ticker) continue;
+		if (ms_atomic_compare_exchange(&ring->state,state,state+1)) return ring;
+		i++; /*the state changed while the slot was read, read it again*/
+	}
+	return NULL;
+}
+
+/*takes a slot that is not used by the current recording, waiting for the writers that still hold it*/
+static bool_t claim_slot(MSTraceRing *ring, unsigned int generation){
+	for(;;){
+		unsigned int state=ms_atomic_load(&ring->state);
+		if (RING_GENERATION(state)==generation) return FALSE;
+		if ((state & RING_USERS_MASK)!=0){
+			ms_usleep(10);
+			continue;
+		}
+		if (ms_atomic_compare_exchange(&ring->state,state,0)) return TRUE;
+	}
+}
+
+static MSTraceRing *create_ring(unsigned int generation, unsigned long thread_id, MSTicker *ticker){
+	MSTraceRing *ring=NULL;
+	unsigned int i,nrings;
+	char *c;
+
+	ms_mutex_lock(&recorder.lock);
+	if (ms_atomic_load(&recorder.generation)!=generation) goto end;
+	nrings=ms_atomic_load(&recorder.nrings);
+	for(i=0;i<nrings && ring==NULL;i++){
+		if (claim_slot(&recorder.rings[i],generation)) ring=&recorder.rings[i];
+	}
+	if (ring==NULL && nrings<MAX_THREADS) ring=&recorder.rings[nrings];
+	if (ring==NULL) goto end;
+	ms_atomic_ptr_exchange(&ring->thread_id,(void *)(uintptr_t)thread_id);
+	ms_atomic_ptr_exchange(&ring->ticker,ticker);
+	snprintf(ring->name,sizeof(ring->name),"%s",ticker && ticker->name ? ticker->name : "thread");
+	/*the name is written as is in the JSON file*/
+	for(c=ring->name;*c!='\0';c++){
+		if (*c=='"' || *c=='\\' || (unsigned char)*c<0x20) *c='_';
+	}
+	if (ring->allocated<recorder.capacity){
+		/*no writer holds the slot*/
+		if (ring->events) ms_free(ring->events);
+		ring->events=ms_new0(MSTraceEvent,recorder.capacity);
+		ring->allocated=recorder.capacity;
+	}
+	ring->mask=recorder.capacity-1;
+	ms_atomic_store(&ring->write_index,0);
+	ring->full=FALSE;
+	/*publish the ring once it is initialized, held by the caller*/
+	ms_atomic_store(&ring->state,RING_STATE(generation,1));
+	if (ring==&recorder.rings[nrings]) ms_atomic_store(&recorder.nrings,nrings+1);
+end:
+	ms_mutex_unlock(&recorder.lock);
+	return ring;
+}
+
+void ms_trace_record(MSTicker *ticker, MSTraceEventType type, const char *name, const void *instance, uint32_t arg,
+	const MSTimeSpec *begin, const MSTimeSpec *end){
+	unsigned long thread_id;
+	unsigned int generation;
+	MSTraceRing *ring;
+	MSTraceEvent *ev;
+	unsigned int index;
+	uint64_t begin_ns;
+
+	if (!ms_atomic_load(&recorder.enabled)) return;
+	generation=ms_atomic_load(&recorder.generation);
+	thread_id=ms_thread_self();
+	ring=acquire_ring(generation,thread_id,ticker);
+	if (ring==NULL) ring=create_ring(generation,thread_id,ticker);
+	if (ring==NULL){
+		ms_atomic_fetch_add(&recorder.dropped,1);
+		return;
+	}
+	index=ms_atomic_load(&ring->write_index);
+	ev=&ring->events[index & ring->mask];
+	begin_ns=time_spec_to_ns(begin);
+	ev->begin_ns=begin_ns;
+	ev->duration_ns=(uint32_t)(time_spec_to_ns(end)-begin_ns);
+	ev->name=name;
+	ev->instance=instance;
+	ev->arg=arg;
+	ev->type=type;
+	if (index==ring->mask) ring->full=TRUE;
+	ms_atomic_store(&ring->write_index,index+1);
+	release_ring(ring);
+}
+
+static const char *event_category(int type){
+	switch(type){
+		case MSTraceEventTick: return "tick";
+		case MSTraceEventProcess: return "process";
+		case MSTraceEventTask: return "task";
+	}
+	return "unknown";
+}
+
+/*writes the events of a ring still present after they have been copied, returns the number of events written*/
+static int save_ring(FILE *file, MSTraceRing *ring, MSTraceEvent *copy, int tid){
+	uint32_t capacity=ring->mask+1;
+	uint32_t end=ms_atomic_load(&ring->write_index);
+	uint32_t count=ring->full ? capacity : end;
+	uint32_t first=end-count;
+	uint32_t i,valid_from;
+	int written=0;
+
+	for(i=0;i<count;i++){
+		copy[i]=ring->events[(first+i) & ring->mask];
+	}
+	/*events overwritten by the writer during the copy are unreliable*/
+	valid_from=ms_atomic_load(&ring->write_index)-capacity;
+	fprintf(file,",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"%s\"}}",tid,ring->name);
+	for(i=0;i<count;i++){
+		const MSTraceEvent *ev=&copy[i];
+		if ((int32_t)(first+i-valid_from)<0) continue;
+		if (ev->begin_ns<recorder.origin_ns) continue;
+		fprintf(file,",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%i,"
+			"\"args\":{\"instance\":\"%p\",\"arg\":%u}}",
+			ev->name ? ev->name : "", event_category(ev->type),(double)(ev->begin_ns-recorder.origin_ns)/1000.0,
+			(double)ev->duration_ns/1000.0,tid,ev->instance,ev->arg);
+		written++;
+	}
+	return written;
+}
+
+int ms_trace_save(const char *filename){
+	FILE *file;
+	MSTraceEvent *copy=NULL;
+	uint32_t copy_size=0;
+	unsigned int i,nrings,generation,nthreads=0;
+	int written=0;
+
+	ms_once(&recorder_once,recorder_init);
+	ms_mutex_lock(&recorder.lock);
+	if (!recorder.started){
+		ms_mutex_unlock(&recorder.lock);
+		ms_error("ms_trace_save(): no trace was recorded.");
+		return -1;
+	}
+	file=fopen(filename,"w");
+	if (file==NULL){
+		ms_mutex_unlock(&recorder.lock);
+		ms_error("ms_trace_save(): cannot open %s for writing.",filename);
+		return -1;
+	}
+	fprintf(file,"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file,"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"mediastreamer2\"}}");
+	nrings=ms_atomic_load(&recorder.nrings);
+	generation=ms_atomic_load(&recorder.generation);
+	for(i=0;i<nrings;i++){
+		MSTraceRing *ring=&recorder.rings[i];
+		/*the rings of the current recording cannot be reassigned while the lock is held*/
+		if (RING_GENERATION(ms_atomic_load(&ring->state))!=generation) continue;
+		nthreads++;
+		if (ring->mask+1>copy_size){
+			if (copy) ms_free(copy);
+			copy_size=ring->mask+1;
+			copy=ms_new(MSTraceEvent,copy_size);
+		}
+		written+=save_ring(file,ring,copy,(int)i+1);
+	}
+	fprintf(file,"\n]}\n");
+	if (copy) ms_free(copy);
+	ms_mutex_unlock(&recorder.lock);
+	fclose(file);
+	ms_message("ms_trace_save(): %i spans of %u threads saved in %s (%u spans dropped).",written,nthreads,filename,
+		ms_atomic_load(&recorder.dropped));
+	return 0;
+}
@@ -100,59 +100,85 @@ static void check_and_create_srtp_context(MSMediaStreamSessions *sessions) {
 		sessions->srtp_context=ms_srtp_context_new();
 }
 /**** Sender functions ****/
-static int _process_on_send(RtpSession* session,MSSrtpStreamContext *ctx, mblk_t *m){
-	int slen;
+
+/* room needed after a packet for srtp to write its trailer */
+#define SRTP_RTP_TRAILER_ROOM (SRTP_MAX_TRAILER_LEN+4 /*for 32 bits alignment*/)
+#define SRTP_RTCP_TRAILER_ROOM (SRTP_RTP_TRAILER_ROOM + 4 /*required by srtp_protect_rtcp*/)
+
+static bool_t has_room(const mblk_t *m, int headroom, int tailroom){
+	return m->b_rptr-m->b_datap->db_base>=headroom && m->b_datap->db_lim-m->b_wptr>=tailroom
+		&& ((intptr_t)(m->b_rptr-headroom) & 3)==0;
+}
+
+/*
+ * Make the packet a single buffer followed by room for the srtp trailer, so that it can be protected in place.
+ * The packet is copied only if it is shared, fragmented in more than a header and a payload, or lacks room around its data.
+ * Frames allocated with ms_factory_allocb() have room for the RTP header and the trailer.
+ */
+static void make_protectable(mblk_t *m, int slen, int trailer_room){
+	mblk_t *payload=m->b_cont;
+	int header_len=(int)(m->b_wptr-m->b_rptr);
+
+	if (ms_mblk_is_writable(m)){
+		if (payload==NULL){
+			if (has_room(m,0,trailer_room)) return;
+		}else if (payload->b_cont==NULL && has_room(payload,header_len,trailer_room)){
+			/*move the header in front of the payload, and give the payload buffer to the header message*/
+			dblk_t *header_db=m->b_datap;
+			payload->b_rptr-=header_len;
+			memcpy(payload->b_rptr,m->b_rptr,header_len);
+			m->b_datap=payload->b_datap;
+			m->b_rptr=payload->b_rptr;
+			m->b_wptr=payload->b_wptr;
+			m->b_cont=NULL;
+			payload->b_datap=header_db;
+			freeb(payload);
+			return;
+		}
+	}
+	/* defragment the message and enlarge the buffer for srtp to write its data */
+	msgpullup(m,slen+trailer_room);
+}
+
+/*must be called with ctx->mutex held*/
+static int protect_packet(MSSrtpStreamContext *ctx, bool_t is_rtp, mblk_t *m){
+	int slen=(int)msgdsize(m);
 	err_status_t err;
+
+	if (is_rtp){
+		rtp_header_t *rtp_header=(rtp_header_t*)m->b_rptr;
+		if (slen<=RTP_FIXED_HEADER_SIZE || rtp_header->version!=2) return slen; /*ignoring non rtp packets*/
+	}else{
+		rtcp_common_header_t *rtcp_header=(rtcp_common_header_t*)m->b_rptr;
+		if (slen<=RTP_FIXED_HEADER_SIZE || rtcp_header->version!=2) return slen; /*ignoring non rtcp packets*/
+	}
+	if (!ctx->secured) {
+		/* No need to protect packets, but they are dropped if encryption is mandatory */
+		return ctx->mandatory_enabled ? 0 : slen;
+	}
+	make_protectable(m,slen,is_rtp ? SRTP_RTP_TRAILER_ROOM : SRTP_RTCP_TRAILER_ROOM);
+	err=is_rtp ? srtp_protect(ctx->srtp,m->b_rptr,&slen) : srtp_protect_rtcp(ctx->srtp,m->b_rptr,&slen);
+	if (err!=err_status_ok){
+		ortp_error("srtp_protect%s() failed (%d) for stream ctx [%p]", is_rtp?"":"_rtcp", err,ctx);
+		return -1;
+	}
+	return slen;
+}
+
+static int _process_on_send(RtpSession* session,MSSrtpStreamContext *ctx, mblk_t *m){
+	int ret;
 	bool_t is_rtp=ctx->is_rtp;
-	rtp_header_t *rtp_header=is_rtp?(rtp_header_t*)m->b_rptr:NULL;
-	rtcp_common_header_t *rtcp_header=!is_rtp?(rtcp_common_header_t*)m->b_rptr:NULL;
-	slen=(int)msgdsize(m);
 
 	/* fixed: when rtcp-mux is on and we need to send RTCP packet, we need to use same srtp context as used for RTP stream */
 	if (!is_rtp && session->rtcp_mux) {
 		if (ctx->other_rtp)
 			ctx = ctx->other_rtp;
 	}
-
-	if (rtp_header && (slen>RTP_FIXED_HEADER_SIZE && rtp_header->version==2)) {
-		ms_mutex_lock(&ctx->mutex);
-		if (!ctx->secured) {
-			// No need to protect RTP packets
-			err=err_status_ok;
-			if (ctx->mandatory_enabled) {
-				slen = 0; /*droping packets*/
-			}
-		} else {
-			/* defragment incoming message and enlarge the buffer for srtp to write its data */
-			msgpullup(m,slen+SRTP_MAX_TRAILER_LEN+4 /*for 32 bits alignment*/);
-			err=srtp_protect(ctx->srtp,m->b_rptr,&slen);
-		}
-		ms_mutex_unlock(&ctx->mutex);
-	} else if (rtcp_header && (slen>RTP_FIXED_HEADER_SIZE && rtcp_header->version==2)) {
-		ms_mutex_lock(&ctx->mutex);
-		if (!ctx->secured) {
-			// No need to protect RTCP packets
-			err=err_status_ok;
-			if (ctx->mandatory_enabled) {
-				slen = 0; /*droping packets*/
-			}
-		} else {
-		/* defragment incoming message and enlarge the buffer for srtp to write its data */
-			msgpullup(m,slen+SRTP_MAX_TRAILER_LEN+4 /*for 32 bits alignment*/ + 4 /*required by srtp_protect_rtcp*/);
-			err=srtp_protect_rtcp(ctx->srtp,m->b_rptr,&slen);
-		}
-		ms_mutex_unlock(&ctx->mutex);
-	} else {
-		/*ignoring non rtp/rtcp packets*/
- 		return slen;
- 	}
-
-	/* check return code from srtp_protect */
-	if (err==err_status_ok){
-		return slen;
-	}
-	ortp_error("srtp_protect%s() failed (%d) for stream ctx [%p]", is_rtp?"":"_rtcp", err,ctx);
-	return -1;
+	/* RTCP packets may be sent by the application thread, and share the srtp session of the RTP stream with rtcp-mux */
+	ms_mutex_lock(&ctx->mutex);
+	ret=protect_packet(ctx,is_rtp,m);
+	ms_mutex_unlock(&ctx->mutex);
+	return ret;
 }
 
 static int ms_srtp_process_on_send(RtpTransportModifier *t, mblk_t *m){
@@ -188,7 +214,10 @@ static int _process_on_receive(RtpSession* session,MSSrtpStreamContext *ctx, mbl
 
 	slen=err;
 	if (ctx->secured) {
+		/* the srtp session may be replaced by a new key meanwhile */
+		ms_mutex_lock(&ctx->mutex);
 		srtp_err = is_rtp?srtp_unprotect(ctx->srtp,m->b_rptr,&slen):srtp_unprotect_rtcp(ctx->srtp,m->b_rptr,&slen);
+		ms_mutex_unlock(&ctx->mutex);
 		if (srtp_err==err_status_ok) {
 			return slen;
 		} else {
@@ -230,10 +259,15 @@ static MSSrtpStreamContext* get_stream_context(MSMediaStreamSessions *sessions,
 }
 
 
-static int ms_media_stream_session_fill_srtp_context(MSMediaStreamSessions *sessions, bool_t is_send, bool_t is_rtp) {
+/*
+ * Install the transport modifier of the stream if needed, and replace its srtp session by srtp, or by a new empty one if srtp is NULL.
+ * The srtp session is configured before the lock is taken, so that packets are not delayed while the keys are derived.
+ */
+static int ms_media_stream_session_fill_srtp_context(MSMediaStreamSessions *sessions, bool_t is_send, bool_t is_rtp, srtp_t srtp, bool_t secured) {
 	err_status_t err=0;
 	RtpTransport *transport=NULL;
 	MSSrtpStreamContext* stream_ctx = get_stream_context(sessions,is_send,is_rtp);
+	srtp_t old_srtp;
 
 	if (is_rtp) {
 		rtp_session_get_transports(sessions->rtp_session,&transport,NULL);
@@ -241,22 +275,19 @@ static int ms_media_stream_session_fill_srtp_context(MSMediaStreamSessions *sess
 		rtp_session_get_transports(sessions->rtp_session,NULL,&transport);
 	}
 
-	ms_mutex_lock(&stream_ctx->mutex);
-
-	if (stream_ctx->srtp && stream_ctx->secured) {
-		/*we cannot reuse srtp context, so freeing first*/
-		srtp_dealloc(stream_ctx->srtp);
-		stream_ctx->srtp=NULL;
-	}
-
-	if (!stream_ctx->srtp) {
-		err = srtp_create(&stream_ctx->srtp, NULL);
+	if (!srtp) {
+		err = srtp_create(&srtp, NULL);
 		if (err != 0) {
 			ms_error("Failed to create srtp session (%d) for stream sessions [%p]", err,sessions);
-			goto end;
+			return err;
 		}
 	}
 
+	ms_mutex_lock(&stream_ctx->mutex);
+	/*we cannot reuse srtp context, so it is replaced*/
+	old_srtp=stream_ctx->srtp;
+	stream_ctx->srtp=srtp;
+	stream_ctx->secured=secured;
 	if (!stream_ctx->modifier) {
 		stream_ctx->modifier=ms_new0(RtpTransportModifier,1);
 		stream_ctx->modifier->data=stream_ctx;
@@ -265,24 +296,24 @@ static int ms_media_stream_session_fill_srtp_context(MSMediaStreamSessions *sess
 		stream_ctx->modifier->t_destroy=ms_srtp_transport_modifier_destroy;
 		meta_rtp_transport_append_modifier(transport, stream_ctx->modifier);
 	}
-end:
 	ms_mutex_unlock(&stream_ctx->mutex);
-	return err;
-
+	if (old_srtp) srtp_dealloc(old_srtp);
+	return 0;
 }
+
 int ms_media_stream_sessions_fill_srtp_context_all_stream(struct _MSMediaStreamSessions *sessions) {
 	int  err = -1;
 	/*check if exist before filling*/
 
-	if (!(get_stream_context(sessions, TRUE,TRUE)->srtp) && (err = ms_media_stream_session_fill_srtp_context(sessions, TRUE, TRUE)))
+	if (!(get_stream_context(sessions, TRUE,TRUE)->srtp) && (err = ms_media_stream_session_fill_srtp_context(sessions, TRUE, TRUE, NULL, FALSE)))
 		 return err;
-	if (!(get_stream_context(sessions, TRUE,FALSE)->srtp) && (err = ms_media_stream_session_fill_srtp_context(sessions, TRUE, FALSE)))
+	if (!(get_stream_context(sessions, TRUE,FALSE)->srtp) && (err = ms_media_stream_session_fill_srtp_context(sessions, TRUE, FALSE, NULL, FALSE)))
 		 return err;
-	if (!(get_stream_context(sessions, FALSE,TRUE)->srtp) && (err = ms_media_stream_session_fill_srtp_context(sessions, FALSE, TRUE)))
+	if (!(get_stream_context(sessions, FALSE,TRUE)->srtp) && (err = ms_media_stream_session_fill_srtp_context(sessions, FALSE, TRUE, NULL, FALSE)))
 		 return err;
 
 	if (!get_stream_context(sessions, FALSE,FALSE)->srtp)
-		err = ms_media_stream_session_fill_srtp_context(sessions,FALSE,FALSE);
+		err = ms_media_stream_session_fill_srtp_context(sessions,FALSE,FALSE,NULL,FALSE);
 
 	return err;
 }
@@ -463,6 +494,7 @@ void ms_srtp_shutdown(void){
 
 static int ms_media_stream_sessions_set_srtp_key_base(MSMediaStreamSessions *sessions, MSCryptoSuite suite, const char* key, size_t key_length, size_t cipher_key_length, bool_t is_send, bool_t is_rtp){
 	MSSrtpStreamContext* stream_ctx;
+	srtp_t srtp=NULL;
 	uint32_t ssrc;
 	int error = -1;
 
@@ -475,17 +507,22 @@ static int ms_media_stream_sessions_set_srtp_key_base(MSMediaStreamSessions *ses
 	stream_ctx = get_stream_context(sessions,is_send,is_rtp);
 	ssrc = is_send? rtp_session_get_send_ssrc(sessions->rtp_session):0/*only relevant for send*/;
 
-	if ((error = ms_media_stream_session_fill_srtp_context(sessions,is_send,is_rtp))) {
+	if ((error = srtp_create(&srtp, NULL))) {
+		ms_error("Failed to create srtp session (%d) for stream sessions [%p]", error,sessions);
 		stream_ctx->secured=FALSE;
 		return error;
 	}
 
-	if ((error = ms_add_srtp_stream(stream_ctx->srtp, suite, ssrc, key, cipher_key_length, is_send, is_rtp))) {
+	if ((error = ms_add_srtp_stream(srtp, suite, ssrc, key, cipher_key_length, is_send, is_rtp))) {
+		srtp_dealloc(srtp);
 		stream_ctx->secured=FALSE;
 		return error;
 	}
 
-	stream_ctx->secured=(cipher_key_length!=0);
+	if ((error = ms_media_stream_session_fill_srtp_context(sessions,is_send,is_rtp,srtp,cipher_key_length!=0))) {
+		stream_ctx->secured=FALSE;
+		return error;
+	}
 	return 0;
 }
 
@@ -630,6 +667,25 @@ bool_t ms_media_stream_sessions_get_encryption_mandatory(const MSMediaStreamSess
 			&& sessions->srtp_context->recv_rtcp_context.mandatory_enabled;
 }
 
+int ms_media_stream_sessions_protect_rtp_packets(MSMediaStreamSessions *sessions, mblk_t **packets, int *sizes, int count) {
+	MSSrtpStreamContext *ctx;
+	int i, ret = 0;
+
+	if (!sessions->srtp_context) {
+		for (i = 0; i < count; i++) sizes[i] = (int)msgdsize(packets[i]);
+		return 0;
+	}
+	ctx = &sessions->srtp_context->send_rtp_context;
+	ms_mutex_lock(&ctx->mutex);
+	for (i = 0; i < count; i++) {
+		sizes[i] = protect_packet(ctx, TRUE, packets[i]);
+		if (sizes[i] < 0) ret = -1;
+		else if (packets[i]->b_cont == NULL) packets[i]->b_wptr = packets[i]->b_rptr + sizes[i];
+	}
+	ms_mutex_unlock(&ctx->mutex);
+	return ret;
+}
+
 #else /* HAVE_SRTP */
 
 typedef void* srtp_t;
@@ -680,6 +736,12 @@ bool_t ms_media_stream_sessions_secured(const MSMediaStreamSessions *sessions,Me
 	return FALSE;
 }
 
+int ms_media_stream_sessions_protect_rtp_packets(MSMediaStreamSessions *sessions, mblk_t **packets, int *sizes, int count) {
+	int i;
+	for (i = 0; i < count; i++) sizes[i] = (int)msgdsize(packets[i]);
+	return 0;
+}
+
 void ms_srtp_context_delete(MSSrtpCtx* session) {
 	ms_error("Unable to delete srtp context [%p]: srtp support disabled in mediastreamer2",session);
 }
@@ -19,17 +19,105 @@
 
 
 #include "mediastreamer2/msitc.h"
+#include "msatomic.h"
+
+#define ITC_DEFAULT_MAX_SIZE 1024
+
+/*
+ * Messages go from the sink to the source through a bounded ring, so that crossing from one ticker to another takes no lock.
+ * The sink is the only writer. The source reads, and so does the sink when it drops the oldest message: a reader claims a slot
+ * by moving tail, and the sequence number of the slot tells whether it can be read or written.
+ * The mutex protects the connection between the sink and the source. The ring is replaced with the sink filter and ring_lock
+ * held, which the sink and the source respectively hold while they use it.
+ */
+typedef struct ItcSlot{
+	ms_atomic_uint_t seq; /*equal to the position of the slot when it can be written, to the position + 1 when it can be read*/
+	mblk_t *m;
+}ItcSlot;
 
 typedef struct SharedState{
 	ms_mutex_t mutex;
+	ms_mutex_t ring_lock;
 	int refcnt;
 	int rate;
 	int nchannels;
-	MSQueue q;
+	ItcSlot *ring;
+	unsigned int mask;
+	ms_atomic_uint_t head; /*next slot to be written, only modified by the sink*/
+	ms_atomic_uint_t tail; /*next slot to be read, modified by the source, and by the sink when dropping the oldest message*/
+	ms_atomic_uint_t transferred;
+	ms_atomic_uint_t dropped;
+	ms_atomic_uint_t max_occupancy;
+	MSItcOverflowPolicy policy;
 	const MSFmtDescriptor *fmt;
 	MSFilter *source;
 }SharedState;
 
+static void ring_init(SharedState *s, int max_size){
+	unsigned int size=1;
+	unsigned int i;
+	while(size<(unsigned int)max_size) size<<=1;
+	s->ring=ms_new0(ItcSlot,size);
+	for(i=0;i<size;i++) ms_atomic_store(&s->ring[i].seq,i);
+	s->mask=size-1;
+	ms_atomic_store(&s->head,0);
+	ms_atomic_store(&s->tail,0);
+}
+
+static mblk_t *ring_get(SharedState *s){
+	unsigned int tail;
+	ItcSlot *slot;
+	mblk_t *m;
+	for(;;){
+		int diff;
+		tail=ms_atomic_load(&s->tail);
+		slot=&s->ring[tail & s->mask];
+		diff=(int)(ms_atomic_load(&slot->seq)-(tail+1));
+		if (diff<0) return NULL; /*not written yet*/
+		/*when diff>0, the other reader took this message meanwhile*/
+		if (diff==0 && ms_atomic_compare_exchange(&s->tail,tail,tail+1)) break;
+	}
+	/*the slot is ours until its sequence number is moved to the next turn*/
+	m=slot->m;
+	slot->m=NULL;
+	ms_atomic_store(&slot->seq,tail+s->mask+1);
+	return m;
+}
+
+static void ring_put(SharedState *s, mblk_t *m){
+	unsigned int head=ms_atomic_load(&s->head);
+	ItcSlot *slot=&s->ring[head & s->mask];
+	unsigned int occupancy;
+
+	while(ms_atomic_load(&slot->seq)!=head){
+		mblk_t *old;
+		/*otherwise the slot is being released by the source*/
+		if (head-ms_atomic_load(&s->tail)<=s->mask) continue;
+		if (s->policy==MSItcDropNewest){
+			freemsg(m);
+			ms_atomic_store(&s->dropped,ms_atomic_load(&s->dropped)+1);
+			return;
+		}
+		if ((old=ring_get(s))!=NULL){
+			freemsg(old);
+			ms_atomic_store(&s->dropped,ms_atomic_load(&s->dropped)+1);
+		}
+	}
+	slot->m=m;
+	ms_atomic_store(&slot->seq,head+1);
+	ms_atomic_store(&s->head,head+1);
+	ms_atomic_store(&s->transferred,ms_atomic_load(&s->transferred)+1);
+	occupancy=head+1-ms_atomic_load(&s->tail);
+	if (occupancy>ms_atomic_load(&s->max_occupancy)) ms_atomic_store(&s->max_occupancy,occupancy);
+}
+
+static void ring_uninit(SharedState *s){
+	mblk_t *m;
+	while((m=ring_get(s))!=NULL) freemsg(m);
+	ms_free(s->ring);
+	s->ring=NULL;
+}
+
 static SharedState * itc_get_shared_state(MSFilter *f){
 	SharedState *s=(SharedState*)f->data;
 	return s;
@@ -38,18 +126,22 @@ static SharedState * itc_get_shared_state(MSFilter *f){
 static SharedState *shared_state_new(void){
 	SharedState *s = ms_new0(SharedState,1);
 	ms_mutex_init(&s->mutex, NULL);
-	ms_queue_init(&s->q);
+	ms_mutex_init(&s->ring_lock, NULL);
+	ring_init(s, ITC_DEFAULT_MAX_SIZE);
+	s->policy = MSItcDropOldest;
 	return s;
 }
 
 static void shared_state_release(SharedState *s){
+	int refcnt;
 	ms_mutex_lock(&s->mutex);
-	s->refcnt--;
+	refcnt = --s->refcnt;
 	ms_mutex_unlock(&s->mutex);
 	
-	if (s->refcnt == 0){
+	if (refcnt == 0){
 		ms_mutex_destroy(&s->mutex);
-		ms_queue_flush(&s->q);
+		ms_mutex_destroy(&s->ring_lock);
+		ring_uninit(s);
 		ms_free(s);
 	}
 }
@@ -138,13 +230,11 @@ static void itc_source_process(MSFilter *f){
 	ss = itc_get_shared_state(f);
 	
 	if (ss){
-		ms_mutex_lock(&ss->mutex);
-		while((m=ms_queue_get(&ss->q))!=NULL){
-			ms_mutex_unlock(&ss->mutex);
+		ms_mutex_lock(&ss->ring_lock);
+		while((m=ring_get(ss))!=NULL){
 			ms_queue_put(f->outputs[0],m);
-			ms_mutex_lock(&ss->mutex);
 		}
-		ms_mutex_unlock(&ss->mutex);
+		ms_mutex_unlock(&ss->ring_lock);
 	}
 	ms_filter_unlock(f);
 }
@@ -213,20 +303,24 @@ static void itc_sink_preprocess(MSFilter *f){
 static void itc_sink_process(MSFilter *f){
 	SharedState *s;
 	mblk_t *im;
+	bool_t connected;
 	
+	/*the filter stays locked while the ring is written, see itc_sink_set_max_size()*/
 	ms_filter_lock(f);
 	s = itc_get_shared_state(f);
-	ms_filter_unlock(f);
-	
 	ms_mutex_lock(&s->mutex);
+	connected = s->source != NULL;
+	ms_mutex_unlock(&s->mutex);
+	
 	while((im=ms_queue_get(f->inputs[0]))!=NULL){
-		if (s->source == NULL){
+		/*a message queued while the source is being disconnected is released with the shared state*/
+		if (!connected){
 			freemsg(im);
 		}else{
-			ms_queue_put(&s->q, im);
+			ring_put(s, im);
 		}
 	}
-	ms_mutex_unlock(&s->mutex);
+	ms_filter_unlock(f);
 }
 
 static int itc_sink_connect(MSFilter *f, void *data){
@@ -285,6 +379,41 @@ static int itc_sink_set_fmt(MSFilter *f, void *data){
 	return 0;
 }
 
+static int itc_sink_set_max_size(MSFilter *f, void *data){
+	SharedState *s;
+	ms_filter_lock(f);
+	s = itc_get_shared_state(f);
+	ms_mutex_lock(&s->ring_lock);
+	ring_uninit(s);
+	ring_init(s, *(int*)data);
+	ms_mutex_unlock(&s->ring_lock);
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int itc_sink_set_overflow_policy(MSFilter *f, void *data){
+	SharedState *s;
+	ms_filter_lock(f);
+	s = itc_get_shared_state(f);
+	s->policy=*(MSItcOverflowPolicy*)data;
+	ms_filter_unlock(f);
+	return 0;
+}
+
+static int itc_sink_get_stats(MSFilter *f, void *data){
+	SharedState *s;
+	MSItcStats *stats=(MSItcStats*)data;
+	ms_filter_lock(f);
+	s = itc_get_shared_state(f);
+	stats->size=(int)s->mask+1;
+	stats->occupancy=(int)(ms_atomic_load(&s->head)-ms_atomic_load(&s->tail));
+	stats->max_occupancy=(int)ms_atomic_load(&s->max_occupancy);
+	stats->transferred=ms_atomic_load(&s->transferred);
+	stats->dropped=ms_atomic_load(&s->dropped);
+	ms_filter_unlock(f);
+	return 0;
+}
+
 static MSFilterMethod sink_methods[]={
 	{	MS_ITC_SINK_CONNECT , itc_sink_connect },
 	{	MS_FILTER_SET_NCHANNELS , itc_sink_set_nchannels },
@@ -292,6 +421,9 @@ static MSFilterMethod sink_methods[]={
 	{	MS_FILTER_GET_NCHANNELS, itc_sink_get_nchannels },
 	{	MS_FILTER_GET_SAMPLE_RATE, itc_sink_get_sr },
 	{	MS_FILTER_SET_INPUT_FMT, itc_sink_set_fmt },
+	{	MS_ITC_SINK_SET_MAX_SIZE, itc_sink_set_max_size },
+	{	MS_ITC_SINK_SET_OVERFLOW_POLICY, itc_sink_set_overflow_policy },
+	{	MS_ITC_SINK_GET_STATS, itc_sink_get_stats },
 	{ 0, NULL }
 };
 
@@ -29,11 +29,13 @@
 #endif
 #include "ortp/b64.h"
 #include "mediastreamer2/stun.h"
+#include "msudpbatch.h"
 
 static const int default_dtmf_duration_ms=100; /*in milliseconds*/
 
 struct SenderData {
 	RtpSession *session;
+	MSRtpBatch *batch;
 	MSBoxPlot processing_delay_stats;
 	uint32_t tsoff;
 	uint32_t last_ts;
@@ -150,6 +152,10 @@ static void sender_init(MSFilter * f)
 static void sender_uninit(MSFilter * f)
 {
 	SenderData *d = (SenderData *) f->data;
+	if (d->batch) {
+		ms_rtp_batch_enable_send(d->batch, FALSE);
+		ms_rtp_batch_unref(d->batch);
+	}
 
 	ms_free(d);
 }
@@ -185,6 +191,13 @@ static int sender_set_session(MSFilter * f, void *arg)
 	PayloadType *pt =
 		rtp_profile_get_payload(rtp_session_get_profile(s),
 								rtp_session_get_send_payload_type(s));
+	if (d->batch && d->session != s){
+		/*batching follows the session*/
+		ms_rtp_batch_enable_send(d->batch, FALSE);
+		ms_rtp_batch_unref(d->batch);
+		d->batch = ms_rtp_batch_ref_from_session(s);
+		if (d->batch) ms_rtp_batch_enable_send(d->batch, TRUE);
+	}
 	d->session = s;
 	if (pt != NULL) {
 		d->rate = pt->clock_rate;
@@ -199,6 +212,36 @@ static int sender_set_session(MSFilter * f, void *arg)
 	return 0;
 }
 
+static int sender_enable_batch_send(MSFilter *f, void *arg){
+	SenderData *d = (SenderData *) f->data;
+	bool_t enabled = *(bool_t*)arg;
+	int err = 0;
+	ms_filter_lock(f);
+	if (enabled && d->batch == NULL){
+		if (d->session == NULL){
+			ms_error("MSRtpSend: the session must be set before enabling batched send.");
+			err = -1;
+		}else{
+			d->batch = ms_rtp_batch_ref_from_session(d->session);
+			if (d->batch) ms_rtp_batch_enable_send(d->batch, TRUE);
+			else err = -1;
+		}
+	}else if (!enabled && d->batch){
+		ms_rtp_batch_enable_send(d->batch, FALSE);
+		ms_rtp_batch_unref(d->batch);
+		d->batch = NULL;
+	}
+	ms_filter_unlock(f);
+	return err;
+}
+
+static int sender_get_batch_stats(MSFilter *f, void *arg){
+	SenderData *d = (SenderData *) f->data;
+	if (d->batch == NULL) return -1;
+	ms_rtp_batch_get_stats(d->batch, (MSRtpBatchStats*)arg);
+	return 0;
+}
+
 static int sender_mute(MSFilter * f, void *arg)
 {
 	SenderData *d = (SenderData *) f->data;
@@ -511,6 +554,8 @@ static void _sender_process(MSFilter * f)
 	}
 
 	ms_filter_lock(f);
+	/*the packets of the tick are sent together*/
+	if (d->batch) ms_rtp_batch_begin_send(d->batch);
 	im = ms_queue_get(f->inputs[0]);
 	do {
 		mblk_t *header = NULL;
@@ -572,6 +617,7 @@ static void _sender_process(MSFilter * f)
 	if (d->last_sent_time == -1) {
 		check_stun_sending(f);
 	}
+	if (d->batch) ms_rtp_batch_flush(d->batch);
 
 	/*every second, compute output bandwidth*/
 	if (f->ticker && (f->ticker->time % 1000 == 0)) rtp_session_compute_send_bandwidth(d->session);
@@ -648,6 +694,8 @@ static MSFilterMethod sender_methods[] = {
 	{ MS_FILTER_GET_OUTPUT_FMT, get_sender_output_fmt },
 	{ MS_RTP_SEND_ENABLE_TS_ADJUSTMENT, enable_ts_adjustment },
 	{ MS_RTP_SEND_ENABLE_STUN_FORCED, sender_enable_stun_forced },
+	{ MS_RTP_SEND_ENABLE_BATCH_SEND, sender_enable_batch_send },
+	{ MS_RTP_SEND_GET_BATCH_STATS, sender_get_batch_stats },
 	{0, NULL}
 };
 
@@ -690,6 +738,7 @@ MSFilterDesc ms_rtp_send_desc = {
 
 struct ReceiverData {
 	RtpSession *session;
+	MSRtpBatch *batch;
 	int current_pt;
 	int rate;
 	bool_t starting;
@@ -716,6 +765,7 @@ static void receiver_postprocess(MSFilter * f){
 
 static void receiver_uninit(MSFilter * f){
 	ReceiverData *d = (ReceiverData *) f->data;
+	if (d->batch) ms_rtp_batch_unref(d->batch);
 	ms_free(d);
 }
 
@@ -732,11 +782,44 @@ static int receiver_set_session(MSFilter * f, void *arg)
 		ms_warning("receiver_set_session(): receiving undefined payload type %i ?",
 		    rtp_session_get_recv_payload_type(s));
 	}
+	if (d->batch && d->session != s){
+		/*batching follows the session*/
+		ms_rtp_batch_enable_receive(d->batch, FALSE);
+		ms_rtp_batch_unref(d->batch);
+		d->batch = ms_rtp_batch_ref_from_session(s);
+		if (d->batch) ms_rtp_batch_enable_receive(d->batch, TRUE);
+	}
 	d->session = s;
 
 	return 0;
 }
 
+static int receiver_enable_batch_receive(MSFilter *f, void *arg){
+	ReceiverData *d = (ReceiverData *) f->data;
+	bool_t enabled = *(bool_t*)arg;
+	if (enabled && d->batch == NULL){
+		if (d->session == NULL){
+			ms_error("MSRtpRecv: the session must be set before enabling batched receive.");
+			return -1;
+		}
+		d->batch = ms_rtp_batch_ref_from_session(d->session);
+		if (d->batch == NULL) return -1;
+		ms_rtp_batch_enable_receive(d->batch, TRUE);
+	}else if (!enabled && d->batch){
+		ms_rtp_batch_enable_receive(d->batch, FALSE);
+		ms_rtp_batch_unref(d->batch);
+		d->batch = NULL;
+	}
+	return 0;
+}
+
+static int receiver_get_batch_stats(MSFilter *f, void *arg){
+	ReceiverData *d = (ReceiverData *) f->data;
+	if (d->batch == NULL) return -1;
+	ms_rtp_batch_get_stats(d->batch, (MSRtpBatchStats*)arg);
+	return 0;
+}
+
 static int receiver_set_mixer_to_client_extension_id(MSFilter * f, void *arg) {
 	ReceiverData *d = (ReceiverData *) f->data;
 	int *id = (int *) arg;
@@ -906,6 +989,8 @@ static MSFilterMethod receiver_methods[] = {
 	{	MS_RTP_RECV_RESET_JITTER_BUFFER, receiver_reset_jitter_buffer },
 	{	MS_RTP_RECV_SET_MIXER_TO_CLIENT_EXTENSION_ID, receiver_set_mixer_to_client_extension_id },
 	{	MS_RTP_RECV_SET_CLIENT_TO_MIXER_EXTENSION_ID, receiver_set_client_to_mixer_extension_id },
+	{	MS_RTP_RECV_ENABLE_BATCH_RECEIVE, receiver_enable_batch_receive },
+	{	MS_RTP_RECV_GET_BATCH_STATS, receiver_get_batch_stats },
 	{	MS_FILTER_GET_SAMPLE_RATE	, receiver_get_sr		},
 	{	MS_FILTER_GET_NCHANNELS	,	receiver_get_ch	},
 	{ 	MS_FILTER_GET_OUTPUT_FMT, get_receiver_output_fmt },
@@ -26,18 +26,22 @@
 #define B64_NO_NAMESPACE
 #endif
 #include "ortp/b64.h"
+#include "msudpbatch.h"
 
 struct SenderData {
 	// Contains both destination ip and port
 	struct addrinfo *dst_info;
 	ortp_socket_t sockfd;
+	MSUdpSendQueue *send_queue;
 };
 
 typedef struct SenderData SenderData;
 
 static void sender_init(MSFilter * f)
 {
-	f->data = ms_new0(SenderData, 1);
+	SenderData *d = ms_new0(SenderData, 1);
+	d->send_queue = ms_udp_send_queue_new();
+	f->data = d;
 }
 
 
@@ -45,6 +49,7 @@ static void sender_uninit(MSFilter * f)
 {
 	SenderData *d = (SenderData *) f->data;
 
+	ms_udp_send_queue_destroy(d->send_queue);
 	if (d->sockfd != (ortp_socket_t)-1) {
 		close_socket(d->sockfd);
 	}
@@ -61,23 +66,11 @@ static void sender_process(MSFilter * f)
 
 	ms_filter_lock(f);
 
+	/*messages are not pulled up, and are sent together at the end of the tick*/
 	while ((im = ms_queue_get(f->inputs[0])) != NULL) {
-		int error;
-		msgpullup(im, -1);
-
-		error = bctbx_sendto(
-			d->sockfd,
-			im->b_rptr,
-			(int) (im->b_wptr - im->b_rptr),
-			0,
-			d->dst_info->ai_addr,
-			(socklen_t)d->dst_info->ai_addrlen
-		);
-
-		if (error == -1) {
-			ms_error("Failed to send UDP packet: errno=%d", errno);
-		}
+		ms_udp_send_queue_put(d->send_queue, d->sockfd, im, d->dst_info->ai_addr, (socklen_t)d->dst_info->ai_addrlen);
 	}
+	ms_udp_send_queue_flush(d->send_queue);
 
 	ms_filter_unlock(f);
 }
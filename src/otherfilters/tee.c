@@ -24,16 +24,36 @@
 
 typedef struct _TeeData{
 	bool_t muted[MS_TEE_NOUTPUTS];
+	MSTeeOutputStats stats[MS_TEE_NOUTPUTS];
+	int max_queue_size;
 }TeeData;
 
 static void tee_init(MSFilter *f){
-	f->data=ms_new0(TeeData,1);
+	TeeData *d=ms_new0(TeeData,1);
+	int i;
+	for(i=0;i<MS_TEE_NOUTPUTS;i++){
+		d->stats[i].pin=i;
+	}
+	f->data=d;
 }
 
 static void tee_uninit(MSFilter *f){
 	ms_free(f->data);
 }
 
+static void tee_put(TeeData *d, MSQueue *q, int pin, mblk_t *m){
+	MSTeeOutputStats *stats=&d->stats[pin];
+	if (d->max_queue_size>0){
+		while(q->q.q_mcount>=d->max_queue_size){
+			freemsg(ms_queue_get(q));
+			stats->dropped++;
+		}
+	}
+	ms_queue_put(q,m);
+	stats->packets++;
+	stats->bytes+=msgdsize(m);
+}
+
 static void tee_process(MSFilter *f){
 	TeeData *d=(TeeData*)f->data;
 	mblk_t *im;
@@ -45,15 +65,24 @@ static void tee_process(MSFilter *f){
 		
 		for(i=0;i<f->desc->noutputs;i++){
 			if (f->outputs[i]!=NULL && !d->muted[i]){
+				/*no copy of the data: outputs share the data blocks, which are reference counted*/
 				if (output_count == 0){
 					outm = im;
 				}else{
 					outm = dupmsg(im);
 				}
-				ms_queue_put(f->outputs[i],outm);
+				tee_put(d,f->outputs[i],i,outm);
 				output_count++;
 			}
 		}
+		if (output_count == 0) freemsg(im);
+	}
+	for(i=0;i<f->desc->noutputs;i++){
+		if (f->outputs[i]!=NULL){
+			MSTeeOutputStats *stats=&d->stats[i];
+			stats->queue_depth=f->outputs[i]->q.q_mcount;
+			if (stats->queue_depth>stats->max_queue_depth) stats->max_queue_depth=stats->queue_depth;
+		}
 	}
 }
 
@@ -77,9 +106,27 @@ static int tee_unmute(MSFilter *f, void *arg){
 	return -1;
 }
 
+static int tee_set_max_queue_size(MSFilter *f, void *arg){
+	TeeData *d=(TeeData*)f->data;
+	d->max_queue_size=*(int*)arg;
+	return 0;
+}
+
+static int tee_get_output_stats(MSFilter *f, void *arg){
+	TeeData *d=(TeeData*)f->data;
+	MSTeeOutputStats *stats=(MSTeeOutputStats*)arg;
+	if (stats->pin>=0 && stats->pin<MS_TEE_NOUTPUTS){
+		*stats=d->stats[stats->pin];
+		return 0;
+	}
+	return -1;
+}
+
 static MSFilterMethod tee_methods[]={
 	{	MS_TEE_MUTE	,	tee_mute	},
 	{	MS_TEE_UNMUTE	,	tee_unmute	},
+	{	MS_TEE_SET_MAX_QUEUE_SIZE	,	tee_set_max_queue_size	},
+	{	MS_TEE_GET_OUTPUT_STATS	,	tee_get_output_stats	},
 	{	0		,	NULL		}
 };
 
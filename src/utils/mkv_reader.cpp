@@ -22,10 +22,19 @@
 #include <array>
 #include <cwchar>
 #include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <limits>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define bool_t mkv_bool_t
 extern "C" {
 #include <matroska/matroska.h>
@@ -97,6 +106,104 @@ static std::vector<tchar_t> cppStringToMkvString(const std::string &str) {
 	return mkvString;
 }
 
+/*
+ * Read-only mapping of a whole MKV file.
+ * Each frame handed out by makeView() owns its own data block whose free function
+ * drops a reference on the mapping. Thus the mapping outlives the reader as long as
+ * frames are still travelling through the filter graph, and those frames may be freed
+ * from any thread. The frames must not be written into: their free function is declared
+ * read-only, so that ms_mblk_make_writable() copies them.
+ */
+class MKVFileMapping {
+public:
+	MKVFileMapping(const MKVFileMapping &) = delete;
+	MKVFileMapping(MKVFileMapping &&) = delete;
+
+	static MKVFileMapping *open(const std::string &filename) noexcept;
+	void release() noexcept;
+
+	const uint8_t *data() const noexcept {return mBase;}
+	size_t size() const noexcept {return mSize;}
+	mblk_t *makeView(filepos_t pos, size_t size) noexcept;
+
+private:
+	MKVFileMapping(const uint8_t *base, size_t size) noexcept: mBase(base), mSize(size) {}
+	~MKVFileMapping() noexcept;
+
+	static void onViewFreed(void *data) noexcept;
+
+	const uint8_t *mBase{nullptr};
+	size_t mSize{0};
+	int mRefs{1};
+
+	static std::mutex sMutex;
+	static std::map<const uint8_t *, MKVFileMapping *> sMappings;
+	static std::once_flag sReadOnlyDeclared;
+};
+
+std::mutex MKVFileMapping::sMutex{};
+std::map<const uint8_t *, MKVFileMapping *> MKVFileMapping::sMappings{};
+std::once_flag MKVFileMapping::sReadOnlyDeclared{};
+
+MKVFileMapping *MKVFileMapping::open(const std::string &filename) noexcept {
+#ifndef _WIN32
+	struct stat st;
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return nullptr;
+	if (fstat(fd, &st) < 0 || st.st_size <= 0 || (uint64_t)st.st_size > (uint64_t)numeric_limits<int>::max()) {
+		::close(fd);
+		return nullptr;
+	}
+	void *base = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (base == MAP_FAILED) {
+		ms_warning("MKVParser: could not map %s, falling back on buffered reads", filename.c_str());
+		return nullptr;
+	}
+	call_once(sReadOnlyDeclared, [](){ms_mblk_add_read_only_free_function(onViewFreed);});
+	auto mapping = new MKVFileMapping{static_cast<const uint8_t *>(base), (size_t)st.st_size};
+	lock_guard<mutex> lock{sMutex};
+	sMappings[mapping->mBase] = mapping;
+	return mapping;
+#else
+	return nullptr;
+#endif
+}
+
+void MKVFileMapping::release() noexcept {
+	unique_lock<mutex> lock{sMutex};
+	if (--mRefs > 0) return;
+	sMappings.erase(mBase);
+	lock.unlock();
+	delete this;
+}
+
+MKVFileMapping::~MKVFileMapping() noexcept {
+#ifndef _WIN32
+	munmap(const_cast<uint8_t *>(mBase), mSize);
+#endif
+}
+
+mblk_t *MKVFileMapping::makeView(filepos_t pos, size_t size) noexcept {
+	if (pos < 0 || (size_t)pos > mSize || size > mSize - (size_t)pos) return nullptr;
+	mblk_t *m = esballoc(const_cast<uint8_t *>(mBase) + pos, (int)size, 0, onViewFreed);
+	m->b_wptr += size;
+	lock_guard<mutex> lock{sMutex};
+	mRefs++;
+	return m;
+}
+
+void MKVFileMapping::onViewFreed(void *data) noexcept {
+	MKVFileMapping *mapping;
+	{
+		lock_guard<mutex> lock{sMutex};
+		auto it = sMappings.upper_bound(static_cast<const uint8_t *>(data));
+		if (it == sMappings.begin()) return;
+		mapping = prev(it)->second;
+	}
+	mapping->release();
+}
+
 MKVParserCtx::MKVParserCtx() {
 	try {
 		ParserContext_Init(&mParserCtx, nullptr, nullptr, nullptr);
@@ -230,6 +337,7 @@ void MKVReader::open(const std::string &filename) {
 		if(parseHeaders() < 0) {
 			throw runtime_error("MKVParser: error while parsing EBML header");
 		}
+		mMapping = MKVFileMapping::open(filename);
 	} catch (...) {
 		close();
 		throw;
@@ -240,13 +348,18 @@ void MKVReader::close() noexcept {
 	mFile.reset();
 	mInfoElt.reset();
 	mTracksElt.clear();
-	mCues.reset();
 	mInfo.reset();
 	mTracks.clear();
 	mFirstClusterPos = 0;
 	mLastClusterEnd = 0;
 	mFirstLevel1Pos = 0;
+	mCueIndex.clear();
+	mClusterIndex.clear();
 	mReaders.clear();
+	if (mMapping) {
+		mMapping->release();
+		mMapping = nullptr;
+	}
 	mParserCtx.reset();
 }
 
@@ -282,6 +395,9 @@ MKVTrackReader *MKVReader::getTrackReader(int track_num) noexcept {
 	track_reader->mRoot = this;
 	track_reader->mTrackNum = track_num;
 	track_reader->mTrackElt = trackElt.get();
+	/* the blocks of encoded tracks (header stripping, compression) must be decoded by libmatroska */
+	track_reader->mMappable = mMapping != nullptr
+		&& EBML_MasterFindChild((ebml_master *)trackElt.get(), &MATROSKA_ContextContentEncodings) == nullptr;
 	track_reader->mFile.reset(Stream_Duplicate(mFile.get(), SFLAG_RDONLY));
 	track_reader->mParser.Context = &MATROSKA_ContextSegment;
 	track_reader->mParser.EndPosition = mLastClusterEnd;
@@ -294,41 +410,32 @@ MKVTrackReader *MKVReader::getTrackReader(int track_num) noexcept {
 }
 
 int MKVReader::seek(int pos_ms) noexcept {
-	ebml_element *cue_point = nullptr;
+	auto byTimestamp = [](const MKVIndexEntry &entry, int timestamp){return entry.mTimestamp < timestamp;};
+	auto cue = lower_bound(mCueIndex.cbegin(), mCueIndex.cend(), pos_ms, byTimestamp);
 
-	if (mCues) {
-		EBML_MasterForEachChild(cue_point, mCues.get(), &MATROSKA_ContextCuePoint) {
-			MATROSKA_LinkCueSegmentInfo((matroska_cuepoint *)cue_point, (ebml_master *)mInfoElt.get());
-			if(MATROSKA_CueTimecode((matroska_cuepoint *)cue_point) >= (timecode_t)pos_ms * 1000000LL) break;
-		}
-	}
-
-	if(cue_point) {
+	if(cue != mCueIndex.cend()) {
 		filepos_t pos = INVALID_FILEPOS_T;
-		ebml_element *track_position;
+		int cue_timestamp = cue->mTimestamp;
 		for (const auto &r : mReaders) {r->mNeedSeeking = true;}
-		for(track_position=EBML_MasterFindChild((ebml_master *)cue_point, &MATROSKA_ContextCueTrackPositions);
-			track_position!=NULL;
-			track_position = EBML_MasterFindNextElt((ebml_master *)cue_point, track_position, FALSE, FALSE)) {
-			int track_num = (int)EBML_IntegerValue((ebml_integer *)EBML_MasterFindChild((ebml_master *)track_position, &MATROSKA_ContextCueTrack));
+		for(; cue != mCueIndex.cend() && cue->mTimestamp == cue_timestamp; ++cue) {
+			int track_num = cue->mTrackNum;
 			auto it = find_if(mReaders.cbegin(), mReaders.cend(),
 				[track_num](const unique_ptr<MKVTrackReader> &r){return r->mTrackNum == track_num;}
 			);
 			if(it != mReaders.cend()) {
-				const auto &t_reader = *it;
-				pos = EBML_IntegerValue((ebml_integer *)EBML_MasterFindChild((ebml_master *)track_position, &MATROSKA_ContextCueClusterPosition));
-				pos += mFirstLevel1Pos;
-				t_reader->seek(pos);
+				pos = cue->mClusterPos;
+				(*it)->seek(pos);
 			}
 		}
 		for(const auto &t_reader : mReaders) {
 			if(t_reader->mNeedSeeking) t_reader->seek(pos);
 		}
-		return (int)(MATROSKA_CueTimecode((matroska_cuepoint *)cue_point) / 1000000LL);
+		return cue_timestamp;
 	} else {
 		constexpr auto invalidTimePos = numeric_limits<int>::max();
 		auto time_pos = invalidTimePos;
 		auto pos = findClusterPosition(pos_ms);
+		if (pos == INVALID_FILEPOS_T) return -1;
 		for (const auto &r : mReaders) {
 			time_pos = min(r->seek(pos, pos_ms), time_pos);
 		}
@@ -345,6 +452,7 @@ int MKVReader::parseHeaders() noexcept {
 	int upper_level = 0;
 	bool_t cluster_found = FALSE;
 	bool_t level1_found = FALSE;
+	EbmlElementPtr cues{};
 	const tchar_t *matroska_doc_type =
 #ifdef UNICODE
 		L"matroska";
@@ -436,6 +544,10 @@ int MKVReader::parseHeaders() noexcept {
 				cluster_found = TRUE;
 			}
 			mLastClusterEnd = EBML_ElementPositionEnd(level1.get());
+			int timestamp = readClusterTimestamp(level1.get());
+			if(timestamp >= 0) {
+				mClusterIndex.push_back({timestamp, 0, EBML_ElementPosition(level1.get())});
+			}
 			EBML_ElementSkipData(level1.get(), mFile.get(), &seg_pctx, NULL, FALSE);
 		} else if(EBML_ElementIsType(level1.get(), &MATROSKA_ContextCues)) {
 			err = EBML_ElementReadData(level1.get(), mFile.get(), &seg_pctx, FALSE, SCOPE_ALL_DATA, FALSE);
@@ -444,13 +556,18 @@ int MKVReader::parseHeaders() noexcept {
 			} else if(!EBML_MasterCheckMandatory((ebml_master *)level1.get(), FALSE)) {
 				ms_error("MKVParser: fail to parse the table of cues");
 			} else {
-				mCues = move(level1);
+				cues = move(level1);
 			}
 		} else {
 			EBML_ElementSkipData(level1.get(), mFile.get(), &seg_pctx, NULL, FALSE);
 		}
 	}
 	if(!cluster_found) return -1;
+	/* Clusters are expected in chronological order already; sorting only guards against odd muxers. */
+	stable_sort(mClusterIndex.begin(), mClusterIndex.end(),
+		[](const MKVIndexEntry &a, const MKVIndexEntry &b){return a.mTimestamp < b.mTimestamp;}
+	);
+	if(cues && mInfoElt) buildCueIndex(cues.get());
 	return 0;
 }
 
@@ -469,38 +586,57 @@ int MKVReader::parseTracks(const ebml_element *tracks_elt) noexcept {
 	return 0;
 }
 
-filepos_t MKVReader::findClusterPosition(int pos_ms) noexcept {
-	auto &f = mFile;
-
-	Stream_Seek(f.get(), mFirstClusterPos, SEEK_SET);
+void MKVReader::buildCueIndex(const ebml_element *cues_elt) noexcept {
+	ebml_element *cue_point;
+	EBML_MasterForEachChild(cue_point, cues_elt, &MATROSKA_ContextCuePoint) {
+		MATROSKA_LinkCueSegmentInfo((matroska_cuepoint *)cue_point, (ebml_master *)mInfoElt.get());
+		int timestamp = (int)(MATROSKA_CueTimecode((matroska_cuepoint *)cue_point) / 1000000LL);
+		ebml_element *track_position;
+		for(track_position=EBML_MasterFindChild((ebml_master *)cue_point, &MATROSKA_ContextCueTrackPositions);
+			track_position!=NULL;
+			track_position = EBML_MasterFindNextElt((ebml_master *)cue_point, track_position, FALSE, FALSE)) {
+			MKVIndexEntry entry{};
+			entry.mTimestamp = timestamp;
+			entry.mTrackNum = (int)EBML_IntegerValue((ebml_integer *)EBML_MasterFindChild((ebml_master *)track_position, &MATROSKA_ContextCueTrack));
+			entry.mClusterPos = EBML_IntegerValue((ebml_integer *)EBML_MasterFindChild((ebml_master *)track_position, &MATROSKA_ContextCueClusterPosition));
+			entry.mClusterPos += mFirstLevel1Pos;
+			mCueIndex.push_back(entry);
+		}
+	}
+	stable_sort(mCueIndex.begin(), mCueIndex.end(),
+		[](const MKVIndexEntry &a, const MKVIndexEntry &b){return a.mTimestamp < b.mTimestamp;}
+	);
+}
 
+/*
+ * Read the timecode of a cluster whose header has just been parsed.
+ * The reading head of the file is left somewhere inside the cluster.
+ */
+int MKVReader::readClusterTimestamp(const ebml_element *cluster_elt) noexcept {
 	int upper_level = 0;
-	const ebml_parser_context seg_parser_ctx = {&MATROSKA_ContextSegment, nullptr, mLastClusterEnd, 0};
-	EbmlElementPtr cluster{}, prev_cluster{};
-	while (cluster.reset(EBML_FindNextElement(f.get(), &seg_parser_ctx, &upper_level, FALSE)), cluster) {
-		if (!EBML_ElementIsType(cluster.get(), &MATROSKA_ContextCluster)) {
-			EBML_ElementSkipData(cluster.get(), f.get(), &seg_parser_ctx, nullptr, false);
-			continue;
-		}
-		int upper_level2 = 0;
-		ebml_parser_context cluster_parser_context = {&MATROSKA_ContextCluster, nullptr, EBML_ElementPositionEnd(cluster.get()), 0};
-		EbmlElementPtr timecode_elt{};
-		while ((timecode_elt.reset(EBML_FindNextElement(f.get(), &cluster_parser_context, &upper_level2, FALSE)), timecode_elt)
-			&& !EBML_ElementIsType(timecode_elt.get(), &MATROSKA_ContextTimecode));
-		if (timecode_elt == nullptr) return INVALID_FILEPOS_T;
-
-		EBML_ElementReadData(timecode_elt.get(), f.get(), &cluster_parser_context, FALSE, SCOPE_ALL_DATA, 0);
-		auto timecode = EBML_IntegerValue(reinterpret_cast<ebml_integer *>(timecode_elt.get()));
-		auto timestamp = timecode * mInfo->mTimecodeScale / 1000000;
-		if (timestamp >= pos_ms) break;
-
-		EBML_ElementSkipData(cluster.get(), f.get(), &seg_parser_ctx, nullptr, false);
-		prev_cluster = std::move(cluster);
+	ebml_parser_context cluster_parser_context = {&MATROSKA_ContextCluster, nullptr, EBML_ElementPositionEnd(cluster_elt), 0};
+	EbmlElementPtr timecode_elt{};
+	while ((timecode_elt.reset(EBML_FindNextElement(mFile.get(), &cluster_parser_context, &upper_level, FALSE)), timecode_elt)
+		&& upper_level == 0
+		&& !EBML_ElementIsType(timecode_elt.get(), &MATROSKA_ContextTimecode)) {
+		EBML_ElementSkipData(timecode_elt.get(), mFile.get(), &cluster_parser_context, nullptr, FALSE);
 	}
-	if (!prev_cluster && !cluster) return INVALID_FILEPOS_T;
-	if (prev_cluster) cluster = std::move(prev_cluster);
+	if (timecode_elt == nullptr || upper_level != 0) return -1;
 
-	return EBML_ElementPosition(cluster.get());
+	if (EBML_ElementReadData(timecode_elt.get(), mFile.get(), &cluster_parser_context, FALSE, SCOPE_ALL_DATA, 0) != ERR_NONE) return -1;
+	auto timecode = EBML_IntegerValue(reinterpret_cast<ebml_integer *>(timecode_elt.get()));
+	return int(timecode * mInfo->mTimecodeScale / 1000000);
+}
+
+filepos_t MKVReader::findClusterPosition(int pos_ms) const noexcept {
+	if (mClusterIndex.empty()) return INVALID_FILEPOS_T;
+
+	/* Pick the last cluster starting before pos_ms, or the first one if pos_ms precedes all clusters. */
+	auto it = lower_bound(mClusterIndex.cbegin(), mClusterIndex.cend(), pos_ms,
+		[](const MKVIndexEntry &entry, int timestamp){return entry.mTimestamp < timestamp;}
+	);
+	if (it != mClusterIndex.cbegin()) --it;
+	return it->mClusterPos;
 }
 
 void MKVTrackReader::nextBlock(std::unique_ptr<MKVBlock> &block, bool &end_of_track) noexcept {
@@ -546,8 +682,9 @@ void MKVTrackReader::nextBlock(std::unique_ptr<MKVBlock> &block, bool &end_of_tr
 
 	MATROSKA_LinkBlockReadSegmentInfo(block_elt, (ebml_master *)mRoot->mInfoElt.get(), TRUE);
 	MATROSKA_LinkBlockReadTrack(block_elt, (ebml_master *)mTrackElt, TRUE);
-	MATROSKA_BlockReadData(block_elt, mFile.get());
 	block = make_unique<MKVBlock>();
+	block->mFrame = mapFrame((const ebml_element *)block_elt);
+	if(block->mFrame == nullptr) MATROSKA_BlockReadData(block_elt, mFile.get());
 	if(EBML_ElementIsType(mCurrentFrameElt, &MATROSKA_ContextBlockGroup)) {
 		ebml_element *codec_state_elt = EBML_MasterFindChild(mCurrentFrameElt, &MATROSKA_ContextCodecState);
 		if(codec_state_elt) {
@@ -558,10 +695,12 @@ void MKVTrackReader::nextBlock(std::unique_ptr<MKVBlock> &block, bool &end_of_tr
 	}
 	block->mKeyframe = (bool_t)MATROSKA_BlockKeyframe(block_elt);
 	block->mTrackNum = (uint8_t)MATROSKA_BlockTrackNum(block_elt);
-	MATROSKA_BlockGetFrame(block_elt, 0, &m_frame, TRUE);
 	block->mTimestamp = (uint32_t)(MATROSKA_BlockTimecode(block_elt) / 1000000LL);
-	block->mData.assign(m_frame.Data, m_frame.Data + m_frame.Size);
-	MATROSKA_BlockReleaseData(block_elt, TRUE);
+	if(block->mFrame == nullptr) {
+		MATROSKA_BlockGetFrame(block_elt, 0, &m_frame, TRUE);
+		block->mData.assign(m_frame.Data, m_frame.Data + m_frame.Size);
+		MATROSKA_BlockReleaseData(block_elt, TRUE);
+	}
 }
 
 void MKVTrackReader::reset() noexcept {
@@ -623,3 +762,28 @@ matroska_block *MKVTrackReader::frameToBlock(const ebml_element *frameElt) noexc
 	}
 	return (matroska_block *)blockElt;
 }
+
+/*
+ * Get the frame of a block as a view on the mapped file. The block header
+ * (track number, relative timecode and flags) is parsed by hand. Laced blocks,
+ * which hold several frames, and blocks of encoded tracks are left to libmatroska.
+ */
+MblkPtr MKVTrackReader::mapFrame(const ebml_element *blockElt) const noexcept {
+	MKVFileMapping *mapping = mRoot->mMapping;
+	if (mapping == nullptr || !mMappable) return nullptr;
+
+	filepos_t pos = EBML_ElementPositionData(blockElt);
+	auto size = (size_t)EBML_ElementDataSize(blockElt, FALSE);
+	if (pos < 0 || (size_t)pos >= mapping->size() || size > mapping->size() - (size_t)pos || size == 0) return nullptr;
+
+	const uint8_t *data = mapping->data() + pos;
+	size_t trackNumLen = 1;
+	while (trackNumLen <= 8 && (data[0] & (0x80 >> (trackNumLen - 1))) == 0) trackNumLen++;
+	size_t headerLen = trackNumLen + 3; // track number + timecode (16 bits) + flags
+	if (trackNumLen > 8 || headerLen > size) return nullptr;
+
+	uint8_t flags = data[headerLen - 1];
+	if ((flags & 0x06) != 0) return nullptr; // lacing
+
+	return MblkPtr{mapping->makeView(pos + (filepos_t)headerLen, size - headerLen)};
+}
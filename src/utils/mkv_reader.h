@@ -38,6 +38,11 @@ struct StreamCloser {
 };
 using StreamPtr = std::unique_ptr<stream, StreamCloser>;
 
+struct MblkFreer {
+	void operator()(mblk_t *ptr) {freemsg(ptr);}
+};
+using MblkPtr = std::unique_ptr<mblk_t, MblkFreer>;
+
 class MKVParserCtx {
 public:
 	MKVParserCtx();
@@ -68,6 +73,7 @@ struct MKVBlock {
 	bool mKeyframe{false};
 	std::vector<uint8_t> mData{};
 	std::vector<uint8_t>mCodecState{};
+	MblkPtr mFrame{}; // view on the mapped file. When set, mData is left empty
 };
 
 #define MKV_TRACK_TYPE_VIDEO    0x01
@@ -114,7 +120,18 @@ struct MKVAudioTrack : public MKVTrack {
 	void parse(const ebml_element *track_elt) noexcept override;
 };
 
+/**
+ * @brief Entry of the seeking index built on opening.
+ * Cluster index entries are valid for every track and have mTrackNum set to 0.
+ */
+struct MKVIndexEntry {
+	int mTimestamp{0}; // ms
+	int mTrackNum{0};
+	filepos_t mClusterPos{0};
+};
+
 class MKVTrackReader;
+class MKVFileMapping;
 
 class MKVReader{
 public:
@@ -173,22 +190,33 @@ public:
 	 */
 	int seek(int pos_ms) noexcept;
 
+	/**
+	 * @brief Tell whether blocks are served as views on a memory mapping of the file.
+	 * That is the case on platforms supporting mmap() for files which fit in the address space,
+	 * except for the tracks having a content encoding (e.g. header stripping), whose blocks are still copied.
+	 */
+	bool isMapped() const noexcept {return mMapping != nullptr;}
+
 private:
 	void resetPrivateData() noexcept;
 	int parseHeaders() noexcept;
 	int parseTracks(const ebml_element *tracks_elt) noexcept;
-	filepos_t findClusterPosition(int pos_ms) noexcept;
+	void buildCueIndex(const ebml_element *cues_elt) noexcept;
+	int readClusterTimestamp(const ebml_element *cluster_elt) noexcept;
+	filepos_t findClusterPosition(int pos_ms) const noexcept;
 
 	std::unique_ptr<MKVParserCtx> mParserCtx{};
 	StreamPtr mFile{};
 	EbmlElementPtr mInfoElt{};
 	std::vector<EbmlElementPtr> mTracksElt{};
-	EbmlElementPtr mCues{};
 	std::unique_ptr<MKVSegmentInfo> mInfo{};
 	std::vector<std::unique_ptr<MKVTrack>> mTracks{};
 	filepos_t mFirstClusterPos{0};
 	filepos_t mLastClusterEnd{0};
 	filepos_t mFirstLevel1Pos{0};
+	std::vector<MKVIndexEntry> mCueIndex{}; // sorted by timestamp
+	std::vector<MKVIndexEntry> mClusterIndex{}; // sorted by timestamp
+	MKVFileMapping *mMapping{nullptr};
 	std::list<std::unique_ptr<MKVTrackReader>> mReaders{};
 
 	friend class MKVTrackReader;
@@ -215,6 +243,7 @@ private:
 	int seek(filepos_t clusterPos, int pos_ms) noexcept;
 
 	static matroska_block *frameToBlock(const ebml_element *frameElt) noexcept;
+	MblkPtr mapFrame(const ebml_element *blockElt) const noexcept;
 
 	int mTrackNum{0};
 	ebml_parser_context mParser{0};
@@ -224,6 +253,7 @@ private:
 	StreamPtr mFile{};
 	MKVReader *mRoot{nullptr};
 	bool mNeedSeeking{false};
+	bool mMappable{false}; // frames may be views on the mapped file: the file is mapped and the track has no content encoding
 
 	friend class MKVReader;
 };
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MS_ATOMIC_H
+#define MS_ATOMIC_H
+
+#include "mediastreamer2/mscommon.h"
+
+/*
+ * Minimal set of atomic operations on 32 bits counters and pointers, used by the lock-free structures of mediastreamer2.
+ * Loads have acquire semantics, stores have release semantics, read-modify-write operations are sequentially consistent.
+ */
+
+#ifdef _MSC_VER
+
+#include <windows.h>
+
+typedef volatile LONG ms_atomic_uint_t;
+typedef void * volatile ms_atomic_ptr_t;
+
+static MS2_INLINE unsigned int ms_atomic_load(ms_atomic_uint_t *v){
+	return (unsigned int)InterlockedCompareExchange(v, 0, 0);
+}
+
+static MS2_INLINE void ms_atomic_store(ms_atomic_uint_t *v, unsigned int value){
+	InterlockedExchange(v, (LONG)value);
+}
+
+static MS2_INLINE unsigned int ms_atomic_fetch_add(ms_atomic_uint_t *v, unsigned int value){
+	return (unsigned int)InterlockedExchangeAdd(v, (LONG)value);
+}
+
+static MS2_INLINE bool_t ms_atomic_compare_exchange(ms_atomic_uint_t *v, unsigned int expected, unsigned int desired){
+	return (unsigned int)InterlockedCompareExchange(v, (LONG)desired, (LONG)expected) == expected;
+}
+
+static MS2_INLINE void *ms_atomic_ptr_load(ms_atomic_ptr_t *p){
+	return InterlockedCompareExchangePointer(p, NULL, NULL);
+}
+
+static MS2_INLINE void *ms_atomic_ptr_exchange(ms_atomic_ptr_t *p, void *value){
+	return InterlockedExchangePointer(p, value);
+}
+
+#else
+
+typedef volatile unsigned int ms_atomic_uint_t;
+typedef void * volatile ms_atomic_ptr_t;
+
+static MS2_INLINE unsigned int ms_atomic_load(ms_atomic_uint_t *v){
+	return __atomic_load_n(v, __ATOMIC_ACQUIRE);
+}
+
+static MS2_INLINE void ms_atomic_store(ms_atomic_uint_t *v, unsigned int value){
+	__atomic_store_n(v, value, __ATOMIC_RELEASE);
+}
+
+static MS2_INLINE unsigned int ms_atomic_fetch_add(ms_atomic_uint_t *v, unsigned int value){
+	return __atomic_fetch_add(v, value, __ATOMIC_SEQ_CST);
+}
+
+static MS2_INLINE bool_t ms_atomic_compare_exchange(ms_atomic_uint_t *v, unsigned int expected, unsigned int desired){
+	return __atomic_compare_exchange_n(v, &expected, desired, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) ? TRUE : FALSE;
+}
+
+static MS2_INLINE void *ms_atomic_ptr_load(ms_atomic_ptr_t *p){
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static MS2_INLINE void *ms_atomic_ptr_exchange(ms_atomic_ptr_t *p, void *value){
+	return __atomic_exchange_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+#endif
+
+/*
+ * One-time initialization: the first caller runs init, the concurrent ones wait until it returns. The state must be
+ * statically initialized to MS_ONCE_INIT.
+ */
+typedef ms_atomic_uint_t ms_once_t;
+
+#define MS_ONCE_INIT 0
+
+static MS2_INLINE void ms_once(ms_once_t *once, void (*init)(void)){
+	if (ms_atomic_load(once) == 2) return;
+	if (ms_atomic_compare_exchange(once, 0, 1)){
+		init();
+		ms_atomic_store(once, 2);
+		return;
+	}
+	while (ms_atomic_load(once) != 2) ms_usleep(100);
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mssimd.h"
+
+#if MS_HAS_AVX2 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifdef __ANDROID__
+#include "cpu-features.h"
+#endif
+
+static unsigned int detect_cpu_features(void){
+	unsigned int features=0;
+#if MS_HAS_SSE2
+	features|=MSCpuFeatureSSE2;
+#endif
+#if MS_HAS_AVX2
+#ifdef _MSC_VER
+	{
+		int regs[4];
+		__cpuid(regs,0);
+		if (regs[0]>=7){
+			__cpuid(regs,1);
+			/*OSXSAVE and AVX: the OS must save the ymm registers*/
+			if ((regs[2] & (1<<27)) && (regs[2] & (1<<28)) && ((_xgetbv(0) & 6)==6)){
+				__cpuidex(regs,7,0);
+				if (regs[1] & (1<<5)) features|=MSCpuFeatureAVX2;
+			}
+		}
+	}
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) features|=MSCpuFeatureAVX2;
+#endif
+#endif
+#if MS_HAS_ARM_NEON
+#if defined(__ANDROID__) && !defined(__aarch64__)
+	if ((android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON)!=0)
+		features|=MSCpuFeatureNEON;
+#else
+	features|=MSCpuFeatureNEON;
+#endif
+#endif
+	return features;
+}
+
+unsigned int ms_get_cpu_features(void){
+	static int features=-1;
+	if (features==-1){
+		unsigned int detected=detect_cpu_features();
+		const char *mask=getenv("MS_CPU_FEATURES_MASK");
+		if (mask) detected&=(unsigned int)strtoul(mask,NULL,0);
+		ms_message("CPU features available for SIMD kernels:%s%s%s",
+			(detected & MSCpuFeatureSSE2) ? " SSE2" : "",
+			(detected & MSCpuFeatureAVX2) ? " AVX2" : "",
+			(detected & MSCpuFeatureNEON) ? " NEON" : "");
+		features=(int)detected;
+	}
+	return (unsigned int)features;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MS_SIMD_H
+#define MS_SIMD_H
+
+#include "mediastreamer2/mscommon.h"
+
+/*
+ * Compile-time availability of SIMD instruction sets, and runtime detection of the ones supported by the cpu.
+ * SSE2 is part of the x86_64 baseline. AVX2 kernels are compiled with a per-function target attribute, so that
+ * the rest of the library does not require AVX2, and must only be called when ms_get_cpu_features() reports it.
+ */
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MS_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if MS_HAS_SSE2 && (defined(_MSC_VER) || (defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))))
+#define MS_HAS_AVX2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define MS_TARGET_AVX2
+#else
+#define MS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if MS_HAS_ARM_NEON
+#include <arm_neon.h>
+#endif
+
+enum _MSCpuFeature{
+	MSCpuFeatureSSE2 = 1,
+	MSCpuFeatureAVX2 = 1 << 1,
+	MSCpuFeatureNEON = 1 << 2
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Returns the bitmask of MSCpuFeature supported by both the build and the cpu running it.
+ * The environment variable MS_CPU_FEATURES_MASK, if set, is and-ed with the result, which is handy to benchmark or
+ * test the generic code paths.
+**/
+unsigned int ms_get_cpu_features(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,463 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include "mediastreamer-config.h"
+#endif
+
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for recvmmsg() and sendmmsg() */
+#endif
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <string.h>
+#include <errno.h>
+#define MS_UDP_BATCH_SUPPORTED 1
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103 /* since Linux 4.18 */
+#endif
+#endif
+
+#include "msudpbatch.h"
+#include "msatomic.h"
+
+#ifdef MS_UDP_BATCH_SUPPORTED
+
+#define MS_UDP_SEND_QUEUE_SIZE 64 /* maximum number of packets sent with one system call */
+#define MS_UDP_MAX_IOV_PER_PACKET 8 /* packets made of more fragments are pulled up */
+#define MS_UDP_GSO_MAX_SEGMENTS 64
+#define MS_UDP_GSO_MAX_SIZE 65000 /* an UDP datagram, including headers, cannot exceed 65535 bytes */
+
+typedef struct _MSUdpPendingPacket{
+	mblk_t *m;
+	ortp_socket_t sock;
+	struct sockaddr_storage to;
+	socklen_t tolen;
+	int size;
+}MSUdpPendingPacket;
+
+struct _MSUdpSendQueue{
+	MSUdpPendingPacket packets[MS_UDP_SEND_QUEUE_SIZE];
+	int count;
+	struct mmsghdr msgs[MS_UDP_SEND_QUEUE_SIZE];
+	int msg_packets[MS_UDP_SEND_QUEUE_SIZE+1]; /* index of the first packet of each message, and end of the last one */
+	struct iovec iovs[MS_UDP_SEND_QUEUE_SIZE*MS_UDP_MAX_IOV_PER_PACKET];
+	uint8_t controls[MS_UDP_SEND_QUEUE_SIZE][CMSG_SPACE(sizeof(uint16_t))];
+	MSRtpBatchStats stats;
+	bool_t gso_enabled;
+};
+
+MSUdpSendQueue *ms_udp_send_queue_new(void){
+	MSUdpSendQueue *q=ms_new0(MSUdpSendQueue,1);
+	q->gso_enabled=TRUE;
+	return q;
+}
+
+void ms_udp_send_queue_put(MSUdpSendQueue *q, ortp_socket_t sock, mblk_t *m, const struct sockaddr *to, socklen_t tolen){
+	MSUdpPendingPacket *p;
+	mblk_t *it;
+	int nfrags=0;
+
+	if (q->count==MS_UDP_SEND_QUEUE_SIZE) ms_udp_send_queue_flush(q);
+	for(it=m;it!=NULL;it=it->b_cont) nfrags++;
+	if (nfrags>MS_UDP_MAX_IOV_PER_PACKET) msgpullup(m,-1);
+	p=&q->packets[q->count++];
+	p->m=m;
+	p->sock=sock;
+	p->size=(int)msgdsize(m);
+	p->tolen=(to && tolen<=(socklen_t)sizeof(p->to)) ? tolen : 0;
+	if (p->tolen>0) memcpy(&p->to,to,p->tolen);
+}
+
+static bool_t same_destination(const MSUdpPendingPacket *p1, const MSUdpPendingPacket *p2){
+	return p1->sock==p2->sock && p1->tolen==p2->tolen && memcmp(&p1->to,&p2->to,p1->tolen)==0;
+}
+
+static void add_packet_iovs(MSUdpSendQueue *q, struct msghdr *hdr, const MSUdpPendingPacket *p){
+	mblk_t *it;
+	for(it=p->m;it!=NULL;it=it->b_cont){
+		struct iovec *iov=&hdr->msg_iov[hdr->msg_iovlen];
+		if (it->b_wptr==it->b_rptr) continue;
+		iov->iov_base=it->b_rptr;
+		iov->iov_len=it->b_wptr-it->b_rptr;
+		hdr->msg_iovlen++;
+	}
+}
+
+/*
+ * Build the messages for the packets starting at first, that are to be sent on the same socket.
+ * With GSO, consecutive packets of the same size to the same destination are sent as one message, the last one being possibly shorter.
+ * Returns the number of messages.
+ */
+static int build_messages(MSUdpSendQueue *q, int first){
+	int nmsgs=0;
+	int i=first;
+	struct iovec *iov=q->iovs;
+
+	while(i<q->count && q->packets[i].sock==q->packets[first].sock){
+		struct msghdr *hdr=&q->msgs[nmsgs].msg_hdr;
+		const MSUdpPendingPacket *p=&q->packets[i];
+		int nsegments=1;
+		int total=p->size;
+
+		memset(hdr,0,sizeof(*hdr));
+		hdr->msg_name=p->tolen>0 ? (void*)&p->to : NULL;
+		hdr->msg_namelen=p->tolen;
+		hdr->msg_iov=iov;
+		q->msg_packets[nmsgs]=i;
+		add_packet_iovs(q,hdr,p);
+		i++;
+		if (q->gso_enabled){
+			while(i<q->count && nsegments<MS_UDP_GSO_MAX_SEGMENTS && same_destination(p,&q->packets[i])
+				&& q->packets[i-1].size==p->size && q->packets[i].size<=p->size && total+q->packets[i].size<=MS_UDP_GSO_MAX_SIZE){
+				add_packet_iovs(q,hdr,&q->packets[i]);
+				total+=q->packets[i].size;
+				nsegments++;
+				i++;
+			}
+			if (nsegments>1){
+				struct cmsghdr *cmsg;
+				hdr->msg_control=q->controls[nmsgs];
+				hdr->msg_controllen=CMSG_SPACE(sizeof(uint16_t));
+				cmsg=CMSG_FIRSTHDR(hdr);
+				cmsg->cmsg_level=SOL_UDP;
+				cmsg->cmsg_type=UDP_SEGMENT;
+				cmsg->cmsg_len=CMSG_LEN(sizeof(uint16_t));
+				*(uint16_t*)CMSG_DATA(cmsg)=(uint16_t)p->size;
+			}
+		}
+		iov+=hdr->msg_iovlen;
+		nmsgs++;
+	}
+	q->msg_packets[nmsgs]=i;
+	return nmsgs;
+}
+
+void ms_udp_send_queue_flush(MSUdpSendQueue *q){
+	int first=0;
+	int i;
+
+	while(first<q->count){
+		ortp_socket_t sock=q->packets[first].sock;
+		int nmsgs=build_messages(q,first);
+		int sent=0;
+
+		while(sent<nmsgs){
+			int ret=sendmmsg(sock,&q->msgs[sent],nmsgs-sent,0);
+			q->stats.send_calls++;
+			if (ret>0){
+				q->stats.send_packets+=q->msg_packets[sent+ret]-q->msg_packets[sent];
+				sent+=ret;
+			}else if (q->msgs[sent].msg_hdr.msg_control!=NULL && (errno==EIO || errno==EINVAL || errno==ENOPROTOOPT)){
+				/*GSO not supported by the kernel or the network interface: send again without it.
+				 Other errors, such as a full socket buffer, are not related to GSO.*/
+				ms_warning("MSUdpSendQueue [%p]: sending with UDP segmentation offload failed (errno=%i), disabling it.",q,errno);
+				q->gso_enabled=FALSE;
+				break;
+			}else{
+				/*the packets were already reported as sent to the caller, the error can only be counted*/
+				int npackets=q->msg_packets[sent+1]-q->msg_packets[sent];
+				ms_error("MSUdpSendQueue [%p]: failed to send %i UDP packet(s): errno=%i",q,npackets,errno);
+				q->stats.send_errors+=npackets;
+				sent++;
+			}
+		}
+		first=q->msg_packets[sent];
+	}
+	for(i=0;i<q->count;i++){
+		freemsg(q->packets[i].m);
+	}
+	q->count=0;
+}
+
+void ms_udp_send_queue_get_stats(const MSUdpSendQueue *q, MSRtpBatchStats *stats){
+	stats->send_calls=q->stats.send_calls;
+	stats->send_packets=q->stats.send_packets;
+	stats->send_errors=q->stats.send_errors;
+}
+
+void ms_udp_send_queue_destroy(MSUdpSendQueue *q){
+	ms_udp_send_queue_flush(q);
+	ms_free(q);
+}
+
+#define MS_RTP_BATCH_SIZE 32 /* maximum number of packets received with one system call */
+#define MS_RTP_BATCH_PACKET_SIZE 2048
+#define MS_RTP_BATCH_CONTROL_SIZE 128 /* enough for packet info and timestamp control messages */
+
+struct _MSRtpBatch{
+	RtpSession *session;
+	RtpTransport *endpoint;
+	ms_atomic_uint_t refcount; /*the MSRtpRecv and MSRtpSend holding the batch may run on different tickers*/
+	/*receive*/
+	struct mmsghdr msgs[MS_RTP_BATCH_SIZE];
+	struct iovec iovs[MS_RTP_BATCH_SIZE];
+	struct sockaddr_storage addrs[MS_RTP_BATCH_SIZE];
+	uint8_t controls[MS_RTP_BATCH_SIZE][MS_RTP_BATCH_CONTROL_SIZE];
+	uint8_t *buffers;
+	int count; /* number of packets received by the last recvmmsg() */
+	int next; /* index of the next packet to give to oRTP */
+	unsigned int recv_calls;
+	unsigned int recv_packets;
+	/*send*/
+	MSUdpSendQueue *send_queue;
+	ms_thread_t sending_thread;
+	bool_t receive_enabled;
+	bool_t send_enabled;
+	bool_t sending;
+};
+
+static int ms_rtp_batch_fill(MSRtpBatch *b){
+	ortp_socket_t sock=rtp_session_get_rtp_socket(b->session);
+	int i,ret;
+
+	for(i=0;i<MS_RTP_BATCH_SIZE;i++){
+		struct msghdr *hdr=&b->msgs[i].msg_hdr;
+		b->iovs[i].iov_base=b->buffers+i*MS_RTP_BATCH_PACKET_SIZE;
+		b->iovs[i].iov_len=MS_RTP_BATCH_PACKET_SIZE;
+		hdr->msg_name=&b->addrs[i];
+		hdr->msg_namelen=sizeof(b->addrs[i]);
+		hdr->msg_iov=&b->iovs[i];
+		hdr->msg_iovlen=1;
+		hdr->msg_control=b->controls[i];
+		hdr->msg_controllen=MS_RTP_BATCH_CONTROL_SIZE;
+		hdr->msg_flags=0;
+	}
+	b->next=0;
+	b->count=0;
+	ret=recvmmsg(sock,b->msgs,MS_RTP_BATCH_SIZE,MSG_DONTWAIT,NULL);
+	b->recv_calls++;
+	if (ret>0){
+		b->count=ret;
+		b->recv_packets+=ret;
+	}
+	return ret;
+}
+
+/* same information as the one oRTP extracts from the control messages when it receives a packet by itself */
+static void ms_rtp_batch_parse_control(MSRtpBatch *b, struct msghdr *hdr, mblk_t *msg){
+	struct cmsghdr *cmsg;
+	for(cmsg=CMSG_FIRSTHDR(hdr);cmsg!=NULL;cmsg=CMSG_NXTHDR(hdr,cmsg)){
+#if defined(ORTP_TIMESTAMP)
+		if (cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SO_TIMESTAMP){
+			memcpy(&msg->timestamp,CMSG_DATA(cmsg),sizeof(struct timeval));
+			continue;
+		}
+#endif
+		if (cmsg->cmsg_level==IPPROTO_IP && cmsg->cmsg_type==IP_PKTINFO){
+			struct in_pktinfo *pi=(struct in_pktinfo*)CMSG_DATA(cmsg);
+			memcpy(&msg->recv_addr.addr.ipi_addr,&pi->ipi_addr,sizeof(msg->recv_addr.addr.ipi_addr));
+			msg->recv_addr.family=AF_INET;
+		}else if (cmsg->cmsg_level==IPPROTO_IPV6 && cmsg->cmsg_type==IPV6_PKTINFO){
+			struct in6_pktinfo *pi=(struct in6_pktinfo*)CMSG_DATA(cmsg);
+			memcpy(&msg->recv_addr.addr.ipi6_addr,&pi->ipi6_addr,sizeof(msg->recv_addr.addr.ipi6_addr));
+			msg->recv_addr.family=AF_INET6;
+		}
+	}
+	if (msg->recv_addr.family!=AF_UNSPEC) msg->recv_addr.port=htons(rtp_session_get_local_port(b->session));
+}
+
+static int ms_rtp_batch_endpoint_recvfrom(RtpTransport *rtptp, mblk_t *msg, int flags, struct sockaddr *from, socklen_t *fromlen){
+	MSRtpBatch *b=(MSRtpBatch*)rtptp->data;
+	struct msghdr *hdr;
+	int len;
+
+	if (b==NULL) return -1;
+	if (!b->receive_enabled) return rtp_session_recvfrom(b->session,TRUE,msg,flags,from,fromlen);
+	if (b->next>=b->count && ms_rtp_batch_fill(b)<=0) return -1; /*errno is set by recvmmsg()*/
+	hdr=&b->msgs[b->next].msg_hdr;
+	len=(int)b->msgs[b->next].msg_len;
+	if (hdr->msg_flags & MSG_TRUNC){
+		ms_warning("MSRtpBatch [%p]: truncated packet of %i bytes received.",b,len);
+	}
+	if (len>(int)(msg->b_datap->db_lim-msg->b_wptr)) len=(int)(msg->b_datap->db_lim-msg->b_wptr);
+	memcpy(msg->b_wptr,b->iovs[b->next].iov_base,len);
+	if (from && fromlen){
+		socklen_t addrlen=*fromlen<hdr->msg_namelen ? *fromlen : hdr->msg_namelen;
+		memcpy(from,hdr->msg_name,addrlen);
+		*fromlen=hdr->msg_namelen;
+	}
+	ms_rtp_batch_parse_control(b,hdr,msg);
+	b->next++;
+	return len;
+}
+
+static int ms_rtp_batch_endpoint_sendto(RtpTransport *rtptp, mblk_t *msg, int flags, const struct sockaddr *to, socklen_t tolen){
+	MSRtpBatch *b=(MSRtpBatch*)rtptp->data;
+	if (b==NULL) return -1;
+	/*packets with a source address given by ICE are sent by oRTP, that knows how to set it*/
+	if (b->sending && b->sending_thread==ms_thread_self() && msg->recv_addr.family==AF_UNSPEC){
+		int size=(int)msgdsize(msg);
+		/*the caller frees msg once sent: only references to its data are kept*/
+		ms_udp_send_queue_put(b->send_queue,rtp_session_get_rtp_socket(b->session),dupmsg(msg),to,tolen);
+		return size;
+	}
+	return rtp_session_sendto(b->session,TRUE,msg,flags,to,tolen);
+}
+
+static void ms_rtp_batch_endpoint_destroy(RtpTransport *rtptp){
+	MSRtpBatch *b=(MSRtpBatch*)rtptp->data;
+	/*the meta transport is destroyed with the session, before the batch*/
+	if (b) b->endpoint=NULL;
+	ms_free(rtptp);
+}
+
+MSRtpBatch *ms_rtp_batch_ref_from_session(RtpSession *session){
+	RtpTransport *rtpt=NULL;
+	RtpTransport *endpoint;
+	MSRtpBatch *b;
+
+	rtp_session_get_transports(session,&rtpt,NULL);
+	if (rtpt==NULL){
+		ms_error("MSRtpBatch: session %p has no meta transport, batching not possible.",session);
+		return NULL;
+	}
+	endpoint=meta_rtp_transport_get_endpoint(rtpt);
+	if (endpoint!=NULL){
+		if (endpoint->t_recvfrom==ms_rtp_batch_endpoint_recvfrom && endpoint->data!=NULL){
+			b=(MSRtpBatch*)endpoint->data;
+			ms_atomic_fetch_add(&b->refcount,1);
+			return b;
+		}
+		/*for example the TURN endpoint: it reads from the socket by itself*/
+		ms_warning("MSRtpBatch: session %p already has a transport endpoint, batching not possible.",session);
+		return NULL;
+	}
+	b=ms_new0(MSRtpBatch,1);
+	b->session=session;
+	ms_atomic_store(&b->refcount,1);
+	b->buffers=ms_malloc(MS_RTP_BATCH_SIZE*MS_RTP_BATCH_PACKET_SIZE);
+	b->send_queue=ms_udp_send_queue_new();
+	b->endpoint=ms_new0(RtpTransport,1);
+	b->endpoint->t_getsocket=NULL;
+	b->endpoint->t_recvfrom=ms_rtp_batch_endpoint_recvfrom;
+	b->endpoint->t_sendto=ms_rtp_batch_endpoint_sendto;
+	b->endpoint->t_destroy=ms_rtp_batch_endpoint_destroy;
+	b->endpoint->data=b;
+	meta_rtp_transport_set_endpoint(rtpt,b->endpoint);
+	ms_message("MSRtpBatch [%p]: installed on session %p.",b,session);
+	return b;
+}
+
+void ms_rtp_batch_enable_receive(MSRtpBatch *b, bool_t enabled){
+	b->receive_enabled=enabled;
+}
+
+void ms_rtp_batch_enable_send(MSRtpBatch *b, bool_t enabled){
+	if (!enabled) ms_rtp_batch_flush(b);
+	b->send_enabled=enabled;
+}
+
+void ms_rtp_batch_begin_send(MSRtpBatch *b){
+	if (!b->send_enabled) return;
+	b->sending_thread=ms_thread_self();
+	b->sending=TRUE;
+}
+
+void ms_rtp_batch_flush(MSRtpBatch *b){
+	b->sending=FALSE;
+	ms_udp_send_queue_flush(b->send_queue);
+}
+
+void ms_rtp_batch_get_stats(const MSRtpBatch *b, MSRtpBatchStats *stats){
+	ms_udp_send_queue_get_stats(b->send_queue,stats);
+	stats->recv_calls=b->recv_calls;
+	stats->recv_packets=b->recv_packets;
+}
+
+void ms_rtp_batch_unref(MSRtpBatch *b){
+	if (ms_atomic_fetch_add(&b->refcount,(unsigned int)-1)>1) return;
+	ms_udp_send_queue_destroy(b->send_queue);
+	if (b->endpoint){
+		RtpTransport *rtpt=NULL;
+		rtp_session_get_transports(b->session,&rtpt,NULL);
+		if (rtpt && meta_rtp_transport_get_endpoint(rtpt)==b->endpoint){
+			meta_rtp_transport_set_endpoint(rtpt,NULL);
+		}
+		ms_free(b->endpoint);
+	}
+	if (b->count>b->next){
+		ms_message("MSRtpBatch [%p]: %i received packets discarded.",b,b->count-b->next);
+	}
+	ms_free(b->buffers);
+	ms_free(b);
+}
+
+#else
+
+struct _MSUdpSendQueue{
+	MSRtpBatchStats stats;
+};
+
+MSUdpSendQueue *ms_udp_send_queue_new(void){
+	return ms_new0(MSUdpSendQueue,1);
+}
+
+void ms_udp_send_queue_put(MSUdpSendQueue *q, ortp_socket_t sock, mblk_t *m, const struct sockaddr *to, socklen_t tolen){
+	msgpullup(m,-1);
+	q->stats.send_calls++;
+	if (bctbx_sendto(sock,m->b_rptr,(int)(m->b_wptr-m->b_rptr),0,to,tolen)==-1){
+		ms_error("MSUdpSendQueue [%p]: failed to send UDP packet: errno=%i",q,errno);
+		q->stats.send_errors++;
+	}else q->stats.send_packets++;
+	freemsg(m);
+}
+
+void ms_udp_send_queue_flush(MSUdpSendQueue *q){
+}
+
+void ms_udp_send_queue_get_stats(const MSUdpSendQueue *q, MSRtpBatchStats *stats){
+	stats->send_calls=q->stats.send_calls;
+	stats->send_packets=q->stats.send_packets;
+	stats->send_errors=q->stats.send_errors;
+}
+
+void ms_udp_send_queue_destroy(MSUdpSendQueue *q){
+	ms_free(q);
+}
+
+MSRtpBatch *ms_rtp_batch_ref_from_session(RtpSession *session){
+	ms_warning("MSRtpBatch: batched I/O is not supported on this platform.");
+	return NULL;
+}
+
+void ms_rtp_batch_enable_receive(MSRtpBatch *b, bool_t enabled){
+}
+
+void ms_rtp_batch_enable_send(MSRtpBatch *b, bool_t enabled){
+}
+
+void ms_rtp_batch_begin_send(MSRtpBatch *b){
+}
+
+void ms_rtp_batch_flush(MSRtpBatch *b){
+}
+
+void ms_rtp_batch_get_stats(const MSRtpBatch *b, MSRtpBatchStats *stats){
+}
+
+void ms_rtp_batch_unref(MSRtpBatch *b){
+}
+
+#endif
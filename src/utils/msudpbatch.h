@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2010-2019 Belledonne Communications SARL.
+ *
+ * This file is part of mediastreamer2.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MS_UDP_BATCH_H
+#define MS_UDP_BATCH_H
+
+#include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/msrtp.h"
+
+/*
+ * Batched UDP I/O.
+ * On Linux, packets are sent with sendmmsg(), without pulling up the messages, and with UDP segmentation offload (GSO)
+ * when consecutive packets to the same destination have the same size. They are received with recvmmsg().
+ * Elsewhere, packets are sent one by one as soon as they are queued, and batched receive is not available.
+ */
+
+/*
+ * A queue of packets to send, that is flushed with as few system calls as possible.
+ */
+typedef struct _MSUdpSendQueue MSUdpSendQueue;
+
+MSUdpSendQueue *ms_udp_send_queue_new(void);
+
+/* queue a packet to be sent on sock to the given destination (to may be NULL for a connected socket). m is owned by the queue. */
+void ms_udp_send_queue_put(MSUdpSendQueue *q, ortp_socket_t sock, mblk_t *m, const struct sockaddr *to, socklen_t tolen);
+
+void ms_udp_send_queue_flush(MSUdpSendQueue *q);
+
+void ms_udp_send_queue_get_stats(const MSUdpSendQueue *q, MSRtpBatchStats *stats);
+
+void ms_udp_send_queue_destroy(MSUdpSendQueue *q);
+
+/*
+ * Batched I/O on the RTP socket of a RtpSession.
+ * A MSRtpBatch installs itself as the endpoint of the RTP meta transport of the session. It is shared by the MSRtpRecv and
+ * MSRtpSend of the session, each one holding a reference.
+ * When receive batching is enabled, the packets requested one by one by oRTP are received several at a time with recvmmsg().
+ * When send batching is enabled, the packets sent by oRTP between ms_rtp_batch_begin_send() and ms_rtp_batch_flush()
+ * from the calling thread are queued and sent together by ms_rtp_batch_flush().
+ * ms_rtp_batch_ref_from_session() returns NULL when batching is not possible.
+ */
+typedef struct _MSRtpBatch MSRtpBatch;
+
+MSRtpBatch *ms_rtp_batch_ref_from_session(RtpSession *session);
+
+void ms_rtp_batch_enable_receive(MSRtpBatch *batch, bool_t enabled);
+
+void ms_rtp_batch_enable_send(MSRtpBatch *batch, bool_t enabled);
+
+void ms_rtp_batch_begin_send(MSRtpBatch *batch);
+
+void ms_rtp_batch_flush(MSRtpBatch *batch);
+
+void ms_rtp_batch_get_stats(const MSRtpBatch *batch, MSRtpBatchStats *stats);
+
+void ms_rtp_batch_unref(MSRtpBatch *batch);
+
+#endif
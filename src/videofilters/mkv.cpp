@@ -21,6 +21,11 @@
 #include <algorithm>
 #include <memory>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include <stdint.h>
 #define bool_t matroska_bool_t
 extern "C" {
@@ -460,9 +465,12 @@ static void h264_module_reverse(MSFactory* factory, void *data, mblk_t *input, M
 		memcpy(&naluSize, input->b_rptr, sizeof(uint32_t));
 		input->b_rptr += sizeof(uint32_t);
 		naluSize = ntohl(naluSize);
-		nalu = allocb(naluSize, 0);
-		memcpy(nalu->b_wptr, input->b_rptr, naluSize);
-		nalu->b_wptr += naluSize;
+		if(naluSize > (uint32_t)(input->b_wptr - input->b_rptr)) {
+			ms_error("MKVPlayer: H264 frame truncated");
+			break;
+		}
+		nalu = dupb(input);
+		nalu->b_wptr = nalu->b_rptr + naluSize;
 		input->b_rptr += naluSize;
 		if(buffer == NULL) {
 			buffer = nalu;
@@ -1207,6 +1215,15 @@ static int matroska_open_file(Matroska *obj, const char *path, MatroskaOpenMode
 	return err;
 }
 
+/* Push the data held by the output stream to the operating system. corec streams have no flush entry: seeking to the
+ * current position makes a buffered stream write its buffer out, and costs nothing to the File stream, which writes
+ * to its descriptor directly. */
+static void matroska_flush(Matroska *obj) {
+	if(obj->output != NULL) {
+		Stream_Seek(obj->output, 0, SEEK_CUR);
+	}
+}
+
 static void matroska_close_file(Matroska *obj) {
 	if(obj->output != NULL) {
 		StreamClose(obj->output);
@@ -1811,6 +1828,121 @@ static uint32_t time_loop_canceler_apply(TimeLoopCanceler *obj, uint32_t timesta
 	return (uint32_t)((uint64_t)timestamp + (uint64_t)0x00000000ffffffff * (uint64_t)obj->module - (uint64_t)obj->offset);
 }
 
+/*********************************************************************************************
+ * Writer                                                                                    *
+ *********************************************************************************************/
+/*
+ * Bounded queue of the frames leaving the muxer, consumed by the thread which builds the clusters and writes
+ * them to the file, so that a slow disk does not delay the ticker.
+ */
+#define WRITER_QUEUE_CAPACITY 2048 /* frames */
+#define WRITER_DEFAULT_MAX_BYTES (16 * 1024 * 1024)
+
+typedef struct {
+	mblk_t *frame;
+	uint16_t pin;
+} WriterItem;
+
+typedef struct {
+	ms_thread_t thread;
+	ms_mutex_t lock;
+	ms_cond_t cond;
+	WriterItem items[WRITER_QUEUE_CAPACITY]; /* ring of the frames waiting to be written */
+	int first;
+	int count;
+	size_t bytes; /* size of the frames waiting to be written, including the ones being written */
+	size_t maxBytes;
+	ms_bool_t running;
+} Writer;
+
+static void writer_init(Writer *obj) {
+	ms_mutex_init(&obj->lock, NULL);
+	ms_cond_init(&obj->cond, NULL);
+	obj->maxBytes = WRITER_DEFAULT_MAX_BYTES;
+}
+
+static void writer_flush(Writer *obj) {
+	for(; obj->count > 0; obj->count--) {
+		freemsg(obj->items[obj->first].frame);
+		obj->first = (obj->first + 1) % WRITER_QUEUE_CAPACITY;
+	}
+	obj->first = 0;
+	obj->bytes = 0;
+}
+
+static void writer_uninit(Writer *obj) {
+	writer_flush(obj);
+	ms_cond_destroy(&obj->cond);
+	ms_mutex_destroy(&obj->lock);
+}
+
+/* Returns FALSE, without taking the frame, if the queue is full. */
+static ms_bool_t writer_put(Writer *obj, mblk_t *frame, uint16_t pin, size_t *queuedBytes) {
+	size_t size = msgdsize(frame);
+	ms_bool_t ret = FALSE;
+
+	ms_mutex_lock(&obj->lock);
+	if(obj->count < WRITER_QUEUE_CAPACITY && (obj->bytes == 0 || obj->bytes + size <= obj->maxBytes)) {
+		WriterItem *item = &obj->items[(obj->first + obj->count) % WRITER_QUEUE_CAPACITY];
+		item->frame = frame;
+		item->pin = pin;
+		obj->count++;
+		obj->bytes += size;
+		ms_cond_signal(&obj->cond);
+		ret = TRUE;
+	}
+	*queuedBytes = obj->bytes;
+	ms_mutex_unlock(&obj->lock);
+	return ret;
+}
+
+/*
+ * Wait for frames and move all the queued ones into batch. Returns the number of frames, which is zero once the writer
+ * is stopped and the queue is empty.
+ */
+static int writer_get_batch(Writer *obj, WriterItem *batch) {
+	int count;
+
+	ms_mutex_lock(&obj->lock);
+	while(obj->count == 0 && obj->running) {
+		ms_cond_wait(&obj->cond, &obj->lock);
+	}
+	for(count = 0; obj->count > 0; count++, obj->count--) {
+		batch[count] = obj->items[obj->first];
+		obj->first = (obj->first + 1) % WRITER_QUEUE_CAPACITY;
+	}
+	ms_mutex_unlock(&obj->lock);
+	return count;
+}
+
+static void writer_release_bytes(Writer *obj, size_t bytes) {
+	ms_mutex_lock(&obj->lock);
+	obj->bytes -= bytes;
+	ms_mutex_unlock(&obj->lock);
+}
+
+static void writer_start(Writer *obj, void *(*func)(void *), void *arg) {
+	obj->running = TRUE;
+	ms_thread_create(&obj->thread, NULL, func, arg);
+}
+
+/*
+ * Ask the thread to exit once the frames already queued are written. Returns TRUE if writer_join() must be called,
+ * which may be done without holding the locks the caller needs to keep the thread running.
+ */
+static ms_bool_t writer_request_stop(Writer *obj) {
+	if(!obj->running) return FALSE;
+	ms_mutex_lock(&obj->lock);
+	obj->running = FALSE;
+	ms_cond_signal(&obj->cond);
+	ms_mutex_unlock(&obj->lock);
+	return TRUE;
+}
+
+static void writer_join(Writer *obj) {
+	ms_thread_join(obj->thread, NULL);
+}
+
 /*********************************************************************************************
  * MKV Recorder Filter                                                                       *
  *********************************************************************************************/
@@ -1829,6 +1961,14 @@ typedef struct {
 	TimeLoopCanceler **timeLoopCancelers;
 	ms_bool_t needKeyFrame;
 	ms_bool_t tracksInitialized;
+	/* from recorder_start() to recorder_close(), the file, the duration and the codec private data of the modules
+	 * are only accessed by the writer thread */
+	Writer writer;
+	int syncFd; /* descriptor opened along with the file, so that the writer thread syncs the file it writes */
+	MSRecorderSyncPolicy syncPolicy;
+	ms_bool_t writeLateNotified;
+	ms_bool_t waitKeyFrameAfterDrop;
+	ms_bool_t closing; /* the writer thread is being joined by recorder_close() */
 } MKVRecorder;
 
 static void recorder_init(MSFilter *f) {
@@ -1839,6 +1979,7 @@ static void recorder_init(MSFilter *f) {
 
 	obj->state = MSRecorderClosed;
 	obj->needKeyFrame = TRUE;
+	obj->syncFd = -1;
 
 	muxer_init(&obj->muxer, (uint16_t)f->desc->ninputs);
 
@@ -1847,6 +1988,7 @@ static void recorder_init(MSFilter *f) {
 	obj->timeLoopCancelers = (TimeLoopCanceler **)ms_new0(TimeLoopCanceler *, f->desc->ninputs);
 	obj->lastFirTime = (uint64_t) - 1;
 	time_corrector_init(&obj->timeCorrector, f->desc->ninputs);
+	writer_init(&obj->writer);
 
 	f->data = obj;
 }
@@ -1866,6 +2008,7 @@ static void recorder_uninit(MSFilter *f) {
 		if(obj->timeLoopCancelers[i] != NULL) ms_free(obj->timeLoopCancelers[i]);
 	}
 	time_corrector_uninit(&obj->timeCorrector);
+	writer_uninit(&obj->writer);
 	ms_free(obj->timeLoopCancelers);
 	ms_free(obj->modulesList);
 	ms_free((void *)obj->inputDescsList);
@@ -1921,12 +2064,62 @@ static void changeClockRate(mblk_t *buffer, unsigned int oldClockRate, unsigned
 	mblk_set_timestamp_info(buffer, (uint64_t)mblk_get_timestamp_info(buffer) * (uint64_t)newClockRate / (uint64_t)oldClockRate);
 }
 
+/* Flush the data written so far to the disk. */
+static void recorder_sync_file(MKVRecorder *obj) {
+	matroska_flush(&obj->file);
+#ifndef _WIN32
+	if(obj->syncFd < 0) return;
+#ifdef __linux__
+	fdatasync(obj->syncFd);
+#else
+	fsync(obj->syncFd);
+#endif
+#endif
+}
+
+static void *recorder_writer_run(void *arg) {
+	MKVRecorder *obj = (MKVRecorder *)arg;
+	WriterItem *batch = ms_new0(WriterItem, WRITER_QUEUE_CAPACITY);
+	int count;
+
+	while((count = writer_get_batch(&obj->writer, batch)) > 0) {
+		size_t bytes = 0;
+		ms_bool_t clusterClosed = FALSE;
+		int i;
+
+		for(i = 0; i < count; i++) {
+			mblk_t *buffer = batch[i].frame;
+			uint16_t pin = batch[i].pin;
+			timecode_t bufferTimecode = mblk_get_timestamp_info(buffer);
+			int clusters = matroska_clusters_count(&obj->file);
+			matroska_block *block;
+
+			bytes += msgdsize(buffer);
+			block = write_frame(obj, buffer, pin);
+			if(clusters > 0 && matroska_clusters_count(&obj->file) > clusters) clusterClosed = TRUE;
+
+			if(obj->inputDescsList[pin]->type == MSVideo && block != NULL) {
+				matroska_add_cue(&obj->file, block);
+			}
+			if(bufferTimecode > obj->duration) {
+				obj->duration = bufferTimecode;
+			}
+		}
+		if(clusterClosed && obj->syncPolicy == MSRecorderSyncOnCluster) {
+			recorder_sync_file(obj);
+		}
+		writer_release_bytes(&obj->writer, bytes);
+	}
+	ms_free(batch);
+	return NULL;
+}
+
 static int recorder_open_file(MSFilter *f, void *arg) {
 	MKVRecorder *obj = (MKVRecorder *)f->data;
 	const char *filename = (const char *)arg;
 
 	ms_filter_lock(f);
-	if(obj->state != MSRecorderClosed) {
+	if(obj->state != MSRecorderClosed || obj->closing) {
 		ms_error("MKVRecorder: %s is alread open", filename);
 		goto fail;
 	}
@@ -1947,6 +2140,14 @@ static int recorder_open_file(MSFilter *f, void *arg) {
 	}
 
 
+#ifndef _WIN32
+	/* the stream of libmatroska2 does not expose its descriptor. Opened now, this one refers to the same file
+	 * even if the path is renamed or replaced while recording. */
+	obj->syncFd = open(filename, O_WRONLY);
+	if(obj->syncFd < 0) ms_warning("MKVRecorder: could not open %s to sync it", filename);
+#endif
+	obj->writeLateNotified = FALSE;
+	obj->waitKeyFrameAfterDrop = FALSE;
 	obj->state = MSRecorderPaused;
 	ms_filter_unlock(f);
 	return 0;
@@ -1968,7 +2169,7 @@ static int recorder_start(MSFilter *f, void *arg) {
 	int i;
 
 	ms_filter_lock(f);
-	if(obj->state == MSRecorderClosed) {
+	if(obj->state == MSRecorderClosed || obj->closing) {
 		ms_error("MKVRecorder: fail to start recording. The file has not been opened");
 		goto fail;
 	}
@@ -2011,8 +2212,12 @@ static int recorder_start(MSFilter *f, void *arg) {
 		time_corrector_set_origin(&obj->timeCorrector, obj->duration);
 		obj->tracksInitialized = TRUE;
 	}
+	if(!obj->writer.running) {
+		writer_start(&obj->writer, recorder_writer_run, obj);
+	}
 	obj->state = MSRecorderRunning;
 	obj->needKeyFrame = TRUE;
+	obj->waitKeyFrameAfterDrop = FALSE;
 	recorder_request_fir(f, obj);
 	ms_message("MKVRecorder: recording successfully started");
 	ms_filter_unlock(f);
@@ -2067,6 +2272,8 @@ static void recorder_process(MSFilter *f) {
 	} else {
 		uint16_t pin;
 		mblk_t *buffer = NULL;
+		int dropped = 0;
+		size_t queuedBytes = 0;
 		for(i = 0; i < f->desc->ninputs; i++) {
 			if(f->inputs[i] != NULL && obj->inputDescsList[i] == NULL) {
 				ms_queue_flush(f->inputs[i]);
@@ -2112,19 +2319,39 @@ static void recorder_process(MSFilter *f) {
 			}
 		}
 		while((buffer = muxer_get_buffer(&obj->muxer, &pin)) != NULL) {
-			matroska_block *block;
-			timecode_t bufferTimecode;
-
-			bufferTimecode = mblk_get_timestamp_info(buffer);
+			ms_bool_t isVideo = obj->inputDescsList[pin]->type == MSVideo;
 
-			block = write_frame(obj, buffer, pin);
-
-			if(obj->inputDescsList[pin]->type == MSVideo && block != NULL) {
-				matroska_add_cue(&obj->file, block);
+			if(isVideo && obj->waitKeyFrameAfterDrop) {
+				if(!module_is_key_frame(obj->modulesList[pin], buffer)) {
+					freemsg(buffer);
+					dropped++;
+					continue;
+				}
+				obj->waitKeyFrameAfterDrop = FALSE;
 			}
-			if(bufferTimecode > obj->duration) {
-				obj->duration = bufferTimecode;
+			if(!writer_put(&obj->writer, buffer, pin, &queuedBytes)) {
+				freemsg(buffer);
+				dropped++;
+				if(isVideo) {
+					/*the next video frames cannot be decoded without the dropped one*/
+					obj->waitKeyFrameAfterDrop = TRUE;
+					recorder_request_fir(f, obj);
+				}
+			}
+		}
+		if(queuedBytes > obj->writer.maxBytes / 2) {
+			if(!obj->writeLateNotified) {
+				int bytes = (int)queuedBytes;
+				ms_warning("MKVRecorder: %i bytes waiting to be written", bytes);
+				obj->writeLateNotified = TRUE;
+				ms_filter_notify(f, MS_RECORDER_WRITE_LATE, &bytes);
 			}
+		} else if(queuedBytes < obj->writer.maxBytes / 4) {
+			obj->writeLateNotified = FALSE;
+		}
+		if(dropped > 0) {
+			ms_warning("MKVRecorder: %i frames dropped, the file is not written fast enough", dropped);
+			ms_filter_notify(f, MS_RECORDER_FRAMES_DROPPED, &dropped);
 		}
 	}
 	ms_filter_unlock(f);
@@ -2136,10 +2363,20 @@ static int recorder_close(MSFilter *f, void *arg) {
 
 	ms_filter_lock(f);
 	ms_message("MKVRecorder: closing file");
-	if(obj->state == MSRecorderClosed) {
+	if(obj->state == MSRecorderClosed || obj->closing) {
 		ms_warning("MKVRecorder: no file has been opened");
 		goto end;
 	}
+	/* recorder_process() does not queue any frame once paused, so the writer is joined without the filter lock,
+	 * which would block the ticker until all the queued frames are written */
+	obj->state = MSRecorderPaused;
+	obj->closing = TRUE;
+	if(writer_request_stop(&obj->writer)) {
+		ms_filter_unlock(f);
+		writer_join(&obj->writer);
+		ms_filter_lock(f);
+	}
+	obj->closing = FALSE;
 
 	for(i = 0; i < f->desc->ninputs; i++) {
 		if(obj->inputDescsList[i] != NULL) {
@@ -2177,7 +2414,16 @@ static int recorder_close(MSFilter *f, void *arg) {
 	matroska_go_to_file_end(&obj->file);
 	matroska_close_segment(&obj->file);
 
+	if(obj->syncPolicy != MSRecorderSyncNone) {
+		recorder_sync_file(obj);
+	}
 	matroska_close_file(&obj->file);
+#ifndef _WIN32
+	if(obj->syncFd >= 0) {
+		close(obj->syncFd);
+		obj->syncFd = -1;
+	}
+#endif
 	for(i = 0; i < f->desc->ninputs; i++) {
 		if(f->inputs[i] != NULL) ms_queue_flush(f->inputs[i]);
 		if(obj->modulesList[i]) {
@@ -2259,6 +2505,22 @@ static int recorder_get_state(MSFilter *f, void *data) {
 	return 0;
 }
 
+static int recorder_set_sync_policy(MSFilter *f, void *data) {
+	MKVRecorder *priv = (MKVRecorder *)f->data;
+	priv->syncPolicy = *(MSRecorderSyncPolicy *)data;
+	return 0;
+}
+
+static int recorder_set_write_queue_size(MSFilter *f, void *data) {
+	MKVRecorder *priv = (MKVRecorder *)f->data;
+	int size = *(int *)data;
+	if(size <= 0) return -1;
+	ms_mutex_lock(&priv->writer.lock);
+	priv->writer.maxBytes = (size_t)size;
+	ms_mutex_unlock(&priv->writer.lock);
+	return 0;
+}
+
 static MSFilterMethod recorder_methods[] = {
 	{	MS_RECORDER_OPEN            ,	recorder_open_file         },
 	{	MS_RECORDER_CLOSE           ,	recorder_close             },
@@ -2266,6 +2528,8 @@ static MSFilterMethod recorder_methods[] = {
 	{	MS_RECORDER_PAUSE           ,	recorder_stop              },
 	{	MS_FILTER_SET_INPUT_FMT     ,   recorder_set_input_fmt     },
 	{	MS_RECORDER_GET_STATE	    ,	recorder_get_state         },
+	{	MS_RECORDER_SET_SYNC_POLICY ,	recorder_set_sync_policy   },
+	{	MS_RECORDER_SET_WRITE_QUEUE_SIZE, recorder_set_write_queue_size },
 	{	0                           ,   NULL                       }
 };
 
@@ -2473,10 +2737,15 @@ static void mkv_track_player_free(MKVTrackPlayer *obj) {
 	ms_free(obj);
 }
 
-static void mkv_track_player_send_block(MSFactory *f, MKVTrackPlayer *obj, const MKVBlock *block, MSQueue *output) {
-	mblk_t *tmp = allocb(block->mData.size(), 0);
-	memcpy(tmp->b_wptr, block->mData.data(), block->mData.size());
-	tmp->b_wptr += block->mData.size();
+static void mkv_track_player_send_block(MSFactory *f, MKVTrackPlayer *obj, MKVBlock *block, MSQueue *output) {
+	mblk_t *tmp;
+	if (block->mFrame) {
+		tmp = block->mFrame.release();
+	} else {
+		tmp = allocb(block->mData.size(), 0);
+		memcpy(tmp->b_wptr, block->mData.data(), block->mData.size());
+		tmp->b_wptr += block->mData.size();
+	}
 	mblk_set_timestamp_info(tmp, block->mTimestamp);
 	changeClockRate(tmp, 1000, obj->output_pin_desc->rate);
 	module_reverse(f, obj->module, tmp, output, obj->first_frame, block->mCodecState.data(), block->mCodecState.size());
@@ -50,6 +50,11 @@ static bool_t is_key_frame_dummy(mblk_t *frame){
 
 typedef bool_t (*is_key_frame_func_t)(mblk_t *frame);
 
+typedef bool_t (*get_temporal_layer_func_t)(mblk_t *m, int *tid, bool_t *layer_sync);
+
+#define ROUTER_MAX_TEMPORAL_LAYERS 4
+#define ROUTER_BITRATE_WINDOW 1000 /* interval of the measurement of the bitrate of temporal layers, in milliseconds */
+
 
 enum _IOState{
 	STOPPED,
@@ -67,6 +72,13 @@ typedef struct _InputContext{
 	int seq_set;
 	int key_frame_requested;
 	mblk_t *key_frame_start;
+	int first_subscriber; /* first output whose current source is this input, -1 if none */
+	int temporal_layers; /* number of temporal layers seen during the last measurement window, 0 if the stream is not layered */
+	int window_max_tid;
+	bool_t window_started; /* the measurement window starts with the first packet carrying a temporal layer */
+	uint64_t window_start;
+	int layer_bytes[ROUTER_MAX_TEMPORAL_LAYERS];
+	int layer_bitrates[ROUTER_MAX_TEMPORAL_LAYERS]; /* bitrate of each temporal layer, in bits/s */
 }InputContext;
 
 typedef struct _OutputContext{
@@ -77,6 +89,13 @@ typedef struct _OutputContext{
 	int next_source;
 	int current_source;
 	int switched;
+	int next_subscriber; /* next output having the same current source, -1 at the end of the list */
+	bool_t active; /* the output forwards packets of its current source during this tick */
+	mblk_t *start; /* packet from which the forwarding starts during this tick, NULL to forward all packets */
+	int max_bitrate; /* bitrate the receiver can take, in bits/s, 0 if unlimited */
+	int target_layer; /* highest temporal layer fitting in max_bitrate */
+	int current_layer; /* highest temporal layer forwarded, raised only at layer sync points or key frames */
+	uint32_t layer_ts; /* timestamp of the last frame for which current_layer was updated */
 }OutputContext;
 
 typedef struct RouterState{
@@ -84,12 +103,49 @@ typedef struct RouterState{
 	OutputContext output_contexts[ROUTER_MAX_OUTPUT_CHANNELS];
 	int focus_pin;
 	is_key_frame_func_t is_key_frame;
+	get_temporal_layer_func_t get_temporal_layer; /* NULL if the format has no temporal layers */
 } RouterState;
 
+/*
+ * Change the current source of an output, keeping the list of outputs of each input (its subscribers) up to date,
+ * so that the packets of an input are forwarded only to the outputs watching it.
+ */
+static void router_set_output_source(RouterState *s, int output, int source){
+	OutputContext *output_context = &s->output_contexts[output];
+	int *it;
+
+	if (output_context->current_source == source) return;
+	if (output_context->current_source != -1){
+		for (it = &s->input_contexts[output_context->current_source].first_subscriber; *it != -1; it = &s->output_contexts[*it].next_subscriber){
+			if (*it == output){
+				*it = output_context->next_subscriber;
+				break;
+			}
+		}
+	}
+	output_context->current_source = source;
+	output_context->next_subscriber = -1;
+	/* start with all layers, the output goes down to its target layer on the first frame */
+	output_context->current_layer = ROUTER_MAX_TEMPORAL_LAYERS - 1;
+	if (source != -1){
+		output_context->next_subscriber = s->input_contexts[source].first_subscriber;
+		s->input_contexts[source].first_subscriber = output;
+	}
+}
+
 static void router_init(MSFilter *f){
 	RouterState *s=ms_new0(RouterState,1);
+	int i;
 	s->is_key_frame=is_key_frame_dummy;
 	s->focus_pin = -1;
+	for (i = 0; i < ROUTER_MAX_INPUT_CHANNELS; ++i){
+		s->input_contexts[i].first_subscriber = -1;
+		s->input_contexts[i].window_max_tid = -1;
+	}
+	for (i = 0; i < ROUTER_MAX_OUTPUT_CHANNELS; ++i){
+		s->output_contexts[i].current_source = -1;
+		router_set_output_source(s, i, 0);
+	}
 	f->data=s;
 }
 
@@ -102,7 +158,7 @@ static int router_configure_output(MSFilter *f, void *data){
 	RouterState *s=(RouterState *)f->data;
 	MSVideoRouterPinData *pd = (MSVideoRouterPinData *)data;
 	ms_filter_lock(f);
-	s->output_contexts[pd->output].current_source = pd->input;
+	router_set_output_source(s, pd->output, pd->input);
 	s->output_contexts[pd->output].switched =pd->switched;
 	ms_filter_unlock(f);
 	ms_message("%s: router configure switched[%d] pin output %d with input %d", f->desc->name, pd->switched, pd->output, pd->input);
@@ -113,13 +169,29 @@ static int router_unconfigure_output(MSFilter *f, void *data){
 	RouterState *s=(RouterState *)f->data;
 	int pin = *(int*)data;
 	ms_filter_lock(f);
-	s->output_contexts[pin].current_source = -1;
+	router_set_output_source(s, pin, -1);
 	ms_filter_unlock(f);
 	ms_message("%s: router unconfigure output pin %i ", f->desc->name, pin);
 	return 0;
 }
 
-static void router_channel_update_input(RouterState *s, int pin, MSQueue *q){
+static void router_channel_update_layers(InputContext *input_context, uint64_t now){
+	int i;
+	uint64_t elapsed;
+
+	if (!input_context->window_started) return;
+	elapsed = now - input_context->window_start;
+	if (elapsed < ROUTER_BITRATE_WINDOW) return;
+	input_context->temporal_layers = input_context->window_max_tid + 1;
+	for (i = 0; i < ROUTER_MAX_TEMPORAL_LAYERS; ++i){
+		input_context->layer_bitrates[i] = (int)((uint64_t)input_context->layer_bytes[i] * 8000 / elapsed);
+		input_context->layer_bytes[i] = 0;
+	}
+	input_context->window_max_tid = -1;
+	input_context->window_start = now;
+}
+
+static void router_channel_update_input(RouterState *s, int pin, MSQueue *q, uint64_t now){
 	InputContext *input_context = &s->input_contexts[pin];
 	mblk_t *m;
 	input_context->key_frame_start = NULL;
@@ -127,8 +199,19 @@ static void router_channel_update_input(RouterState *s, int pin, MSQueue *q){
 	for(m = ms_queue_peek_first(q); !ms_queue_end(q, m); m = ms_queue_peek_next(q,m)){
 		uint32_t new_ts = mblk_get_timestamp_info(m);
 		uint16_t new_seq = mblk_get_cseq(m);
+		int tid;
+		bool_t layer_sync;
 		//uint8_t marker = mblk_get_marker_info(m);
 
+		if (s->get_temporal_layer && s->get_temporal_layer(m, &tid, &layer_sync)){
+			if (!input_context->window_started){
+				input_context->window_started = TRUE;
+				input_context->window_start = now;
+			}
+			input_context->layer_bytes[tid] += (int)msgdsize(m);
+			if (tid > input_context->window_max_tid) input_context->window_max_tid = tid;
+		}
+
 		if (!input_context->seq_set){
 			input_context->state = STOPPED;
 			input_context->key_frame_requested = TRUE;
@@ -152,6 +235,41 @@ static void router_channel_update_input(RouterState *s, int pin, MSQueue *q){
 		input_context->cur_seq = new_seq;
 		input_context->seq_set = 1;
 	}
+	router_channel_update_layers(input_context, now);
+}
+
+/* Select the highest temporal layer whose cumulated bitrate fits in what the receiver of an output can take. */
+static int router_select_layer(const InputContext *input_context, int max_bitrate){
+	int layer;
+	int cumulated = 0;
+
+	if (max_bitrate <= 0) return ROUTER_MAX_TEMPORAL_LAYERS - 1;
+	for (layer = 0; layer < input_context->temporal_layers; ++layer){
+		cumulated += input_context->layer_bitrates[layer];
+		if (cumulated > max_bitrate) break;
+	}
+	return layer > 0 ? layer - 1 : 0;
+}
+
+/*
+ * Tell whether a packet of a layered stream is forwarded to an output.
+ * The forwarded layer changes only at the beginning of frames: upper layers can be dropped on any frame, as lower layers never
+ * reference them, but they are added only on a key frame or on a layer sync frame (which references the base layer only).
+ */
+static bool_t router_output_accepts_layer(RouterState *s, OutputContext *output_context, mblk_t *m, uint32_t ts, int tid, bool_t layer_sync){
+	if (ts != output_context->layer_ts){
+		output_context->layer_ts = ts;
+		if (output_context->target_layer < output_context->current_layer){
+			output_context->current_layer = output_context->target_layer;
+		}else if (output_context->target_layer > output_context->current_layer){
+			if (layer_sync && tid > output_context->current_layer && tid <= output_context->target_layer){
+				output_context->current_layer = tid;
+			}else if (tid == 0 && s->is_key_frame(m)){
+				output_context->current_layer = output_context->target_layer;
+			}
+		}
+	}
+	return tid <= output_context->current_layer;
 }
 
 static int next_input_pin(MSFilter *f, int i){
@@ -164,29 +282,61 @@ static int next_input_pin(MSFilter *f, int i){
 	return 0;
 }
 
-static void router_transfer(MSFilter *f, MSQueue *input,  MSQueue *output, OutputContext *output_context, mblk_t *start){
-	mblk_t *m;
-	if (ms_queue_empty(input)) return;
+static void router_forward(MSFilter *f, MSQueue *output, OutputContext *output_context, mblk_t *o, uint32_t ts, int marker){
+	if (ts != output_context->out_ts){
+		/* Each time we observe a new input timestamp, we must select a new output timestamp */
+		output_context->out_ts = ts;
+		output_context->adjusted_out_ts = (uint32_t) (f->ticker->time * 90LL);
+	}
 
-	if (start == NULL) start = ms_queue_peek_first(input);
+	/* We need to set sequence number for what we send out, otherwise the VP8 decoder won't be able
+	 * to verify the integrity of the stream*/
 
-	for(m = start; !ms_queue_end(input, m) ; m = ms_queue_peek_next(input,m)){
-		mblk_t *o = dupmsg(m);
+	mblk_set_timestamp_info(o, output_context->adjusted_out_ts);
+	mblk_set_cseq(o, output_context->out_seq++);
+	mblk_set_marker_info(o, marker);
 
-		if (mblk_get_timestamp_info(m) != output_context->out_ts){
-			/* Each time we observe a new input timestamp, we must select a new output timestamp */
-			output_context->out_ts = mblk_get_timestamp_info(m);
-			output_context->adjusted_out_ts = (uint32_t) (f->ticker->time * 90LL);
-		}
+	ms_queue_put(output, o);
+}
 
-		/* We need to set sequence number for what we send out, otherwise the VP8 decoder won't be able
-		 * to verify the integrity of the stream*/
+/*
+ * Forward the packets of an input to the outputs subscribed to it.
+ * The payload is shared between outputs: each one gets its own header, carrying its timestamp and sequence number.
+ * The last recipient of a packet gets the original header, so that a packet forwarded to a single output is not copied at all.
+ */
+static void router_transfer(MSFilter *f, RouterState *s, int pin){
+	MSQueue *input = f->inputs[pin];
+	bool_t layered = s->get_temporal_layer != NULL && s->input_contexts[pin].temporal_layers > 0;
+	int recipients[ROUTER_MAX_OUTPUT_CHANNELS];
+	mblk_t *m;
 
-		mblk_set_timestamp_info(o, output_context->adjusted_out_ts);
-		mblk_set_cseq(o, output_context->out_seq++);
-		mblk_set_marker_info(o, mblk_get_marker_info(m));
-		
-		ms_queue_put(output, o);
+	while ((m = ms_queue_get(input)) != NULL){
+		uint32_t ts = mblk_get_timestamp_info(m);
+		int marker = mblk_get_marker_info(m);
+		int nrecipients = 0;
+		int tid = 0;
+		bool_t layer_sync = FALSE;
+		bool_t has_layer = layered && s->get_temporal_layer(m, &tid, &layer_sync);
+		int i;
+
+		for (i = s->input_contexts[pin].first_subscriber; i != -1; i = s->output_contexts[i].next_subscriber){
+			OutputContext *output_context = &s->output_contexts[i];
+			if (!output_context->active) continue;
+			if (output_context->start != NULL){
+				if (output_context->start != m) continue;
+				output_context->start = NULL;
+			}
+			if (has_layer && !router_output_accepts_layer(s, output_context, m, ts, tid, layer_sync)) continue;
+			recipients[nrecipients++] = i;
+		}
+		if (nrecipients == 0){
+			freemsg(m);
+			continue;
+		}
+		for (i = 0; i < nrecipients - 1; ++i){
+			router_forward(f, f->outputs[recipients[i]], &s->output_contexts[recipients[i]], dupmsg(m), ts, marker);
+		}
+		router_forward(f, f->outputs[recipients[i]], &s->output_contexts[recipients[i]], m, ts, marker);
 	}
 }
 
@@ -228,7 +378,7 @@ static void router_process(MSFilter *f){
 		MSQueue *q=f->inputs[i];
 		InputContext *input_context=&s->input_contexts[i];
 		if (q) {
-			router_channel_update_input(s, i, q);
+			router_channel_update_input(s, i, q, f->ticker->time);
 			if (!ms_queue_empty(q) && input_context->key_frame_requested){
 				if (input_context->state == STOPPED){
 					ms_filter_notify(f, MS_VIDEO_ROUTER_SEND_PLI, &i);
@@ -239,12 +389,14 @@ static void router_process(MSFilter *f){
 		}
 	}
 
-	/*fill outputs from inputs according to rules below*/
+	/*select the source of each output according to rules below*/
 	for(i=0;i<f->desc->noutputs;++i){
 		MSQueue * q = f->outputs[i];
 		OutputContext *output_context = &s->output_contexts[i];
 		InputContext *input_context;
 
+		output_context->active = FALSE;
+		output_context->start = NULL;
 		if (q){
 			mblk_t *key_frame_start = NULL;
 
@@ -256,7 +408,7 @@ static void router_process(MSFilter *f){
 				if (output_context->current_source != -1 && f->inputs[output_context->current_source] == NULL){
 					ms_warning("%s: current source %i disapeared, choosing another one to switch to.", f->desc->name, output_context->current_source);
 					output_context->next_source = next_input_pin(f, output_context->current_source);
-					output_context->current_source = -1; /* Invalidate the current source until the switch.*/
+					router_set_output_source(s, i, -1); /* Invalidate the current source until the switch.*/
 				}
 				
 				if (output_context->current_source != output_context->next_source){
@@ -264,7 +416,7 @@ static void router_process(MSFilter *f){
 					input_context = &s->input_contexts[output_context->next_source];
 					if (input_context->key_frame_start != NULL){
 						/* The input just got a key frame, we can switch ! */
-						output_context->current_source = output_context->next_source;
+						router_set_output_source(s, i, output_context->next_source);
 						key_frame_start = input_context->key_frame_start;
 					}else{
 						/* else request a key frame */
@@ -278,21 +430,25 @@ static void router_process(MSFilter *f){
 				if (output_context->current_source != -1){
 					input_context = &s->input_contexts[output_context->current_source];
 					if (input_context->state == RUNNING){
-						router_transfer(f, f->inputs[output_context->current_source], q, output_context, key_frame_start);
+						output_context->active = TRUE;
+						output_context->start = key_frame_start;
+						output_context->target_layer = router_select_layer(input_context, output_context->max_bitrate);
 					}
 				}
 			} else if (output_context->current_source != -1 && f->inputs[output_context->current_source]){
 				input_context = &s->input_contexts[output_context->current_source];
 				if (input_context->state == RUNNING){
-					router_transfer(f, f->inputs[output_context->current_source], q, output_context, input_context->key_frame_start);
+					output_context->active = TRUE;
+					output_context->start = input_context->key_frame_start;
+					output_context->target_layer = router_select_layer(input_context, output_context->max_bitrate);
 				}
 			}
 		}
 	}
-	/*purge all inputs, we are done*/
+	/*forward the packets of each input to its subscribers, the inputs are emptied*/
 	for(i=0;i<f->desc->ninputs;++i){
 		MSQueue *q=f->inputs[i];
-		if (q) ms_queue_flush(q);
+		if (q) router_transfer(f, s, i);
 	}
 	ms_filter_unlock(f);
 }
@@ -319,8 +475,10 @@ static int router_set_fmt(MSFilter *f, void *data){
 	if (fmt){
 		if (strcasecmp(fmt->encoding,"VP8")==0){
 			s->is_key_frame=is_vp8_key_frame;
+			s->get_temporal_layer=vp8rtpfmt_get_temporal_layer;
 		}else if (strcasecmp(fmt->encoding,"H264")==0){
 			s->is_key_frame=is_h264_key_frame;
+			s->get_temporal_layer=NULL;
 		}else{
 			ms_error("%s: unsupported format %s", f->desc->name, fmt->encoding);
 			return -1;
@@ -373,6 +531,37 @@ static int router_notify_fir(MSFilter *f, void *data){
 	return 0;
 }
 
+static int router_set_output_bitrate(MSFilter *f, void *data){
+	RouterState *s=(RouterState *)f->data;
+	MSVideoRouterOutputBitrate *ob = (MSVideoRouterOutputBitrate *)data;
+	if (ob->output < 0 || ob->output >= f->desc->noutputs){
+		ms_error("%s: invalid argument to MS_VIDEO_ROUTER_SET_OUTPUT_BITRATE", f->desc->name);
+		return -1;
+	}
+	ms_filter_lock(f);
+	s->output_contexts[ob->output].max_bitrate = ob->bitrate;
+	ms_filter_unlock(f);
+	ms_message("%s: output pin %i limited to %i kbits/s", f->desc->name, ob->output, ob->bitrate/1000);
+	return 0;
+}
+
+static int router_get_input_layers(MSFilter *f, void *data){
+	RouterState *s=(RouterState *)f->data;
+	MSVideoRouterInputLayers *il = (MSVideoRouterInputLayers *)data;
+	int i;
+	if (il->input < 0 || il->input >= f->desc->ninputs){
+		ms_error("%s: invalid argument to MS_VIDEO_ROUTER_GET_INPUT_LAYERS", f->desc->name);
+		return -1;
+	}
+	ms_filter_lock(f);
+	il->temporal_layers = s->get_temporal_layer ? s->input_contexts[il->input].temporal_layers : 0;
+	il->bitrate = 0;
+	for (i = 0; i < il->temporal_layers; ++i) il->bitrate += s->input_contexts[il->input].layer_bitrates[i];
+	il->base_layer_bitrate = il->temporal_layers > 0 ? s->input_contexts[il->input].layer_bitrates[0] : 0;
+	ms_filter_unlock(f);
+	return 0;
+}
+
 static MSFilterMethod methods[]={
 	{	MS_VIDEO_ROUTER_CONFIGURE_OUTPUT , router_configure_output },
 	{	MS_VIDEO_ROUTER_UNCONFIGURE_OUTPUT , router_unconfigure_output },
@@ -380,6 +569,8 @@ static MSFilterMethod methods[]={
 	{	MS_VIDEO_ROUTER_SET_AS_LOCAL_MEMBER , router_set_local_member_pin },
 	{	MS_VIDEO_ROUTER_NOTIFY_PLI, router_notify_pli },
 	{	MS_VIDEO_ROUTER_NOTIFY_FIR, router_notify_fir },
+	{	MS_VIDEO_ROUTER_SET_OUTPUT_BITRATE, router_set_output_bitrate },
+	{	MS_VIDEO_ROUTER_GET_INPUT_LAYERS, router_get_input_layers },
 	{	MS_FILTER_SET_INPUT_FMT, router_set_fmt },
 	{0,NULL}
 };
@@ -24,6 +24,7 @@
 #include "private.h"
 
 static const int audio_threshold_min_db = -30;
+static const float speaker_hysteresis_db = 6; /* advantage given to the participants already mixed, so that the selection doesn't flap */
 
 struct _MSAudioConference{
 	MSTicker *ticker;
@@ -32,6 +33,8 @@ struct _MSAudioConference{
 	bctbx_list_t *members; /* list of MSAudioEndpoint */
 	int nmembers;
 	MSAudioEndpoint *active_speaker;
+	MSAudioEndpoint **speakers; /* work array for the selection of the mixed participants */
+	float *speaker_scores;
 };
 
 struct _MSAudioEndpoint{
@@ -50,6 +53,7 @@ struct _MSAudioEndpoint{
 	int pin;
 	int samplerate;
 	bool_t muted;
+	bool_t selected; /* mixed by the conference, when the number of active speakers is limited */
 };
 
 
@@ -65,6 +69,10 @@ MSAudioConference * ms_audio_conference_new(const MSAudioConferenceParams *param
 	obj->params=*params;
 	ms_filter_call_method(obj->mixer,MS_AUDIO_MIXER_ENABLE_CONFERENCE_MODE,&tmp);
 	ms_filter_call_method(obj->mixer,MS_FILTER_SET_SAMPLE_RATE,&obj->params.samplerate);
+	if (obj->params.max_active_speakers>0){
+		obj->speakers=ms_new0(MSAudioEndpoint*,obj->params.max_active_speakers);
+		obj->speaker_scores=ms_new0(float,obj->params.max_active_speakers);
+	}
 	return obj;
 }
 
@@ -146,7 +154,6 @@ static int find_free_pin(MSFilter *mixer){
 			return i;
 		}
 	}
-	ms_fatal("No more free pin in mixer filter");
 	return -1;
 }
 
@@ -229,9 +236,33 @@ static int request_volumes(MSFilter *filter, rtp_audio_level_t *audio_levels, vo
 	return count;
 }
 
-void ms_audio_conference_add_member(MSAudioConference *obj, MSAudioEndpoint *ep){
+static int count_selected_members(MSAudioConference *obj){
+	bctbx_list_t *it;
+	int count=0;
+	for(it=obj->members;it!=NULL;it=it->next){
+		MSAudioEndpoint *ep=(MSAudioEndpoint*)it->data;
+		/*players and recorders are always mixed, they do not take the room of a speaker*/
+		if (ep->st!=NULL && ep->selected) count++;
+	}
+	return count;
+}
+
+static void update_member_mixing(MSAudioConference *obj, MSAudioEndpoint *ep){
+	MSAudioMixerCtl ctl={0};
+	ctl.pin=ep->pin;
+	ctl.param.active=!ep->muted && ep->selected;
+	ms_filter_call_method(obj->mixer, MS_AUDIO_MIXER_SET_ACTIVE, &ctl);
+}
+
+int ms_audio_conference_add_member(MSAudioConference *obj, MSAudioEndpoint *ep){
+	if (find_free_pin(obj->mixer)<0){
+		ms_error("ms_audio_conference_add_member(): no more free pin in the mixer, the conference has already %i members.",obj->nmembers);
+		return -1;
+	}
 	/* now connect to the mixer */
 	ep->conference=obj;
+	/* new participants are heard immediately if there is room left, otherwise at the next selection of speakers*/
+	ep->selected=(obj->params.max_active_speakers<=0 || ep->st==NULL || count_selected_members(obj)<obj->params.max_active_speakers);
 	if (obj->nmembers>0) ms_ticker_detach(obj->ticker,obj->mixer);
 	plumb_to_conf(ep);
 	ms_ticker_attach(obj->ticker,obj->mixer);
@@ -246,6 +277,7 @@ void ms_audio_conference_add_member(MSAudioConference *obj, MSAudioEndpoint *ep)
 		callback.user_data = ep;
 		ms_filter_call_method(ep->st->ms.rtpsend, MS_RTP_SEND_SET_MIXER_TO_CLIENT_DATA_REQUEST_CB, &callback);
 	}
+	return 0;
 }
 
 static void unplumb_from_conf(MSAudioEndpoint *ep){
@@ -267,15 +299,17 @@ void ms_audio_conference_remove_member(MSAudioConference *obj, MSAudioEndpoint *
 	ep->conference=NULL;
 	obj->nmembers--;
 	obj->members = bctbx_list_remove(obj->members, ep);
+	if (obj->active_speaker == ep) obj->active_speaker = NULL;
 	if (obj->nmembers>0) ms_ticker_attach(obj->ticker,obj->mixer);
 }
 
 void ms_audio_conference_mute_member(MSAudioConference *obj, MSAudioEndpoint *ep, bool_t muted){
-	MSAudioMixerCtl ctl={0};
-	ctl.pin=ep->pin;
-	ctl.param.active=!muted;
 	ep->muted = muted;
-	ms_filter_call_method(ep->conference->mixer, MS_AUDIO_MIXER_SET_ACTIVE, &ctl);
+	update_member_mixing(ep->conference, ep);
+}
+
+bool_t ms_audio_conference_member_is_mixed(MSAudioConference *obj, MSAudioEndpoint *ep){
+	return !ep->muted && ep->selected;
 }
 
 int ms_audio_conference_get_size(MSAudioConference *obj){
@@ -306,6 +340,52 @@ int ms_audio_conference_get_participant_volume(MSAudioConference *obj, uint32_t
 }
 
 
+/*
+ * Keep only the max_active_speakers loudest participants in the mix, so that the mixing cost does not depend on the size of the conference.
+ * The volumes are the ones measured by the MSVolume filters of the streams. Participants already mixed are favoured by
+ * speaker_hysteresis_db, so that two participants at similar levels are not swapped back and forth.
+ * Endpoints without stream (player, recorder) are not ranked and always mixed.
+ */
+static void select_speakers(MSAudioConference *obj){
+	const bctbx_list_t *elem;
+	int max=obj->params.max_active_speakers;
+	int count=0;
+	int i,j;
+
+	for (elem = obj->members; elem != NULL; elem = elem->next){
+		MSAudioEndpoint *ep = (MSAudioEndpoint *) elem->data;
+		MSFilter *volume_filter;
+		float score = MS_VOLUME_DB_LOWEST;
+
+		if (ep->st == NULL || ep->muted) continue;
+		volume_filter = (ep->in_cut_point_prev.filter == ep->st->volrecv) ? ep->st->volrecv : ep->st->volsend;
+		if (volume_filter) ms_filter_call_method(volume_filter, MS_VOLUME_GET, &score);
+		if (ep->selected) score += speaker_hysteresis_db;
+		/*insertion in the array of the loudest participants, sorted by decreasing score*/
+		for (i = 0; i < count && obj->speaker_scores[i] >= score; i++);
+		if (i >= max) continue;
+		if (count < max) count++;
+		for (j = count - 1; j > i; j--){
+			obj->speakers[j] = obj->speakers[j-1];
+			obj->speaker_scores[j] = obj->speaker_scores[j-1];
+		}
+		obj->speakers[i] = ep;
+		obj->speaker_scores[i] = score;
+	}
+	for (elem = obj->members; elem != NULL; elem = elem->next){
+		MSAudioEndpoint *ep = (MSAudioEndpoint *) elem->data;
+		bool_t selected = (ep->st == NULL);
+
+		for (i = 0; i < count && !selected; i++){
+			if (obj->speakers[i] == ep) selected = TRUE;
+		}
+		if (selected != ep->selected){
+			ep->selected = selected;
+			if (!ep->muted) update_member_mixing(obj, ep);
+		}
+	}
+}
+
 void ms_audio_conference_process_events(MSAudioConference *obj){
 	const bctbx_list_t *elem;
 	float max_db_over_member = MS_VOLUME_DB_LOWEST;
@@ -335,12 +415,15 @@ void ms_audio_conference_process_events(MSAudioConference *obj){
 			obj->params.active_talker_callback(obj, winner);
 		obj->active_speaker = winner;
 	}
+	if (obj->params.max_active_speakers > 0) select_speakers(obj);
 }
 
 
 void ms_audio_conference_destroy(MSAudioConference *obj){
 	ms_ticker_destroy(obj->ticker);
 	ms_filter_destroy(obj->mixer);
+	if (obj->speakers) ms_free(obj->speakers);
+	if (obj->speaker_scores) ms_free(obj->speaker_scores);
 	ms_free(obj);
 }
 
@@ -17,6 +17,8 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+
 #include "h264-utils.h"
 
 #include "h264-nal-packer.h"
@@ -36,7 +38,13 @@ mblk_t *H264NalPacker::NaluAggregator::feed(mblk_t *nalu) {
 		_size = size + 3; /* STAP-A header + size */
 	} else {
 		if ((_size + size) < (_maxSize - 2)) {
-			_stap = concatNalus(_stap, nalu);
+			/*eventually copy m1 into a STAP-A packet, if not already done*/
+			if (ms_h264_nalu_get_type(_stap) != MSH264NaluTypeSTAPA) {
+				_stap = makeStapA(_stap);
+			}
+			putNalSize(_stap, size);
+			appendData(_stap, nalu);
+			freemsg(nalu);
 			_size += (size + 2); /* +2 for the STAP-A size field */
 		} else {
 			return completeAggregation();
@@ -57,31 +65,23 @@ mblk_t *H264NalPacker::NaluAggregator::completeAggregation() {
 	return res;
 }
 
-
-mblk_t *H264NalPacker::NaluAggregator::concatNalus(mblk_t *m1, mblk_t *m2) {
-	mblk_t *l = allocb(2, 0);
-	/*eventually append a STAP-A header to m1, if not already done*/
-	if (ms_h264_nalu_get_type(m1) != MSH264NaluTypeSTAPA) {
-		m1 = prependStapA(m1);
-	}
-	putNalSize(l, msgdsize(m2));
-	l->b_cont = m2;
-	concatb(m1, l);
-	return m1;
-}
-
-mblk_t *H264NalPacker::NaluAggregator::prependStapA(mblk_t *m) {
-	mblk_t *hm = allocb(3, 0);
-	H264Tools::nalHeaderInit(hm->b_wptr, ms_h264_nalu_get_nri(m), MSH264NaluTypeSTAPA);
-	hm->b_wptr += 1;
-	putNalSize(hm, msgdsize(m));
-	hm->b_cont = m;
-	return hm;
+/*
+ * The STAP-A packet is allocated with the maximum payload size, so that the following NALus are
+ * appended to it without any further allocation.
+ */
+mblk_t *H264NalPacker::NaluAggregator::makeStapA(mblk_t *m) {
+	mblk_t *stap = allocPacket(_bufferPool, _maxSize);
+	H264Tools::nalHeaderInit(stap->b_wptr, ms_h264_nalu_get_nri(m), MSH264NaluTypeSTAPA);
+	stap->b_wptr += 1;
+	putNalSize(stap, msgdsize(m));
+	appendData(stap, m);
+	freemsg(m);
+	return stap;
 }
 
 void H264NalPacker::NaluAggregator::putNalSize(mblk_t *m, size_t sz) {
 	uint16_t size = htons((uint16_t)sz);
-	*(uint16_t *)m->b_wptr = size;
+	memcpy(m->b_wptr, &size, sizeof(size));
 	m->b_wptr += 2;
 }
 
@@ -89,26 +89,35 @@ void H264NalPacker::NaluAggregator::putNalSize(mblk_t *m, size_t sz) {
 // H264NalToFuaSpliter class
 // =========================
 
+/*
+ * The number of fragments is computed first, so that the NALu payload is spread evenly between them, and each
+ * fragment is written with its FU indicator and header into a single buffer.
+ */
 void H264NalPacker::NaluSpliter::feed(mblk_t *nalu) {
-	mblk_t *m;
-	size_t payload_max_size = _maxSize - 2; /*minus FU-A header*/
-	uint8_t fu_indicator;
+	size_t payloadMaxSize = _maxSize - 2; /*minus FU-A header*/
+	uint8_t fuIndicator;
 	uint8_t type = ms_h264_nalu_get_type(nalu);
 	uint8_t nri = ms_h264_nalu_get_nri(nalu);
-	bool start = true;
-
-	H264Tools::nalHeaderInit(&fu_indicator, nri, MSH264NaluTypeFUA);
-	while ((size_t)(nalu->b_wptr - nalu->b_rptr) > payload_max_size) {
-		m = dupb(nalu);
-		nalu->b_rptr += payload_max_size;
-		m->b_wptr = nalu->b_rptr;
-		m = H264Tools::prependFuIndicatorAndHeader(m, fu_indicator, start, FALSE, type);
+
+	if (nalu->b_cont) msgpullup(nalu, -1);
+	H264Tools::nalHeaderInit(&fuIndicator, nri, MSH264NaluTypeFUA);
+
+	const uint8_t *payload = nalu->b_rptr + 1; /*the original nalu header is replaced by the FU indicator and header*/
+	size_t remaining = (size_t)(nalu->b_wptr - payload);
+	size_t count = (remaining + payloadMaxSize - 1) / payloadMaxSize;
+	size_t fragmentSize = (remaining + count - 1) / count;
+	for (size_t i = 0; i < count; i++) {
+		size_t size = min(fragmentSize, remaining);
+		mblk_t *m = allocPacket(_bufferPool, size + 2);
+		m->b_wptr[0] = fuIndicator;
+		m->b_wptr[1] = ((i == 0 ? 1 : 0) << 7) | ((i == count - 1 ? 1 : 0) << 6) | type;
+		memcpy(m->b_wptr + 2, payload, size);
+		m->b_wptr += size + 2;
+		payload += size;
+		remaining -= size;
 		ms_queue_put(&_q, m);
-		start = false;
 	}
-	/*send last packet */
-	m = H264Tools::prependFuIndicatorAndHeader(nalu, fu_indicator, FALSE, TRUE, type);
-	ms_queue_put(&_q, m);
+	freemsg(nalu);
 }
 
 } // namespace mediastreamer
@@ -45,8 +45,7 @@ private:
 		mblk_t *completeAggregation() override;
 
 	private:
-		static mblk_t *concatNalus(mblk_t *m1, mblk_t *m2);
-		static mblk_t *prependStapA(mblk_t *m);
+		mblk_t *makeStapA(mblk_t *m);
 		static void putNalSize(mblk_t *m, size_t sz);
 
 		mblk_t *_stap = nullptr;
@@ -30,7 +30,10 @@ using namespace std;
 extern "C" {
 
 void ms_h264_bitstream_to_nalus(const uint8_t *bitstream, size_t size, MSQueue *nalus) {
-	H26xUtils::byteStreamToNalus(bitstream, size, nalus);
+	mblk_t *m = allocb(size, 0);
+	memcpy(m->b_wptr, bitstream, size);
+	m->b_wptr += size;
+	H26xUtils::byteStreamToNalus(m, nalus);
 }
 
 uint8_t ms_h264_nalu_get_nri(const mblk_t *nalu) {
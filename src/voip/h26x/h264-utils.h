@@ -70,8 +70,9 @@ unsigned int ms_h264_pps_get_id(const mblk_t *pps);
 /**
  * Slices a bitstream buffer into several nal units.
  *
- * Nal units are stored in freshly allocated mblk_t buffers which are pushed into
- * a queue. This function does not alter the buffer where the bitstream is contained in.
+ * The bitstream is copied once into a freshly allocated mblk_t, and the nal units pushed into
+ * the queue share this copy, except the ones whose start code prevention bytes are removed.
+ * This function does not alter the buffer where the bitstream is contained in.
  * @param bitstream Pointer on a memory segment that contains the bitstream to slice.
  * @param size Size of the memory segment.
  * @param nalus A queue where produced nal units will be pushed into.
@@ -33,9 +33,8 @@ mblk_t *H265NalPacker::NaluAggregator::feed(mblk_t *nalu) {
 		placeFirstNalu(nalu);
 	} else {
 		if (H265NaluHeader::length + _size + 2 + msgdsize(nalu) > _maxSize) {
-			mblk_t *m = completeAggregation();
-			placeFirstNalu(nalu);
-			return m;
+			/*like with H264, the NALu is not consumed and is processed again by the caller*/
+			return completeAggregation();
 		} else {
 			aggregate(nalu);
 		}
@@ -45,20 +44,16 @@ mblk_t *H265NalPacker::NaluAggregator::feed(mblk_t *nalu) {
 
 void H265NalPacker::NaluAggregator::reset() {
 	if (_ap) freemsg(_ap);
+	_ap = nullptr;
 }
 
 mblk_t *H265NalPacker::NaluAggregator::completeAggregation() {
-	mblk_t *m;
-
 	if (_ap == nullptr) return nullptr;
 
-	if (_apHeader.getType() != H265NaluType::Ap) {
-		m = _ap;
-	} else {
-		m = _apHeader.forge();
-		concatb(m, _ap);
-		msgpullup(m, -1);
+	if (_apHeader.getType() == H265NaluType::Ap) {
+		_apHeader.write(_ap->b_rptr);
 	}
+	mblk_t *m = _ap;
 	_ap = nullptr;
 	return m;
 }
@@ -67,60 +62,81 @@ void H265NalPacker::NaluAggregator::placeFirstNalu(mblk_t *nalu) {
 	H265NaluHeader header(nalu->b_rptr);
 	_ap = nalu;
 	_apHeader = header;
-	_size = msgdsize(nalu);
+	/*the size of the first NALu is counted with the length field it gets once a second one is aggregated*/
+	_size = msgdsize(nalu) + 2;
 }
 
+/*
+ * The first aggregated NALu is copied into a packet of the maximum payload size, whose header is written
+ * once the aggregation is complete. The following NALus are appended to it without any further allocation.
+ */
 void H265NalPacker::NaluAggregator::aggregate(mblk_t *nalu) {
 	H265NaluHeader header(nalu->b_rptr);
+	if (_apHeader.getType() != H265NaluType::Ap) {
+		mblk_t *ap = allocPacket(_bufferPool, _maxSize);
+		ap->b_wptr += H265NaluHeader::length;
+		putNalSize(ap, msgdsize(_ap));
+		appendData(ap, _ap);
+		freemsg(_ap);
+		_ap = ap;
+	}
 	_apHeader.setFBit(_apHeader.getFBit() || header.getFBit());
 	_apHeader.setType(H265NaluType::Ap);
 	_apHeader.setLayerId(min(_apHeader.getLayerId(), header.getLayerId()));
 	_apHeader.setTid(min(_apHeader.getTid(), header.getTid()));
 
-	mblk_t *size = allocb(2, 0);
-	uint16_t *sizePtr = reinterpret_cast<uint16_t *>(size->b_wptr);
-	*sizePtr = htons(uint16_t(msgdsize(nalu)));
-	size->b_wptr += 2;
-
-	_size += (msgdsize(size) + msgdsize(nalu)); // warning: this line must remain before 'concatb()' invocations.
+	size_t size = msgdsize(nalu);
+	putNalSize(_ap, size);
+	appendData(_ap, nalu);
+	freemsg(nalu);
+	_size += 2 + size;
+}
 
-	concatb(_ap, size);
-	concatb(_ap, nalu);
+void H265NalPacker::NaluAggregator::putNalSize(mblk_t *m, size_t size) {
+	uint16_t value = htons(uint16_t(size));
+	memcpy(m->b_wptr, &value, sizeof(value));
+	m->b_wptr += 2;
 }
 
+/*
+ * The number of fragments is computed first, so that the NALu payload is spread evenly between them, and each
+ * fragment is written with its headers into a single buffer.
+ */
 void H265NalPacker::NaluSpliter::feed(mblk_t *nalu) {
 	if (msgdsize(nalu) <= _maxSize) return;
+	if (nalu->b_cont) msgpullup(nalu, -1);
 
 	H265NaluHeader naluHeader(nalu->b_rptr);
-	nalu->b_rptr += H265NaluHeader::length;
+	const uint8_t *payload = nalu->b_rptr + H265NaluHeader::length;
 
 	H265FuHeader fuHeader;
 	fuHeader.setType(naluHeader.getType());
 	naluHeader.setType(H265NaluType::Fu);
 
 	const size_t maxFuPayloadSize = _maxSize - H265NaluHeader::length - H265FuHeader::length;
-	while (msgdsize(nalu) > maxFuPayloadSize) {
-		ms_queue_put(&_q, makeFu(naluHeader, fuHeader, nalu->b_rptr, maxFuPayloadSize));
-		fuHeader.setPosition(H265FuHeader::Position::Middle);
-		nalu->b_rptr += maxFuPayloadSize;
+	size_t remaining = (size_t)(nalu->b_wptr - payload);
+	size_t count = (remaining + maxFuPayloadSize - 1) / maxFuPayloadSize;
+	size_t fragmentSize = (remaining + count - 1) / count;
+	for (size_t i = 0; i < count; i++) {
+		size_t size = min(fragmentSize, remaining);
+		if (i == count - 1) fuHeader.setPosition(H265FuHeader::Position::End);
+		else if (i > 0) fuHeader.setPosition(H265FuHeader::Position::Middle);
+		ms_queue_put(&_q, makeFu(naluHeader, fuHeader, payload, size));
+		payload += size;
+		remaining -= size;
 	}
-	fuHeader.setPosition(H265FuHeader::Position::End);
-	ms_queue_put(&_q, makeFu(naluHeader, fuHeader, nalu->b_rptr, msgdsize(nalu)));
 
 	freemsg(nalu);
 }
 
 mblk_t *H265NalPacker::NaluSpliter::makeFu(const H265NaluHeader &naluHeader, const H265FuHeader &fuHeader, const uint8_t *payload, size_t length) {
-	mblk_t *naluHeaderBuf = naluHeader.forge();
-	mblk_t *fuHeaderBuf = fuHeader.forge();
-	mblk_t *payloadBuf = allocb(length, 0);
-	memcpy(payloadBuf->b_wptr, payload, length);
-	payloadBuf->b_wptr += length;
-
-	mblk_t *fu = naluHeaderBuf;
-	concatb(fu, fuHeaderBuf);
-	concatb(fu, payloadBuf);
-	msgpullup(fu, -1);
+	mblk_t *fu = allocPacket(_bufferPool, H265NaluHeader::length + H265FuHeader::length + length);
+	naluHeader.write(fu->b_wptr);
+	fu->b_wptr += H265NaluHeader::length;
+	fuHeader.write(fu->b_wptr);
+	fu->b_wptr += H265FuHeader::length;
+	memcpy(fu->b_wptr, payload, length);
+	fu->b_wptr += length;
 	return fu;
 }
 
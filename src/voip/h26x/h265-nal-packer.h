@@ -43,6 +43,7 @@ private:
 	private:
 		void placeFirstNalu(mblk_t *nalu);
 		void aggregate(mblk_t *nalu);
+		static void putNalSize(mblk_t *m, size_t size);
 
 		size_t _size = 0;
 		H265NaluHeader _apHeader;
@@ -66,21 +66,24 @@ void H265NaluHeader::parse(const uint8_t *header) {
 }
 
 mblk_t *H265NaluHeader::forge() const {
-	uint16_t header = _fBit ? 1 : 0;
-	header <<= 6;
-	header |= _type;
-	header <<= 6;
-	header |= _layerId;
-	header <<= 3;
-	header |= _tid;
-	header = htons(header);
-
 	mblk_t *newHeader = allocb(2, 0);
-	*reinterpret_cast<uint16_t *>(newHeader->b_wptr) = header;
+	write(newHeader->b_wptr);
 	newHeader->b_wptr += 2;
 	return newHeader;
 }
 
+void H265NaluHeader::write(uint8_t *header) const {
+	uint16_t value = _fBit ? 1 : 0;
+	value <<= 6;
+	value |= _type;
+	value <<= 6;
+	value |= _layerId;
+	value <<= 3;
+	value |= _tid;
+	value = htons(value);
+	memcpy(header, &value, sizeof(value));
+}
+
 void H265FuHeader::parse(const uint8_t *header) {
 	uint8_t header2 = *header;
 	_type = header2 & 0x3f;
@@ -101,17 +104,20 @@ void H265FuHeader::parse(const uint8_t *header) {
 }
 
 mblk_t *H265FuHeader::forge() const {
-	uint8_t header = (_pos == Position::Start ? 1 : 0);
-	header <<= 1;
-	header |= (_pos == Position::End ? 1 : 0);
-	header <<= 6;
-	header |= _type;
-
 	mblk_t *newHeader = allocb(1, 0);
-	*newHeader->b_wptr++ = header;
+	write(newHeader->b_wptr++);
 	return newHeader;
 }
 
+void H265FuHeader::write(uint8_t *header) const {
+	uint8_t value = (_pos == Position::Start ? 1 : 0);
+	value <<= 1;
+	value |= (_pos == Position::End ? 1 : 0);
+	value <<= 6;
+	value |= _type;
+	*header = value;
+}
+
 void H265ParameterSetsInserter::process(MSQueue *in, MSQueue *out) {
 	H265NaluHeader header;
 	bool isKeyFrame = false;
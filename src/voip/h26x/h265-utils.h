@@ -63,6 +63,7 @@ public:
 
 	void parse(const uint8_t *header) override;
 	mblk_t *forge() const override;
+	void write(uint8_t *header) const;
 
 	static const size_t length = 2;
 
@@ -91,6 +92,7 @@ public:
 
 	void parse(const uint8_t *header);
 	mblk_t *forge() const;
+	void write(uint8_t *header) const;
 
 	static const size_t length = 1;
 
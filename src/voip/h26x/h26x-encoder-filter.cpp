@@ -34,6 +34,7 @@ H26xEncoderFilter::H26xEncoderFilter(MSFilter *f, H26xEncoder *encoder, const MS
 	_packer.reset(H26xToolFactory::get(_encoder->getMime()).createNalPacker(ms_factory_get_payload_max_size(f->factory)));
 	_packer->setPacketizationMode(NalPacker::NonInterleavedMode);
 	_packer->enableAggregation(false);
+	_packer->setBufferPool(ms_factory_get_buffer_pool(f->factory));
 }
 
 void H26xEncoderFilter::preprocess() {
@@ -23,6 +23,7 @@
 #include "h265-utils.h"
 
 #include "h26x-utils.h"
+#include "mssimd.h"
 
 using namespace std;
 
@@ -58,49 +59,132 @@ static bool isPictureStartCode(const uint8_t *bytestream, size_t size){
 	return false;
 }
 
+/*
+ * Returns the first position p in [begin, end - 3[ such that p[0..2] is 00 00 <lastByte>, or end if there is none.
+ * Like the former byte by byte scan, the pattern is only matched when it is followed by at least one byte.
+ * The SSE2 path tests 16 positions per iteration. Elsewhere memchr(), which libcs vectorize, looks for the
+ * last byte of the pattern, which is rare in compressed data, and the two preceding bytes are checked afterwards.
+ */
+const uint8_t *H26xUtils::findStartCode(const uint8_t *begin, const uint8_t *end, uint8_t lastByte) {
+	if (end - begin < 4) return end;
+	const uint8_t *last = end - 4; // last position where the pattern may start
+	const uint8_t *p = begin;
+#if MS_HAS_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i third = _mm_set1_epi8((char)lastByte);
+	/* 16 candidate positions per iteration, the loads reading up to p + 17. */
+	while (last - p >= 15) {
+		__m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		__m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+		__m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 2));
+		__m128i match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)), _mm_cmpeq_epi8(b2, third));
+		int mask = _mm_movemask_epi8(match);
+		if (mask != 0) {
+			int offset = 0;
+			while ((mask & 1) == 0) {
+				mask >>= 1;
+				offset++;
+			}
+			return p + offset;
+		}
+		p += 16;
+	}
+#endif
+	while (p <= last) {
+		const uint8_t *found = static_cast<const uint8_t *>(memchr(p + 2, lastByte, (size_t)(last - p) + 1));
+		if (found == nullptr) break;
+		if (found[-1] == 0 && found[-2] == 0) return found - 2;
+		p = found - 1;
+	}
+	return end;
+}
+
+/* Returns the first 00 00 03 01 sequence of [begin, end[, or end if there is none. */
+static const uint8_t *findPreventionSequence(const uint8_t *begin, const uint8_t *end) {
+	const uint8_t *p = begin;
+	while ((p = H26xUtils::findStartCode(p, end, 3)) != end) {
+		if (p[3] == 1) return p;
+		p++;
+	}
+	return end;
+}
+
 mblk_t * H26xUtils::makeNalu(const uint8_t *byteStream, size_t naluSize, bool removePreventionBytes, int *preventionBytesRemoved){
 	mblk_t *nalu = allocb(naluSize, 0);
-	const uint8_t *it;
+	const uint8_t *it = byteStream;
 	const uint8_t *end = byteStream + naluSize;
-	for(it = byteStream; it < end ;){
-		if (removePreventionBytes && it[0] == 0 && it + 3 < end && it[1] == 0 && it[2] == 3 && it[3] == 1){
+	if (removePreventionBytes) {
+		const uint8_t *found;
+		while ((found = findPreventionSequence(it, end)) != end) {
 			/* Found 0x00000301, replace by 0x000001*/
-			it += 3;
-			*nalu->b_wptr++ = 0;
-			*nalu->b_wptr++ = 0;
-			*nalu->b_wptr++ = 1;
+			memcpy(nalu->b_wptr, it, (size_t)(found - it) + 2);
+			nalu->b_wptr += (found - it) + 2;
+			it = found + 3;
 			(*preventionBytesRemoved)++;
-		}else{
-			*nalu->b_wptr++ = *it++;
 		}
 	}
+	memcpy(nalu->b_wptr, it, (size_t)(end - it));
+	nalu->b_wptr += end - it;
 	return nalu;
 }
 
-void H26xUtils::byteStreamToNalus(const uint8_t *byteStream, size_t size, MSQueue *out, bool removePreventionBytes) {
-	int preventionBytesRemoved = 0;
-	size_t i;
-	size_t begin, end;
-	size_t naluSize;
-	
+/*
+ * Calls onNalu(offset, size) for each NAL unit of the byte stream. As before, the zero byte of a four bytes start code
+ * stays at the end of the preceding NAL unit, so that nalusToByteStream() gives back the original byte stream.
+ */
+template <typename Function>
+static void splitByteStream(const uint8_t *byteStream, size_t size, Function onNalu) {
 	if (!isPictureStartCode(byteStream, size)){
 		ms_error("no picture start code found in H26x byte stream");
 		throw invalid_argument("no picutre start code found in H26x byte stream");
-		return;
-	}
-	begin = 4;
-	for (i = begin; i + 3 < size ; ++i){
-		if (byteStream[i] == 0 && byteStream[i+1] == 0 && byteStream[i+2] == 1){
-			end = i;
-			naluSize = end - begin;
-			ms_queue_put(out, makeNalu(byteStream + begin, naluSize, removePreventionBytes, &preventionBytesRemoved));
-			i+=3;
-			begin = i;
-		}
 	}
-	naluSize = size - begin;
-	ms_queue_put(out, makeNalu(byteStream + begin, naluSize, removePreventionBytes, &preventionBytesRemoved));
-	
+	const uint8_t *end = byteStream + size;
+	const uint8_t *begin = byteStream + 4;
+	const uint8_t *from = begin;
+	const uint8_t *found;
+	while ((found = H26xUtils::findStartCode(from, end, 1)) != end) {
+		onNalu((size_t)(begin - byteStream), (size_t)(found - begin));
+		begin = found + 3;
+		from = begin + 1; // the first byte of a NAL unit is its header
+	}
+	onNalu((size_t)(begin - byteStream), (size_t)(end - begin));
+}
+
+void H26xUtils::byteStreamToNalus(const uint8_t *byteStream, size_t size, MSQueue *out, bool removePreventionBytes) {
+	int preventionBytesRemoved = 0;
+
+	splitByteStream(byteStream, size, [&](size_t offset, size_t naluSize) {
+		ms_queue_put(out, makeNalu(byteStream + offset, naluSize, removePreventionBytes, &preventionBytesRemoved));
+	});
+
+	if (preventionBytesRemoved > 0){
+		ms_message("Removed %i start code prevention bytes", preventionBytesRemoved);
+	}
+}
+
+void H26xUtils::byteStreamToNalus(mblk_t *byteStream, MSQueue *out, bool removePreventionBytes) {
+	int preventionBytesRemoved = 0;
+
+	msgpullup(byteStream, -1);
+	const uint8_t *base = byteStream->b_rptr;
+	try {
+		splitByteStream(base, (size_t)(byteStream->b_wptr - base), [&](size_t offset, size_t naluSize) {
+			const uint8_t *naluBegin = base + offset;
+			if (removePreventionBytes && findPreventionSequence(naluBegin, naluBegin + naluSize) != naluBegin + naluSize) {
+				ms_queue_put(out, makeNalu(naluBegin, naluSize, true, &preventionBytesRemoved));
+				return;
+			}
+			mblk_t *nalu = dupb(byteStream);
+			nalu->b_rptr = const_cast<uint8_t *>(naluBegin);
+			nalu->b_wptr = nalu->b_rptr + naluSize;
+			ms_queue_put(out, nalu);
+		});
+	} catch (const invalid_argument &) {
+		freemsg(byteStream);
+		throw;
+	}
+	freemsg(byteStream);
+
 	if (preventionBytesRemoved > 0){
 		ms_message("Removed %i start code prevention bytes", preventionBytesRemoved);
 	}
@@ -146,7 +230,12 @@ size_t H26xUtils::nalusToByteStream(MSQueue *nalus, uint8_t* byteStream, size_t
 
 void H26xParameterSetsInserter::replaceParameterSet(mblk_t *&ps, mblk_t *newPs) {
 	if (ps) freemsg(ps);
-	ps = newPs;
+	ps = nullptr;
+	if (newPs) {
+		/*copied, so that a NAL unit sharing the buffer of a whole frame does not keep it alive*/
+		ps = copymsg(newPs);
+		freemsg(newPs);
+	}
 }
 
 H26xParameterSetsStore::H26xParameterSetsStore(const std::string &mime, const std::initializer_list<int> &psCodes) {
@@ -210,7 +299,8 @@ void H26xParameterSetsStore::addPs(int naluType, mblk_t *nalu) {
 
 	if (replaceParam) {
 		if (lastPs) freemsg(lastPs);
-		_ps[naluType] = nalu ? dupmsg(nalu) : nullptr;
+		/*copied, so that a NAL unit sharing the buffer of a whole frame does not keep it alive*/
+		_ps[naluType] = nalu ? copymsg(nalu) : nullptr;
 		_newParameters = true;
 	}
 }
@@ -75,6 +75,14 @@ public:
 
 	static void byteStreamToNalus(const std::vector<uint8_t> &byteStream, MSQueue *out, bool removePreventionBytes = true);
 	static void byteStreamToNalus(const uint8_t *byteStream, size_t size, MSQueue *out, bool removePreventionBytes = true);
+	/*
+	 * Same as above, but the NAL units are views on the byte stream buffer (see dupb()) instead of copies.
+	 * Only the NAL units from which prevention bytes are removed are copied. The byte stream is consumed.
+	 */
+	static void byteStreamToNalus(mblk_t *byteStream, MSQueue *out, bool removePreventionBytes = true);
+
+	/* Returns the first position of a 00 00 <lastByte> sequence followed by at least one byte in [begin, end[, or end.*/
+	static const uint8_t *findStartCode(const uint8_t *begin, const uint8_t *end, uint8_t lastByte = 1);
 
 	/* Convert nalus to byte stream. If byteStream buffer is not large enough std::invalid_argument is thrown.*/
 	static size_t nalusToByteStream(MSQueue *nalus, uint8_t* byteStream, size_t size);
@@ -253,7 +253,11 @@ bool MediaCodecEncoder::fetch(MSQueue *encodedData) {
 	 *   however 0x00000301 may happen but this is not a prevention byte.
 	 * - this could mean that we have another bug elsewhere in H26xUtils routines, but then why decoding goes perfectly well when not removing prevention bytes ?
 	 */
-	H26xUtils::byteStreamToNalus(buf + info.offset, info.size, &outq, false);
+	mblk_t *byteStream = allocb(info.size, 0);
+	memcpy(byteStream->b_wptr, buf + info.offset, info.size);
+	byteStream->b_wptr += info.size;
+	/*the output buffer is given back to MediaCodec below, so it is copied once and the NAL units are views on the copy*/
+	H26xUtils::byteStreamToNalus(byteStream, &outq, false);
 	_psInserter->process(&outq, encodedData);
 
 	AMediaCodec_releaseOutputBuffer(_impl, obufidx, FALSE);
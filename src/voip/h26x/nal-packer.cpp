@@ -42,6 +42,11 @@ void NalPacker::setMaxPayloadSize(size_t size) {
 	ms_message("H26xNalPacker: max payload size set to %zu bytes", size);
 }
 
+void NalPacker::setBufferPool(MSBufferPool *pool) {
+	_naluSpliter->setBufferPool(pool);
+	_naluAggregator->setBufferPool(pool);
+}
+
 void NalPacker::pack(MSQueue *naluq, MSQueue *rtpq, uint32_t ts) {
 	switch (_packMode) {
 		case SingleNalUnitMode:
@@ -124,4 +129,16 @@ void NalPacker::sendPacket(MSQueue *rtpq, uint32_t ts, mblk_t *m, bool_t marker)
 	ms_queue_put(rtpq, m);
 }
 
+mblk_t *NalPacker::allocPacket(MSBufferPool *pool, size_t size) {
+	return pool ? ms_buffer_pool_get(pool, (int)size) : allocb(size, 0);
+}
+
+void NalPacker::appendData(mblk_t *packet, const mblk_t *m) {
+	for (; m != nullptr; m = m->b_cont) {
+		size_t size = (size_t)(m->b_wptr - m->b_rptr);
+		memcpy(packet->b_wptr, m->b_rptr, size);
+		packet->b_wptr += size;
+	}
+}
+
 }
@@ -23,6 +23,7 @@
 
 #include <ortp/str_utils.h>
 
+#include "mediastreamer2/msbufferpool.h"
 #include "mediastreamer2/msqueue.h"
 
 namespace mediastreamer {
@@ -42,6 +43,8 @@ public:
 		size_t getMaxSize() const {return _maxSize;}
 		void setMaxSize(size_t maxSize);
 
+		void setBufferPool(MSBufferPool *pool) {_bufferPool = pool;}
+
 		virtual mblk_t *feed(mblk_t *nalu) = 0;
 		virtual bool isAggregating() const = 0;
 		virtual void reset() = 0;
@@ -49,6 +52,7 @@ public:
 
 	protected:
 		size_t _maxSize;
+		MSBufferPool *_bufferPool = nullptr;
 	};
 
 	class NaluSpliterInterface {
@@ -59,11 +63,14 @@ public:
 		size_t getMaxSize() const {return _maxSize;}
 		void setMaxSize(size_t maxSize) {_maxSize = maxSize;}
 
+		void setBufferPool(MSBufferPool *pool) {_bufferPool = pool;}
+
 		virtual void feed(mblk_t *nalu) = 0;
 		MSQueue *getPackets() {return &_q;}
 
 	protected:
 		size_t _maxSize;
+		MSBufferPool *_bufferPool = nullptr;
 		MSQueue _q;
 	};
 
@@ -77,6 +84,12 @@ public:
 	void setMaxPayloadSize(size_t size);
 	size_t getMaxPayloadSize() {return _maxSize;}
 
+	/*
+	 * Make FU and aggregation packets be written into buffers of the pool, which have room for the RTP header and the
+	 * SRTP trailer. Without pool, they are allocated with allocb().
+	 */
+	void setBufferPool(MSBufferPool *pool);
+
 	// process NALus and pack them into RTP payloads
 	MS2_PUBLIC void pack(MSQueue *naluq, MSQueue *rtpq, uint32_t ts);
 	void flush();
@@ -89,6 +102,11 @@ protected:
 	void fragNaluAndSend(MSQueue *rtpq, uint32_t ts, mblk_t *nalu, bool_t marker);
 	void sendPacket(MSQueue *rtpq, uint32_t ts, mblk_t *m, bool_t marker);
 
+	// allocate a packet of the given size, from the pool if any
+	static mblk_t *allocPacket(MSBufferPool *pool, size_t size);
+	// copy all the data of m at the write pointer of packet
+	static void appendData(mblk_t *packet, const mblk_t *m);
+
 	size_t _maxSize;
 	uint16_t _refCSeq = 0;
 	PacketizationMode _packMode = SingleNalUnitMode;
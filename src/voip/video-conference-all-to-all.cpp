@@ -230,42 +230,75 @@ void VideoConferenceAllToAll::connectEndpoint(VideoEndpoint *ep) {
 	}
 }
 
+/*
+ * Each receiver gets the temporal layers of its sources that fit in its own bitrate (see MS_VIDEO_ROUTER_SET_OUTPUT_BITRATE).
+ * When all sources are layered, the senders are asked for the bitrate of the best receiver: slow receivers only lose frame rate.
+ * This request is lowered so that the base layer, which every receiver gets, still fits in what the weakest receiver can take.
+ * Otherwise, the senders are limited to what the weakest receiver can take.
+ */
 void VideoConferenceAllToAll::updateBitrateRequest() {
 	const bctbx_list_t *elem;
 	int min_of_tmmbr = -1;
+	int max_of_tmmbr = -1;
+	bool layered = (mMembers != NULL);
+	float base_layer_ratio = 0; /* largest share of the base layer in the bitrate of a source */
+
 	for (elem = mEndpoints; elem != NULL; elem = elem->next){
 		VideoEndpoint *ep = (VideoEndpoint*) elem->data;
-		if (!video_stream_thumbnail_enabled(ep->mSt) && ep->mLastTmmbrReceived != 0){
-			if (min_of_tmmbr == -1){
-				min_of_tmmbr = ep->mLastTmmbrReceived;
-			}else{
-				if (ep->mLastTmmbrReceived < min_of_tmmbr){
-					min_of_tmmbr = ep->mLastTmmbrReceived;
-				}
+		if (ep->mLastTmmbrReceived != 0){
+			setOutputBitrate(ep->mOutPin, ep->mLastTmmbrReceived);
+			if (!video_stream_thumbnail_enabled(ep->mSt)){
+				if (min_of_tmmbr == -1 || ep->mLastTmmbrReceived < min_of_tmmbr) min_of_tmmbr = ep->mLastTmmbrReceived;
+				if (ep->mLastTmmbrReceived > max_of_tmmbr) max_of_tmmbr = ep->mLastTmmbrReceived;
 			}
 		}
 	}
 	for (elem = mMembers; elem != NULL; elem = elem->next){
 		VideoEndpoint *ep = (VideoEndpoint*) elem->data;
 		if ((ep->mOutPin > -1) && ep->mLastTmmbrReceived != 0){
-			if (min_of_tmmbr == -1){
-				min_of_tmmbr = ep->mLastTmmbrReceived;
-			}else{
-				if (ep->mLastTmmbrReceived < min_of_tmmbr){
-					min_of_tmmbr = ep->mLastTmmbrReceived;
-				}
-			}
+			setOutputBitrate(ep->mOutPin, ep->mLastTmmbrReceived);
+			if (min_of_tmmbr == -1 || ep->mLastTmmbrReceived < min_of_tmmbr) min_of_tmmbr = ep->mLastTmmbrReceived;
+			if (ep->mLastTmmbrReceived > max_of_tmmbr) max_of_tmmbr = ep->mLastTmmbrReceived;
+		}
+		MSVideoRouterInputLayers il;
+		if (!getInputLayers(ep->mPin, &il) || il.temporal_layers < 2) layered = false;
+		else{
+			/* until the layers are measured, assume the base layer is the whole stream */
+			float ratio = (il.bitrate > 0) ? (float)il.base_layer_bitrate / (float)il.bitrate : 1.0f;
+			if (ratio > base_layer_ratio) base_layer_ratio = ratio;
 		}
 	}
 	if (min_of_tmmbr != -1){
-		if (mBitrate != min_of_tmmbr){
-			mBitrate = min_of_tmmbr;
-			ms_message("MSVideoConference [%p]: new bitrate requested: %i kbits/s.", this, mBitrate/1000);
+		int bitrate = layered ? max_of_tmmbr : min_of_tmmbr;
+		bool limited = false;
+		if (layered && bitrate * base_layer_ratio > min_of_tmmbr){
+			bitrate = (int)(min_of_tmmbr / base_layer_ratio);
+			limited = true;
+		}
+		if (mBitrate != bitrate){
+			mBitrate = bitrate;
+			ms_message("MSVideoConference [%p]: new bitrate requested: %i kbits/s (%s).", this, mBitrate/1000,
+				limited ? "base layer limited by the weakest receiver" : (layered ? "best receiver, sources are layered" : "weakest receiver"));
 			applyNewBitrateRequest();
 		}
 	}
 }
 
+void VideoConferenceAllToAll::setOutputBitrate(int pin, int bitrate) {
+	MSVideoRouterOutputBitrate ob;
+	if (pin < 0) return;
+	ob.output = pin;
+	ob.bitrate = bitrate;
+	ms_filter_call_method(mMixer, MS_VIDEO_ROUTER_SET_OUTPUT_BITRATE, &ob);
+}
+
+bool VideoConferenceAllToAll::getInputLayers(int pin, MSVideoRouterInputLayers *il) {
+	memset(il, 0, sizeof(*il));
+	if (pin < 0) return false;
+	il->input = pin;
+	return ms_filter_call_method(mMixer, MS_VIDEO_ROUTER_GET_INPUT_LAYERS, il) == 0;
+}
+
 void VideoConferenceAllToAll::configureOutput(VideoEndpoint *ep) {
 	MSVideoRouterPinData pd;
 	pd.input = ep->mSource;
@@ -124,6 +124,8 @@ protected:
 	int findSinkPin(std::string participant);
 	int findSourcePin(std::string participant);
 	void configureOutput(VideoEndpoint *ep) override;
+	void setOutputBitrate(int pin, int bitrate);
+	bool getInputLayers(int pin, MSVideoRouterInputLayers *il);
 	int mOutputs[ROUTER_MAX_OUTPUT_CHANNELS] ;
 	int mInputs[ROUTER_MAX_INPUT_CHANNELS];
 };
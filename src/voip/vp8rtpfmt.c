@@ -978,6 +978,26 @@ uint8_t * vp8rtpfmt_skip_payload_descriptor(mblk_t *m){
 	return &h[offset];
 }
 
+bool_t vp8rtpfmt_get_temporal_layer(mblk_t *m, int *tid, bool_t *layer_sync){
+	uint8_t *h = m->b_rptr;
+	unsigned int packet_size = (unsigned int)(m->b_wptr - m->b_rptr);
+	unsigned int offset = 1;
+
+	/* The TID is in the extension octets, which are present only if the X bit is set. */
+	if (packet_size < 2 || !(h[0] & (1 << 7))) return FALSE;
+	if (!(h[1] & (1 << 5))) return FALSE;
+	offset++;
+	if (h[1] & (1 << 7)) {
+		/* Skip the 8 or 16 bits pictureID. */
+		if (offset >= packet_size) return FALSE;
+		offset += (h[offset] & (1 << 7)) ? 2 : 1;
+	}
+	if (h[1] & (1 << 6)) offset++; /* Skip the tl0picidx. */
+	if (offset >= packet_size) return FALSE;
+	*tid = (h[offset] & 0xC0) >> 6;
+	*layer_sync = (h[offset] & (1 << 5)) ? TRUE : FALSE;
+	return TRUE;
+}
 
 void vp8rtpfmt_unpacker_init(Vp8RtpFmtUnpackerCtx *ctx, MSFilter *f, bool_t avpf_enabled, bool_t freeze_on_error, bool_t output_partitions) {
 	ctx->filter = f;
@@ -142,6 +142,9 @@ extern "C"{
 	/* Fast version that just skips the vp8 rtp payload header, and returns the start of the VP8 payload. */
 	uint8_t * vp8rtpfmt_skip_payload_descriptor(mblk_t *m);
 
+	/* Get the temporal layer index (TID) and layer sync bit of a packet. Returns FALSE if the payload descriptor has no TID. */
+	bool_t vp8rtpfmt_get_temporal_layer(mblk_t *m, int *tid, bool_t *layer_sync);
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,6 +19,7 @@
 
 #include "mediastreamer2/mediastream.h"
 #include "mediastreamer2/dtmfgen.h"
+#include "mediastreamer2/msconference.h"
 #include "mediastreamer2/msfileplayer.h"
 #include "mediastreamer2/msfilerec.h"
 #include "mediastreamer2/msrtp.h"
@@ -724,6 +725,76 @@ static void participants_volumes_in_audio_stream(void) {
 	rtp_profile_destroy(profile);
 }
 
+#define CONFERENCE_LEG_RTP_PORT 20000
+#define CONFERENCE_CLIENT_RTP_PORT 21000
+
+/*
+ * Three participants, only one of them speaking, in a conference mixing a single speaker.
+ * The silent participant added first is mixed until the speaking one is selected instead of it.
+ */
+static void audio_conference_max_active_speakers(void) {
+	MSAudioConferenceParams params = {0};
+	MSAudioConference *conf;
+	AudioStream *legs[3], *clients[3];
+	MSAudioEndpoint *endpoints[3];
+	RtpProfile *profile = rtp_profile_new("default profile");
+	char *hello_file = bc_tester_res(HELLO_8K_1S_FILE);
+	int loop_interval = 0;
+	int dummy = 0;
+	int i;
+
+	rtp_profile_set_payload(profile, 0, &payload_type_pcmu8000);
+	params.samplerate = 8000;
+	params.max_active_speakers = 1;
+	conf = ms_audio_conference_new(&params, _factory);
+
+	for (i = 0; i < 3; i++) {
+		/*the first participant to join is silent, the second one speaks*/
+		const char *infile = (i == 1) ? hello_file : NULL;
+		int leg_port = CONFERENCE_LEG_RTP_PORT + 10 * i;
+		int client_port = CONFERENCE_CLIENT_RTP_PORT + 10 * i;
+
+		legs[i] = audio_stream_new2(_factory, MARIELLE_IP, leg_port, leg_port + 1);
+		clients[i] = audio_stream_new2(_factory, MARGAUX_IP, client_port, client_port + 1);
+		BC_ASSERT_EQUAL(audio_stream_start_full(legs[i], profile, MARGAUX_IP, client_port, MARGAUX_IP, client_port + 1,
+			0, 50, NULL, NULL, NULL, NULL, FALSE), 0, int, "%d");
+		BC_ASSERT_EQUAL(audio_stream_start_full(clients[i], profile, MARIELLE_IP, leg_port, MARIELLE_IP, leg_port + 1,
+			0, 50, infile, NULL, NULL, NULL, FALSE), 0, int, "%d");
+		if (infile) ms_filter_call_method(clients[i]->soundread, MS_FILE_PLAYER_LOOP, &loop_interval);
+		endpoints[i] = ms_audio_endpoint_get_from_stream(legs[i], TRUE);
+		BC_ASSERT_EQUAL(ms_audio_conference_add_member(conf, endpoints[i]), 0, int, "%d");
+	}
+	/*there is room for the first participant only*/
+	BC_ASSERT_TRUE(ms_audio_conference_member_is_mixed(conf, endpoints[0]));
+	BC_ASSERT_FALSE(ms_audio_conference_member_is_mixed(conf, endpoints[1]));
+	BC_ASSERT_FALSE(ms_audio_conference_member_is_mixed(conf, endpoints[2]));
+
+	for (i = 0; i < 40; i++) {
+		wait_for_until(&legs[1]->ms, &clients[1]->ms, &dummy, 1, 50);
+		ms_audio_conference_process_events(conf);
+	}
+	/*the speaking participant replaces the silent one*/
+	BC_ASSERT_FALSE(ms_audio_conference_member_is_mixed(conf, endpoints[0]));
+	BC_ASSERT_TRUE(ms_audio_conference_member_is_mixed(conf, endpoints[1]));
+	BC_ASSERT_FALSE(ms_audio_conference_member_is_mixed(conf, endpoints[2]));
+
+	/*once muted, it leaves its place to one of the others*/
+	ms_audio_conference_mute_member(conf, endpoints[1], TRUE);
+	ms_audio_conference_process_events(conf);
+	BC_ASSERT_FALSE(ms_audio_conference_member_is_mixed(conf, endpoints[1]));
+	BC_ASSERT_EQUAL(ms_audio_conference_member_is_mixed(conf, endpoints[0]) + ms_audio_conference_member_is_mixed(conf, endpoints[2]),
+		1, int, "%d");
+
+	for (i = 0; i < 3; i++) {
+		ms_audio_conference_remove_member(conf, endpoints[i]);
+		ms_audio_endpoint_release_from_stream(endpoints[i]);
+		audio_stream_stop(legs[i]);
+		audio_stream_stop(clients[i]);
+	}
+	ms_audio_conference_destroy(conf);
+	free(hello_file);
+	rtp_profile_destroy(profile);
+}
 
 static test_t tests[] = {
 	TEST_NO_TAG("Basic audio stream", basic_audio_stream),
@@ -740,6 +811,7 @@ static test_t tests[] = {
 	TEST_NO_TAG("Symetric rtp with wrong address", symetric_rtp_with_wrong_addr),
 	TEST_NO_TAG("Symetric rtp with wrong rtcp port", symetric_rtp_with_wrong_rtcp_port),
 	TEST_NO_TAG("Participants volumes in audio stream", participants_volumes_in_audio_stream),
+	TEST_NO_TAG("Audio conference mixing the loudest participants", audio_conference_max_active_speakers),
 };
 
 test_suite_t audio_stream_test_suite = {
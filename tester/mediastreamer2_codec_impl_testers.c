@@ -205,6 +205,292 @@ static void play_scenario_with_mkv_recorder(const char *pcap_scenario_file, cons
 	bctbx_free(output_file);
 }
 
+/* Drive the recorder by hand so that every frame goes through the writer thread before the file is closed. */
+static void mkv_recorder_writer_thread(void) {
+	const MSFmtDescriptor *fmt = ms_factory_get_audio_format(_factory, "pcmu", 8000, 1, NULL);
+	MSFilter *recorder = ms_factory_create_filter(_factory, MS_MKV_RECORDER_ID);
+	MSFilter *player;
+	MSPinFormat pinfmt = {1, fmt};
+	MSTicker ticker;
+	MSQueue input;
+	MSRecorderState state;
+	char *output_file = bctbx_strdup_printf("%s/writer_thread.mkv", bc_tester_get_writable_dir_prefix());
+	int duration = 0;
+	int pass, i;
+
+	unlink(output_file);
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 20;
+	ms_queue_init(&input);
+	recorder->inputs[1] = &input;
+	ms_filter_call_method(recorder, MS_FILTER_SET_INPUT_FMT, &pinfmt);
+
+	/* the second pass appends to the file written by the first one */
+	for (pass = 0; pass < 2; pass++) {
+		BC_ASSERT_EQUAL(ms_filter_call_method(recorder, MS_RECORDER_OPEN, output_file), 0, int, "%d");
+		BC_ASSERT_EQUAL(ms_filter_call_method_noarg(recorder, MS_RECORDER_START), 0, int, "%d");
+		ms_filter_preprocess(recorder, &ticker);
+		for (i = 0; i < 100; i++) {
+			mblk_t *m = allocb(160, 0);
+			memset(m->b_wptr, 0xff, 160);
+			m->b_wptr += 160;
+			mblk_set_timestamp_info(m, (uint32_t)(i * 160));
+			ms_queue_put(&input, m);
+			ms_filter_process(recorder);
+			ticker.time += ticker.interval;
+		}
+		ms_filter_postprocess(recorder);
+		BC_ASSERT_EQUAL(ms_filter_call_method(recorder, MS_RECORDER_CLOSE, NULL), 0, int, "%d");
+		ms_filter_call_method(recorder, MS_RECORDER_GET_STATE, &state);
+		BC_ASSERT_EQUAL(state, MSRecorderClosed, int, "%d");
+	}
+	recorder->inputs[1] = NULL;
+	ms_filter_destroy(recorder);
+
+	player = ms_factory_create_filter(_factory, MS_MKV_PLAYER_ID);
+	BC_ASSERT_EQUAL(ms_filter_call_method(player, MS_PLAYER_OPEN, output_file), 0, int, "%d");
+	ms_filter_call_method(player, MS_PLAYER_GET_DURATION, &duration);
+	BC_ASSERT_GREATER(duration, 3900, int, "%d");
+	BC_ASSERT_LOWER(duration, 4100, int, "%d");
+	ms_filter_call_method_noarg(player, MS_PLAYER_CLOSE);
+	ms_filter_destroy(player);
+
+	unlink(output_file);
+	bctbx_free(output_file);
+}
+
+#define MKV_TEST_FRAME_SIZE 160
+
+static uint8_t mkv_test_payload_byte(int frame, int offset) {
+	/* the first two bytes are the same in every frame, so that they can be stripped from the blocks */
+	if (offset == 0) return 0x12;
+	if (offset == 1) return 0x34;
+	return (uint8_t)(frame * 7 + offset);
+}
+
+/* Play the audio track of an MKV file by hand and check the payload of every frame. */
+static void check_mkv_audio_playback(const char *file, int nframes) {
+	MSFilter *player = ms_factory_create_filter(_factory, MS_MKV_PLAYER_ID);
+	MSTicker ticker;
+	MSQueue output;
+	int received = 0;
+	int i;
+
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 20;
+	ms_queue_init(&output);
+	if (!BC_ASSERT_EQUAL(ms_filter_call_method(player, MS_PLAYER_OPEN, (void *)file), 0, int, "%d")) {
+		ms_filter_destroy(player);
+		return;
+	}
+	player->outputs[1] = &output;
+	ms_filter_preprocess(player, &ticker);
+	ms_filter_call_method_noarg(player, MS_PLAYER_START);
+	for (i = 0; i < nframes + 50; i++) {
+		mblk_t *m;
+		ticker.time += ticker.interval;
+		ms_filter_process(player);
+		while ((m = ms_queue_get(&output)) != NULL) {
+			int size = (int)(m->b_wptr - m->b_rptr);
+			int mismatches = 0;
+			int j;
+			BC_ASSERT_EQUAL(size, MKV_TEST_FRAME_SIZE, int, "%d");
+			for (j = 0; j < size && j < MKV_TEST_FRAME_SIZE; j++) {
+				if (m->b_rptr[j] != mkv_test_payload_byte(received, j)) mismatches++;
+			}
+			BC_ASSERT_EQUAL(mismatches, 0, int, "%d");
+			received++;
+			freemsg(m);
+		}
+	}
+	BC_ASSERT_EQUAL(received, nframes, int, "%d");
+	ms_filter_postprocess(player);
+	player->outputs[1] = NULL;
+	ms_filter_call_method_noarg(player, MS_PLAYER_CLOSE);
+	ms_filter_destroy(player);
+}
+
+/* Frames are served as views on the mapped file where mmap() is available: they must hold the recorded payloads. */
+static void mkv_player_frames(void) {
+	const MSFmtDescriptor *fmt = ms_factory_get_audio_format(_factory, "pcmu", 8000, 1, NULL);
+	MSFilter *recorder = ms_factory_create_filter(_factory, MS_MKV_RECORDER_ID);
+	MSPinFormat pinfmt = {1, fmt};
+	MSTicker ticker;
+	MSQueue input;
+	char *output_file = bctbx_strdup_printf("%s/player_frames.mkv", bc_tester_get_writable_dir_prefix());
+	int i, j;
+
+	unlink(output_file);
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 20;
+	ms_queue_init(&input);
+	recorder->inputs[1] = &input;
+	ms_filter_call_method(recorder, MS_FILTER_SET_INPUT_FMT, &pinfmt);
+	BC_ASSERT_EQUAL(ms_filter_call_method(recorder, MS_RECORDER_OPEN, output_file), 0, int, "%d");
+	ms_filter_call_method_noarg(recorder, MS_RECORDER_START);
+	ms_filter_preprocess(recorder, &ticker);
+	for (i = 0; i < 50; i++) {
+		mblk_t *m = allocb(MKV_TEST_FRAME_SIZE, 0);
+		for (j = 0; j < MKV_TEST_FRAME_SIZE; j++) *m->b_wptr++ = mkv_test_payload_byte(i, j);
+		mblk_set_timestamp_info(m, (uint32_t)(i * MKV_TEST_FRAME_SIZE));
+		ms_queue_put(&input, m);
+		ms_filter_process(recorder);
+		ticker.time += ticker.interval;
+	}
+	ms_filter_postprocess(recorder);
+	ms_filter_call_method(recorder, MS_RECORDER_CLOSE, NULL);
+	recorder->inputs[1] = NULL;
+	ms_filter_destroy(recorder);
+
+	check_mkv_audio_playback(output_file, 50);
+
+	unlink(output_file);
+	bctbx_free(output_file);
+}
+
+/* Minimal EBML writer: every element size is written on 8 bytes, masters are patched when closed. */
+typedef struct {
+	uint8_t data[16384];
+	size_t size;
+} EbmlBuffer;
+
+static void ebml_put_bytes(EbmlBuffer *b, const void *data, size_t size) {
+	memcpy(b->data + b->size, data, size);
+	b->size += size;
+}
+
+static void ebml_put_id(EbmlBuffer *b, uint32_t id) {
+	int shift;
+	for (shift = 24; shift > 0 && (id >> shift) == 0; shift -= 8);
+	for (; shift >= 0; shift -= 8) b->data[b->size++] = (uint8_t)(id >> shift);
+}
+
+static void ebml_put_size(EbmlBuffer *b, size_t offset, uint64_t size) {
+	int i;
+	b->data[offset] = 0x01;
+	for (i = 1; i < 8; i++) b->data[offset + i] = (uint8_t)(size >> (8 * (7 - i)));
+}
+
+static void ebml_put_binary(EbmlBuffer *b, uint32_t id, const void *data, size_t size) {
+	ebml_put_id(b, id);
+	ebml_put_size(b, b->size, size);
+	b->size += 8;
+	ebml_put_bytes(b, data, size);
+}
+
+static void ebml_put_uint(EbmlBuffer *b, uint32_t id, uint64_t value) {
+	uint8_t bytes[8];
+	int i;
+	for (i = 0; i < 8; i++) bytes[i] = (uint8_t)(value >> (8 * (7 - i)));
+	ebml_put_binary(b, id, bytes, sizeof(bytes));
+}
+
+static void ebml_put_float(EbmlBuffer *b, uint32_t id, double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	ebml_put_uint(b, id, bits);
+}
+
+static void ebml_put_string(EbmlBuffer *b, uint32_t id, const char *value) {
+	ebml_put_binary(b, id, value, strlen(value));
+}
+
+static size_t ebml_open_master(EbmlBuffer *b, uint32_t id) {
+	size_t offset;
+	ebml_put_id(b, id);
+	offset = b->size;
+	b->size += 8;
+	return offset;
+}
+
+static void ebml_close_master(EbmlBuffer *b, size_t offset) {
+	ebml_put_size(b, offset, b->size - offset - 8);
+}
+
+/* The first two bytes of every frame are stripped from the blocks and stored once in the track header: frames must be served whole. */
+static void mkv_player_header_stripping(void) {
+	static const uint8_t stripped[2] = {0x12, 0x34};
+	EbmlBuffer *b = ms_new0(EbmlBuffer, 1);
+	char *file = bctbx_strdup_printf("%s/header_stripping.mkv", bc_tester_get_writable_dir_prefix());
+	size_t segment, master, track, encoding, cluster;
+	FILE *f;
+	int i, j;
+
+	master = ebml_open_master(b, 0x1A45DFA3); /* EBML header */
+	ebml_put_uint(b, 0x4286, 1); /* EBMLVersion */
+	ebml_put_uint(b, 0x42F7, 1); /* EBMLReadVersion */
+	ebml_put_uint(b, 0x42F2, 4); /* EBMLMaxIDLength */
+	ebml_put_uint(b, 0x42F3, 8); /* EBMLMaxSizeLength */
+	ebml_put_string(b, 0x4282, "matroska"); /* DocType */
+	ebml_put_uint(b, 0x4287, 4); /* DocTypeVersion */
+	ebml_put_uint(b, 0x4285, 2); /* DocTypeReadVersion */
+	ebml_close_master(b, master);
+
+	segment = ebml_open_master(b, 0x18538067);
+	master = ebml_open_master(b, 0x1549A966); /* Info */
+	ebml_put_uint(b, 0x2AD7B1, 1000000); /* TimecodeScale */
+	ebml_put_float(b, 0x4489, 1000.0); /* Duration */
+	ebml_put_string(b, 0x4D80, "mediastreamer2 tester"); /* MuxingApp */
+	ebml_put_string(b, 0x5741, "mediastreamer2 tester"); /* WritingApp */
+	ebml_close_master(b, master);
+
+	master = ebml_open_master(b, 0x1654AE6B); /* Tracks */
+	track = ebml_open_master(b, 0xAE); /* TrackEntry */
+	ebml_put_uint(b, 0xD7, 1); /* TrackNumber */
+	ebml_put_uint(b, 0x73C5, 1); /* TrackUID */
+	ebml_put_uint(b, 0x83, 2); /* TrackType: audio */
+	ebml_put_uint(b, 0xB9, 1); /* FlagEnabled */
+	ebml_put_uint(b, 0x88, 1); /* FlagDefault */
+	ebml_put_uint(b, 0x9C, 0); /* FlagLacing */
+	ebml_put_string(b, 0x86, "A_MS/ACM"); /* CodecID */
+	encoding = ebml_open_master(b, 0xE1); /* Audio */
+	ebml_put_float(b, 0xB5, 8000.0); /* SamplingFrequency */
+	ebml_put_uint(b, 0x9F, 1); /* Channels */
+	ebml_close_master(b, encoding);
+	encoding = ebml_open_master(b, 0x6D80); /* ContentEncodings */
+	{
+		size_t content_encoding = ebml_open_master(b, 0x6240); /* ContentEncoding */
+		size_t compression;
+		ebml_put_uint(b, 0x5031, 0); /* ContentEncodingOrder */
+		ebml_put_uint(b, 0x5032, 1); /* ContentEncodingScope: frames */
+		ebml_put_uint(b, 0x5033, 0); /* ContentEncodingType: compression */
+		compression = ebml_open_master(b, 0x5034); /* ContentCompression */
+		ebml_put_uint(b, 0x4254, 3); /* ContentCompAlgo: header stripping */
+		ebml_put_binary(b, 0x4255, stripped, sizeof(stripped)); /* ContentCompSettings */
+		ebml_close_master(b, compression);
+		ebml_close_master(b, content_encoding);
+	}
+	ebml_close_master(b, encoding);
+	ebml_close_master(b, track);
+	ebml_close_master(b, master);
+
+	cluster = ebml_open_master(b, 0x1F43B675); /* Cluster */
+	ebml_put_uint(b, 0xE7, 0); /* Timecode */
+	for (i = 0; i < 50; i++) {
+		uint8_t block[4 + MKV_TEST_FRAME_SIZE];
+		int timecode = i * 20;
+		block[0] = 0x81; /* track number */
+		block[1] = (uint8_t)(timecode >> 8);
+		block[2] = (uint8_t)timecode;
+		block[3] = 0x80; /* keyframe, no lacing */
+		for (j = sizeof(stripped); j < MKV_TEST_FRAME_SIZE; j++) block[4 + j - sizeof(stripped)] = mkv_test_payload_byte(i, j);
+		ebml_put_binary(b, 0xA3, block, 4 + MKV_TEST_FRAME_SIZE - sizeof(stripped)); /* SimpleBlock */
+	}
+	ebml_close_master(b, cluster);
+	ebml_close_master(b, segment);
+
+	f = fopen(file, "wb");
+	if (BC_ASSERT_PTR_NOT_NULL(f)) {
+		BC_ASSERT_EQUAL(fwrite(b->data, 1, b->size, f), b->size, size_t, "%zu");
+		fclose(f);
+		check_mkv_audio_playback(file, 50);
+	}
+
+	unlink(file);
+	bctbx_free(file);
+	ms_free(b);
+}
+
 void h264_one_nalu_per_frame_with_mkv_recorder(void) {
 	const MSFmtDescriptor *fmt = ms_factory_get_video_format(_factory, "h264", MS_VIDEO_SIZE_VGA, 15, NULL);
 	char *scenario_pcap_file = bctbx_strdup_printf("%s/scenarios/h264_one_nalu_per_frame.pcap",bc_tester_get_resource_dir_prefix());
@@ -218,7 +504,10 @@ static test_t tests[] = {
 	{ "H264: one NALu per frame scenario"                    , h264_one_nalu_per_frame                    },
 	{ "H264: one NALu per frame with corrupted IDR scenario" , h264_one_nalu_per_frame_with_corrupted_idr },
 #ifdef HAVE_MATROSKA
-	{ "H264: one NALu per frame scenario (MKV recorder)"     , h264_one_nalu_per_frame_with_mkv_recorder  }
+	{ "H264: one NALu per frame scenario (MKV recorder)"     , h264_one_nalu_per_frame_with_mkv_recorder  },
+	{ "MKV recorder writer thread"                           , mkv_recorder_writer_thread                 },
+	{ "MKV player frames"                                    , mkv_player_frames                          },
+	{ "MKV player with header stripping"                     , mkv_player_header_stripping                }
 #endif
 };
 
@@ -24,9 +24,26 @@
 #include "mediastreamer2/msfilerec.h"
 #include "mediastreamer2/msrtp.h"
 #include "mediastreamer2/mstonedetector.h"
+#include "mediastreamer2/mstickerpool.h"
+#include "mediastreamer2/msitc.h"
+#include "mediastreamer2/msvolume.h"
+#include "mediastreamer2/mstee.h"
+#include "mediastreamer2/msbufferpool.h"
+#include "mediastreamer2/msaudiomixer.h"
+#include "mediastreamer2/msequalizer.h"
+#include "mediastreamer2/msg711.h"
+#include "mediastreamer2/msprofile.h"
+#include "mediastreamer2/msresample.h"
+#include "mediastreamer2/mstrace.h"
 #include "mediastreamer2_tester.h"
 #include "mediastreamer2_tester_private.h"
 
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
 #ifdef VIDEO_ENABLED
 typedef enum {
 	YUV420Planar,
@@ -545,10 +562,1589 @@ static void test_filterdesc_enable_disable(void) {
 	test_filterdesc_enable_disable_base("pcmu", "MSUlawDec", FALSE);
 	test_filterdesc_enable_disable_base("pcma", "MSAlawEnc", TRUE);
 }
+static void test_ticker_parallel_graphs(void) {
+	MSFactory *factory = ms_factory_new_with_voip();
+	MSTicker *ticker = ms_ticker_new();
+	MSFilter *sources[8];
+	MSFilter *sinks[8];
+	bool_t send_silence = TRUE;
+	const bctbx_list_t *elem;
+	uint64_t source_runs = 0, sink_runs = 0;
+	int i;
+
+	/* the statistics of a filter type are shared by the filters running in parallel */
+	ms_factory_enable_statistics(factory, TRUE);
+	ms_ticker_set_thread_count(ticker, 4);
+	BC_ASSERT_EQUAL(ms_ticker_get_thread_count(ticker), 4, int, "%d");
+	for (i = 0; i < 8; i++) {
+		sources[i] = ms_factory_create_filter(factory, MS_VOID_SOURCE_ID);
+		sinks[i] = ms_factory_create_filter(factory, MS_VOID_SINK_ID);
+		ms_filter_call_method(sources[i], MS_VOID_SOURCE_SEND_SILENCE, &send_silence);
+		ms_filter_link(sources[i], 0, sinks[i], 0);
+		ms_ticker_attach(ticker, sources[i]);
+	}
+	ms_usleep(200000);
+	for (i = 0; i < 8; i++) {
+		ms_ticker_detach(ticker, sources[i]);
+		/* every independent graph must have been run up to its sink */
+		BC_ASSERT_GREATER(sinks[i]->last_tick, 1, uint32_t, "%u");
+		BC_ASSERT_EQUAL(sinks[i]->last_tick, sources[i]->last_tick, uint32_t, "%u");
+		ms_filter_unlink(sources[i], 0, sinks[i], 0);
+		ms_filter_destroy(sources[i]);
+		ms_filter_destroy(sinks[i]);
+	}
+	for (elem = ms_factory_get_statistics(factory); elem != NULL; elem = elem->next) {
+		const MSFilterStats *stats = (const MSFilterStats *)elem->data;
+		if (strcmp(stats->name, "MSVoidSource") == 0) source_runs = stats->bp_elapsed.count;
+		else if (strcmp(stats->name, "MSVoidSink") == 0) sink_runs = stats->bp_elapsed.count;
+	}
+	BC_ASSERT_GREATER((int)source_runs, 8, int, "%d");
+	BC_ASSERT_EQUAL((int)sink_runs, (int)source_runs, int, "%d");
+	ms_ticker_set_thread_count(ticker, 1);
+	BC_ASSERT_EQUAL(ms_ticker_get_thread_count(ticker), 1, int, "%d");
+	ms_ticker_destroy(ticker);
+	ms_factory_destroy(factory);
+}
+
+static void test_ticker_pool_placement(void) {
+	MSFactory *factory = ms_factory_new_with_voip();
+	MSTickerParams params = {MS_TICKER_PRIO_NORMAL, "PoolTicker"};
+	MSTickerPool *pool = ms_ticker_pool_new(2, &params);
+	MSFilter *sources[4];
+	MSFilter *sinks[4];
+	int on_first_ticker = 0;
+	int i;
+
+	BC_ASSERT_EQUAL(ms_ticker_pool_get_size(pool), 2, int, "%d");
+	for (i = 0; i < 4; i++) {
+		sources[i] = ms_factory_create_filter(factory, MS_VOID_SOURCE_ID);
+		sinks[i] = ms_factory_create_filter(factory, MS_VOID_SINK_ID);
+		ms_filter_link(sources[i], 0, sinks[i], 0);
+		BC_ASSERT_EQUAL(ms_ticker_pool_attach(pool, sources[i]), 0, int, "%d");
+		if (ms_filter_get_ticker(sinks[i]) == ms_ticker_pool_get_ticker(pool, 0)) on_first_ticker++;
+	}
+	/* idle graphs are spread evenly */
+	BC_ASSERT_EQUAL(on_first_ticker, 2, int, "%d");
+	ms_usleep(100000);
+	for (i = 0; i < 4; i++) {
+		/* detaching is possible from any filter of the graph */
+		BC_ASSERT_EQUAL(ms_ticker_pool_detach(pool, sinks[i]), 0, int, "%d");
+		BC_ASSERT_PTR_NULL(ms_filter_get_ticker(sources[i]));
+		ms_filter_unlink(sources[i], 0, sinks[i], 0);
+		ms_filter_destroy(sources[i]);
+		ms_filter_destroy(sinks[i]);
+	}
+	ms_ticker_pool_destroy(pool);
+	ms_factory_destroy(factory);
+}
+
+static void test_itc_overflow_policy(void) {
+	MSFactory *factory = ms_factory_new_with_voip();
+	MSTicker *ticker = ms_ticker_new();
+	MSFilter *voidsource = ms_factory_create_filter(factory, MS_VOID_SOURCE_ID);
+	MSFilter *itcsink = ms_factory_create_filter(factory, MS_ITC_SINK_ID);
+	MSFilter *itcsource = ms_factory_create_filter(factory, MS_ITC_SOURCE_ID);
+	MSItcOverflowPolicy policy = MSItcDropNewest;
+	MSItcStats stats = {0};
+	bool_t send_silence = TRUE;
+	int max_size = 6;
+
+	ms_filter_call_method(voidsource, MS_VOID_SOURCE_SEND_SILENCE, &send_silence);
+	ms_filter_call_method(itcsink, MS_ITC_SINK_CONNECT, itcsource);
+	ms_filter_call_method(itcsink, MS_ITC_SINK_SET_MAX_SIZE, &max_size);
+	ms_filter_call_method(itcsink, MS_ITC_SINK_SET_OVERFLOW_POLICY, &policy);
+	ms_filter_link(voidsource, 0, itcsink, 0);
+	/* the itc source is not scheduled, so that the queue fills up */
+	ms_ticker_attach(ticker, voidsource);
+	ms_usleep(300000);
+	ms_ticker_detach(ticker, voidsource);
+
+	BC_ASSERT_EQUAL(ms_filter_call_method(itcsink, MS_ITC_SINK_GET_STATS, &stats), 0, int, "%d");
+	BC_ASSERT_EQUAL(stats.size, 8, int, "%d");
+	BC_ASSERT_EQUAL(stats.occupancy, 8, int, "%d");
+	BC_ASSERT_EQUAL(stats.max_occupancy, 8, int, "%d");
+	BC_ASSERT_EQUAL(stats.transferred, 8, unsigned int, "%u");
+	BC_ASSERT_GREATER(stats.dropped, 0, unsigned int, "%u");
+
+	ms_filter_unlink(voidsource, 0, itcsink, 0);
+	ms_filter_destroy(voidsource);
+	ms_filter_destroy(itcsink);
+	ms_filter_destroy(itcsource);
+	ms_ticker_destroy(ticker);
+	ms_factory_destroy(factory);
+}
+
+typedef struct {
+	int producer;
+	int seq;
+} SmallEventArg;
+
+typedef struct {
+	int producer;
+	int seq;
+	char payload[56];
+} LargeEventArg;
+
+#define TEST_SMALL_EVENT MS_FILTER_EVENT(MS_VOID_SINK_ID, 0xf0, SmallEventArg)
+#define TEST_LARGE_EVENT MS_FILTER_EVENT(MS_VOID_SINK_ID, 0xf1, LargeEventArg)
+
+#define EVENT_PRODUCERS 4
+
+typedef struct {
+	MSFilter *filters[EVENT_PRODUCERS];
+	int next_seq[EVENT_PRODUCERS];
+	int received;
+	int out_of_order;
+	int corrupted;
+	int received_from_destroyed;
+	MSFilter *destroyed;
+} EventQueueTestContext;
+
+typedef struct {
+	MSFilter *filter;
+	int producer;
+	int count; /* 0 to notify until stop is set */
+	volatile bool_t *stop;
+} EventProducer;
+
+static void event_queue_test_cb(void *userdata, MSFilter *f, unsigned int id, void *arg) {
+	EventQueueTestContext *ctx = (EventQueueTestContext *)userdata;
+	const SmallEventArg *small = (const SmallEventArg *)arg;
+	int i;
+
+	if (f == ctx->destroyed) {
+		ctx->received_from_destroyed++;
+		return;
+	}
+	if (id == TEST_LARGE_EVENT) {
+		const LargeEventArg *large = (const LargeEventArg *)arg;
+		for (i = 0; i < (int)sizeof(large->payload); i++) {
+			if (large->payload[i] != (char)(large->seq + i)) {
+				ctx->corrupted++;
+				break;
+			}
+		}
+	}
+	if (small->producer < 0 || small->producer >= EVENT_PRODUCERS || ctx->filters[small->producer] != f) {
+		ctx->corrupted++;
+		return;
+	}
+	if (small->seq != ctx->next_seq[small->producer]) ctx->out_of_order++;
+	ctx->next_seq[small->producer] = small->seq + 1;
+	ctx->received++;
+}
+
+static void notify_test_event(MSFilter *f, int producer, int seq) {
+	/* one event out of three has an argument too large to be stored in the slots of the queue */
+	if (seq % 3 == 0) {
+		LargeEventArg large;
+		int i;
+		large.producer = producer;
+		large.seq = seq;
+		for (i = 0; i < (int)sizeof(large.payload); i++) large.payload[i] = (char)(seq + i);
+		ms_filter_notify(f, TEST_LARGE_EVENT, &large);
+	} else {
+		SmallEventArg small;
+		small.producer = producer;
+		small.seq = seq;
+		ms_filter_notify(f, TEST_SMALL_EVENT, &small);
+	}
+}
+
+static void *event_producer_thread(void *arg) {
+	EventProducer *producer = (EventProducer *)arg;
+	int seq;
+	for (seq = 0; producer->count == 0 ? !*producer->stop : seq < producer->count; seq++) {
+		notify_test_event(producer->filter, producer->producer, seq);
+		/* the producers that run until stopped must not fill the queue between two pumps */
+		if (producer->count == 0 && seq % 16 == 15) ms_usleep(1000);
+	}
+	return NULL;
+}
+
+static void event_queue_test_init(EventQueueTestContext *ctx, MSFactory *factory) {
+	int i;
+	memset(ctx, 0, sizeof(*ctx));
+	for (i = 0; i < EVENT_PRODUCERS; i++) {
+		ctx->filters[i] = ms_factory_create_filter(factory, MS_VOID_SINK_ID);
+		ms_filter_add_notify_callback(ctx->filters[i], event_queue_test_cb, ctx, FALSE);
+	}
+}
+
+static void event_queue_test_uninit(EventQueueTestContext *ctx) {
+	int i;
+	for (i = 0; i < EVENT_PRODUCERS; i++) {
+		if (ctx->filters[i]) ms_filter_destroy(ctx->filters[i]);
+	}
+}
+
+/* the events of each producer are received in order, none is lost when the queue is large enough */
+static void test_event_queue_producers(void) {
+	MSFactory *factory = ms_factory_new_with_voip();
+	MSEventQueue *q = ms_event_queue_new_with_size(EVENT_PRODUCERS * 5000);
+	EventQueueTestContext ctx;
+	EventProducer producers[EVENT_PRODUCERS];
+	ms_thread_t threads[EVENT_PRODUCERS];
+	int i;
+
+	ms_factory_set_event_queue(factory, q);
+	event_queue_test_init(&ctx, factory);
+	for (i = 0; i < EVENT_PRODUCERS; i++) {
+		producers[i].filter = ctx.filters[i];
+		producers[i].producer = i;
+		producers[i].count = 5000;
+		producers[i].stop = NULL;
+		ms_thread_create(&threads[i], NULL, event_producer_thread, &producers[i]);
+	}
+	/* the queue is pumped while it is written */
+	while (ctx.received < EVENT_PRODUCERS * 5000 / 2) {
+		ms_event_queue_pump(q);
+		ms_usleep(1000);
+	}
+	for (i = 0; i < EVENT_PRODUCERS; i++) ms_thread_join(threads[i], NULL);
+	ms_event_queue_pump(q);
+	BC_ASSERT_EQUAL(ctx.received, EVENT_PRODUCERS * 5000, int, "%d");
+	BC_ASSERT_EQUAL(ctx.out_of_order, 0, int, "%d");
+	BC_ASSERT_EQUAL(ctx.corrupted, 0, int, "%d");
+
+	event_queue_test_uninit(&ctx);
+	ms_factory_set_event_queue(factory, NULL);
+	ms_event_queue_destroy(q);
+	ms_factory_destroy(factory);
+}
+
+/* the events notified while the queue is full are discarded, the queue works again once pumped */
+static void test_event_queue_overflow(void) {
+	MSFactory *factory = ms_factory_new_with_voip();
+	MSEventQueue *q = ms_event_queue_new_with_size(8);
+	EventQueueTestContext ctx;
+	int seq;
+
+	ms_factory_set_event_queue(factory, q);
+	event_queue_test_init(&ctx, factory);
+	for (seq = 0; seq < 20; seq++) notify_test_event(ctx.filters[0], 0, seq);
+	ms_event_queue_pump(q);
+	BC_ASSERT_EQUAL(ctx.received, 8, int, "%d");
+	BC_ASSERT_EQUAL(ctx.next_seq[0], 8, int, "%d");
+	BC_ASSERT_EQUAL(ctx.out_of_order, 0, int, "%d");
+
+	ctx.next_seq[0] = 100;
+	for (seq = 100; seq < 108; seq++) notify_test_event(ctx.filters[0], 0, seq);
+	ms_event_queue_pump(q);
+	BC_ASSERT_EQUAL(ctx.received, 16, int, "%d");
+	BC_ASSERT_EQUAL(ctx.out_of_order, 0, int, "%d");
+	BC_ASSERT_EQUAL(ctx.corrupted, 0, int, "%d");
+
+	/* pending events, with allocated arguments, are released by skip and destroy */
+	for (seq = 0; seq < 6; seq++) notify_test_event(ctx.filters[0], 0, seq);
+	ms_event_queue_skip(q);
+	ms_event_queue_pump(q);
+	BC_ASSERT_EQUAL(ctx.received, 16, int, "%d");
+	for (seq = 0; seq < 6; seq++) notify_test_event(ctx.filters[0], 0, seq);
+
+	event_queue_test_uninit(&ctx);
+	ms_factory_set_event_queue(factory, NULL);
+	ms_event_queue_destroy(q);
+	ms_factory_destroy(factory);
+}
+
+/* the pending events of a destroyed filter are dropped even when other threads are writing into the queue */
+static void test_event_queue_clean_while_written(void) {
+	MSFactory *factory = ms_factory_new_with_voip();
+	MSEventQueue *q = ms_event_queue_new_with_size(4096);
+	EventQueueTestContext ctx;
+	EventProducer producers[EVENT_PRODUCERS - 1];
+	ms_thread_t threads[EVENT_PRODUCERS - 1];
+	volatile bool_t stop = FALSE;
+	int round, seq, i;
+
+	ms_factory_set_event_queue(factory, q);
+	event_queue_test_init(&ctx, factory);
+	/* the first filter is replaced by a new one at each round */
+	ms_filter_destroy(ctx.filters[0]);
+	for (i = 0; i < EVENT_PRODUCERS - 1; i++) {
+		producers[i].filter = ctx.filters[i + 1];
+		producers[i].producer = i + 1;
+		producers[i].count = 0;
+		producers[i].stop = &stop;
+		ms_thread_create(&threads[i], NULL, event_producer_thread, &producers[i]);
+	}
+	for (round = 0; round < 200; round++) {
+		MSFilter *f = ms_factory_create_filter(factory, MS_VOID_SINK_ID);
+		ms_filter_add_notify_callback(f, event_queue_test_cb, &ctx, FALSE);
+		ctx.filters[0] = f;
+		ctx.next_seq[0] = 0;
+		for (seq = 0; seq < 20; seq++) notify_test_event(f, 0, seq);
+		ms_filter_destroy(f);
+		ctx.destroyed = f;
+		ms_event_queue_pump(q);
+		ctx.destroyed = NULL;
+	}
+	ctx.filters[0] = NULL;
+	stop = TRUE;
+	for (i = 0; i < EVENT_PRODUCERS - 1; i++) ms_thread_join(threads[i], NULL);
+	ms_event_queue_pump(q);
+	BC_ASSERT_EQUAL(ctx.received_from_destroyed, 0, int, "%d");
+	BC_ASSERT_EQUAL(ctx.corrupted, 0, int, "%d");
+
+	event_queue_test_uninit(&ctx);
+	ms_factory_set_event_queue(factory, NULL);
+	ms_event_queue_destroy(q);
+	ms_factory_destroy(factory);
+}
+
+static void test_tee_shared_outputs(void) {
+	MSFactory *factory = ms_factory_new_with_voip();
+	MSTicker *ticker = ms_ticker_new();
+	MSFilter *voidsource = ms_factory_create_filter(factory, MS_VOID_SOURCE_ID);
+	MSFilter *tee = ms_factory_create_filter(factory, MS_TEE_ID);
+	MSFilter *voidsink1 = ms_factory_create_filter(factory, MS_VOID_SINK_ID);
+	MSFilter *voidsink2 = ms_factory_create_filter(factory, MS_VOID_SINK_ID);
+	MSTeeOutputStats stats1 = {0}, stats2 = {0};
+	bool_t send_silence = TRUE;
+	mblk_t *m, *dup, *writable;
+
+	ms_filter_call_method(voidsource, MS_VOID_SOURCE_SEND_SILENCE, &send_silence);
+	ms_filter_link(voidsource, 0, tee, 0);
+	ms_filter_link(tee, 0, voidsink1, 0);
+	ms_filter_link(tee, 1, voidsink2, 0);
+	ms_ticker_attach(ticker, voidsource);
+	ms_usleep(200000);
+	ms_ticker_detach(ticker, voidsource);
+
+	stats1.pin = 0;
+	stats2.pin = 1;
+	BC_ASSERT_EQUAL(ms_filter_call_method(tee, MS_TEE_GET_OUTPUT_STATS, &stats1), 0, int, "%d");
+	BC_ASSERT_EQUAL(ms_filter_call_method(tee, MS_TEE_GET_OUTPUT_STATS, &stats2), 0, int, "%d");
+	BC_ASSERT_GREATER(stats1.packets, 0, unsigned int, "%u");
+	BC_ASSERT_EQUAL(stats1.packets, stats2.packets, unsigned int, "%u");
+	BC_ASSERT_TRUE(stats1.bytes == stats2.bytes);
+	BC_ASSERT_EQUAL(stats1.dropped, 0, unsigned int, "%u");
+
+	/* copy-on-write */
+	m = allocb(160, 0);
+	m->b_wptr += 160;
+	dup = dupmsg(m);
+	writable = ms_mblk_make_writable(dup);
+	BC_ASSERT_TRUE(writable != dup);
+	BC_ASSERT_TRUE(writable->b_datap != m->b_datap);
+	BC_ASSERT_TRUE(ms_mblk_make_writable(writable) == writable);
+	BC_ASSERT_TRUE(ms_mblk_make_writable(m) == m);
+	freemsg(writable);
+	freemsg(m);
+
+	ms_filter_unlink(voidsource, 0, tee, 0);
+	ms_filter_unlink(tee, 0, voidsink1, 0);
+	ms_filter_unlink(tee, 1, voidsink2, 0);
+	ms_filter_destroy(voidsource);
+	ms_filter_destroy(tee);
+	ms_filter_destroy(voidsink1);
+	ms_filter_destroy(voidsink2);
+	ms_ticker_destroy(ticker);
+	ms_factory_destroy(factory);
+}
+
+static void test_buffer_pool_reuse(void) {
+	MSBufferPool *pool = ms_buffer_pool_new();
+	MSBufferPoolStats stats;
+	mblk_t *m1, *m2, *m3;
+	uint8_t *first;
+
+	m1 = ms_buffer_pool_get(pool, 320);
+	BC_ASSERT_TRUE(m1->b_datap->db_lim - m1->b_rptr >= 320);
+	BC_ASSERT_TRUE(m1->b_rptr == m1->b_wptr);
+	first = m1->b_datap->db_base;
+	/* the pool holds no reference, so that the code checking the reference count modifies lent buffers in place */
+	BC_ASSERT_EQUAL(dblk_ref_value(m1->b_datap), 1, int, "%d");
+	BC_ASSERT_TRUE(ms_mblk_is_writable(m1));
+	m2 = dupmsg(m1);
+	BC_ASSERT_FALSE(ms_mblk_is_writable(m1));
+	freemsg(m2);
+	BC_ASSERT_TRUE(m1->b_rptr - m1->b_datap->db_base >= MS_BUFFER_POOL_HEADROOM);
+	/* a buffer still in use is not lent again */
+	m2 = ms_buffer_pool_get(pool, 320);
+	BC_ASSERT_TRUE(m2->b_datap->db_base != first);
+	freemsg(m1);
+	m3 = ms_buffer_pool_get(pool, 300);
+	BC_ASSERT_TRUE(m3->b_datap->db_base == first);
+	freemsg(m2);
+	freemsg(m3);
+
+	ms_buffer_pool_get_stats(pool, &stats);
+	BC_ASSERT_EQUAL(stats.requests, 3, unsigned int, "%u");
+	BC_ASSERT_EQUAL(stats.hits, 1, unsigned int, "%u");
+	BC_ASSERT_EQUAL(stats.buffers, 2, int, "%d");
+
+	/* beyond the limit, messages are allocated outside of the pool */
+	ms_buffer_pool_set_max_buffers(pool, 2);
+	m1 = ms_buffer_pool_get(pool, 320);
+	m2 = ms_buffer_pool_get(pool, 320);
+	m3 = ms_buffer_pool_get(pool, 320);
+	ms_buffer_pool_get_stats(pool, &stats);
+	BC_ASSERT_EQUAL(stats.buffers, 2, int, "%d");
+	/* messages outlive the pool */
+	ms_buffer_pool_destroy(pool);
+	freemsg(m1);
+	freemsg(m2);
+	freemsg(m3);
+}
+
+static void test_buffer_pool_held_buffers(void) {
+	/* buffers held for a long time at the head of a class, like the ones of a jitter buffer, must not stop the pooling */
+	MSBufferPool *pool = ms_buffer_pool_new();
+	MSBufferPoolStats stats;
+	mblk_t *held[8];
+	int i;
+
+	for (i = 0; i < 8; i++) held[i] = ms_buffer_pool_get(pool, 320);
+	for (i = 0; i < 1000; i++) {
+		mblk_t *m = ms_buffer_pool_get(pool, 320);
+		BC_ASSERT_TRUE(ms_buffer_pool_is_pool_buffer(m->b_datap));
+		freemsg(m);
+	}
+	ms_buffer_pool_get_stats(pool, &stats);
+	BC_ASSERT_EQUAL(stats.requests, 1008, unsigned int, "%u");
+	/* a single buffer serves all the requests */
+	BC_ASSERT_LOWER(stats.buffers, 8 + 2, int, "%d");
+	BC_ASSERT_GREATER(stats.hits, 1000 - 2, unsigned int, "%u");
+
+	for (i = 0; i < 8; i++) freemsg(held[i]);
+	ms_buffer_pool_destroy(pool);
+}
+
+static void write_test_rtp_header(uint8_t *header, uint16_t seq, uint32_t ssrc) {
+	memset(header, 0, 12);
+	header[0] = 0x80;
+	header[2] = (uint8_t)(seq >> 8);
+	header[3] = (uint8_t)seq;
+	header[8] = (uint8_t)(ssrc >> 24);
+	header[9] = (uint8_t)(ssrc >> 16);
+	header[10] = (uint8_t)(ssrc >> 8);
+	header[11] = (uint8_t)ssrc;
+}
+
+static void test_srtp_protect_in_place(void) {
+	const char *key = "d0RmdmcmVCspeEc3QGZiNWpVLFJhQX1cfHAwJSoj";
+	const uint32_t ssrc = 0x12345678;
+	MSFactory *factory;
+	MSMediaStreamSessions sessions;
+	mblk_t *packets[3];
+	mblk_t *payload, *shared;
+	dblk_t *db;
+	uint8_t *payload_ptr;
+	int sizes[3];
+	int i;
+
+	if (!ms_srtp_supported()) {
+		ms_warning("SRTP is not supported, test skipped");
+		return;
+	}
+	factory = ms_factory_new_with_voip();
+	memset(&sessions, 0, sizeof(sessions));
+	sessions.rtp_session = rtp_session_new(RTP_SESSION_SENDONLY);
+	rtp_session_set_ssrc(sessions.rtp_session, ssrc);
+	BC_ASSERT_EQUAL(ms_media_stream_sessions_set_srtp_send_key_b64(&sessions, MS_AES_128_SHA1_80, key), 0, int, "%d");
+
+	/* a pool buffer holding the whole packet, with room for the trailer, is protected in place */
+	packets[0] = ms_factory_allocb(factory, 12 + 160);
+	write_test_rtp_header(packets[0]->b_wptr, 1, ssrc);
+	memset(packets[0]->b_wptr + 12, 0x55, 160);
+	packets[0]->b_wptr += 12 + 160;
+	db = packets[0]->b_datap;
+
+	/* a header followed by a payload in a pool buffer: the header is moved in front of the payload */
+	packets[1] = allocb(12, 0);
+	write_test_rtp_header(packets[1]->b_wptr, 1, ssrc);
+	packets[1]->b_wptr += 12;
+	payload = ms_factory_allocb(factory, 160);
+	memset(payload->b_wptr, 0x55, 160);
+	payload->b_wptr += 160;
+	payload_ptr = payload->b_rptr;
+	packets[1]->b_cont = payload;
+
+	/* a shared packet is copied */
+	shared = copymsg(packets[0]);
+	packets[2] = dupmsg(shared);
+
+	for (i = 0; i < 3; i++) {
+		/* the three packets have the same sequence number, their protection must give the same result */
+		BC_ASSERT_EQUAL(ms_media_stream_sessions_protect_rtp_packets(&sessions, &packets[i], &sizes[i], 1), 0, int, "%d");
+		BC_ASSERT_EQUAL(sizes[i], 12 + 160 + 10, int, "%d");
+		BC_ASSERT_PTR_NULL(packets[i]->b_cont);
+		BC_ASSERT_EQUAL((int)msgdsize(packets[i]), sizes[i], int, "%d");
+		/* reset the srtp index for the next packet */
+		ms_media_stream_sessions_set_srtp_send_key_b64(&sessions, MS_AES_128_SHA1_80, key);
+	}
+	BC_ASSERT_PTR_EQUAL(packets[0]->b_datap, db);
+	BC_ASSERT_PTR_EQUAL(packets[1]->b_rptr, payload_ptr - 12);
+	BC_ASSERT_TRUE(packets[2]->b_datap != shared->b_datap);
+	BC_ASSERT_TRUE(memcmp(packets[1]->b_rptr, packets[0]->b_rptr, sizes[0]) == 0);
+	BC_ASSERT_TRUE(memcmp(packets[2]->b_rptr, packets[0]->b_rptr, sizes[0]) == 0);
+	/* the original of the shared packet is left untouched */
+	BC_ASSERT_EQUAL((int)msgdsize(shared), 12 + 160, int, "%d");
+	BC_ASSERT_EQUAL(shared->b_rptr[12], 0x55, int, "%d");
+
+	for (i = 0; i < 3; i++) freemsg(packets[i]);
+	freemsg(shared);
+	ms_media_stream_sessions_uninit(&sessions);
+	ms_factory_destroy(factory);
+}
+
+static int read_only_frees;
+
+static void read_only_buffer_free(void *data) {
+	read_only_frees++;
+}
+
+static void test_read_only_messages(void) {
+	/* like the frames of a read-only file mapping, a block with a single reference is not writable */
+	static const uint8_t data[16] = {1, 2, 3, 4};
+	mblk_t *m, *copy;
+
+	ms_mblk_add_read_only_free_function(read_only_buffer_free);
+	read_only_frees = 0;
+	m = esballoc((uint8_t *)data, sizeof(data), 0, read_only_buffer_free);
+	m->b_wptr += sizeof(data);
+	BC_ASSERT_FALSE(ms_mblk_is_writable(m));
+	copy = ms_mblk_make_writable(m);
+	BC_ASSERT_EQUAL(read_only_frees, 1, int, "%d");
+	BC_ASSERT_TRUE(ms_mblk_is_writable(copy));
+	BC_ASSERT_TRUE(copy->b_rptr != data);
+	BC_ASSERT_EQUAL((int)msgdsize(copy), (int)sizeof(data), int, "%d");
+	BC_ASSERT_TRUE(memcmp(copy->b_rptr, data, sizeof(data)) == 0);
+	freemsg(copy);
+}
+
+static void test_ring_bufferizer(void) {
+	MSRingBufferizer *ring = ms_ring_bufferizer_new(256);
+	MSBufferizer *reference = ms_bufferizer_new();
+	mblk_t *ring_metas = allocb(0, 0);
+	mblk_t *reference_metas = allocb(0, 0);
+	uint8_t expected[480];
+	uint8_t written = 0, read = 0;
+	int i, k;
+
+	for (i = 0; i < 200; i++) {
+		/* odd sizes, larger than the initial ring after a while, to exercise wrapping and growth */
+		int size = 1 + (i * 37) % 300 + (i > 150 ? 600 : 0);
+		mblk_t *m = allocb(size, 0);
+		uint8_t *view;
+
+		for (k = 0; k < size; k++) *m->b_wptr++ = written++;
+		m->ttl_or_hl = (uint8_t)i;
+		ms_bufferizer_put(reference, dupmsg(m));
+		ms_ring_bufferizer_put(ring, m);
+		BC_ASSERT_EQUAL(ms_ring_bufferizer_get_avail(ring), ms_bufferizer_get_avail(reference), size_t, "%zu");
+
+		while ((view = ms_ring_bufferizer_peek(ring, sizeof(expected))) != NULL) {
+			bool_t same = TRUE;
+			for (k = 0; k < (int)sizeof(expected); k++) {
+				if (view[k] != read++) same = FALSE;
+			}
+			BC_ASSERT_TRUE(same);
+			BC_ASSERT_EQUAL(ms_bufferizer_read(reference, expected, sizeof(expected)), sizeof(expected), size_t, "%zu");
+			BC_ASSERT_TRUE(memcmp(view, expected, sizeof(expected)) == 0);
+			ms_ring_bufferizer_fill_current_metas(ring, ring_metas);
+			ms_bufferizer_fill_current_metas(reference, reference_metas);
+			BC_ASSERT_EQUAL(ring_metas->ttl_or_hl, reference_metas->ttl_or_hl, int, "%d");
+			ms_ring_bufferizer_consume(ring, sizeof(expected));
+		}
+	}
+	BC_ASSERT_TRUE(ms_ring_bufferizer_peek(ring, ms_ring_bufferizer_get_avail(ring) + 1) == NULL);
+	/* the copying read behaves like the one of MSBufferizer */
+	k = (int)ms_ring_bufferizer_get_avail(ring);
+	BC_ASSERT_EQUAL(ms_ring_bufferizer_read(ring, expected, k + 1), 0, size_t, "%zu");
+	BC_ASSERT_EQUAL(ms_ring_bufferizer_read(ring, expected, k), (size_t)k, size_t, "%zu");
+	BC_ASSERT_EQUAL(expected[0], read, int, "%d");
+	ms_ring_bufferizer_flush(ring);
+	BC_ASSERT_EQUAL(ms_ring_bufferizer_get_avail(ring), 0, size_t, "%zu");
+
+	/* a long run of small blocks: the metas of each one are still known when its byte is read */
+	for (i = 0; i < 100; i++) {
+		mblk_t *m = allocb(1, 0);
+		*m->b_wptr++ = (uint8_t)i;
+		m->ttl_or_hl = (uint8_t)i;
+		ms_ring_bufferizer_put(ring, m);
+	}
+	for (i = 0; i < 100; i++) {
+		BC_ASSERT_EQUAL(ms_ring_bufferizer_read(ring, expected, 1), 1, size_t, "%zu");
+		ms_ring_bufferizer_fill_current_metas(ring, ring_metas);
+		BC_ASSERT_EQUAL(ring_metas->ttl_or_hl, i, int, "%d");
+	}
+
+	freemsg(ring_metas);
+	freemsg(reference_metas);
+	ms_bufferizer_destroy(reference);
+	ms_ring_bufferizer_destroy(ring);
+}
+
+static void test_g711_kernels(void) {
+	const MSG711Kernels * const *kernels = ms_g711_list_kernels();
+	const MSG711Kernels *reference = kernels[0];
+	int16_t *pcm = ms_new(int16_t, 65536);
+	int16_t *decoded = ms_new(int16_t, 65536);
+	uint8_t *expected = ms_new(uint8_t, 65536);
+	uint8_t *encoded = ms_new(uint8_t, 65536);
+	int i, k;
+
+	for (i = 0; i < 65536; i++) pcm[i] = (int16_t)(i - 32768);
+	for (k = 0; kernels[k] != NULL; k++) {
+		const MSG711Kernels *kern = kernels[k];
+		uint64_t start;
+		int iterations;
+
+		/* all the 16 bits samples, with an odd count to exercise the tails of the SIMD loops */
+		reference->alaw_encode(expected, pcm, 65535);
+		kern->alaw_encode(encoded, pcm, 65535);
+		BC_ASSERT_TRUE(memcmp(expected, encoded, 65535) == 0);
+		reference->ulaw_encode(expected, pcm, 65535);
+		kern->ulaw_encode(encoded, pcm, 65535);
+		BC_ASSERT_TRUE(memcmp(expected, encoded, 65535) == 0);
+		for (i = 0; i < 256; i++) encoded[i] = (uint8_t)i;
+		reference->alaw_decode(decoded, encoded, 256);
+		kern->alaw_decode(decoded + 256, encoded, 256);
+		BC_ASSERT_TRUE(memcmp(decoded, decoded + 256, 256 * sizeof(int16_t)) == 0);
+		reference->ulaw_decode(decoded, encoded, 256);
+		kern->ulaw_decode(decoded + 256, encoded, 256);
+		BC_ASSERT_TRUE(memcmp(decoded, decoded + 256, 256 * sizeof(int16_t)) == 0);
+
+		start = ms_get_cur_time_ms();
+		for (iterations = 0; iterations < 200 || ms_get_cur_time_ms() - start < 100; iterations++) {
+			kern->alaw_encode(encoded, pcm, 65536);
+			kern->alaw_decode(decoded, encoded, 65536);
+		}
+		ms_message("G.711 %s kernels: %.1f million samples encoded and decoded per second", kern->name,
+			(double)iterations * 65536 / (double)(MAX(ms_get_cur_time_ms() - start, 1) * 1000));
+	}
+	ms_message("G.711 encoders and decoders use the %s kernels", ms_g711_get_kernels()->name);
+	ms_free(pcm);
+	ms_free(decoded);
+	ms_free(expected);
+	ms_free(encoded);
+}
+
+static void test_audio_mixer_kernels(void) {
+	const MSAudioMixerKernels * const *kernels = ms_audio_mixer_list_kernels();
+	const MSAudioMixerKernels *reference = kernels[0];
+	int nwords = 4099; /* odd, to exercise the tails of the SIMD loops */
+	int16_t *contrib = ms_new(int16_t, nwords);
+	int32_t *sums = ms_new(int32_t, nwords);
+	int32_t *expected_sum = ms_new(int32_t, nwords);
+	int32_t *sum = ms_new(int32_t, nwords);
+	int16_t *expected = ms_new(int16_t, nwords);
+	int16_t *out = ms_new(int16_t, nwords);
+	int i, k;
+
+	/* sums up to the mix of a few loud participants, saturating in both directions */
+	for (i = 0; i < nwords; i++) {
+		contrib[i] = (int16_t)((i * 7919) % 65536 - 32768);
+		sums[i] = (int32_t)((i * 104729) % 262144) - 131072;
+	}
+	for (k = 0; kernels[k] != NULL; k++) {
+		const MSAudioMixerKernels *kern = kernels[k];
+		uint64_t start;
+		int iterations;
+
+		memcpy(expected_sum, sums, nwords * sizeof(int32_t));
+		memcpy(sum, sums, nwords * sizeof(int32_t));
+		reference->accumulate(expected_sum, contrib, nwords);
+		kern->accumulate(sum, contrib, nwords);
+		BC_ASSERT_TRUE(memcmp(expected_sum, sum, nwords * sizeof(int32_t)) == 0);
+		reference->saturate(expected, sums, nwords);
+		kern->saturate(out, sums, nwords);
+		BC_ASSERT_TRUE(memcmp(expected, out, nwords * sizeof(int16_t)) == 0);
+		reference->subtract(expected, sums, contrib, nwords);
+		kern->subtract(out, sums, contrib, nwords);
+		BC_ASSERT_TRUE(memcmp(expected, out, nwords * sizeof(int16_t)) == 0);
+
+		start = ms_get_cur_time_ms();
+		for (iterations = 0; iterations < 200 || ms_get_cur_time_ms() - start < 100; iterations++) {
+			memcpy(sum, sums, nwords * sizeof(int32_t));
+			kern->accumulate(sum, contrib, nwords);
+			kern->subtract(out, sum, contrib, nwords);
+		}
+		ms_message("Audio mixer %s kernels: %.1f million samples mixed per second", kern->name,
+			(double)iterations * nwords / (double)(MAX(ms_get_cur_time_ms() - start, 1) * 1000));
+	}
+	ms_free(contrib);
+	ms_free(sums);
+	ms_free(expected_sum);
+	ms_free(sum);
+	ms_free(expected);
+	ms_free(out);
+}
+
+/* a buffer shared with another consumer, as the outputs of a mixer, is copied before the gain is applied */
+static void test_volume_shared_buffer(void) {
+	MSFactory *factory = ms_factory_new_with_voip();
+	MSFilter *volume = ms_factory_create_filter(factory, MS_VOLUME_ID);
+	MSTicker ticker;
+	MSQueue input, output;
+	mblk_t *m, *shared, *om;
+	float gain = 0.5f;
+	int i;
+
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 10;
+	ms_queue_init(&input);
+	ms_queue_init(&output);
+	volume->inputs[0] = &input;
+	volume->outputs[0] = &output;
+	ms_filter_call_method(volume, MS_VOLUME_SET_GAIN, &gain);
+	ms_filter_preprocess(volume, &ticker);
+
+	m = allocb(160, 0);
+	for (i = 0; i < 80; i++) ((int16_t *)m->b_wptr)[i] = 1000;
+	m->b_wptr += 160;
+	shared = dupb(m);
+	ms_queue_put(&input, shared);
+	ms_filter_process(volume);
+	om = ms_queue_get(&output);
+	if (BC_ASSERT_PTR_NOT_NULL(om)) {
+		BC_ASSERT_TRUE(om->b_datap != m->b_datap);
+		BC_ASSERT_EQUAL(((int16_t *)om->b_rptr)[0], 500, int, "%d");
+		freemsg(om);
+	}
+	BC_ASSERT_EQUAL(((int16_t *)m->b_rptr)[0], 1000, int, "%d");
+
+	/* a buffer that is not shared is modified in place */
+	ms_queue_put(&input, m);
+	ms_filter_process(volume);
+	om = ms_queue_get(&output);
+	if (BC_ASSERT_PTR_NOT_NULL(om)) {
+		BC_ASSERT_TRUE(om == m);
+		BC_ASSERT_EQUAL(((int16_t *)om->b_rptr)[0], 500, int, "%d");
+		freemsg(om);
+	}
+
+	ms_filter_postprocess(volume);
+	volume->inputs[0] = NULL;
+	volume->outputs[0] = NULL;
+	ms_filter_destroy(volume);
+	ms_factory_destroy(factory);
+}
+
+static void tone_bank_event_cb(void *userdata, MSFilter *f, unsigned int id, void *arg) {
+	if (id == MS_TONE_DETECTOR_EVENT) {
+		char *detected = (char *)userdata;
+		MSToneDetectorEvent *ev = (MSToneDetectorEvent *)arg;
+		strncat(detected, ev->tone_name, 8);
+		strncat(detected, ";", 1);
+	}
+}
+
+static void test_tone_detector_bank(void) {
+	/* two tones mixed, among dozens of scans, fed in blocks of odd sizes that split samples */
+	MSFactory *factory = ms_factory_new_with_voip();
+	MSFilter *detector = ms_factory_create_filter(factory, MS_TONE_DETECTOR_ID);
+	MSQueue inq, outq;
+	MSTicker ticker;
+	char detected[512] = {0};
+	int rate = 16000;
+	int nsamples = rate;
+	int16_t *signal = ms_new0(int16_t, nsamples);
+	const uint8_t *bytes = (const uint8_t *)signal;
+	int offset = 0, block = 0, i;
+
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 10;
+	ms_filter_call_method(detector, MS_FILTER_SET_SAMPLE_RATE, &rate);
+	for (i = 0; i < 32; i++) {
+		MSToneDetectorDef def;
+		memset(&def, 0, sizeof(def));
+		snprintf(def.tone_name, sizeof(def.tone_name), "%i", 400 + 100 * i);
+		def.frequency = 400 + 100 * i;
+		def.min_duration = 100;
+		def.min_amplitude = 0.1f;
+		BC_ASSERT_EQUAL(ms_filter_call_method(detector, MS_TONE_DETECTOR_ADD_SCAN, &def), 0, int, "%d");
+	}
+	ms_filter_add_notify_callback(detector, tone_bank_event_cb, detected, TRUE);
+	for (i = 0; i < nsamples; i++) {
+		signal[i] = (int16_t)(6000 * sin(2 * M_PI * 1000 * i / rate) + 6000 * sin(2 * M_PI * 2300 * i / rate));
+	}
+
+	ms_queue_init(&inq);
+	ms_queue_init(&outq);
+	detector->inputs[0] = &inq;
+	detector->outputs[0] = &outq;
+	ms_filter_preprocess(detector, &ticker);
+	while (offset < nsamples * (int)sizeof(int16_t)) {
+		int len = MIN(1 + (block++ * 131) % 333, nsamples * (int)sizeof(int16_t) - offset);
+		mblk_t *m = allocb(len, 0);
+		memcpy(m->b_wptr, bytes + offset, len);
+		m->b_wptr += len;
+		offset += len;
+		ms_queue_put(&inq, m);
+		ticker.time += ticker.interval;
+		ms_filter_process(detector);
+		BC_ASSERT_EQUAL(ms_queue_empty(&outq) ? 0 : (int)msgdsize(ms_queue_peek_first(&outq)), len, int, "%d");
+		ms_queue_flush(&outq);
+	}
+	BC_ASSERT_STRING_EQUAL(detected, "1000;2300;");
+
+	ms_filter_postprocess(detector);
+	detector->inputs[0] = NULL;
+	detector->outputs[0] = NULL;
+	ms_filter_destroy(detector);
+	ms_free(signal);
+	ms_factory_destroy(factory);
+}
+
+static void test_tone_detector_kernels(void) {
+	const MSToneDetectorKernel * const *kernels = ms_tone_detector_list_kernels();
+	float coef[64], samples[80];
+	float q1[64], q2[64], ref_q1[64], ref_q2[64];
+	int k, i, ntones, nsamples;
+
+	BC_ASSERT_PTR_NOT_NULL(kernels[0]);
+	srand(1);
+	for (i = 0; i < 64; i++) coef[i] = 2.0f * (float)cos(2 * M_PI * (rand() % 4000) / 8000.0);
+	for (i = 0; i < 80; i++) samples[i] = (float)(rand() % 65536 - 32768) / 32768.0f;
+	for (ntones = 8; ntones <= 64; ntones += 8) {
+		for (nsamples = 1; nsamples <= 80; nsamples += 13) {
+			/* the state left by a previous chunk is carried on */
+			for (i = 0; i < ntones; i++) {
+				ref_q1[i] = (float)(i % 5) * 0.25f;
+				ref_q2[i] = -(float)(i % 3) * 0.5f;
+			}
+			memcpy(q1, ref_q1, sizeof(q1));
+			memcpy(q2, ref_q2, sizeof(q2));
+			kernels[0]->run(ref_q1, ref_q2, coef, ntones, samples, nsamples);
+			for (k = 1; kernels[k] != NULL; k++) {
+				float k_q1[64], k_q2[64];
+				memcpy(k_q1, q1, sizeof(q1));
+				memcpy(k_q2, q2, sizeof(q2));
+				kernels[k]->run(k_q1, k_q2, coef, ntones, samples, nsamples);
+				BC_ASSERT_TRUE(memcmp(k_q1, ref_q1, ntones * sizeof(float)) == 0);
+				BC_ASSERT_TRUE(memcmp(k_q2, ref_q2, ntones * sizeof(float)) == 0);
+			}
+		}
+	}
+	for (k = 0; kernels[k] != NULL; k++) ms_message("Tone detector kernel: %s", kernels[k]->name);
+}
+
+static void test_generic_plc_cost(void) {
+	/* concealment cost of several streams fed through the generic PLC, the ticker being driven by hand */
+	enum { nstreams = 8, nticks = 1000, rate = 16000 };
+	MSFactory *factory = ms_factory_new_with_voip();
+	MSFilter *plc[nstreams];
+	MSQueue inq[nstreams], outq[nstreams];
+	MSTicker ticker;
+	MSTimeSpec begin, end;
+	int samplerate = rate;
+	int lost = 0, concealed = 0, produced = 0;
+	int64_t elapsed_ns = 0;
+	int i, t;
+
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 10;
+	for (i = 0; i < nstreams; i++) {
+		plc[i] = ms_factory_create_filter(factory, MS_GENERIC_PLC_ID);
+		ms_filter_call_method(plc[i], MS_FILTER_SET_SAMPLE_RATE, &samplerate);
+		ms_queue_init(&inq[i]);
+		ms_queue_init(&outq[i]);
+		plc[i]->inputs[0] = &inq[i];
+		plc[i]->outputs[0] = &outq[i];
+		ms_filter_preprocess(plc[i], &ticker);
+	}
+
+	for (t = 0; t < nticks; t++) {
+		/* synthetic loss: isolated losses, then bursts of 60 ms every second */
+		bool_t loss = (t > 10) && ((t % 17) == 3 || (t % 100) >= 94);
+		ticker.time += ticker.interval;
+		for (i = 0; i < nstreams; i++) {
+			mblk_t *m;
+			if (!loss) {
+				int16_t *samples;
+				int k;
+				m = allocb(rate / 100 * sizeof(int16_t), 0);
+				samples = (int16_t *)m->b_wptr;
+				/* triangle wave, its frequency differs from one stream to the other */
+				for (k = 0; k < rate / 100; k++) {
+					int phase = (t * rate / 100 + k) * (i + 1) % 64;
+					samples[k] = (int16_t)((phase < 32 ? phase : 64 - phase) * 512 - 8192);
+				}
+				m->b_wptr += rate / 100 * sizeof(int16_t);
+				ms_queue_put(&inq[i], m);
+			}
+			ms_get_cur_time(&begin);
+			ms_filter_process(plc[i]);
+			ms_get_cur_time(&end);
+			elapsed_ns += (end.tv_sec - begin.tv_sec) * 1000000000LL + (end.tv_nsec - begin.tv_nsec);
+			while ((m = ms_queue_get(&outq[i])) != NULL) {
+				produced++;
+				if (mblk_get_plc_flag(m)) concealed++;
+				freemsg(m);
+			}
+		}
+		if (loss) lost++;
+	}
+	ms_message("Generic PLC: %i streams, %i/%i frames lost, %.1f us of processing per stream and per second of audio",
+		nstreams, lost, nticks, (double)elapsed_ns / 1000.0 / nstreams / (nticks * ticker.interval / 1000.0));
+
+	BC_ASSERT_EQUAL(produced, nstreams * nticks, int, "%d");
+	BC_ASSERT_EQUAL(concealed, nstreams * lost, int, "%d");
+
+	for (i = 0; i < nstreams; i++) {
+		ms_filter_postprocess(plc[i]);
+		plc[i]->inputs[0] = NULL;
+		plc[i]->outputs[0] = NULL;
+		ms_queue_flush(&inq[i]);
+		ms_filter_destroy(plc[i]);
+	}
+	ms_factory_destroy(factory);
+}
+
+#ifdef RESAMPLE_ENABLED
+static void test_resampler_backends(void) {
+	MSFactory *factory = ms_factory_new_with_voip();
+	MSFilter *resampler = ms_factory_create_filter(factory, MS_RESAMPLE_ID);
+	MSResamplerBackend backend;
+	MSQueue inq, outq;
+	MSTicker ticker;
+	int input_rate = 16000, output_rate = 16000;
+	int produced = 0, peak = 0, t, i;
+
+	if (!BC_ASSERT_PTR_NOT_NULL(resampler)) {
+		ms_factory_destroy(factory);
+		return;
+	}
+	ms_filter_call_method(resampler, MS_FILTER_SET_SAMPLE_RATE, &input_rate);
+	ms_filter_call_method(resampler, MS_FILTER_SET_OUTPUT_SAMPLE_RATE, &output_rate);
+	ms_filter_call_method(resampler, MS_RESAMPLE_GET_BACKEND, &backend);
+	BC_ASSERT_EQUAL(backend, MSResamplerBackendNone, int, "%d");
+	input_rate = 44100;
+	output_rate = 48000;
+	ms_filter_call_method(resampler, MS_FILTER_SET_SAMPLE_RATE, &input_rate);
+	ms_filter_call_method(resampler, MS_FILTER_SET_OUTPUT_SAMPLE_RATE, &output_rate);
+	ms_filter_call_method(resampler, MS_RESAMPLE_GET_BACKEND, &backend);
+	BC_ASSERT_EQUAL(backend, MSResamplerBackendSpeex, int, "%d");
+	input_rate = 48000;
+	output_rate = 8000;
+	ms_filter_call_method(resampler, MS_FILTER_SET_SAMPLE_RATE, &input_rate);
+	ms_filter_call_method(resampler, MS_FILTER_SET_OUTPUT_SAMPLE_RATE, &output_rate);
+	ms_filter_call_method(resampler, MS_RESAMPLE_GET_BACKEND, &backend);
+	BC_ASSERT_EQUAL(backend, MSResamplerBackendPolyphase, int, "%d");
+
+	/* 8 kHz to 48 kHz: one second of a 1 kHz tone, in blocks of 20 ms */
+	input_rate = 8000;
+	output_rate = 48000;
+	ms_filter_call_method(resampler, MS_FILTER_SET_SAMPLE_RATE, &input_rate);
+	ms_filter_call_method(resampler, MS_FILTER_SET_OUTPUT_SAMPLE_RATE, &output_rate);
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 20;
+	ms_queue_init(&inq);
+	ms_queue_init(&outq);
+	resampler->inputs[0] = &inq;
+	resampler->outputs[0] = &outq;
+	ms_filter_preprocess(resampler, &ticker);
+	ms_filter_call_method(resampler, MS_RESAMPLE_GET_BACKEND, &backend);
+	BC_ASSERT_EQUAL(backend, MSResamplerBackendPolyphase, int, "%d");
+	for (t = 0; t < 50; t++) {
+		mblk_t *m = allocb(160 * sizeof(int16_t), 0);
+		for (i = 0; i < 160; i++) {
+			((int16_t *)m->b_wptr)[i] = (int16_t)(10000 * sin(2 * M_PI * 1000 * (t * 160 + i) / input_rate));
+		}
+		m->b_wptr += 160 * sizeof(int16_t);
+		ms_queue_put(&inq, m);
+		ticker.time += ticker.interval;
+		ms_filter_process(resampler);
+		while ((m = ms_queue_get(&outq)) != NULL) {
+			int n = (int)(msgdsize(m) / sizeof(int16_t));
+			for (i = 0; i < n; i++) peak = MAX(peak, MAX(((int16_t *)m->b_rptr)[i], -((int16_t *)m->b_rptr)[i]));
+			produced += n;
+			freemsg(m);
+		}
+	}
+	BC_ASSERT_EQUAL(produced, output_rate, int, "%d");
+	/* the tone is in the passband, its amplitude is kept */
+	BC_ASSERT_GREATER(peak, 9900, int, "%d");
+	BC_ASSERT_LOWER(peak, 10100, int, "%d");
+
+	ms_filter_postprocess(resampler);
+	resampler->inputs[0] = NULL;
+	resampler->outputs[0] = NULL;
+	ms_filter_destroy(resampler);
+	ms_factory_destroy(factory);
+}
+
+/* one second of a tone through the resampler, in blocks of 20 ms, returns the peak after the filter delay */
+static int resample_tone(MSFactory *factory, int input_rate, int output_rate, int freq, int *produced) {
+	MSFilter *resampler = ms_factory_create_filter(factory, MS_RESAMPLE_ID);
+	MSQueue inq, outq;
+	MSTicker ticker;
+	int block = input_rate / 50;
+	int peak = 0, t, i;
+
+	*produced = 0;
+	ms_filter_call_method(resampler, MS_FILTER_SET_SAMPLE_RATE, &input_rate);
+	ms_filter_call_method(resampler, MS_FILTER_SET_OUTPUT_SAMPLE_RATE, &output_rate);
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 20;
+	ms_queue_init(&inq);
+	ms_queue_init(&outq);
+	resampler->inputs[0] = &inq;
+	resampler->outputs[0] = &outq;
+	ms_filter_preprocess(resampler, &ticker);
+	for (t = 0; t < 50; t++) {
+		mblk_t *m = allocb(block * sizeof(int16_t), 0);
+		for (i = 0; i < block; i++) {
+			((int16_t *)m->b_wptr)[i] = (int16_t)(10000 * sin(2 * M_PI * freq * (t * block + i) / input_rate));
+		}
+		m->b_wptr += block * sizeof(int16_t);
+		ms_queue_put(&inq, m);
+		ticker.time += ticker.interval;
+		ms_filter_process(resampler);
+		while ((m = ms_queue_get(&outq)) != NULL) {
+			int n = (int)(msgdsize(m) / sizeof(int16_t));
+			for (i = 0; i < n; i++, (*produced)++) {
+				if (*produced >= output_rate / 40) peak = MAX(peak, abs(((int16_t *)m->b_rptr)[i]));
+			}
+			freemsg(m);
+		}
+	}
+	ms_filter_postprocess(resampler);
+	resampler->inputs[0] = NULL;
+	resampler->outputs[0] = NULL;
+	ms_filter_destroy(resampler);
+	return peak;
+}
+
+static void test_resampler_decimation(void) {
+	MSFactory *factory = ms_factory_new_with_voip();
+	int produced, peak;
+
+	/* 48 kHz to 8 kHz: a tone in the passband is kept */
+	peak = resample_tone(factory, 48000, 8000, 1000, &produced);
+	BC_ASSERT_EQUAL(produced, 8000, int, "%d");
+	BC_ASSERT_GREATER(peak, 9900, int, "%d");
+	BC_ASSERT_LOWER(peak, 10100, int, "%d");
+	/* tones above 4 kHz would alias in the output, they must be attenuated by more than 70 dB */
+	peak = resample_tone(factory, 48000, 8000, 5000, &produced);
+	BC_ASSERT_EQUAL(produced, 8000, int, "%d");
+	BC_ASSERT_LOWER(peak, 3, int, "%d");
+	peak = resample_tone(factory, 48000, 8000, 6000, &produced);
+	BC_ASSERT_LOWER(peak, 3, int, "%d");
+	peak = resample_tone(factory, 48000, 8000, 12000, &produced);
+	BC_ASSERT_LOWER(peak, 3, int, "%d");
+	ms_factory_destroy(factory);
+}
+
+static void test_resampler_kernels(void) {
+	const MSResamplerKernel * const *kernels = ms_resampler_list_kernels();
+	int16_t a[192], b[192];
+	int k, n, i, round;
+
+	BC_ASSERT_PTR_NOT_NULL(kernels[0]);
+	srand(1);
+	for (round = 0; round < 100; round++) {
+		/* full scale samples and coefficients small enough for the sum to fit in 32 bits, as with the filters */
+		for (i = 0; i < 192; i++) {
+			a[i] = (int16_t)(rand() % 65536 - 32768);
+			b[i] = (int16_t)(rand() % 513 - 256);
+		}
+		a[round % 192] = -32768;
+		b[round % 192] = round % 2 ? -256 : 256;
+		for (n = 16; n <= 192; n += 16) {
+			int32_t expected = kernels[0]->dot(a, b, n);
+			for (k = 1; kernels[k] != NULL; k++) {
+				BC_ASSERT_EQUAL(kernels[k]->dot(a, b, n), expected, int, "%d");
+			}
+		}
+	}
+	for (k = 0; kernels[k] != NULL; k++) ms_message("Resampler dot product kernel: %s", kernels[k]->name);
+}
+#endif
+
+/* process a block through a filter having one input and one output, in place */
+static void process_block(MSFilter *f, int16_t *samples, int nsamples) {
+	MSQueue *inq = f->inputs[0], *outq = f->outputs[0];
+	mblk_t *m = allocb(nsamples * sizeof(int16_t), 0);
+
+	memcpy(m->b_wptr, samples, nsamples * sizeof(int16_t));
+	m->b_wptr += nsamples * sizeof(int16_t);
+	ms_queue_put(inq, m);
+	ms_filter_process(f);
+	m = ms_queue_get(outq);
+	if (BC_ASSERT_PTR_NOT_NULL(m)) {
+		BC_ASSERT_EQUAL((int)msgdsize(m), nsamples * (int)sizeof(int16_t), int, "%d");
+		memcpy(samples, m->b_rptr, nsamples * sizeof(int16_t));
+		freemsg(m);
+	}
+}
+
+static void test_equalizer_fft_convolution(void) {
+	/* long impulse responses are applied by FFT overlap-save: the output must be the direct convolution of the input by the
+	 * impulse response of the filter, whatever the sizes of the blocks, which are not multiples of the FFT size */
+	static const int rates[] = {16000, 48000};
+	static const int block_sizes[] = {17, 160, 769, 1000, 2047, 333};
+	MSFactory *factory = ms_factory_new_with_voip();
+	int r;
+
+	for (r = 0; r < 2; r++) {
+		MSFilter *probe = ms_factory_create_filter(factory, MS_EQUALIZER_ID);
+		MSFilter *eq = ms_factory_create_filter(factory, MS_EQUALIZER_ID);
+		MSEqualizerGain cut = {1000, 0.3f, 500};
+		MSQueue inq[2], outq[2];
+		MSTicker ticker;
+		int rate = rates[r];
+		int nsamples = rate;
+		int nfreqs = 0, fir_len, offset = 0, block = 0, i, k;
+		int16_t *input = ms_new0(int16_t, nsamples);
+		int16_t *output = ms_new0(int16_t, nsamples);
+		int16_t *impulse;
+		float *response;
+		float max_diff = 0;
+		unsigned int seed = 1;
+
+		memset(&ticker, 0, sizeof(ticker));
+		ticker.interval = 10;
+		ms_queue_init(&inq[0]);
+		ms_queue_init(&outq[0]);
+		ms_queue_init(&inq[1]);
+		ms_queue_init(&outq[1]);
+		probe->inputs[0] = &inq[0];
+		probe->outputs[0] = &outq[0];
+		eq->inputs[0] = &inq[1];
+		eq->outputs[0] = &outq[1];
+		ms_filter_call_method(probe, MS_FILTER_SET_SAMPLE_RATE, &rate);
+		ms_filter_call_method(probe, MS_EQUALIZER_SET_GAIN, &cut);
+		ms_filter_call_method(eq, MS_FILTER_SET_SAMPLE_RATE, &rate);
+		ms_filter_call_method(eq, MS_EQUALIZER_SET_GAIN, &cut);
+		ms_filter_preprocess(probe, &ticker);
+		ms_filter_preprocess(eq, &ticker);
+
+		/* the impulse response is as long as the FFT used to design it */
+		ms_filter_call_method(eq, MS_EQUALIZER_GET_NUM_FREQUENCIES, &nfreqs);
+		fir_len = 2 * nfreqs;
+		BC_ASSERT_GREATER(fir_len, 256, int, "%d");
+		impulse = ms_new0(int16_t, fir_len);
+		response = ms_new0(float, fir_len);
+		impulse[0] = 16384;
+		process_block(probe, impulse, fir_len);
+		for (i = 0; i < fir_len; i++) response[i] = impulse[i] / 16384.0f;
+
+		for (i = 0; i < nsamples; i++) {
+			seed = seed * 1103515245 + 12345;
+			input[i] = (int16_t)((int)((seed >> 16) % 2001) - 1000);
+		}
+		memcpy(output, input, nsamples * sizeof(int16_t));
+		while (offset < nsamples) {
+			int n = MIN(block_sizes[block++ % 6], nsamples - offset);
+			process_block(eq, output + offset, n);
+			offset += n;
+		}
+
+		for (i = 0; i < nsamples; i++) {
+			float expected = 0;
+			for (k = 0; k < fir_len && k <= i; k++) expected += response[k] * input[i - k];
+			if (fabsf(output[i] - expected) > max_diff) max_diff = fabsf(output[i] - expected);
+		}
+		ms_message("Equalizer at %i Hz: %i taps, largest difference with the direct convolution: %f", rate, fir_len, max_diff);
+		BC_ASSERT_LOWER(max_diff, 4.0f, float, "%f");
+
+		ms_filter_postprocess(probe);
+		ms_filter_postprocess(eq);
+		probe->inputs[0] = probe->outputs[0] = NULL;
+		eq->inputs[0] = eq->outputs[0] = NULL;
+		ms_filter_destroy(probe);
+		ms_filter_destroy(eq);
+		ms_free(impulse);
+		ms_free(response);
+		ms_free(input);
+		ms_free(output);
+	}
+	ms_factory_destroy(factory);
+}
+
+static void test_ticker_profile(void) {
+	MSFactory *factory = ms_factory_new_with_voip();
+	MSTicker *ticker = ms_ticker_new();
+	MSFilter *source = ms_factory_create_filter(factory, MS_VOID_SOURCE_ID);
+	MSFilter *sink = ms_factory_create_filter(factory, MS_VOID_SINK_ID);
+	MSLatencyHistogram *h = ms_new0(MSLatencyHistogram, 1);
+	const MSLatencyHistogram *latency;
+	MSTickerParams params = {MS_TICKER_PRIO_NORMAL, "PoolTicker"};
+	MSTickerPool *pool;
+	MSList *tickers = NULL;
+	bool_t send_silence = TRUE;
+	char *profile;
+	const char *type;
+	int i;
+
+	for (i = 1; i <= 1000; i++) ms_latency_histogram_add_value(h, (uint64_t)i * 1000);
+	/* buckets are precise to about 3% */
+	BC_ASSERT_TRUE(ms_latency_histogram_get_percentile(h, 50) >= 500000);
+	BC_ASSERT_TRUE(ms_latency_histogram_get_percentile(h, 50) <= 515000);
+	BC_ASSERT_TRUE(ms_latency_histogram_get_percentile(h, 99.9) >= 999000);
+	BC_ASSERT_EQUAL((int)ms_latency_histogram_get_percentile(h, 100), 1000000, int, "%d");
+	ms_free(h);
+
+	ms_ticker_enable_profiling(ticker, TRUE);
+	ms_filter_call_method(source, MS_VOID_SOURCE_SEND_SILENCE, &send_silence);
+	ms_filter_link(source, 0, sink, 0);
+	ms_ticker_attach(ticker, source);
+	ms_usleep(100000);
+	latency = ms_filter_get_latency_histogram(sink);
+	if (BC_ASSERT_PTR_NOT_NULL(latency)) BC_ASSERT_GREATER((int)latency->count, 1, int, "%d");
+	BC_ASSERT_EQUAL(source->outputs[0]->max_depth, 1, int, "%d");
+
+	profile = ms_ticker_get_profile(ticker, MSProfileFormatJson);
+	BC_ASSERT_PTR_NOT_NULL(strstr(profile, "\"name\":\"MSVoidSink\""));
+	BC_ASSERT_PTR_NOT_NULL(strstr(profile, "\"overruns\":"));
+	ms_free(profile);
+	profile = ms_ticker_get_profile(ticker, MSProfileFormatPrometheus);
+	BC_ASSERT_PTR_NOT_NULL(strstr(profile, "ms_filter_process_duration_seconds{ticker=\"MSTicker\",filter=\"MSVoidSource\""));
+	BC_ASSERT_PTR_NOT_NULL(strstr(profile, "ms_queue_max_depth{"));
+	ms_free(profile);
+
+	/* with several tickers, each metric family is declared once */
+	pool = ms_ticker_pool_new(2, &params);
+	tickers = bctbx_list_append(tickers, ms_ticker_pool_get_ticker(pool, 0));
+	tickers = bctbx_list_append(tickers, ms_ticker_pool_get_ticker(pool, 1));
+	tickers = bctbx_list_append(tickers, ticker);
+	profile = ms_tickers_get_profile(tickers, MSProfileFormatPrometheus);
+	type = strstr(profile, "# TYPE ms_ticker_overruns_total counter\n");
+	if (BC_ASSERT_PTR_NOT_NULL(type)) BC_ASSERT_PTR_NULL(strstr(type + 1, "# TYPE ms_ticker_overruns_total"));
+	type = strstr(profile, "# TYPE ms_queue_depth gauge\n");
+	if (BC_ASSERT_PTR_NOT_NULL(type)) BC_ASSERT_PTR_NULL(strstr(type + 1, "# TYPE ms_queue_depth"));
+	BC_ASSERT_PTR_NOT_NULL(strstr(profile, "ms_ticker_overruns_total{ticker=\"PoolTicker-1\"}"));
+	BC_ASSERT_PTR_NOT_NULL(strstr(profile, "ms_ticker_overruns_total{ticker=\"MSTicker\"}"));
+	ms_free(profile);
+	profile = ms_tickers_get_profile(tickers, MSProfileFormatJson);
+	BC_ASSERT_EQUAL(profile[0], '[', char, "%c");
+	ms_free(profile);
+	/* the pool keeps measuring its graphs when the profiling of its tickers is disabled */
+	ms_ticker_enable_profiling(ms_ticker_pool_get_ticker(pool, 0), FALSE);
+	BC_ASSERT_TRUE(ms_ticker_pool_get_ticker(pool, 0)->measure_filters);
+	bctbx_list_free(tickers);
+	ms_ticker_pool_destroy(pool);
+
+	ms_ticker_detach(ticker, source);
+	ms_ticker_reset_profile(ticker);
+	BC_ASSERT_EQUAL((int)ms_ticker_get_overrun_count(ticker), 0, int, "%d");
+	ms_filter_unlink(source, 0, sink, 0);
+	ms_filter_destroy(source);
+	ms_filter_destroy(sink);
+	ms_ticker_destroy(ticker);
+	ms_factory_destroy(factory);
+}
+
+static void test_ticker_trace(void) {
+	MSFactory *factory = ms_factory_new_with_voip();
+	MSTicker *ticker = ms_ticker_new();
+	MSFilter *source = ms_factory_create_filter(factory, MS_VOID_SOURCE_ID);
+	MSFilter *sink = ms_factory_create_filter(factory, MS_VOID_SINK_ID);
+	char *trace_file = bc_tester_file("ticker_trace.json");
+	bool_t send_silence = TRUE;
+	char *content;
+	size_t size;
+	FILE *f;
+
+	ms_filter_call_method(source, MS_VOID_SOURCE_SEND_SILENCE, &send_silence);
+	ms_filter_link(source, 0, sink, 0);
+	ms_trace_start(0);
+	BC_ASSERT_TRUE(ms_trace_is_enabled());
+	ms_ticker_attach(ticker, source);
+	ms_usleep(100000);
+	ms_ticker_detach(ticker, source);
+	ms_trace_stop();
+	BC_ASSERT_EQUAL(ms_trace_save(trace_file), 0, int, "%d");
+
+	f = fopen(trace_file, "rb");
+	if (BC_ASSERT_PTR_NOT_NULL(f)) {
+		content = ms_new0(char, 1024 * 1024);
+		size = fread(content, 1, 1024 * 1024 - 1, f);
+		BC_ASSERT_GREATER((int)size, 0, int, "%d");
+		BC_ASSERT_PTR_NOT_NULL(strstr(content, "\"traceEvents\""));
+		BC_ASSERT_PTR_NOT_NULL(strstr(content, "\"name\":\"MSVoidSink\",\"cat\":\"process\""));
+		BC_ASSERT_PTR_NOT_NULL(strstr(content, "\"name\":\"tick\",\"cat\":\"tick\""));
+		ms_free(content);
+		fclose(f);
+	}
+	unlink(trace_file);
+	free(trace_file);
+	ms_filter_unlink(source, 0, sink, 0);
+	ms_filter_destroy(source);
+	ms_filter_destroy(sink);
+	ms_ticker_destroy(ticker);
+	ms_factory_destroy(factory);
+}
+
+/* each recording uses new tickers, more of them in total than the rings of the recorder */
+static void test_ticker_trace_restart(void) {
+	MSTicker tickers[3][48];
+	char *trace_file = bc_tester_file("ticker_trace_restart.json");
+	char *content = ms_new0(char, 1024 * 1024);
+	int round, i;
+
+	memset(tickers, 0, sizeof(tickers));
+	for (round = 0; round < 3; round++) {
+		MSTimeSpec begin, end;
+		const char *p;
+		size_t size;
+		int spans = 0;
+		FILE *f;
+
+		ms_trace_start(64);
+		ms_get_cur_time(&begin);
+		ms_get_cur_time(&end);
+		for (i = 0; i < 48; i++) {
+			ms_trace_record(&tickers[round][i], MSTraceEventProcess, "MSRestart", &tickers[round][i], (uint32_t)round, &begin,
+				&end);
+		}
+		ms_trace_stop();
+		BC_ASSERT_EQUAL(ms_trace_save(trace_file), 0, int, "%d");
+		f = fopen(trace_file, "rb");
+		if (!BC_ASSERT_PTR_NOT_NULL(f)) break;
+		size = fread(content, 1, 1024 * 1024 - 1, f);
+		content[size] = '\0';
+		fclose(f);
+		for (p = content; (p = strstr(p, "\"name\":\"MSRestart\"")) != NULL; p++) spans++;
+		BC_ASSERT_EQUAL(spans, 48, int, "%d");
+	}
+	unlink(trace_file);
+	free(trace_file);
+	ms_free(content);
+}
+
+/* the ticker keeps recording while the trace is restarted with growing capacities, which reallocates its ring */
+static void test_ticker_trace_restart_while_running(void) {
+	MSFactory *factory = ms_factory_new_with_voip();
+	MSTicker *ticker = ms_ticker_new();
+	MSFilter *source = ms_factory_create_filter(factory, MS_VOID_SOURCE_ID);
+	MSFilter *sink = ms_factory_create_filter(factory, MS_VOID_SINK_ID);
+	char *trace_file = bc_tester_file("ticker_trace_running.json");
+	bool_t send_silence = TRUE;
+	char *content;
+	size_t size;
+	FILE *f;
+	int i;
+
+	ms_filter_call_method(source, MS_VOID_SOURCE_SEND_SILENCE, &send_silence);
+	ms_filter_link(source, 0, sink, 0);
+	ms_ticker_attach(ticker, source);
+	for (i = 0; i < 40; i++) {
+		ms_trace_start(64 << (i % 8));
+		ms_usleep(5000 + (i % 3) * 5000);
+	}
+	ms_usleep(100000);
+	ms_trace_stop();
+	ms_ticker_detach(ticker, source);
+	BC_ASSERT_EQUAL(ms_trace_save(trace_file), 0, int, "%d");
+
+	f = fopen(trace_file, "rb");
+	if (BC_ASSERT_PTR_NOT_NULL(f)) {
+		content = ms_new0(char, 1024 * 1024);
+		size = fread(content, 1, 1024 * 1024 - 1, f);
+		BC_ASSERT_GREATER((int)size, 0, int, "%d");
+		BC_ASSERT_PTR_NOT_NULL(strstr(content, "\"name\":\"MSVoidSink\",\"cat\":\"process\""));
+		ms_free(content);
+		fclose(f);
+	}
+	unlink(trace_file);
+	free(trace_file);
+	ms_filter_unlink(source, 0, sink, 0);
+	ms_filter_destroy(source);
+	ms_filter_destroy(sink);
+	ms_ticker_destroy(ticker);
+	ms_factory_destroy(factory);
+}
+
+static void queue_rtp_payload(MSQueue *q, int size, uint32_t ts) {
+	mblk_t *m = allocb(size, 0);
+	memset(m->b_wptr, 0x55, size);
+	m->b_wptr += size;
+	mblk_set_timestamp_info(m, ts);
+	ms_queue_put(q, m);
+}
+
+static void test_rtp_batch_send(void) {
+	/* a tick of equal sized packets, which may be sent with UDP segmentation offload, then a tick of packets of alternating
+	 * sizes, which cannot: all of them must reach the receiver, in order and with their size, with a few system calls */
+	MSFactory *factory = ms_factory_new_with_voip();
+	RtpSession *sender_session = ms_create_duplex_rtp_session("127.0.0.1", 50180, 0, ms_factory_get_mtu(factory));
+	RtpSession *receiver_session = ms_create_duplex_rtp_session("127.0.0.1", 50190, 0, ms_factory_get_mtu(factory));
+	MSFilter *sender = ms_factory_create_filter(factory, MS_RTP_SEND_ID);
+	MSQueue inq;
+	MSTicker ticker;
+	MSRtpBatchStats stats;
+	bool_t enabled = TRUE, stun = FALSE;
+	uint8_t buf[1500];
+	int expected_sizes[48];
+	int nexpected = 0, nreceived = 0, i;
+	uint32_t ts = 0;
+
+	rtp_session_set_remote_addr_full(sender_session, "127.0.0.1", 50190, "127.0.0.1", 50191);
+	rtp_session_set_payload_type(sender_session, 0);
+	rtp_session_enable_rtcp(sender_session, FALSE);
+	rtp_session_enable_rtcp(receiver_session, FALSE);
+	ms_filter_call_method(sender, MS_RTP_SEND_ENABLE_STUN, &stun);
+	ms_filter_call_method(sender, MS_RTP_SEND_SET_SESSION, sender_session);
+	if (ms_filter_call_method(sender, MS_RTP_SEND_ENABLE_BATCH_SEND, &enabled) != 0) {
+		ms_message("Batched send is not available on this platform.");
+		goto end;
+	}
+
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 20;
+	ms_queue_init(&inq);
+	sender->inputs[0] = &inq;
+	ms_filter_preprocess(sender, &ticker);
+	for (i = 0; i < 24; i++) {
+		int size = (i == 23) ? 80 : 160;
+		queue_rtp_payload(&inq, size, ts);
+		expected_sizes[nexpected++] = RTP_FIXED_HEADER_SIZE + size;
+		ts += 160;
+	}
+	ticker.time += ticker.interval;
+	ms_filter_process(sender);
+	for (i = 0; i < 24; i++) {
+		int size = (i % 2) ? 120 : 160;
+		queue_rtp_payload(&inq, size, ts);
+		expected_sizes[nexpected++] = RTP_FIXED_HEADER_SIZE + size;
+		ts += 160;
+	}
+	ticker.time += ticker.interval;
+	ms_filter_process(sender);
+
+	BC_ASSERT_EQUAL(ms_filter_call_method(sender, MS_RTP_SEND_GET_BATCH_STATS, &stats), 0, int, "%d");
+	BC_ASSERT_EQUAL(stats.send_packets, (unsigned int)nexpected, unsigned int, "%u");
+	BC_ASSERT_EQUAL(stats.send_errors, 0, unsigned int, "%u");
+	/* one call per tick, and one more for each tick if the kernel rejected the segmentation offload */
+	BC_ASSERT_LOWER(stats.send_calls, 4, unsigned int, "%u");
+
+	for (;;) {
+		int len = (int)recv(rtp_session_get_rtp_socket(receiver_session), (char *)buf, sizeof(buf), 0);
+		if (len < 0) break;
+		if (len < RTP_FIXED_HEADER_SIZE || (buf[0] >> 6) != 2) continue;
+		if (nreceived < nexpected) BC_ASSERT_EQUAL(len, expected_sizes[nreceived], int, "%d");
+		nreceived++;
+	}
+	BC_ASSERT_EQUAL(nreceived, nexpected, int, "%d");
+
+	ms_filter_postprocess(sender);
+	sender->inputs[0] = NULL;
+end:
+	ms_filter_destroy(sender);
+	rtp_session_destroy(sender_session);
+	rtp_session_destroy(receiver_session);
+	ms_factory_destroy(factory);
+}
+
+static void test_rtp_batch_receive(void) {
+	/* more packets than a batch holds, so that they are received with several recvmmsg() calls: each one must come out of
+	 * the MSRtpRecv once, in order, with its own RTP header fields, payload and destination address */
+	MSFactory *factory = ms_factory_new_with_voip();
+	RtpSession *sender_session = ms_create_duplex_rtp_session("127.0.0.1", 50200, 0, ms_factory_get_mtu(factory));
+	RtpSession *receiver_session = ms_create_duplex_rtp_session("127.0.0.1", 50210, 0, ms_factory_get_mtu(factory));
+	MSFilter *receiver = ms_factory_create_filter(factory, MS_RTP_RECV_ID);
+	MSQueue outq;
+	MSTicker ticker;
+	MSRtpBatchStats stats;
+	bool_t enabled = TRUE;
+	const int npackets = 40;
+	int nreceived = 0, i, loops;
+	uint16_t first_seq = 0;
+
+	rtp_session_set_remote_addr_full(sender_session, "127.0.0.1", 50210, "127.0.0.1", 50211);
+	rtp_session_set_payload_type(sender_session, 0);
+	rtp_session_set_payload_type(receiver_session, 0);
+	rtp_session_enable_rtcp(sender_session, FALSE);
+	rtp_session_enable_rtcp(receiver_session, FALSE);
+	/* packets are delivered as soon as they are received */
+	rtp_session_enable_jitter_buffer(receiver_session, FALSE);
+	ms_filter_call_method(receiver, MS_RTP_RECV_SET_SESSION, receiver_session);
+	if (ms_filter_call_method(receiver, MS_RTP_RECV_ENABLE_BATCH_RECEIVE, &enabled) != 0) {
+		ms_message("Batched receive is not available on this platform.");
+		goto end;
+	}
+
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 20;
+	ms_queue_init(&outq);
+	receiver->outputs[0] = &outq;
+	ms_filter_preprocess(receiver, &ticker);
+	/* the first process flushes the socket */
+	ms_filter_process(receiver);
+
+	for (i = 0; i < npackets; i++) {
+		mblk_t *packet = rtp_session_create_packet(sender_session, RTP_FIXED_HEADER_SIZE, NULL, 0);
+		int size = 100 + i;
+		memset(packet->b_wptr, i, size);
+		packet->b_wptr += size;
+		rtp_set_markbit(packet, (i % 5) == 0);
+		rtp_session_sendm_with_ts(sender_session, packet, (uint32_t)(i * 160));
+	}
+
+	for (loops = 0; loops < 100 && nreceived < npackets; loops++) {
+		mblk_t *m;
+		ticker.time += ticker.interval;
+		ms_filter_process(receiver);
+		while ((m = ms_queue_get(&outq)) != NULL) {
+			if (nreceived == 0) first_seq = mblk_get_cseq(m);
+			if (nreceived < npackets) {
+				BC_ASSERT_EQUAL(mblk_get_cseq(m), (uint16_t)(first_seq + nreceived), uint16_t, "%u");
+				BC_ASSERT_EQUAL(mblk_get_timestamp_info(m), (uint32_t)(nreceived * 160), uint32_t, "%u");
+				BC_ASSERT_EQUAL(mblk_get_marker_info(m), (nreceived % 5) == 0, int, "%d");
+				BC_ASSERT_EQUAL((int)msgdsize(m), 100 + nreceived, int, "%d");
+				BC_ASSERT_EQUAL(m->b_rptr[0], nreceived, int, "%d");
+				/* parsed from the control messages of this packet */
+				BC_ASSERT_EQUAL(m->recv_addr.family, AF_INET, int, "%d");
+				BC_ASSERT_EQUAL(ntohs(m->recv_addr.port), 50210, int, "%d");
+			}
+			nreceived++;
+			freemsg(m);
+		}
+		if (nreceived < npackets) ms_usleep(10000);
+	}
+	BC_ASSERT_EQUAL(nreceived, npackets, int, "%d");
+	BC_ASSERT_EQUAL(ms_filter_call_method(receiver, MS_RTP_RECV_GET_BATCH_STATS, &stats), 0, int, "%d");
+	BC_ASSERT_EQUAL(stats.recv_packets, (unsigned int)npackets, unsigned int, "%u");
+
+	ms_filter_postprocess(receiver);
+	receiver->outputs[0] = NULL;
+end:
+	ms_filter_destroy(receiver);
+	rtp_session_destroy(sender_session);
+	rtp_session_destroy(receiver_session);
+	ms_factory_destroy(factory);
+}
+
 static test_t tests[] = {
 	 TEST_NO_TAG("Multiple ms_voip_init", filter_register_tester),
 	 TEST_NO_TAG("Is multicast", test_is_multicast),
 	 TEST_NO_TAG("FilterDesc enabling/disabling", test_filterdesc_enable_disable),
+	 TEST_NO_TAG("Ticker running graphs in parallel", test_ticker_parallel_graphs),
+	 TEST_NO_TAG("Ticker pool graph placement", test_ticker_pool_placement),
+	 TEST_NO_TAG("Inter-ticker queue overflow", test_itc_overflow_policy),
+	 TEST_NO_TAG("Event queue with several producers", test_event_queue_producers),
+	 TEST_NO_TAG("Event queue overflow", test_event_queue_overflow),
+	 TEST_NO_TAG("Event queue cleaned while written", test_event_queue_clean_while_written),
+	 TEST_NO_TAG("Tee outputs sharing data", test_tee_shared_outputs),
+	 TEST_NO_TAG("Buffer pool reuse", test_buffer_pool_reuse),
+	 TEST_NO_TAG("Buffer pool with held buffers", test_buffer_pool_held_buffers),
+	 TEST_NO_TAG("SRTP protection in place", test_srtp_protect_in_place),
+	 TEST_NO_TAG("Read-only messages", test_read_only_messages),
+	 TEST_NO_TAG("Ring bufferizer views", test_ring_bufferizer),
+	 TEST_NO_TAG("G.711 conversion kernels", test_g711_kernels),
+	 TEST_NO_TAG("Audio mixer kernels", test_audio_mixer_kernels),
+	 TEST_NO_TAG("Volume with a shared buffer", test_volume_shared_buffer),
+	 TEST_NO_TAG("Generic PLC concealment cost", test_generic_plc_cost),
+	 TEST_NO_TAG("Tone detector bank", test_tone_detector_bank),
+	 TEST_NO_TAG("Tone detector kernels", test_tone_detector_kernels),
+#ifdef RESAMPLE_ENABLED
+	 TEST_NO_TAG("Resampler backends", test_resampler_backends),
+	 TEST_NO_TAG("Resampler decimation", test_resampler_decimation),
+	 TEST_NO_TAG("Resampler dot product kernels", test_resampler_kernels),
+#endif
+	 TEST_NO_TAG("Equalizer FFT convolution", test_equalizer_fft_convolution),
+	 TEST_NO_TAG("Ticker profile export", test_ticker_profile),
+	 TEST_NO_TAG("Ticker trace recording", test_ticker_trace),
+	 TEST_NO_TAG("Ticker trace recording restarted", test_ticker_trace_restart),
+	 TEST_NO_TAG("Ticker trace restarted while running", test_ticker_trace_restart_while_running),
+	 TEST_NO_TAG("RTP batched send", test_rtp_batch_send),
+	 TEST_NO_TAG("RTP batched receive", test_rtp_batch_receive),
 #ifdef VIDEO_ENABLED
 	 TEST_NO_TAG("Video processing function", test_video_processing),
 	 TEST_NO_TAG("Copy ycbcrbiplanar to true yuv with downscaling", test_copy_ycbcrbiplanar_to_true_yuv_with_downscaling),
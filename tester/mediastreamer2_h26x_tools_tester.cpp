@@ -25,8 +25,10 @@
 
 #include <bctoolbox/tester.h>
 
+#include <mediastreamer2/msbufferpool.h>
 #include <mediastreamer2/msfactory.h>
 
+#include "h26x/h264-utils.h"
 #include "h26x/h26x-utils.h"
 
 using namespace mediastreamer;
@@ -95,6 +97,80 @@ static void bytestream_transcoding_two_consecutive_prevention_thee_bytes() {
 	bytestream_transcoding_test(byteStream);
 }
 
+static void bytestream_zero_copy_splitting_test() {
+	vector<uint8_t> byteStream = loadFrameByteStream("h265-iframe");
+	MSQueue copies, views;
+	ms_queue_init(&copies);
+	ms_queue_init(&views);
+
+	H26xUtils::byteStreamToNalus(byteStream, &copies);
+	mblk_t *im = allocb(byteStream.size(), 0);
+	memcpy(im->b_wptr, byteStream.data(), byteStream.size());
+	im->b_wptr += byteStream.size();
+	const uint8_t *base = im->b_rptr;
+	H26xUtils::byteStreamToNalus(im, &views);
+
+	BC_ASSERT_EQUAL((int)views.q.q_mcount, (int)copies.q.q_mcount, int, "%i");
+	for (mblk_t *c = ms_queue_peek_first(&copies), *v = ms_queue_peek_first(&views);
+		!ms_queue_end(&copies, c) && !ms_queue_end(&views, v); c = ms_queue_next(&copies, c), v = ms_queue_next(&views, v)) {
+		size_t size = (size_t)(c->b_wptr - c->b_rptr);
+		BC_ASSERT_EQUAL((int)(v->b_wptr - v->b_rptr), (int)size, int, "%i");
+		BC_ASSERT(memcmp(v->b_rptr, c->b_rptr, size) == 0);
+		/*NAL units without prevention bytes must point into the byte stream*/
+		if (v->b_datap->db_base == base) BC_ASSERT(v->b_rptr >= base && v->b_wptr <= base + byteStream.size());
+	}
+	BC_ASSERT_PTR_EQUAL(ms_queue_peek_first(&views)->b_datap->db_base, base);
+
+	ms_queue_flush(&copies);
+	ms_queue_flush(&views);
+
+	vector<uint8_t> preventionByteStream = {0, 0, 0, 1, 0x40, 0, 0, 3, 1, 0, 0, 1, 0x42, 2};
+	im = allocb(preventionByteStream.size(), 0);
+	memcpy(im->b_wptr, preventionByteStream.data(), preventionByteStream.size());
+	im->b_wptr += preventionByteStream.size();
+	base = im->b_rptr;
+	H26xUtils::byteStreamToNalus(im, &views);
+	BC_ASSERT_EQUAL((int)views.q.q_mcount, 2, int, "%i");
+	mblk_t *first = ms_queue_peek_first(&views);
+	mblk_t *second = ms_queue_next(&views, first);
+	/*the first NAL unit is copied without its prevention byte, the second one is a view*/
+	BC_ASSERT_EQUAL((int)(first->b_wptr - first->b_rptr), 4, int, "%i");
+	BC_ASSERT(first->b_datap->db_base != base);
+	BC_ASSERT_PTR_EQUAL(second->b_rptr, base + 12);
+	ms_queue_flush(&views);
+}
+
+static void h264_bitstream_single_copy_test() {
+	const uint8_t byteStream[] = {0, 0, 0, 1, 0x67, 0x42, 0xc0, 0x1f, 0xda, 0x01, 0x40, 0x16, 0xe8, 0x40,
+		0, 0, 0, 1, 0x68, 0xce, 0x0f, 0xc8, 0, 0, 0, 1, 0x65, 0x88, 0x84, 0x21, 0xa0};
+	MSQueue nalus, out;
+	ms_queue_init(&nalus);
+	ms_queue_init(&out);
+
+	/*the byte stream is copied once, all the NAL units share this copy*/
+	ms_h264_bitstream_to_nalus(byteStream, sizeof(byteStream), &nalus);
+	BC_ASSERT_EQUAL((int)nalus.q.q_mcount, 3, int, "%i");
+	mblk_t *first = ms_queue_peek_first(&nalus);
+	const uint8_t *base = first->b_datap->db_base;
+	for (mblk_t *m = first; !ms_queue_end(&nalus, m); m = ms_queue_next(&nalus, m)) {
+		BC_ASSERT_PTR_EQUAL(m->b_datap, first->b_datap);
+	}
+	BC_ASSERT_PTR_EQUAL(first->b_rptr, base + 4);
+	BC_ASSERT(memcmp(ms_queue_next(&nalus, first)->b_rptr, byteStream + 18, 4) == 0);
+
+	/*the parameter sets kept by the inserter must not hold the buffer of the frame*/
+	std::unique_ptr<H26xParameterSetsInserter> inserter(H26xToolFactory::get("video/avc").createParameterSetsInserter());
+	inserter->process(&nalus, &out);
+	BC_ASSERT_EQUAL((int)out.q.q_mcount, 3, int, "%i");
+	mblk_t *idr = ms_queue_peek_last(&out);
+	BC_ASSERT_EQUAL(idr->b_rptr[0] & 0x1f, 5, int, "%i");
+	BC_ASSERT_PTR_EQUAL(idr->b_rptr, base + 26);
+	for (mblk_t *m = ms_queue_peek_first(&out); m != idr; m = ms_queue_next(&out, m)) {
+		BC_ASSERT(m->b_datap != idr->b_datap);
+	}
+	ms_queue_flush(&out);
+}
+
 static void packing_unpacking_test(const std::vector<uint8_t> &byteStream, const std::string &mime) {
 	MSQueue nalus, rtp;
 
@@ -143,12 +219,140 @@ static void packing_unpacking_test_h265_iframe() {
 	packing_unpacking_test(byteStream, "video/hevc");
 }
 
+static void h264_packing_with_buffer_pool_test() {
+	/*SPS and PPS are aggregated into a STAP-A packet, the IDR slice does not fit and is split into FU-A packets*/
+	vector<uint8_t> byteStream = {0, 0, 0, 1, 0x67, 0x42, 0xc0, 0x1f, 0xda, 0x01, 0x40, 0x16, 0xe8, 0x40,
+		0, 0, 0, 1, 0x68, 0xce, 0x0f, 0xc8};
+	const uint8_t idr[] = {0, 0, 0, 1, 0x65};
+	byteStream.insert(byteStream.end(), idr, idr + sizeof(idr));
+	for (int i = 0; i < 4000; i++) byteStream.push_back((uint8_t)(1 + i % 251));
+
+	MSBufferPool *pool = ms_buffer_pool_new();
+	const H26xToolFactory &factory = H26xToolFactory::get("video/avc");
+	std::unique_ptr<NalPacker> packer(factory.createNalPacker(ms_factory_get_payload_max_size(msFactory)));
+	std::unique_ptr<NalUnpacker> unpacker(factory.createNalUnpacker());
+	packer->setPacketizationMode(NalPacker::NonInterleavedMode);
+	packer->enableAggregation(true);
+	packer->setBufferPool(pool);
+
+	MSQueue nalus, rtp;
+	ms_queue_init(&nalus);
+	ms_queue_init(&rtp);
+	int packetsPerFrame = 0;
+	for (int frame = 0; frame < 20; frame++) {
+		H26xUtils::byteStreamToNalus(byteStream, &nalus);
+		packer->pack(&nalus, &rtp, frame * 3000);
+		BC_ASSERT(ms_queue_empty(&nalus));
+		if (frame == 0) packetsPerFrame = rtp.q.q_mcount;
+		BC_ASSERT_EQUAL((int)rtp.q.q_mcount, packetsPerFrame, int, "%i");
+
+		int stapCount = 0, fuaCount = 0;
+		for (mblk_t *m = ms_queue_peek_first(&rtp); !ms_queue_end(&rtp, m); m = ms_queue_next(&rtp, m)) {
+			uint8_t type = m->b_rptr[0] & 0x1f;
+			if (type == 24) stapCount++;
+			else if (type == 28) fuaCount++;
+			/*packets are built in pooled buffers, with room for the RTP header in front of the payload*/
+			BC_ASSERT_TRUE(ms_buffer_pool_is_pool_buffer(m->b_datap));
+			BC_ASSERT_TRUE(m->b_rptr - m->b_datap->db_base >= MS_BUFFER_POOL_HEADROOM);
+			BC_ASSERT_LOWER((int)msgdsize(m), ms_factory_get_payload_max_size(msFactory), int, "%i");
+		}
+		BC_ASSERT_EQUAL(stapCount, 1, int, "%i");
+		BC_ASSERT_GREATER(fuaCount, 2, int, "%i");
+
+		NalUnpacker::Status status;
+		while (mblk_t *m = ms_queue_get(&rtp)) {
+			status = unpacker->unpack(m, &nalus);
+			if (status.frameAvailable) break;
+		}
+		BC_ASSERT(status.frameAvailable);
+		BC_ASSERT(!status.frameCorrupted);
+
+		vector<uint8_t> byteStream2(2 * byteStream.size());
+		size_t filled = H26xUtils::nalusToByteStream(&nalus, &byteStream2[0], byteStream2.size());
+		byteStream2.resize(filled);
+		BC_ASSERT(byteStream == byteStream2);
+		ms_queue_flush(&nalus);
+		ms_queue_flush(&rtp);
+	}
+
+	/*the buffers of a frame are reused by the next ones*/
+	MSBufferPoolStats stats;
+	ms_buffer_pool_get_stats(pool, &stats);
+	BC_ASSERT_LOWER(stats.buffers, 2 * packetsPerFrame, int, "%i");
+	BC_ASSERT_GREATER((int)stats.hits, (int)stats.requests - 2 * packetsPerFrame, int, "%i");
+
+	packer.reset();
+	ms_buffer_pool_destroy(pool);
+}
+
+static void h265_aggregation_size_test() {
+	/*an AP made of a payload header and of two NALus with their 2 bytes length fields: 2 + (2 + 497) + (2 + 497) bytes*/
+	const size_t maxSize = 1000;
+	MSBufferPool *pool = ms_buffer_pool_new();
+	const H26xToolFactory &factory = H26xToolFactory::get("video/hevc");
+	std::unique_ptr<NalPacker> packer(factory.createNalPacker(maxSize));
+	std::unique_ptr<NalUnpacker> unpacker(factory.createNalUnpacker());
+	packer->setPacketizationMode(NalPacker::NonInterleavedMode);
+	packer->enableAggregation(true);
+	packer->setBufferPool(pool);
+
+	/*the second frame is one byte too large to be aggregated*/
+	for (size_t secondSize : {497, 498}) {
+		MSQueue nalus, rtp;
+		ms_queue_init(&nalus);
+		ms_queue_init(&rtp);
+		vector<vector<uint8_t>> frame;
+		for (size_t size : {(size_t)497, secondSize}) {
+			vector<uint8_t> nalu = {0x02, 0x01};
+			for (size_t i = 2; i < size; i++) nalu.push_back((uint8_t)(1 + (i + frame.size()) % 251));
+			mblk_t *m = allocb(size, 0);
+			memcpy(m->b_wptr, nalu.data(), size);
+			m->b_wptr += size;
+			ms_queue_put(&nalus, m);
+			frame.push_back(nalu);
+		}
+		packer->pack(&nalus, &rtp, 0);
+		if (secondSize == 497) {
+			BC_ASSERT_EQUAL((int)rtp.q.q_mcount, 1, int, "%i");
+			BC_ASSERT_EQUAL((int)msgdsize(ms_queue_peek_first(&rtp)), (int)maxSize, int, "%i");
+		} else {
+			BC_ASSERT_EQUAL((int)rtp.q.q_mcount, 2, int, "%i");
+		}
+		for (mblk_t *m = ms_queue_peek_first(&rtp); !ms_queue_end(&rtp, m); m = ms_queue_next(&rtp, m)) {
+			BC_ASSERT_LOWER((int)msgdsize(m), (int)maxSize, int, "%i");
+		}
+
+		NalUnpacker::Status status;
+		while (mblk_t *m = ms_queue_get(&rtp)) {
+			status = unpacker->unpack(m, &nalus);
+			if (status.frameAvailable) break;
+		}
+		BC_ASSERT(status.frameAvailable);
+		BC_ASSERT(!status.frameCorrupted);
+		vector<vector<uint8_t>> unpacked;
+		while (mblk_t *m = ms_queue_get(&nalus)) {
+			msgpullup(m, -1);
+			unpacked.emplace_back(m->b_rptr, m->b_wptr);
+			freemsg(m);
+		}
+		BC_ASSERT(unpacked == frame);
+		ms_queue_flush(&rtp);
+	}
+
+	packer.reset();
+	ms_buffer_pool_destroy(pool);
+}
+
 static test_t tests[] = {
 	TEST_NO_TAG("Bytestream transcoding - paramter sets frame", paramter_sets_bytestream_transcoding_test),
 	TEST_NO_TAG("Bytestream transcoding - i-frame", iframe_bytestream_transcoding_test),
 	TEST_NO_TAG("Bytestream transcoding - two consecutive prevention three bytes", bytestream_transcoding_two_consecutive_prevention_thee_bytes),
+	TEST_NO_TAG("Bytestream zero-copy splitting", bytestream_zero_copy_splitting_test),
+	TEST_NO_TAG("H264 bitstream split from a single copy", h264_bitstream_single_copy_test),
 	TEST_NO_TAG("H265 Packing/Unpacking - paramter sets frame", packing_unpacking_test_h265_ps),
-	TEST_NO_TAG("H265 Packing/Unpacking - i-frame", packing_unpacking_test_h265_iframe)
+	TEST_NO_TAG("H265 Packing/Unpacking - i-frame", packing_unpacking_test_h265_iframe),
+	TEST_NO_TAG("H264 Packing with a buffer pool", h264_packing_with_buffer_pool_test),
+	TEST_NO_TAG("H265 aggregation up to the payload size", h265_aggregation_size_test)
 };
 
 extern "C" {
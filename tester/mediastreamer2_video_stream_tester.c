@@ -25,6 +25,7 @@
 #include <math.h>
 #include <ortp/port.h>
 #include "mediastreamer2/msitc.h"
+#include "mediastreamer2/msvideorouter.h"
 
 #ifdef _MSC_VER
 #define unlink _unlink
@@ -1407,6 +1408,200 @@ static void fec_video_stream_h264(void) {
 
 }
 
+/*
+ * A VP8 RTP payload made of a single frame, with a payload descriptor carrying a TID, either alone or after a 16 bits
+ * picture ID and a TL0PICIDX. The VP8 payload starts with the key frame bit.
+ */
+static mblk_t *make_vp8_packet(int size, uint32_t ts, uint16_t seq, int tid, bool_t layer_sync, bool_t key_frame, bool_t long_descriptor) {
+	mblk_t *m = allocb(size, 0);
+	memset(m->b_wptr, 0, size);
+	*m->b_wptr++ = 0x90; /* X and S bits */
+	if (long_descriptor) {
+		*m->b_wptr++ = 0xe0; /* I, L and T bits */
+		*m->b_wptr++ = 0x80 | (seq >> 8);
+		*m->b_wptr++ = seq & 0xff;
+		*m->b_wptr++ = 0; /* TL0PICIDX */
+	} else {
+		*m->b_wptr++ = 0x20; /* T bit */
+	}
+	*m->b_wptr++ = (uint8_t)((tid << 6) | (layer_sync ? 0x20 : 0));
+	*m->b_wptr = key_frame ? 0 : 1;
+	m->b_wptr = m->b_rptr + size;
+	mblk_set_timestamp_info(m, ts);
+	mblk_set_cseq(m, seq);
+	mblk_set_marker_info(m, 1);
+	return m;
+}
+
+static int vp8_packet_tid(mblk_t *m) {
+	return (m->b_rptr[1] & 0x80) ? (m->b_rptr[5] >> 6) : (m->b_rptr[2] >> 6);
+}
+
+static bool_t vp8_packet_layer_sync(mblk_t *m) {
+	return ((m->b_rptr[1] & 0x80) ? (m->b_rptr[5] & 0x20) : (m->b_rptr[2] & 0x20)) != 0;
+}
+
+static void video_router_temporal_layers(void) {
+	/* three temporal layers (TIDs 0,2,1,2 repeated), forwarded whole to output 0 and reduced to the base layer on output 1 */
+	static const int pattern[4] = {0, 2, 1, 2};
+	MSFilter *router = ms_factory_create_filter(_factory, MS_VIDEO_ROUTER_ID);
+	const MSFmtDescriptor *fmt = ms_factory_get_video_format(_factory, "VP8", MS_VIDEO_SIZE_CIF, 30, NULL);
+	MSQueue inq, outq[2];
+	MSTicker ticker;
+	MSVideoRouterOutputBitrate ob;
+	MSVideoRouterInputLayers il;
+	int forwarded[2][3] = {{0}};
+	uint16_t last_seq = 0;
+	bool_t seq_set = FALSE, raised = FALSE;
+	int n, i;
+
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 33;
+	ticker.time = 100000; /* the measurement of the layers starts with the first packet, not at time 0 */
+	ms_filter_call_method(router, MS_FILTER_SET_INPUT_FMT, (void *)fmt);
+	ms_queue_init(&inq);
+	router->inputs[0] = &inq;
+	for (i = 0; i < 2; i++) {
+		MSVideoRouterPinData pd;
+		pd.input = 0;
+		pd.output = i;
+		pd.switched = FALSE;
+		ms_filter_call_method(router, MS_VIDEO_ROUTER_CONFIGURE_OUTPUT, &pd);
+		ms_queue_init(&outq[i]);
+		router->outputs[i] = &outq[i];
+	}
+	ob.output = 1;
+	ob.bitrate = 80000; /* the base layer is about 60 kbits/s, with the middle one about 90 kbits/s */
+	ms_filter_call_method(router, MS_VIDEO_ROUTER_SET_OUTPUT_BITRATE, &ob);
+	ms_filter_preprocess(router, &ticker);
+
+	for (n = 0; n < 100; n++) {
+		int tid = pattern[n % 4];
+		bool_t layer_sync = (tid > 0 && n % 16 < 4);
+		ticker.time += ticker.interval;
+		ms_queue_put(&inq, make_vp8_packet(tid == 0 ? 1000 : 500, n * 3000, (uint16_t)n, tid, layer_sync, n == 0, n % 2));
+		if (n == 70) {
+			/* output 1 may now take all the layers: they are added at the next layer sync frame */
+			ob.bitrate = 0;
+			ms_filter_call_method(router, MS_VIDEO_ROUTER_SET_OUTPUT_BITRATE, &ob);
+		}
+		ms_filter_process(router);
+
+		il.input = 0;
+		BC_ASSERT_EQUAL(ms_filter_call_method(router, MS_VIDEO_ROUTER_GET_INPUT_LAYERS, &il), 0, int, "%d");
+		if (n == 10) {
+			BC_ASSERT_EQUAL(il.temporal_layers, 0, int, "%d");
+		} else if (n == 40) {
+			BC_ASSERT_EQUAL(il.temporal_layers, 3, int, "%d");
+			BC_ASSERT_GREATER(il.base_layer_bitrate, 55000, int, "%d");
+			BC_ASSERT_LOWER(il.base_layer_bitrate, 70000, int, "%d");
+			BC_ASSERT_GREATER(il.bitrate, 140000, int, "%d");
+			BC_ASSERT_LOWER(il.bitrate, 170000, int, "%d");
+		}
+
+		for (i = 0; i < 2; i++) {
+			mblk_t *m;
+			while ((m = ms_queue_get(&outq[i])) != NULL) {
+				int out_tid = vp8_packet_tid(m);
+				if (n >= 40 && n < 70) forwarded[i][out_tid]++;
+				if (i == 1) {
+					/* sequence numbers are rewritten, so that dropped frames leave no gap */
+					if (seq_set) BC_ASSERT_EQUAL(mblk_get_cseq(m), (uint16_t)(last_seq + 1), unsigned short, "%hu");
+					last_seq = mblk_get_cseq(m);
+					seq_set = TRUE;
+					if (n >= 70 && out_tid > 0 && !raised) {
+						BC_ASSERT_TRUE(vp8_packet_layer_sync(m));
+						raised = TRUE;
+					}
+				}
+				freemsg(m);
+			}
+		}
+	}
+	BC_ASSERT_EQUAL(forwarded[0][0] + forwarded[0][1] + forwarded[0][2], 30, int, "%d");
+	BC_ASSERT_EQUAL(forwarded[1][0], 8, int, "%d");
+	BC_ASSERT_EQUAL(forwarded[1][1] + forwarded[1][2], 0, int, "%d");
+	BC_ASSERT_TRUE(raised);
+
+	ms_filter_postprocess(router);
+	router->inputs[0] = NULL;
+	for (i = 0; i < 2; i++) router->outputs[i] = NULL;
+	ms_filter_destroy(router);
+}
+
+static void video_router_fan_out(void) {
+	/* one input forwarded to three outputs: they share the payload, and one of them gets the original packet */
+	MSFilter *router = ms_factory_create_filter(_factory, MS_VIDEO_ROUTER_ID);
+	const MSFmtDescriptor *fmt = ms_factory_get_video_format(_factory, "VP8", MS_VIDEO_SIZE_CIF, 30, NULL);
+	MSQueue inq, outq[3];
+	MSTicker ticker;
+	uint16_t next_seq[3] = {0};
+	int received[3] = {0};
+	int n, i;
+
+	memset(&ticker, 0, sizeof(ticker));
+	ticker.interval = 33;
+	ms_filter_call_method(router, MS_FILTER_SET_INPUT_FMT, (void *)fmt);
+	ms_queue_init(&inq);
+	router->inputs[0] = &inq;
+	for (i = 0; i < 3; i++) {
+		MSVideoRouterPinData pd;
+		pd.input = 0;
+		pd.output = i;
+		pd.switched = FALSE;
+		ms_filter_call_method(router, MS_VIDEO_ROUTER_CONFIGURE_OUTPUT, &pd);
+		ms_queue_init(&outq[i]);
+		router->outputs[i] = &outq[i];
+	}
+	ms_filter_preprocess(router, &ticker);
+
+	for (n = 0; n < 30; n++) {
+		mblk_t *packet = make_vp8_packet(500, n * 3000, (uint16_t)(1000 + n), 0, FALSE, n == 0, FALSE);
+		dblk_t *payload = packet->b_datap;
+		int originals = 0, recipients = 0;
+
+		if (n == 10) {
+			/* output 1 unsubscribes */
+			int pin = 1;
+			ms_filter_call_method(router, MS_VIDEO_ROUTER_UNCONFIGURE_OUTPUT, &pin);
+		} else if (n == 20) {
+			/* and subscribes again */
+			MSVideoRouterPinData pd;
+			pd.input = 0;
+			pd.output = 1;
+			pd.switched = FALSE;
+			ms_filter_call_method(router, MS_VIDEO_ROUTER_CONFIGURE_OUTPUT, &pd);
+		}
+		ticker.time += ticker.interval;
+		ms_queue_put(&inq, packet);
+		ms_filter_process(router);
+
+		for (i = 0; i < 3; i++) {
+			mblk_t *m;
+			while ((m = ms_queue_get(&outq[i])) != NULL) {
+				if (m == packet) originals++;
+				BC_ASSERT_PTR_EQUAL(m->b_datap, payload);
+				/* each output numbers its own packets */
+				BC_ASSERT_EQUAL(mblk_get_cseq(m), next_seq[i], unsigned short, "%hu");
+				next_seq[i] = mblk_get_cseq(m) + 1;
+				received[i]++;
+				recipients++;
+				freemsg(m);
+			}
+		}
+		BC_ASSERT_EQUAL(originals, 1, int, "%d");
+		BC_ASSERT_EQUAL(recipients, (n >= 10 && n < 20) ? 2 : 3, int, "%d");
+	}
+	BC_ASSERT_EQUAL(received[0], 30, int, "%d");
+	BC_ASSERT_EQUAL(received[1], 20, int, "%d");
+	BC_ASSERT_EQUAL(received[2], 30, int, "%d");
+
+	ms_filter_postprocess(router);
+	router->inputs[0] = NULL;
+	for (i = 0; i < 3; i++) router->outputs[i] = NULL;
+	ms_filter_destroy(router);
+}
+
 static test_t tests[] = {
 	TEST_NO_TAG("Basic video stream VP8"                     , basic_video_stream_vp8),
 	TEST_NO_TAG("Basic video stream H264"                    , basic_video_stream_all_h264_codec_combinations),
@@ -1432,7 +1627,9 @@ static test_t tests[] = {
 	TEST_NO_TAG("Lost repair packet"                         , fec_stream_test_lost_repair_packet),
 	TEST_NO_TAG("Lost 2 source packets"                      , fec_stream_test_lost_2_source_packets),
 	TEST_NO_TAG("FEC video stream VP8"                       , fec_video_stream_vp8),
-	TEST_NO_TAG("FEC video stream H264"                      , fec_video_stream_h264)
+	TEST_NO_TAG("FEC video stream H264"                      , fec_video_stream_h264),
+	TEST_NO_TAG("Video router temporal layers"               , video_router_temporal_layers),
+	TEST_NO_TAG("Video router fan-out"                       , video_router_fan_out)
 };
 
 test_suite_t video_stream_test_suite = {